@@ -62,11 +62,13 @@ _cr_createrepo()
         COMPREPLY=( $( compgen -W '--help --version --quiet --verbose
             --excludes --basedir --baseurl --groupfile --checksum
             --pretty --database --no-database --update --update-md-path
-            --skip-stat --pkglist --includepkg --outputdir
-            --skip-symlinks --changelog-limit --unique-md-filenames
+            --skip-stat --checkpoint --pkglist --includepkg --outputdir
+            --skip-symlinks --changelog-limit --changelog-size-limit
+            --unique-md-filenames
             --simple-md-filenames --retain-old-md --distro --content --repo
-            --revision --read-pkgs-list --workers --xz
-            --compress-type --keep-all-metadata --compatibility
+            --revision --read-pkgs-list --workers --numa --xz
+            --compress-type --rsyncable --seekable-metadata
+            --keep-all-metadata --compatibility
             --retain-old-md-by-age --cachedir --local-sqlite
             --cut-dirs --location-prefix
             --deltas --oldpackagedirs
@@ -85,7 +87,7 @@ _cr_mergerepo()
         --version|-h|--help)
             return 0
             ;;
-        -g|--groupfile|--blocked)
+        -g|--groupfile|--blocked|--batch)
             COMPREPLY=( $( compgen -f -o plusdirs -- "$2" ) )
             return 0
             ;;
@@ -106,9 +108,10 @@ _cr_mergerepo()
     if [[ $2 == -* ]] ; then
         COMPREPLY=( $( compgen -W '--version --help --repo --archlist --database
             --no-database --verbose --outputdir --nogroups --noupdateinfo
-            --compress-type --method --all --noarch-repo --unique-md-filenames
-            --simple-md-filenames --omit-baseurl --koji --groupfile
-            --blocked' -- "$2" ) )
+            --compress-type --rsyncable --seekable-metadata --method --all
+            --noarch-repo --unique-md-filenames
+            --simple-md-filenames --omit-baseurl --regenerate-xml
+            --merge-databases --koji --groupfile --blocked --batch --batch-workers --parallel-fetch' -- "$2" ) )
     else
         COMPREPLY=( $( compgen -d -- "$2" ) )
     fi
@@ -176,6 +179,29 @@ _cr_sqliterepo()
 } &&
 complete -F _cr_sqliterepo -o filenames sqliterepo_c
 
+_cr_verifyrepo()
+{
+    COMPREPLY=()
+
+    case $3 in
+        -h|--help|-V|--version|--workers)
+            return 0
+            ;;
+        --report)
+            COMPREPLY=( $( compgen -f -- "$2" ) )
+            return 0
+            ;;
+    esac
+
+    if [[ $2 == -* ]] ; then
+        COMPREPLY=( $( compgen -W '--help --version --quiet --verbose
+            --packages --workers --report ' -- "$2" ) )
+    else
+        COMPREPLY=( $( compgen -d -- "$2" ) )
+    fi
+} &&
+complete -F _cr_verifyrepo -o filenames verifyrepo_c
+
 # Local variables:
 # mode: shell-script
 # sh-basic-offset: 4
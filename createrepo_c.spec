@@ -148,11 +148,13 @@ ln -sr %{buildroot}%{_bindir}/modifyrepo_c %{buildroot}%{_bindir}/modifyrepo
 %{_mandir}/man8/mergerepo_c.8*
 %{_mandir}/man8/modifyrepo_c.8*
 %{_mandir}/man8/sqliterepo_c.8*
+%{_mandir}/man8/verifyrepo_c.8*
 %{bash_completion}
 %{_bindir}/createrepo_c
 %{_bindir}/mergerepo_c
 %{_bindir}/modifyrepo_c
 %{_bindir}/sqliterepo_c
+%{_bindir}/verifyrepo_c
 
 %if 0%{?fedora} || 0%{?rhel} > 7
 %{_bindir}/createrepo
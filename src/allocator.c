@@ -0,0 +1,362 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libxml/xmlmemory.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#define CR_HAVE_THREAD_CACHE
+#endif
+#include "allocator.h"
+#include "error.h"
+
+#define ERR_DOMAIN                  CREATEREPO_C_ERROR
+#define CACHE_CLASSES               6     // Number of block size classes
+#define CACHE_MIN_CLASS_SIZE        16    // Size of the smallest class
+#define CACHE_MAX_BLOCKS            1024  // Max cached blocks per class
+#define CACHE_MAX_USABLE_SIZE       (2 * (CACHE_MIN_CLASS_SIZE << (CACHE_CLASSES-1)))
+
+/*
+ * Every thread has its own cache with free lists of small blocks.
+ * Blocks are regular malloc() blocks, the class of a freed block
+ * is determined by malloc_usable_size(), so blocks allocated
+ * by the system allocator (e.g. before the cr_allocator_setup())
+ * can be freed by the cache and vice versa.
+ */
+
+typedef struct _FreeBlock {
+    struct _FreeBlock *next;
+} FreeBlock;
+
+typedef struct {
+    FreeBlock *lists[CACHE_CLASSES];    // Free lists
+    guint lens[CACHE_CLASSES];          // Lengths of the free lists
+    cr_AllocatorStats stats;            // Counters of the thread
+} ThreadCache;
+
+static cr_AllocatorType active_type = CR_ALLOCATOR_DEFAULT;
+static GMutex caches_mutex;             // Guards caches and retired_stats
+static GSList *caches = NULL;           // Caches of running threads
+static cr_AllocatorStats retired_stats; // Counters of finished threads
+
+static void thread_cache_destroy(gpointer data);
+static GPrivate thread_cache_key = G_PRIVATE_INIT(thread_cache_destroy);
+
+static void
+thread_cache_flush(ThreadCache *cache)
+{
+    for (int cls = 0; cls < CACHE_CLASSES; cls++) {
+        FreeBlock *block = cache->lists[cls];
+        while (block) {
+            FreeBlock *next = block->next;
+            free(block);
+            block = next;
+        }
+        cache->lists[cls] = NULL;
+        cache->lens[cls] = 0;
+    }
+}
+
+static void
+stats_add(cr_AllocatorStats *dst, const cr_AllocatorStats *src)
+{
+    dst->allocs     += src->allocs;
+    dst->reallocs   += src->reallocs;
+    dst->frees      += src->frees;
+    dst->bytes      += src->bytes;
+    dst->cache_hits += src->cache_hits;
+}
+
+static void
+thread_cache_destroy(gpointer data)
+{
+    ThreadCache *cache = data;
+
+    thread_cache_flush(cache);
+
+    g_mutex_lock(&caches_mutex);
+    stats_add(&retired_stats, &cache->stats);
+    caches = g_slist_remove(caches, cache);
+    g_mutex_unlock(&caches_mutex);
+
+    free(cache);
+}
+
+static inline ThreadCache *
+thread_cache(void)
+{
+    ThreadCache *cache = g_private_get(&thread_cache_key);
+    if (G_LIKELY(cache))
+        return cache;
+
+    // Use plain calloc() - the cache must not be allocated by itself
+    cache = calloc(1, sizeof(ThreadCache));
+    if (!cache)
+        return NULL;
+    g_private_set(&thread_cache_key, cache);
+
+    g_mutex_lock(&caches_mutex);
+    caches = g_slist_prepend(caches, cache);
+    g_mutex_unlock(&caches_mutex);
+
+    return cache;
+}
+
+#ifdef CR_HAVE_THREAD_CACHE
+/** Smallest class which can serve the size or -1 */
+static inline int
+class_for_alloc(size_t size)
+{
+    size_t class_size = CACHE_MIN_CLASS_SIZE;
+    for (int cls = 0; cls < CACHE_CLASSES; cls++, class_size <<= 1)
+        if (size <= class_size)
+            return cls;
+    return -1;
+}
+
+/** Biggest class which the block with usable_size can serve or -1 */
+static inline int
+class_for_free(size_t usable_size)
+{
+    if (usable_size < CACHE_MIN_CLASS_SIZE
+        || usable_size > CACHE_MAX_USABLE_SIZE)
+        return -1;
+
+    int cls = 0;
+    size_t class_size = CACHE_MIN_CLASS_SIZE;
+    while (cls < CACHE_CLASSES - 1 && (class_size << 1) <= usable_size) {
+        class_size <<= 1;
+        cls++;
+    }
+    return cls;
+}
+#endif
+
+// Allocation functions installed via xmlMemSetup()
+
+static void *
+cr_allocator_malloc(size_t size)
+{
+    ThreadCache *cache = thread_cache();
+
+    if (G_UNLIKELY(!cache))
+        return malloc(size);
+
+    cache->stats.allocs++;
+    cache->stats.bytes += size;
+
+#ifdef CR_HAVE_THREAD_CACHE
+    if (active_type == CR_ALLOCATOR_THREAD_CACHE) {
+        int cls = class_for_alloc(size);
+        if (cls >= 0 && cache->lists[cls]) {
+            FreeBlock *block = cache->lists[cls];
+            cache->lists[cls] = block->next;
+            cache->lens[cls]--;
+            cache->stats.cache_hits++;
+            return block;
+        }
+        if (cls >= 0)
+            // Allocate the whole class, so the block returns to the same list
+            return malloc((size_t) CACHE_MIN_CLASS_SIZE << cls);
+    }
+#endif
+
+    return malloc(size);
+}
+
+static void
+cr_allocator_free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    ThreadCache *cache = thread_cache();
+    if (G_UNLIKELY(!cache)) {
+        free(ptr);
+        return;
+    }
+
+    cache->stats.frees++;
+
+#ifdef CR_HAVE_THREAD_CACHE
+    if (active_type == CR_ALLOCATOR_THREAD_CACHE) {
+        int cls = class_for_free(malloc_usable_size(ptr));
+        if (cls >= 0 && cache->lens[cls] < CACHE_MAX_BLOCKS) {
+            FreeBlock *block = ptr;
+            block->next = cache->lists[cls];
+            cache->lists[cls] = block;
+            cache->lens[cls]++;
+            return;
+        }
+    }
+#endif
+
+    free(ptr);
+}
+
+static void *
+cr_allocator_realloc(void *ptr, size_t size)
+{
+    if (!ptr)
+        return cr_allocator_malloc(size);
+
+    ThreadCache *cache = thread_cache();
+    if (G_LIKELY(cache)) {
+        cache->stats.reallocs++;
+        cache->stats.bytes += size;
+    }
+
+#ifdef CR_HAVE_THREAD_CACHE
+    // The block may come from a bigger class than requested originally
+    if (active_type == CR_ALLOCATOR_THREAD_CACHE
+        && malloc_usable_size(ptr) >= size)
+        return ptr;
+#endif
+
+    return realloc(ptr, size);
+}
+
+static char *
+cr_allocator_strdup(const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *dup = cr_allocator_malloc(len);
+    if (dup)
+        memcpy(dup, str, len);
+    return dup;
+}
+
+// Public API
+
+cr_AllocatorType
+cr_allocator_type(const char *name)
+{
+    if (!name)
+        return CR_ALLOCATOR_SENTINEL;
+
+    for (int type = 0; type < CR_ALLOCATOR_SENTINEL; type++)
+        if (!g_ascii_strcasecmp(name, cr_allocator_name_str(type)))
+            return type;
+
+    return CR_ALLOCATOR_SENTINEL;
+}
+
+const char *
+cr_allocator_name_str(cr_AllocatorType type)
+{
+    switch (type) {
+        case CR_ALLOCATOR_DEFAULT:      return "default";
+        case CR_ALLOCATOR_COUNTING:     return "counting";
+        case CR_ALLOCATOR_THREAD_CACHE: return "thread-cache";
+        default:                        return NULL;
+    }
+}
+
+gboolean
+cr_allocator_setup(cr_AllocatorType type, GError **err)
+{
+    assert(!err || *err == NULL);
+
+    if (type < CR_ALLOCATOR_DEFAULT || type >= CR_ALLOCATOR_SENTINEL) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Invalid allocator type %d", type);
+        return FALSE;
+    }
+
+    if (type == CR_ALLOCATOR_DEFAULT) {
+        cr_allocator_cleanup();
+        return TRUE;
+    }
+
+#ifndef CR_HAVE_THREAD_CACHE
+    if (type == CR_ALLOCATOR_THREAD_CACHE) {
+        g_debug("%s: Thread-cache allocator is not supported on this "
+                "platform - using counting allocator", __func__);
+        type = CR_ALLOCATOR_COUNTING;
+    }
+#endif
+
+    active_type = type;
+
+    if (xmlMemSetup(cr_allocator_free,
+                    cr_allocator_malloc,
+                    cr_allocator_realloc,
+                    cr_allocator_strdup) != 0) {
+        active_type = CR_ALLOCATOR_DEFAULT;
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "Cannot set libxml2 memory functions");
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void
+cr_allocator_cleanup(void)
+{
+    if (active_type == CR_ALLOCATOR_DEFAULT)
+        return;
+
+    xmlMemSetup(free, malloc, realloc, (xmlStrdupFunc) strdup);
+    active_type = CR_ALLOCATOR_DEFAULT;
+
+    ThreadCache *cache = g_private_get(&thread_cache_key);
+    if (cache)
+        thread_cache_flush(cache);
+}
+
+cr_AllocatorType
+cr_allocator_active(void)
+{
+    return active_type;
+}
+
+void
+cr_allocator_stats(cr_AllocatorStats *stats)
+{
+    assert(stats);
+
+    g_mutex_lock(&caches_mutex);
+    *stats = retired_stats;
+    for (GSList *elem = caches; elem; elem = g_slist_next(elem))
+        stats_add(stats, &((ThreadCache *) elem->data)->stats);
+    g_mutex_unlock(&caches_mutex);
+}
+
+void
+cr_allocator_log_stats(const char *prefix)
+{
+    cr_AllocatorStats stats;
+
+    if (active_type == CR_ALLOCATOR_DEFAULT)
+        return;
+
+    cr_allocator_stats(&stats);
+    g_message("%s%slibxml2 allocations (%s allocator): "
+              "%"G_GINT64_FORMAT" allocs, %"G_GINT64_FORMAT" reallocs, "
+              "%"G_GINT64_FORMAT" frees, %"G_GINT64_FORMAT" bytes requested, "
+              "%"G_GINT64_FORMAT" served from thread caches",
+              prefix ? prefix : "", prefix ? ": " : "",
+              cr_allocator_name_str(active_type),
+              stats.allocs, stats.reallocs, stats.frees, stats.bytes,
+              stats.cache_hits);
+}
@@ -0,0 +1,117 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_ALLOCATOR_H__
+#define __C_CREATEREPOLIB_ALLOCATOR_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+
+/** \defgroup   allocator   Pluggable allocators for libxml2.
+ *  \addtogroup allocator
+ *  @{
+ */
+
+/** Allocator used for libxml2 memory.
+ */
+typedef enum {
+    CR_ALLOCATOR_DEFAULT,       /*!< libxml2 defaults (plain malloc/free) */
+    CR_ALLOCATOR_COUNTING,      /*!< malloc/free with allocation counters */
+    CR_ALLOCATOR_THREAD_CACHE,  /*!< Per-thread caches of small blocks
+                                     (with allocation counters) */
+    CR_ALLOCATOR_SENTINEL,      /*!< Sentinel of the list */
+} cr_AllocatorType;
+
+/** Allocation counters.
+ */
+typedef struct {
+    gint64 allocs;      /*!< Number of allocations (malloc, strdup) */
+    gint64 reallocs;    /*!< Number of reallocations */
+    gint64 frees;       /*!< Number of frees */
+    gint64 bytes;       /*!< Total number of requested bytes */
+    gint64 cache_hits;  /*!< Allocations served from a thread cache */
+} cr_AllocatorStats;
+
+/** Return allocator type by its name.
+ * @param name          Name of the allocator ("default", "counting",
+ *                      "thread-cache")
+ * @return              Allocator type or CR_ALLOCATOR_SENTINEL if the name
+ *                      is unknown
+ */
+cr_AllocatorType
+cr_allocator_type(const char *name);
+
+/** Return name of the allocator type.
+ * @param type          Allocator type
+ * @return              Constant string or NULL for an invalid type
+ */
+const char *
+cr_allocator_name_str(cr_AllocatorType type);
+
+/** Install the allocator for libxml2 (via xmlMemSetup()).
+ * Should be called before the cr_xml_dump_init() and
+ * cr_package_parser_init() and before any other thread is started.
+ * Blocks are still allocated by the system malloc, so memory allocated
+ * before the call may be safely freed after it and vice versa.
+ * If the thread-cache allocator is not supported on the platform,
+ * the counting allocator is used instead.
+ * @param type          Allocator type
+ * @param err           GError **
+ * @return              TRUE on success
+ */
+gboolean
+cr_allocator_setup(cr_AllocatorType type, GError **err);
+
+/** Restore libxml2 default allocation functions and release blocks
+ * cached by the calling thread. Counters are kept.
+ */
+void
+cr_allocator_cleanup(void);
+
+/** Return the active allocator type.
+ * @return              Allocator type
+ */
+cr_AllocatorType
+cr_allocator_active(void);
+
+/** Fill the stats with counters of all threads (finished and running).
+ * Counters of running threads are a snapshot and could be slightly
+ * out of date.
+ * @param stats         Stats structure to fill
+ */
+void
+cr_allocator_stats(cr_AllocatorStats *stats);
+
+/** Log the allocation counters (g_message) if a non-default allocator
+ * is active.
+ * @param prefix        Prefix of the message (e.g. program name) or NULL
+ */
+void
+cr_allocator_log_stats(const char *prefix);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_ALLOCATOR_H__ */
@@ -0,0 +1,408 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "error.h"
+#include "checkpoint.h"
+#include "misc.h"
+#include "xml_parser.h"
+
+#define ERR_DOMAIN              CREATEREPO_C_ERROR
+#define CHECKPOINT_MAGIC        "CRCKPT1\n"
+#define CHECKPOINT_MAGIC_LEN    8
+
+struct _cr_Checkpoint {
+    char *filename;
+    FILE *f;
+    GMutex mutex;
+    GHashTable *recorded;       // href -> pkgId of the loaded records
+    gint64 last_sync;           // Monotonic time of the last sync
+    gboolean dirty;             // Some records are not synced yet
+};
+
+static gboolean
+read_uint32(FILE *f, guint32 *value)
+{
+    guint32 le;
+    if (fread(&le, sizeof(le), 1, f) != 1)
+        return FALSE;
+    *value = GUINT32_FROM_LE(le);
+    return TRUE;
+}
+
+static gboolean
+write_uint32(FILE *f, guint32 value)
+{
+    guint32 le = GUINT32_TO_LE(value);
+    return fwrite(&le, sizeof(le), 1, f) == 1;
+}
+
+/** Read a string of the length. Returns NULL at the end of the file. */
+static gchar *
+read_string(FILE *f, guint32 len)
+{
+    gchar *str = g_malloc(len + 1);
+    if (len && fread(str, len, 1, f) != 1) {
+        g_free(str);
+        return NULL;
+    }
+    str[len] = '\0';
+    return str;
+}
+
+static int
+checkpoint_pkgcb(cr_Package *pkg, void *cbdata, G_GNUC_UNUSED GError **err)
+{
+    cr_Package **target = cbdata;
+    cr_package_free(*target);   // A record contains a single package
+    *target = pkg;
+    return CR_CB_RET_OK;
+}
+
+static int
+checkpoint_newpkgcb(cr_Package **pkg,
+                    const char *pkgId,
+                    G_GNUC_UNUSED const char *name,
+                    G_GNUC_UNUSED const char *arch,
+                    void *cbdata,
+                    GError **err)
+{
+    cr_Package *target = cbdata;
+
+    if (g_strcmp0(pkgId, target->pkgId)) {
+        g_set_error(err, ERR_DOMAIN, CRE_XMLDATA,
+                    "Package %s doesn't belong to the record of %s",
+                    pkgId, target->pkgId);
+        return CR_CB_RET_ERR;
+    }
+
+    *pkg = target;
+    return CR_CB_RET_OK;
+}
+
+/** Build a package from the XML chunks of a record. */
+static cr_Package *
+record_to_package(const char *primary,
+                  const char *filelists,
+                  const char *other,
+                  GError **err)
+{
+    cr_Package *pkg = NULL;
+
+    if (cr_xml_parse_primary_snippet(primary, NULL, NULL, checkpoint_pkgcb,
+                                     &pkg, NULL, NULL, 0, err) != CRE_OK
+        || !pkg)
+        goto error;
+
+    if (cr_xml_parse_filelists_snippet(filelists, checkpoint_newpkgcb, pkg,
+                                       NULL, NULL, NULL, NULL, err) != CRE_OK)
+        goto error;
+
+    if (cr_xml_parse_other_snippet(other, checkpoint_newpkgcb, pkg,
+                                   NULL, NULL, NULL, NULL, err) != CRE_OK)
+        goto error;
+
+    pkg->loadingflags |= CR_PACKAGE_FROM_XML | CR_PACKAGE_LOADED_PRI
+                         | CR_PACKAGE_LOADED_FIL | CR_PACKAGE_LOADED_OTH;
+    return pkg;
+
+error:
+    cr_package_free(pkg);
+    return NULL;
+}
+
+/** Load records of the checkpoint. Returns offset of the end of the last
+ * complete record or -1 if the checkpoint doesn't match the fingerprint.
+ */
+static long
+checkpoint_load(cr_Checkpoint *cp,
+                FILE *f,
+                const char *fingerprint,
+                cr_Metadata *md,
+                long *loaded)
+{
+    char magic[CHECKPOINT_MAGIC_LEN];
+    guint32 len;
+    gchar *stored_fingerprint;
+    gboolean match;
+    long offset;
+
+    if (fread(magic, CHECKPOINT_MAGIC_LEN, 1, f) != 1
+        || memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN)
+        || !read_uint32(f, &len)
+        || !(stored_fingerprint = read_string(f, len)))
+        return -1;
+
+    match = !strcmp(stored_fingerprint, fingerprint);
+    g_free(stored_fingerprint);
+    if (!match)
+        return -1;
+
+    offset = ftell(f);
+    while (1) {
+        guint32 lens[3];
+        gchar *chunks[3] = { NULL, NULL, NULL };
+        cr_Package *pkg = NULL;
+        GError *tmp_err = NULL;
+
+        if (!read_uint32(f, &lens[0])
+            || !read_uint32(f, &lens[1])
+            || !read_uint32(f, &lens[2]))
+            break;
+        for (int x = 0; x < 3; x++)
+            if (!(chunks[x] = read_string(f, lens[x])))
+                break;
+
+        if (chunks[2])
+            pkg = record_to_package(chunks[0], chunks[1], chunks[2], &tmp_err);
+        for (int x = 0; x < 3; x++)
+            g_free(chunks[x]);
+
+        if (!pkg) {
+            if (tmp_err) {
+                g_warning("Checkpoint %s: Bad record at offset %ld: %s",
+                          cp->filename, offset, tmp_err->message);
+                g_error_free(tmp_err);
+            }
+            break;  // Truncated or damaged record, the rest is ignored
+        }
+
+        offset = ftell(f);
+        g_hash_table_replace(cp->recorded,
+                             g_strdup(pkg->location_href),
+                             g_strdup(pkg->pkgId));
+        if (loaded)
+            (*loaded)++;
+
+        if (md)
+            g_hash_table_replace(cr_metadata_hashtable(md),
+                                 cr_get_cleaned_href(pkg->location_href),
+                                 pkg);
+        else
+            cr_package_free(pkg);
+    }
+
+    return offset;
+}
+
+cr_Checkpoint *
+cr_checkpoint_open(const char *filename,
+                   const char *fingerprint,
+                   cr_Metadata *md,
+                   long *loaded,
+                   GError **err)
+{
+    cr_Checkpoint *cp;
+    long offset = -1;
+    FILE *f;
+
+    assert(filename);
+    assert(fingerprint);
+    assert(!md || cr_metadata_key(md) == CR_HT_KEY_HREF);
+    assert(!err || *err == NULL);
+
+    if (loaded)
+        *loaded = 0;
+
+    cp = g_new0(cr_Checkpoint, 1);
+    cp->filename = g_strdup(filename);
+    cp->recorded = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, g_free);
+    g_mutex_init(&(cp->mutex));
+
+    // Load the records of the previous run
+    f = fopen(filename, "r+b");
+    if (f) {
+        offset = checkpoint_load(cp, f, fingerprint, md, loaded);
+        if (offset < 0)
+            g_debug("Checkpoint %s is from a different run - discarded",
+                    filename);
+    } else if (errno != ENOENT) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot open checkpoint %s: %s",
+                    filename, g_strerror(errno));
+        goto error;
+    }
+
+    if (offset >= 0) {
+        // Continue after the last complete record
+        if (fflush(f) || ftruncate(fileno(f), offset)
+            || fseek(f, offset, SEEK_SET))
+        {
+            g_set_error(err, ERR_DOMAIN, CRE_IO,
+                        "Cannot truncate checkpoint %s: %s",
+                        filename, g_strerror(errno));
+            fclose(f);
+            goto error;
+        }
+        cp->f = f;
+    } else {
+        // Start a new checkpoint
+        if (f)
+            fclose(f);
+        g_hash_table_remove_all(cp->recorded);
+        cp->f = fopen(filename, "w+b");
+        if (!cp->f) {
+            g_set_error(err, ERR_DOMAIN, CRE_IO,
+                        "Cannot create checkpoint %s: %s",
+                        filename, g_strerror(errno));
+            goto error;
+        }
+        if (fwrite(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN, 1, cp->f) != 1
+            || !write_uint32(cp->f, strlen(fingerprint))
+            || fwrite(fingerprint, strlen(fingerprint), 1, cp->f) != 1)
+        {
+            g_set_error(err, ERR_DOMAIN, CRE_IO,
+                        "Cannot write checkpoint %s: %s",
+                        filename, g_strerror(errno));
+            goto error;
+        }
+        cp->dirty = TRUE;
+    }
+
+    cp->last_sync = g_get_monotonic_time();
+    return cp;
+
+error:
+    cr_checkpoint_free(cp);
+    return NULL;
+}
+
+static gboolean
+checkpoint_sync_locked(cr_Checkpoint *cp, GError **err)
+{
+    cp->last_sync = g_get_monotonic_time();
+    if (!cp->dirty)
+        return TRUE;
+
+    if (fflush(cp->f) || fsync(fileno(cp->f))) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot sync checkpoint %s: %s",
+                    cp->filename, g_strerror(errno));
+        return FALSE;
+    }
+
+    cp->dirty = FALSE;
+    return TRUE;
+}
+
+gboolean
+cr_checkpoint_add(cr_Checkpoint *cp,
+                  cr_Package *pkg,
+                  struct cr_XmlStruct *res,
+                  GError **err)
+{
+    const char *chunks[3] = { res->primary, res->filelists, res->other };
+    gboolean ret = TRUE;
+
+    assert(cp);
+    assert(pkg);
+    assert(!err || *err == NULL);
+
+    g_mutex_lock(&(cp->mutex));
+
+    // The unchanged package is already in the checkpoint
+    const char *recorded = g_hash_table_lookup(cp->recorded,
+                                               pkg->location_href);
+    if (recorded && !g_strcmp0(recorded, pkg->pkgId))
+        goto exit;
+
+    for (int x = 0; x < 3; x++)
+        if (!write_uint32(cp->f, chunks[x] ? strlen(chunks[x]) : 0))
+            goto write_error;
+    for (int x = 0; x < 3; x++)
+        if (chunks[x] && *chunks[x]
+            && fwrite(chunks[x], strlen(chunks[x]), 1, cp->f) != 1)
+            goto write_error;
+    cp->dirty = TRUE;
+
+    if (g_get_monotonic_time() - cp->last_sync >= CR_CHECKPOINT_SYNC_INTERVAL)
+        ret = checkpoint_sync_locked(cp, err);
+    goto exit;
+
+write_error:
+    g_set_error(err, ERR_DOMAIN, CRE_IO,
+                "Cannot write checkpoint %s: %s",
+                cp->filename, g_strerror(errno));
+    ret = FALSE;
+
+exit:
+    g_mutex_unlock(&(cp->mutex));
+    return ret;
+}
+
+gboolean
+cr_checkpoint_sync(cr_Checkpoint *cp, GError **err)
+{
+    gboolean ret;
+
+    assert(cp);
+
+    g_mutex_lock(&(cp->mutex));
+    ret = checkpoint_sync_locked(cp, err);
+    g_mutex_unlock(&(cp->mutex));
+    return ret;
+}
+
+gboolean
+cr_checkpoint_remove(cr_Checkpoint *cp, GError **err)
+{
+    gboolean ret = TRUE;
+
+    assert(cp);
+
+    fclose(cp->f);
+    cp->f = NULL;
+    if (g_remove(cp->filename) == -1 && errno != ENOENT) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot remove checkpoint %s: %s",
+                    cp->filename, g_strerror(errno));
+        ret = FALSE;
+    }
+
+    cr_checkpoint_free(cp);
+    return ret;
+}
+
+void
+cr_checkpoint_free(cr_Checkpoint *cp)
+{
+    GError *tmp_err = NULL;
+
+    if (!cp)
+        return;
+
+    if (cp->f) {
+        if (!checkpoint_sync_locked(cp, &tmp_err)) {
+            g_warning("%s", tmp_err->message);
+            g_error_free(tmp_err);
+        }
+        fclose(cp->f);
+    }
+    g_hash_table_destroy(cp->recorded);
+    g_mutex_clear(&(cp->mutex));
+    g_free(cp->filename);
+    g_free(cp);
+}
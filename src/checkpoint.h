@@ -0,0 +1,121 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_CHECKPOINT_H__
+#define __C_CREATEREPOLIB_CHECKPOINT_H__
+
+#include <glib.h>
+#include "load_metadata.h"
+#include "package.h"
+#include "xml_dump.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \defgroup   checkpoint  Checkpoints of interrupted createrepo runs.
+ *  \addtogroup checkpoint
+ *  @{
+ */
+
+/** Name of the checkpoint file in the output directory.
+ */
+#define CR_CHECKPOINT_FILENAME          ".repodata.checkpoint"
+
+/** Max time between writing a record and its sync to the disk.
+ */
+#define CR_CHECKPOINT_SYNC_INTERVAL     (30 * G_TIME_SPAN_SECOND)
+
+/** File with XML chunks of packages which were already processed.
+ * Records are appended in the order in which the packages are written
+ * to the metadata. A run which is interrupted (killed, crashed) leaves
+ * the file behind and the next run with the same fingerprint reuses
+ * the recorded packages like the metadata loaded by --update.
+ *
+ * The file starts with a magic string and the fingerprint, a record
+ * contains lengths of the primary, filelists and other XML chunks
+ * (32bit little endian) followed by the chunks. A truncated last record
+ * (the run was killed while writing it) is ignored and overwritten.
+ */
+typedef struct _cr_Checkpoint cr_Checkpoint;
+
+/** Open (or create) the checkpoint file. Packages recorded by a previous
+ * run with the same fingerprint are loaded into the md (they replace
+ * packages with the same href) and new records are appended to them.
+ * A checkpoint with a different fingerprint is discarded.
+ * @param filename      Path to the checkpoint file
+ * @param fingerprint   String describing inputs and options of the run
+ * @param md            Metadata with CR_HT_KEY_HREF key or NULL
+ * @param loaded        Number of loaded packages or NULL
+ * @param err           GError **
+ * @return              Checkpoint or NULL on error
+ */
+cr_Checkpoint *
+cr_checkpoint_open(const char *filename,
+                   const char *fingerprint,
+                   cr_Metadata *md,
+                   long *loaded,
+                   GError **err);
+
+/** Append a record of the package. Packages which were loaded from the
+ * checkpoint and weren't changed are not recorded again. The records are
+ * synced to the disk at most CR_CHECKPOINT_SYNC_INTERVAL after they were
+ * added. The function is thread safe.
+ * @param cp            Checkpoint
+ * @param pkg           Package (location_href and pkgId are used)
+ * @param res           XML chunks of the package
+ * @param err           GError **
+ * @return              TRUE on success
+ */
+gboolean
+cr_checkpoint_add(cr_Checkpoint *cp,
+                  cr_Package *pkg,
+                  struct cr_XmlStruct *res,
+                  GError **err);
+
+/** Write all added records to the disk.
+ * @param cp            Checkpoint
+ * @param err           GError **
+ * @return              TRUE on success
+ */
+gboolean
+cr_checkpoint_sync(cr_Checkpoint *cp, GError **err);
+
+/** Close the checkpoint and remove its file. Should be called when
+ * the run finished successfully.
+ * @param cp            Checkpoint
+ * @param err           GError **
+ * @return              TRUE on success
+ */
+gboolean
+cr_checkpoint_remove(cr_Checkpoint *cp, GError **err);
+
+/** Sync and close the checkpoint, the file is kept.
+ * @param cp            Checkpoint
+ */
+void
+cr_checkpoint_free(cr_Checkpoint *cp);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_CHECKPOINT_H__ */
@@ -0,0 +1,548 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "error.h"
+#include "checksum.h"
+#include "checksum_batch.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define CR_HAVE_MB_SHA256
+#endif
+
+#define ERR_DOMAIN              CREATEREPO_C_ERROR
+#define LANES                   8       // 32bit lanes in an AVX2 register
+#define BATCH_TIMEOUT           (2 * G_TIME_SPAN_MILLISECOND)
+#define SHA256_DIGEST_LEN       32
+
+/*
+ * Multi-buffer SHA-256
+ *
+ * Every lane of the AVX2 registers computes SHA-256 of a different
+ * buffer. A lane which finishes its buffer gets the next one, so buffers
+ * of different sizes keep all lanes busy.
+ */
+
+#ifdef CR_HAVE_MB_SHA256
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+#define ROTR(x, n)  _mm256_or_si256(_mm256_srli_epi32(x, n), \
+                                    _mm256_slli_epi32(x, 32-(n)))
+#define ADD(a, b)   _mm256_add_epi32(a, b)
+#define XOR(a, b)   _mm256_xor_si256(a, b)
+#define AND(a, b)   _mm256_and_si256(a, b)
+
+/** Process one 64 byte block of every lane.
+ * state[word][lane] is the intermediate hash of the lanes.
+ */
+__attribute__((target("avx2")))
+static void
+sha256_x8_block(uint32_t state[8][LANES], const unsigned char *blocks[LANES])
+{
+    __m256i w[64], s[8], v[8];
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                           11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4,
+                                           11, 10, 9, 8, 15, 14, 13, 12);
+
+    // Load big endian words and transpose them (8x8 32bit matrices),
+    // so w[t] contains the word t of all lanes
+    for (int t = 0; t < 16; t += 8) {
+        __m256i r[8], a[8], b[8];
+
+        for (int l = 0; l < LANES; l++)
+            r[l] = _mm256_shuffle_epi8(
+                    _mm256_loadu_si256((const __m256i *) (blocks[l] + 4*t)),
+                    bswap);
+
+        for (int x = 0; x < 4; x++) {
+            a[2*x]   = _mm256_unpacklo_epi32(r[2*x], r[2*x+1]);
+            a[2*x+1] = _mm256_unpackhi_epi32(r[2*x], r[2*x+1]);
+        }
+        for (int x = 0; x < 2; x++) {
+            b[4*x]   = _mm256_unpacklo_epi64(a[4*x],   a[4*x+2]);
+            b[4*x+1] = _mm256_unpackhi_epi64(a[4*x],   a[4*x+2]);
+            b[4*x+2] = _mm256_unpacklo_epi64(a[4*x+1], a[4*x+3]);
+            b[4*x+3] = _mm256_unpackhi_epi64(a[4*x+1], a[4*x+3]);
+        }
+        for (int x = 0; x < 4; x++) {
+            w[t+x]   = _mm256_permute2x128_si256(b[x], b[x+4], 0x20);
+            w[t+x+4] = _mm256_permute2x128_si256(b[x], b[x+4], 0x31);
+        }
+    }
+
+    // Message schedule
+    for (int t = 16; t < 64; t++) {
+        __m256i s0 = XOR(XOR(ROTR(w[t-15], 7), ROTR(w[t-15], 18)),
+                         _mm256_srli_epi32(w[t-15], 3));
+        __m256i s1 = XOR(XOR(ROTR(w[t-2], 17), ROTR(w[t-2], 19)),
+                         _mm256_srli_epi32(w[t-2], 10));
+        w[t] = ADD(ADD(w[t-16], s0), ADD(w[t-7], s1));
+    }
+
+    for (int x = 0; x < 8; x++)
+        v[x] = s[x] = _mm256_loadu_si256((const __m256i *) state[x]);
+
+    // Compression
+    for (int t = 0; t < 64; t++) {
+        __m256i S1  = XOR(XOR(ROTR(v[4], 6), ROTR(v[4], 11)), ROTR(v[4], 25));
+        __m256i ch  = XOR(AND(v[4], v[5]), _mm256_andnot_si256(v[4], v[6]));
+        __m256i t1  = ADD(ADD(ADD(v[7], S1), ch),
+                          ADD(_mm256_set1_epi32(sha256_k[t]), w[t]));
+        __m256i S0  = XOR(XOR(ROTR(v[0], 2), ROTR(v[0], 13)), ROTR(v[0], 22));
+        __m256i maj = XOR(XOR(AND(v[0], v[1]), AND(v[0], v[2])),
+                          AND(v[1], v[2]));
+        v[7] = v[6];
+        v[6] = v[5];
+        v[5] = v[4];
+        v[4] = ADD(v[3], t1);
+        v[3] = v[2];
+        v[2] = v[1];
+        v[1] = v[0];
+        v[0] = ADD(t1, ADD(S0, maj));
+    }
+
+    for (int x = 0; x < 8; x++)
+        _mm256_storeu_si256((__m256i *) state[x], ADD(s[x], v[x]));
+}
+
+typedef struct {
+    const unsigned char *data;  // Buffer of the lane (NULL if idle)
+    size_t index;               // Index of the buffer
+    size_t block;               // Next block
+    size_t data_blocks;         // Number of full blocks in the data
+    size_t blocks;              // Total number of blocks (with padding)
+    unsigned char tail[128];    // Last (partial) block(s) with padding
+} Sha256Lane;
+
+static void
+sha256_lane_init(Sha256Lane *lane,
+                 uint32_t state[8][LANES],
+                 int l,
+                 const unsigned char *data,
+                 size_t len,
+                 size_t index)
+{
+    size_t rest = len % 64;
+    uint64_t bits = (uint64_t) len * 8;
+
+    lane->data = data;
+    lane->index = index;
+    lane->block = 0;
+    lane->data_blocks = len / 64;
+    lane->blocks = lane->data_blocks + (rest < 56 ? 1 : 2);
+
+    // Padding: 0x80, zeros, 64bit big endian length in bits
+    memset(lane->tail, 0, sizeof(lane->tail));
+    memcpy(lane->tail, data + 64*lane->data_blocks, rest);
+    lane->tail[rest] = 0x80;
+    unsigned char *end = lane->tail + 64*(lane->blocks - lane->data_blocks);
+    for (int x = 1; x <= 8; x++, bits >>= 8)
+        *(end - x) = bits & 0xff;
+
+    for (int x = 0; x < 8; x++)
+        state[x][l] = sha256_iv[x];
+}
+
+static void
+sha256_mb(const unsigned char **buffers,
+          const size_t *lens,
+          size_t count,
+          unsigned char (*digests)[SHA256_DIGEST_LEN])
+{
+    static const unsigned char idle_block[64];
+    uint32_t state[8][LANES];
+    Sha256Lane lanes[LANES];
+    size_t next = 0;
+
+    for (int l = 0; l < LANES; l++)
+        lanes[l].data = NULL;
+
+    while (1) {
+        const unsigned char *blocks[LANES];
+        int active = 0;
+
+        for (int l = 0; l < LANES; l++) {
+            Sha256Lane *lane = &lanes[l];
+
+            if (!lane->data && next < count) {
+                // Empty buffers still need a non-NULL data pointer
+                const unsigned char *data = lens[next] ? buffers[next]
+                                                       : idle_block;
+                sha256_lane_init(lane, state, l, data, lens[next], next);
+                next++;
+            }
+
+            if (!lane->data) {
+                blocks[l] = idle_block;
+                continue;
+            }
+
+            active++;
+            if (lane->block < lane->data_blocks)
+                blocks[l] = lane->data + 64*lane->block;
+            else
+                blocks[l] = lane->tail + 64*(lane->block - lane->data_blocks);
+        }
+
+        if (!active)
+            break;
+
+        sha256_x8_block(state, blocks);
+
+        for (int l = 0; l < LANES; l++) {
+            Sha256Lane *lane = &lanes[l];
+
+            if (!lane->data || ++lane->block < lane->blocks)
+                continue;
+
+            unsigned char *digest = digests[lane->index];
+            for (int x = 0; x < 8; x++) {
+                digest[4*x]   = state[x][l] >> 24;
+                digest[4*x+1] = state[x][l] >> 16;
+                digest[4*x+2] = state[x][l] >> 8;
+                digest[4*x+3] = state[x][l];
+            }
+            lane->data = NULL;
+        }
+    }
+}
+
+static gboolean
+cpu_has_avx2(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static gboolean
+cpu_has_sha_extensions(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return FALSE;
+    return (ebx >> 29) & 1;
+}
+
+#endif /* CR_HAVE_MB_SHA256 */
+
+/** TRUE if the multi-buffer kernel can compute the checksum on this CPU */
+static gboolean
+mb_available(G_GNUC_UNUSED cr_ChecksumType type)
+{
+#ifdef CR_HAVE_MB_SHA256
+    return type == CR_CHECKSUM_SHA256 && cpu_has_avx2();
+#else
+    return FALSE;
+#endif
+}
+
+cr_ChecksumBatchMode
+cr_checksum_batch_mode(const char *name)
+{
+    if (!name)
+        return CR_CHECKSUM_BATCH_SENTINEL;
+    if (!g_ascii_strcasecmp(name, "auto"))
+        return CR_CHECKSUM_BATCH_AUTO;
+    if (!g_ascii_strcasecmp(name, "always"))
+        return CR_CHECKSUM_BATCH_ALWAYS;
+    if (!g_ascii_strcasecmp(name, "never"))
+        return CR_CHECKSUM_BATCH_NEVER;
+    return CR_CHECKSUM_BATCH_SENTINEL;
+}
+
+gboolean
+cr_checksum_batch_supported(cr_ChecksumType type, cr_ChecksumBatchMode mode)
+{
+    switch (mode) {
+        case CR_CHECKSUM_BATCH_ALWAYS:
+            return mb_available(type);
+        case CR_CHECKSUM_BATCH_AUTO:
+#ifdef CR_HAVE_MB_SHA256
+            // OpenSSL with SHA extensions is faster than the AVX2 kernel
+            return mb_available(type) && !cpu_has_sha_extensions();
+#else
+            return FALSE;
+#endif
+        default:
+            return FALSE;
+    }
+}
+
+int
+cr_checksum_buffers(cr_ChecksumType type,
+                    const unsigned char **buffers,
+                    const size_t *lens,
+                    size_t count,
+                    char **checksums,
+                    GError **err)
+{
+    assert(buffers || count == 0);
+    assert(lens || count == 0);
+    assert(checksums || count == 0);
+    assert(!err || *err == NULL);
+
+#ifdef CR_HAVE_MB_SHA256
+    if (count > 1 && mb_available(type)) {
+        unsigned char (*digests)[SHA256_DIGEST_LEN];
+
+        digests = g_malloc(count * SHA256_DIGEST_LEN);
+        sha256_mb(buffers, lens, count, digests);
+        for (size_t i = 0; i < count; i++) {
+            checksums[i] = g_malloc0(SHA256_DIGEST_LEN * 2 + 1);
+            for (size_t x = 0; x < SHA256_DIGEST_LEN; x++)
+                sprintf(checksums[i]+(x*2), "%02x", digests[i][x]);
+        }
+        g_free(digests);
+        return CRE_OK;
+    }
+#endif
+
+    for (size_t i = 0; i < count; i++) {
+        GError *tmp_err = NULL;
+        cr_ChecksumCtx *ctx = cr_checksum_new(type, &tmp_err);
+        if (ctx) {
+            cr_checksum_update(ctx, buffers[i], lens[i], NULL);
+            checksums[i] = cr_checksum_final(ctx, &tmp_err);
+        }
+        if (tmp_err) {
+            int code = tmp_err->code;
+            for (size_t x = 0; x < i; x++) {
+                g_free(checksums[x]);
+                checksums[x] = NULL;
+            }
+            checksums[i] = NULL;
+            g_propagate_error(err, tmp_err);
+            return code;
+        }
+    }
+
+    return CRE_OK;
+}
+
+/*
+ * Batch service
+ */
+
+typedef struct {
+    gchar *data;        // Content of the file
+    gsize len;          // Length of the content
+    char *checksum;     // Result
+    GError *err;        // Error of the batch
+    gboolean taken;     // Being processed by a thread
+    gboolean done;      // Checksum is computed
+} BatchJob;
+
+struct _cr_ChecksumBatch {
+    cr_ChecksumType type;   // Checksum type
+    guint batch_size;       // Number of jobs which are processed at once
+    GMutex mutex;           // Guards all the following
+    GCond cond;             // Signalled when a batch is done
+    GPtrArray *pending;     // Jobs waiting for a thread
+    gint64 files;           // Number of files checksummed in batches
+    gint64 batches;         // Number of processed batches
+};
+
+cr_ChecksumBatch *
+cr_checksum_batch_new(cr_ChecksumType type, guint threads)
+{
+    cr_ChecksumBatch *batch = g_new0(cr_ChecksumBatch, 1);
+    batch->type = type;
+    batch->batch_size = CLAMP(threads, 1, LANES);
+    g_mutex_init(&batch->mutex);
+    g_cond_init(&batch->cond);
+    batch->pending = g_ptr_array_new();
+    return batch;
+}
+
+/** Process all pending jobs. Must be called with the mutex locked,
+ * the mutex is unlocked during the calculation. */
+static void
+batch_process_locked(cr_ChecksumBatch *batch)
+{
+    GPtrArray *jobs = batch->pending;
+    batch->pending = g_ptr_array_new();
+
+    for (guint x = 0; x < jobs->len; x++)
+        ((BatchJob *) jobs->pdata[x])->taken = TRUE;
+
+    g_mutex_unlock(&batch->mutex);
+
+    const unsigned char **buffers = g_new(const unsigned char *, jobs->len);
+    size_t *lens = g_new(size_t, jobs->len);
+    char **checksums = g_new0(char *, jobs->len);
+    GError *tmp_err = NULL;
+
+    for (guint x = 0; x < jobs->len; x++) {
+        BatchJob *job = jobs->pdata[x];
+        buffers[x] = (const unsigned char *) job->data;
+        lens[x] = job->len;
+    }
+
+    cr_checksum_buffers(batch->type, buffers, lens, jobs->len,
+                        checksums, &tmp_err);
+
+    g_mutex_lock(&batch->mutex);
+
+    for (guint x = 0; x < jobs->len; x++) {
+        BatchJob *job = jobs->pdata[x];
+        job->checksum = checksums[x];
+        if (tmp_err)
+            job->err = g_error_copy(tmp_err);
+        job->done = TRUE;
+    }
+    batch->files += jobs->len;
+    batch->batches++;
+    g_cond_broadcast(&batch->cond);
+
+    g_clear_error(&tmp_err);
+    g_free(buffers);
+    g_free(lens);
+    g_free(checksums);
+    g_ptr_array_free(jobs, TRUE);
+}
+
+char *
+cr_checksum_batch_file(cr_ChecksumBatch *batch,
+                       const char *filename,
+                       GError **err)
+{
+    struct stat st;
+    BatchJob job;
+
+    assert(batch);
+    assert(filename);
+    assert(!err || *err == NULL);
+
+    // The size is taken from the opened file, so the file is neither
+    // stat()ed by path nor opened twice
+    int fd = g_open(filename, O_RDONLY, 0);
+    if (fd < 0 || fstat(fd, &st) != 0
+        || st.st_size > CR_CHECKSUM_BATCH_MAX_FILE_SIZE)
+    {
+        if (fd >= 0)
+            close(fd);
+        return cr_checksum_file(filename, batch->type, err);
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.data = g_malloc(st.st_size + 1);
+    while (job.len < (gsize) st.st_size) {
+        ssize_t readed = read(fd, job.data + job.len, st.st_size - job.len);
+        if (readed < 0 && errno == EINTR)
+            continue;
+        if (readed <= 0) {
+            g_set_error(err, ERR_DOMAIN, CRE_IO,
+                        "Cannot read a file: %s: %s", filename,
+                        readed ? g_strerror(errno) : "Unexpected end of file");
+            close(fd);
+            g_free(job.data);
+            return NULL;
+        }
+        job.len += readed;
+    }
+    close(fd);
+
+    g_mutex_lock(&batch->mutex);
+    g_ptr_array_add(batch->pending, &job);
+
+    // Process the batch when it's full, when all threads are waiting
+    // or when the job waits for too long
+    gint64 deadline = g_get_monotonic_time() + BATCH_TIMEOUT;
+    while (!job.done) {
+        if (!job.taken && (batch->pending->len >= batch->batch_size
+                           || g_get_monotonic_time() >= deadline))
+            batch_process_locked(batch);
+        else if (job.taken)
+            g_cond_wait(&batch->cond, &batch->mutex);
+        else
+            g_cond_wait_until(&batch->cond, &batch->mutex, deadline);
+    }
+
+    g_mutex_unlock(&batch->mutex);
+    g_free(job.data);
+
+    if (job.err) {
+        g_propagate_prefixed_error(err, job.err, "%s: ", filename);
+        return NULL;
+    }
+
+    return job.checksum;
+}
+
+void
+cr_checksum_batch_log_stats(cr_ChecksumBatch *batch)
+{
+    assert(batch);
+
+    g_mutex_lock(&batch->mutex);
+    if (batch->batches)
+        g_message("Multi-buffer checksums: %"G_GINT64_FORMAT" files in "
+                  "%"G_GINT64_FORMAT" batches (%.1f files per batch)",
+                  batch->files, batch->batches,
+                  (double) batch->files / batch->batches);
+    g_mutex_unlock(&batch->mutex);
+}
+
+void
+cr_checksum_batch_free(cr_ChecksumBatch *batch)
+{
+    if (!batch)
+        return;
+
+    assert(batch->pending->len == 0);
+    g_ptr_array_free(batch->pending, TRUE);
+    g_mutex_clear(&batch->mutex);
+    g_cond_clear(&batch->cond);
+    g_free(batch);
+}
@@ -0,0 +1,138 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_CHECKSUM_BATCH_H__
+#define __C_CREATEREPOLIB_CHECKSUM_BATCH_H__
+
+#include <glib.h>
+#include "checksum.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \defgroup   checksum_batch  Multi-buffer checksum calculation.
+ *  \addtogroup checksum_batch
+ *  @{
+ */
+
+/** Max size of a file which is checksummed by the cr_ChecksumBatch,
+ * bigger files are checksummed by cr_checksum_file() directly.
+ */
+#define CR_CHECKSUM_BATCH_MAX_FILE_SIZE     (1024*1024)
+
+/** Usage of the multi-buffer checksum calculation.
+ */
+typedef enum {
+    CR_CHECKSUM_BATCH_AUTO,     /*!< Only if faster than OpenSSL on the CPU */
+    CR_CHECKSUM_BATCH_ALWAYS,   /*!< Whenever the checksum type and the CPU
+                                     are supported */
+    CR_CHECKSUM_BATCH_NEVER,    /*!< Never */
+    CR_CHECKSUM_BATCH_SENTINEL, /*!< Sentinel of the list */
+} cr_ChecksumBatchMode;
+
+/** Service which computes checksums of files submitted by several
+ * threads at once. Threads calling cr_checksum_batch_file() are blocked
+ * until enough files to fill all lanes of the multi-buffer SIMD kernel
+ * are collected (or a short timeout expires) and the last submitting
+ * thread computes the checksums of the whole batch.
+ */
+typedef struct _cr_ChecksumBatch cr_ChecksumBatch;
+
+/** Mode from its name ("auto", "always", "never").
+ * @param name          Name of the mode
+ * @return              Mode or CR_CHECKSUM_BATCH_SENTINEL if the name is
+ *                      unknown
+ */
+cr_ChecksumBatchMode
+cr_checksum_batch_mode(const char *name);
+
+/** Check if the multi-buffer kernel can be used for the checksum type.
+ * @param type          Checksum type
+ * @param mode          Mode. With CR_CHECKSUM_BATCH_AUTO the kernel is
+ *                      used only on CPUs where it beats OpenSSL (AVX2
+ *                      without SHA extensions)
+ * @return              TRUE if the multi-buffer calculation is used
+ */
+gboolean
+cr_checksum_batch_supported(cr_ChecksumType type, cr_ChecksumBatchMode mode);
+
+/** Compute checksums of several buffers at once. Uses the multi-buffer
+ * kernel if it is available on the CPU and supports the checksum type
+ * (SHA-256), OpenSSL otherwise.
+ * @param type          Checksum type
+ * @param buffers       Array of count buffers
+ * @param lens          Array of count lengths of the buffers
+ * @param count         Number of buffers
+ * @param checksums     Array of count pointers which are set to malloced
+ *                      null terminated strings with the checksums
+ * @param err           GError **
+ * @return              CRE_OK or an error code
+ */
+int
+cr_checksum_buffers(cr_ChecksumType type,
+                    const unsigned char **buffers,
+                    const size_t *lens,
+                    size_t count,
+                    char **checksums,
+                    GError **err);
+
+/** Create a new batch service.
+ * @param type          Checksum type
+ * @param threads       Number of threads which will submit the files
+ *                      (a batch is processed immediately when all of them
+ *                      are waiting)
+ * @return              New cr_ChecksumBatch
+ */
+cr_ChecksumBatch *
+cr_checksum_batch_new(cr_ChecksumType type, guint threads);
+
+/** Compute checksum of the file. Files bigger than
+ * CR_CHECKSUM_BATCH_MAX_FILE_SIZE are checksummed directly by
+ * cr_checksum_file().
+ * @param batch         cr_ChecksumBatch
+ * @param filename      Filename
+ * @param err           GError **
+ * @return              malloced null terminated string with checksum
+ *                      or NULL on error
+ */
+char *
+cr_checksum_batch_file(cr_ChecksumBatch *batch,
+                       const char *filename,
+                       GError **err);
+
+/** Log number of files checksummed in batches and the average batch size.
+ * @param batch         cr_ChecksumBatch
+ */
+void
+cr_checksum_batch_log_stats(cr_ChecksumBatch *batch);
+
+/** Free the service.
+ * @param batch         cr_ChecksumBatch or NULL
+ */
+void
+cr_checksum_batch_free(cr_ChecksumBatch *batch);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_CHECKSUM_BATCH_H__ */
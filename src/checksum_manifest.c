@@ -0,0 +1,341 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "checksum.h"
+#include "checksum_manifest.h"
+#include "misc.h"
+
+#define ERR_DOMAIN              CREATEREPO_C_ERROR
+#define WHITESPACES             " \t\r"
+
+struct _cr_ChecksumManifest {
+    cr_ChecksumType type;
+    GStringChunk *chunk;        // Keys and checksums
+    GHashTable *by_href;        // href -> checksum
+    GHashTable *by_file;        // "filename size mtime" -> checksum
+    double verify_percent;
+    GThreadPool *verify_pool;   // Background verification or NULL
+    gint used;                  // Number of returned checksums
+    gint missing;               // Number of packages not in the manifest
+    gint verified;              // Number of verified checksums
+    gint mismatched;            // Number of wrong checksums
+};
+
+typedef struct {
+    char *filename;
+    const char *checksum;       // From the manifest chunk
+} VerifyJob;
+
+/** Href without the leading "./" and "/". */
+static const char *
+normalize_href(const char *href)
+{
+    while (*href == '/' || (href[0] == '.' && href[1] == '/'))
+        href += (*href == '/') ? 1 : 2;
+    return href;
+}
+
+static gchar *
+file_key(const char *filename, gint64 size, gint64 mtime)
+{
+    return g_strdup_printf("%s %"G_GINT64_FORMAT" %"G_GINT64_FORMAT,
+                           filename, size, mtime);
+}
+
+static gboolean
+parse_int64(const char *str, gint64 *value)
+{
+    char *end;
+
+    if (!g_ascii_isdigit(*str))
+        return FALSE;
+    errno = 0;
+    *value = g_ascii_strtoll(str, &end, 10);
+    return !errno && *end == '\0';
+}
+
+/** Parse the "filename size mtime" part of a manifest line.
+ * Returns the key for the by_file table or NULL if the line has
+ * a different format.
+ */
+static gchar *
+parse_file_key(const char *rest)
+{
+    gchar **tokens = g_strsplit_set(rest, WHITESPACES, -1);
+    const char *fields[3];
+    int count = 0;
+    gint64 size, mtime;
+    gchar *key = NULL;
+
+    for (gchar **token = tokens; *token; token++) {
+        if (!**token)
+            continue;
+        if (count == 3) {
+            count++;
+            break;
+        }
+        fields[count++] = *token;
+    }
+
+    if (count == 3
+        && parse_int64(fields[1], &size)
+        && parse_int64(fields[2], &mtime))
+        key = file_key(fields[0], size, mtime);
+
+    g_strfreev(tokens);
+    return key;
+}
+
+static void
+verify_thread(gpointer data, gpointer user_data)
+{
+    VerifyJob *job = data;
+    cr_ChecksumManifest *manifest = user_data;
+    GError *tmp_err = NULL;
+
+    char *checksum = cr_checksum_file(job->filename, manifest->type, &tmp_err);
+    if (!checksum) {
+        g_critical("Cannot verify checksum of %s from the manifest: %s",
+                   job->filename, tmp_err->message);
+        g_error_free(tmp_err);
+        g_atomic_int_inc(&manifest->mismatched);
+    } else if (strcmp(checksum, job->checksum)) {
+        g_critical("Checksum of %s from the manifest doesn't match: "
+                   "%s (manifest) != %s (package)",
+                   job->filename, job->checksum, checksum);
+        g_atomic_int_inc(&manifest->mismatched);
+    } else {
+        g_debug("Checksum of %s from the manifest verified", job->filename);
+    }
+    g_atomic_int_inc(&manifest->verified);
+
+    g_free(checksum);
+    g_free(job->filename);
+    g_free(job);
+}
+
+cr_ChecksumManifest *
+cr_checksum_manifest_load(const char *filename,
+                          cr_ChecksumType type,
+                          GError **err)
+{
+    gchar *content = NULL;
+    gchar **lines = NULL;
+    gsize checksum_len;
+    cr_ChecksumManifest *manifest = NULL;
+    GError *tmp_err = NULL;
+
+    assert(filename);
+    assert(!err || *err == NULL);
+
+    // Length of the hex digest of the type
+    cr_ChecksumCtx *ctx = cr_checksum_new(type, err);
+    if (!ctx)
+        return NULL;
+    char *empty = cr_checksum_final(ctx, err);
+    if (!empty)
+        return NULL;
+    checksum_len = strlen(empty);
+    g_free(empty);
+
+    if (!g_file_get_contents(filename, &content, NULL, &tmp_err)) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot read checksum manifest: %s", tmp_err->message);
+        g_error_free(tmp_err);
+        return NULL;
+    }
+
+    manifest = g_new0(cr_ChecksumManifest, 1);
+    manifest->type = type;
+    manifest->chunk = g_string_chunk_new(16384);
+    manifest->by_href = g_hash_table_new(g_str_hash, g_str_equal);
+    manifest->by_file = g_hash_table_new(g_str_hash, g_str_equal);
+
+    lines = g_strsplit(content, "\n", -1);
+    for (int x = 0; lines[x]; x++) {
+        gchar *line = g_strchomp(lines[x]);
+        gchar *checksum, *rest, *key;
+
+        line += strspn(line, WHITESPACES);
+        if (!*line || *line == '#')
+            continue;
+
+        // Checksum
+        checksum = line;
+        rest = line + strcspn(line, WHITESPACES);
+        gboolean valid = ((gsize) (rest - checksum) == checksum_len);
+        for (gchar *c = checksum; valid && c < rest; c++)
+            valid = g_ascii_isxdigit(*c);
+        if (!valid) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "%s:%d: Invalid %s checksum", filename, x + 1,
+                        cr_checksum_name_str(type));
+            goto error;
+        }
+        if (*rest)
+            *rest++ = '\0';
+        for (gchar *c = checksum; *c; c++)
+            *c = g_ascii_tolower(*c);
+
+        // Path (the sha256sum binary mode marker "*" is skipped)
+        rest += strspn(rest, WHITESPACES);
+        if (*rest == '*')
+            rest++;
+        if (!*rest) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "%s:%d: Missing path of the package", filename, x + 1);
+            goto error;
+        }
+
+        checksum = g_string_chunk_insert_const(manifest->chunk, checksum);
+        key = parse_file_key(rest);
+        if (key) {
+            g_hash_table_replace(manifest->by_file,
+                    g_string_chunk_insert_const(manifest->chunk, key),
+                    checksum);
+            g_free(key);
+        } else {
+            g_hash_table_replace(manifest->by_href,
+                    g_string_chunk_insert_const(manifest->chunk,
+                                                normalize_href(rest)),
+                    checksum);
+        }
+    }
+
+    g_debug("Checksum manifest %s: %u checksums by path, %u by file", filename,
+            g_hash_table_size(manifest->by_href),
+            g_hash_table_size(manifest->by_file));
+
+    g_strfreev(lines);
+    g_free(content);
+    return manifest;
+
+error:
+    g_strfreev(lines);
+    g_free(content);
+    cr_checksum_manifest_free(manifest);
+    return NULL;
+}
+
+void
+cr_checksum_manifest_set_verify(cr_ChecksumManifest *manifest,
+                                double percent)
+{
+    assert(manifest);
+    assert(!manifest->verify_pool);
+
+    manifest->verify_percent = CLAMP(percent, 0.0, 100.0);
+    if (manifest->verify_percent > 0.0)
+        manifest->verify_pool = g_thread_pool_new(verify_thread, manifest,
+                                                  1, TRUE, NULL);
+}
+
+char *
+cr_checksum_manifest_lookup(cr_ChecksumManifest *manifest,
+                            const char *filename,
+                            const char *href,
+                            gint64 size,
+                            gint64 mtime)
+{
+    const char *checksum = NULL;
+
+    assert(manifest);
+    assert(filename);
+
+    if (href)
+        checksum = g_hash_table_lookup(manifest->by_href, normalize_href(href));
+
+    if (!checksum && g_hash_table_size(manifest->by_file)) {
+        gchar *key = file_key(cr_get_filename(filename), size, mtime);
+        checksum = g_hash_table_lookup(manifest->by_file, key);
+        g_free(key);
+    }
+
+    if (!checksum) {
+        g_atomic_int_inc(&manifest->missing);
+        return NULL;
+    }
+
+    g_atomic_int_inc(&manifest->used);
+
+    if (manifest->verify_pool
+        && g_random_double_range(0.0, 100.0) < manifest->verify_percent)
+    {
+        VerifyJob *job = g_new0(VerifyJob, 1);
+        job->filename = g_strdup(filename);
+        job->checksum = checksum;
+        g_thread_pool_push(manifest->verify_pool, job, NULL);
+    }
+
+    return g_strdup(checksum);
+}
+
+gboolean
+cr_checksum_manifest_finish(cr_ChecksumManifest *manifest, GError **err)
+{
+    assert(manifest);
+    assert(!err || *err == NULL);
+
+    if (manifest->verify_pool) {
+        g_thread_pool_free(manifest->verify_pool, FALSE, TRUE);
+        manifest->verify_pool = NULL;
+    }
+
+    if (manifest->mismatched) {
+        g_set_error(err, ERR_DOMAIN, CRE_ERROR,
+                    "%d of %d verified checksums from the manifest "
+                    "don't match the packages",
+                    manifest->mismatched, manifest->verified);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void
+cr_checksum_manifest_log_stats(cr_ChecksumManifest *manifest)
+{
+    assert(manifest);
+
+    g_message("Checksum manifest: %d checksums used (%d verified), "
+              "%d packages not in the manifest",
+              g_atomic_int_get(&manifest->used),
+              g_atomic_int_get(&manifest->verified),
+              g_atomic_int_get(&manifest->missing));
+}
+
+void
+cr_checksum_manifest_free(cr_ChecksumManifest *manifest)
+{
+    if (!manifest)
+        return;
+
+    if (manifest->verify_pool)
+        g_thread_pool_free(manifest->verify_pool, FALSE, TRUE);
+    g_hash_table_destroy(manifest->by_href);
+    g_hash_table_destroy(manifest->by_file);
+    g_string_chunk_free(manifest->chunk);
+    g_free(manifest);
+}
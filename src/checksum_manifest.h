@@ -0,0 +1,117 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_CHECKSUM_MANIFEST_H__
+#define __C_CREATEREPOLIB_CHECKSUM_MANIFEST_H__
+
+#include <glib.h>
+#include "checksum.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \defgroup   checksum_manifest  Trusted package checksums from a file.
+ *  \addtogroup checksum_manifest
+ *  @{
+ */
+
+/** Checksums of packages known in advance (e.g. from a build system),
+ * used instead of reading and hashing the whole packages.
+ *
+ * Every non-empty line of the manifest file which doesn't start
+ * with '#' contains a hex checksum followed by either:
+ * - a path of the package relative to the repository
+ *   (the format of the sha256sum output, e.g. "CHECKSUM  Packages/foo.rpm")
+ * - a filename, size and mtime of the package separated by whitespaces
+ *   (e.g. "CHECKSUM foo.rpm 12345 1600000000")
+ */
+typedef struct _cr_ChecksumManifest cr_ChecksumManifest;
+
+/** Load a checksum manifest file.
+ * @param filename      Path to the manifest
+ * @param type          Type of the checksums in the manifest
+ * @param err           GError **
+ * @return              Manifest or NULL on error (unreadable file,
+ *                      malformed line)
+ */
+cr_ChecksumManifest *
+cr_checksum_manifest_load(const char *filename,
+                          cr_ChecksumType type,
+                          GError **err);
+
+/** Verify a random sample of the used checksums. The sampled packages
+ * are hashed by a background thread and the result is reported by
+ * cr_checksum_manifest_finish(). Must be called before the first
+ * cr_checksum_manifest_lookup().
+ * @param manifest      Manifest
+ * @param percent       Percentage (0-100) of the used checksums to verify
+ */
+void
+cr_checksum_manifest_set_verify(cr_ChecksumManifest *manifest,
+                                double percent);
+
+/** Get a checksum of a package from the manifest.
+ * The checksum is looked up by the href first, then by the filename,
+ * size and mtime. The function is thread safe.
+ * @param manifest      Manifest
+ * @param filename      Path to the package (used for the verification
+ *                      and for the filename lookup)
+ * @param href          Path of the package relative to the repository
+ *                      or NULL
+ * @param size          Size of the package
+ * @param mtime         Mtime of the package
+ * @return              Checksum (free it with g_free()) or NULL if the
+ *                      package is not in the manifest
+ */
+char *
+cr_checksum_manifest_lookup(cr_ChecksumManifest *manifest,
+                            const char *filename,
+                            const char *href,
+                            gint64 size,
+                            gint64 mtime);
+
+/** Wait until all scheduled verifications are done.
+ * @param manifest      Manifest
+ * @param err           GError **
+ * @return              FALSE if some verified checksum doesn't match
+ *                      its package
+ */
+gboolean
+cr_checksum_manifest_finish(cr_ChecksumManifest *manifest, GError **err);
+
+/** Log the number of used, missing and verified checksums.
+ * @param manifest      Manifest
+ */
+void
+cr_checksum_manifest_log_stats(cr_ChecksumManifest *manifest);
+
+/** Free the manifest. Waits for running verifications.
+ * @param manifest      Manifest
+ */
+void
+cr_checksum_manifest_free(cr_ChecksumManifest *manifest);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_CHECKSUM_MANIFEST_H__ */
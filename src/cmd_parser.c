@@ -22,6 +22,7 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include "checkpoint.h"
 #include "cmd_parser.h"
 #include "deltarpms.h"
 #include "error.h"
@@ -39,6 +40,7 @@
 
 struct CmdOptions _cmd_options = {
         .changelog_limit            = DEFAULT_CHANGELOG_LIMIT,
+        .changelog_size_limit       = -1,
         .checksum                   = NULL,
         .workers                    = DEFAULT_WORKERS,
         .unique_md_filenames        = DEFAULT_UNIQUE_MD_FILENAMES,
@@ -65,6 +67,13 @@ struct CmdOptions _cmd_options = {
         .zck_compression            = FALSE,
         .zck_dict_dir               = NULL,
         .recycle_pkglist            = FALSE,
+        .xml_allocator_type         = CR_ALLOCATOR_DEFAULT,
+        .checksum_batch_mode        = CR_CHECKSUM_BATCH_AUTO,
+        .checksum_manifest          = NULL,
+        .checksum_manifest_verify   = 0.0,
+        .largest_first              = FALSE,
+        .checkpoint                 = FALSE,
+        .reorder_window             = DEFAULT_REORDER_WINDOW,
     };
 
 
@@ -102,7 +111,11 @@ static GOptionEntry cmd_entries[] =
       "(based on file size and mtime) since the metadata was generated, reuse "
       "the existing metadata rather than recalculating it. In the case of a "
       "large repository with only a few new or modified rpms "
-      "this can significantly reduce I/O and processing time.", NULL },
+      "this can significantly reduce I/O and processing time. An rpm moved "
+      "to another directory is recognized by its filename, size and mtime "
+      "and its metadata are reused as well if the file no longer exists at "
+      "the old location, if it is a hardlink of the old file, or if "
+      "the checksum cached in --cachedir matches.", NULL },
     { "update-md-path", 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &(_cmd_options.update_md_paths),
       "Existing metadata from this path are loaded and reused in addition to those "
       "present in the outputdir (works only with --update). Can be specified multiple times.", NULL },
@@ -110,6 +123,14 @@ static GOptionEntry cmd_entries[] =
       "Skip the stat() call on a --update, assumes if the filename is the same "
       "then the file is still the same (only use this if you're fairly "
       "trusting or gullible).", NULL },
+    { "checkpoint", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.checkpoint),
+      "Record metadata of processed packages to the "CR_CHECKPOINT_FILENAME" "
+      "file in the outputdir. If the run is interrupted, the next run with "
+      "the same input directories and options reuses the recorded metadata "
+      "of unchanged packages (based on file size and mtime) instead of "
+      "reading them again. The file is removed when the run finishes. "
+      "A .repodata/ directory left by a killed run has to be removed "
+      "first (or --ignore-lock used).", NULL },
     { "split", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.split),
       "Run in split media mode. Rather than pass a single directory, take a set of"
       "directories corresponding to different volumes in a media set. "
@@ -128,6 +149,10 @@ static GOptionEntry cmd_entries[] =
     { "changelog-limit", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.changelog_limit),
       "Only import the last N changelog entries, from each rpm, into the metadata.",
       "NUM" },
+    { "changelog-size-limit", 0, 0, G_OPTION_ARG_INT64, &(_cmd_options.changelog_size_limit),
+      "Only import the last changelog entries up to total size of BYTES "
+      "(author + text), from each rpm, into the metadata. The last entry "
+      "is always imported.", "BYTES" },
     { "unique-md-filenames", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.unique_md_filenames),
       "Include the file's checksum in the metadata filename, helps HTTP caching (default).",
       NULL },
@@ -153,6 +178,10 @@ static GOptionEntry cmd_entries[] =
       "READ_PKGS_LIST" },
     { "workers", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.workers),
       "Number of workers to spawn to read rpms.", NULL },
+    { "numa", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.numa),
+      "Spread workers over NUMA nodes and bind each of them to the CPUs "
+      "of its node, so packages are read, allocated and dumped node-locally. "
+      "Has no effect on machines with a single NUMA node.", NULL },
     { "xz", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.xz_compression),
       "Use xz for repodata compression.", NULL },
     { "compress-type", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.compress_type),
@@ -160,6 +189,15 @@ static GOptionEntry cmd_entries[] =
     { "general-compress-type", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.general_compress_type),
       "Which compression type to use (even for primary, filelists and other xml).",
       "COMPRESSION_TYPE" },
+    { "rsyncable", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.rsyncable),
+      "Reset the gzip compressor at content-defined package boundaries, so "
+      "unchanged parts of primary, filelists and other xml are compressed "
+      "into identical bytes across runs (rsync and CDN friendly).", NULL },
+    { "seekable-metadata", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.seekable_metadata),
+      "Compress filelists and other xml into independent xz blocks and "
+      "write indexes of their packages (filelists_index and other_index), "
+      "so metadata of a single package can be read without decompressing "
+      "the whole files. Requires --general-compress-type=xz.", NULL },
 #ifdef WITH_ZCHUNK
     { "zck", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.zck_compression),
       "Generate zchunk files as well as the standard repodata.", NULL },
@@ -224,6 +262,35 @@ static GOptionEntry expert_entries[] =
       "own risk! If two createrepos run simultaneously, then the state of the "
       "generated metadata is not guaranteed - it can be inconsistent and wrong.",
       NULL },
+    { "xml-allocator", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.xml_allocator),
+      "Expert option: Allocator used for libxml2 memory "
+      "(available: default, counting, thread-cache). Non-default allocators "
+      "report allocation counters at the end of the run.", "ALLOCATOR" },
+    { "checksum-batching", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.checksum_batching),
+      "Expert option: Compute checksums of small packages in batches "
+      "by a multi-buffer SIMD kernel (available: auto, always, never). "
+      "Only sha256 is supported. \"auto\" (default) uses the kernel only "
+      "on CPUs where it is faster than OpenSSL.", "MODE" },
+    { "checksum-manifest", 0, 0, G_OPTION_ARG_FILENAME, &(_cmd_options.checksum_manifest),
+      "Expert (risky) option: Take checksums of packages from the FILE "
+      "instead of computing them. Every line contains a checksum (of the type "
+      "set by --checksum) followed by a path of the package relative to "
+      "the repository (sha256sum format) or by a filename, size and mtime "
+      "of the package. Packages missing in the FILE are checksummed as usual.",
+      "FILE" },
+    { "checksum-manifest-verify", 0, 0, G_OPTION_ARG_DOUBLE, &(_cmd_options.checksum_manifest_verify),
+      "Expert option: Verify PERCENT of the checksums taken from "
+      "the --checksum-manifest in background. If any of them doesn't match, "
+      "no metadata are written. Default: 0.", "PERCENT" },
+    { "largest-first", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.largest_first),
+      "Expert option: Process the biggest packages first to shorten "
+      "the run on repositories with a few huge packages. Packages are "
+      "reordered in windows of --reorder-window packages, results are "
+      "kept in memory until they can be written in the usual order.", NULL },
+    { "reorder-window", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.reorder_window),
+      "Expert option: Number of packages reordered at once by "
+      "--largest-first. It limits the number of results kept in memory. "
+      "Default: 1000.", "N" },
     { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL },
 };
 
@@ -367,6 +434,13 @@ check_arguments(struct CmdOptions *options,
         options->changelog_limit = DEFAULT_CHANGELOG_LIMIT;
     }
 
+    // Check changelog_size_limit
+    if (options->changelog_size_limit < -1) {
+        g_warning("Wrong changelog size limit \"%"G_GINT64_FORMAT"\" - Using unlimited",
+                  options->changelog_size_limit);
+        options->changelog_size_limit = -1;
+    }
+
     // Check simple filenames
     if (options->simple_md_filenames) {
         options->unique_md_filenames = FALSE;
@@ -422,14 +496,22 @@ check_arguments(struct CmdOptions *options,
         }
     }
 
+    // Seekable framing is implemented by xz blocks
+    if (options->seekable_metadata
+        && options->general_compression_type != CR_CW_XZ_COMPRESSION) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "--seekable-metadata requires --general-compress-type=xz");
+        return FALSE;
+    }
+
     int x;
 
     // Process exclude glob masks
     x = 0;
     while (options->excludes && options->excludes[x] != NULL) {
-        GPatternSpec *pattern = g_pattern_spec_new(options->excludes[x]);
-        options->exclude_masks = g_slist_prepend(options->exclude_masks,
-                                                 (gpointer) pattern);
+        if (!options->exclude_masks)
+            options->exclude_masks = cr_globset_new();
+        cr_globset_add(options->exclude_masks, options->excludes[x]);
         x++;
     }
 
@@ -603,6 +685,55 @@ check_arguments(struct CmdOptions *options,
     if (options->zck_dict_dir)
         options->zck_dict_dir = cr_normalize_dir_path(options->zck_dict_dir);
 
+    // Check and set xml allocator
+    if (options->xml_allocator) {
+        options->xml_allocator_type = cr_allocator_type(options->xml_allocator);
+        if (options->xml_allocator_type == CR_ALLOCATOR_SENTINEL) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Unknown allocator \"%s\"", options->xml_allocator);
+            return FALSE;
+        }
+    }
+
+    // Check and set checksum batching
+    if (options->checksum_batching) {
+        options->checksum_batch_mode = cr_checksum_batch_mode(options->checksum_batching);
+        if (options->checksum_batch_mode == CR_CHECKSUM_BATCH_SENTINEL) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Unknown checksum batching mode \"%s\"",
+                        options->checksum_batching);
+            return FALSE;
+        }
+    }
+
+    // Check reorder window
+    if (options->reorder_window < 1) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "--reorder-window must be a positive integer");
+        return FALSE;
+    }
+
+    // Check checksum manifest
+    if (options->checksum_manifest_verify < 0.0
+        || options->checksum_manifest_verify > 100.0) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "--checksum-manifest-verify must be between 0 and 100");
+        return FALSE;
+    }
+    if (options->checksum_manifest_verify > 0.0 && !options->checksum_manifest) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Cannot use --checksum-manifest-verify without "
+                    "--checksum-manifest");
+        return FALSE;
+    }
+    if (options->checksum_manifest
+        && !g_file_test(options->checksum_manifest, G_FILE_TEST_IS_REGULAR)) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Checksum manifest %s doesn't exist",
+                    options->checksum_manifest);
+        return FALSE;
+    }
+
     return TRUE;
 }
 
@@ -623,6 +754,9 @@ free_options(struct CmdOptions *options)
     g_free(options->retain_old_md_by_age);
     g_free(options->cachedir);
     g_free(options->checksum_cachedir);
+    g_free(options->xml_allocator);
+    g_free(options->checksum_batching);
+    g_free(options->checksum_manifest);
 
     g_strfreev(options->excludes);
     g_strfreev(options->includepkg);
@@ -632,8 +766,7 @@ free_options(struct CmdOptions *options)
     g_strfreev(options->oldpackagedirs);
 
     cr_slist_free_full(options->include_pkgs, g_free);
-    cr_slist_free_full(options->exclude_masks,
-                      (GDestroyNotify) g_pattern_spec_free);
+    cr_globset_free(options->exclude_masks);
     cr_slist_free_full(options->l_update_md_paths, g_free);
     cr_slist_free_full(options->distro_cpeids, g_free);
     cr_slist_free_full(options->distro_values, g_free);
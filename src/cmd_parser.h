@@ -21,10 +21,14 @@
 #define __C_CREATEREPOLIB_CMD_PARSER_H__
 
 #include <glib.h>
+#include "allocator.h"
 #include "checksum.h"
+#include "checksum_batch.h"
 #include "compression_wrapper.h"
+#include "globset.h"
 
 #define DEFAULT_CHANGELOG_LIMIT         10
+#define DEFAULT_REORDER_WINDOW          1000
 
 
 /**
@@ -56,9 +60,14 @@ struct CmdOptions {
     char *compress_type;        /*!< which compression type to use */
     char *general_compress_type;/*!< which compression type to use (even for
                                      primary, filelists and other xml) */
+    gboolean rsyncable;         /*!< rsyncable compression of xml files */
+    gboolean seekable_metadata; /*!< seekable filelists and other xml with
+                                     package indexes */
     gboolean skip_symlinks;     /*!< ignore symlinks of packages */
     gint changelog_limit;       /*!< number of changelog messages in
                                      other.(xml|sqlite) */
+    gint64 changelog_size_limit;/*!< max size of changelog messages of
+                                     a package in bytes (-1 = unlimited) */
     gboolean unique_md_filenames;       /*!< include the file checksums in
                                              the filenames */
     gboolean simple_md_filenames;       /*!< simple filenames (names without
@@ -72,6 +81,7 @@ struct CmdOptions {
                                              time for timestamps */
     char *read_pkgs_list;       /*!< output the paths to pkgs actually read */
     gint workers;               /*!< number of threads to spawn */
+    gboolean numa;              /*!< bind workers to NUMA nodes */
     gboolean xz_compression;    /*!< use xz for repodata compression */
     gboolean zck_compression;   /*!< generate zchunk files */
     char *zck_dict_dir;         /*!< directory with zchunk dictionaries */
@@ -112,12 +122,22 @@ struct CmdOptions {
                                      during repodata generation. */
     gchar *repomd_checksum;     /*!< Checksum type for entries in repomd.xml */
     gboolean error_exit_val;        /*!< exit 2 on processing errors */
+    char *xml_allocator;        /*!< allocator used for libxml2 memory */
+    char *checksum_batching;    /*!< usage of multi-buffer checksums */
+    char *checksum_manifest;    /*!< file with trusted checksums of pkgs */
+    gdouble checksum_manifest_verify; /*!< percentage of checksums from
+                                     the manifest to verify */
+    gboolean largest_first;     /*!< dispatch the biggest packages first */
+    gboolean checkpoint;        /*!< record processed packages and resume
+                                     an interrupted run */
+    gint reorder_window;        /*!< number of tasks reordered at once
+                                     with largest_first */
 
     /* Items filled by check_arguments() */
 
     char *groupfile_fullpath;   /*!< full path to groupfile */
-    GSList *exclude_masks;      /*!< list of exclude masks
-                                     (list of GPatternSpec pointers) */
+    cr_GlobSet *exclude_masks;  /*!< set of exclude masks (NULL if there
+                                     are no excludes) */
     GSList *include_pkgs;       /*!< list of packages to include (build from
                                      includepkg options and pkglist file) */
     GSList *l_update_md_paths;  /*!< list of repo from update_md_paths
@@ -136,6 +156,8 @@ struct CmdOptions {
     char *checksum_cachedir;    /*!< Path to cachedir */
     GSList *oldpackagedirs_paths; /*!< paths to look for older pkgs to delta against */
     GSList *modulemd_metadata;  /*!< paths to all modulemd metadata */
+    cr_AllocatorType xml_allocator_type; /*!< allocator type */
+    cr_ChecksumBatchMode checksum_batch_mode; /*!< multi-buffer checksums */
 
     gboolean recycle_pkglist;
 };
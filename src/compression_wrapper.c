@@ -23,11 +23,19 @@
 #include <magic.h>
 #include <assert.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
 #include <stdbool.h>
+#ifdef WITH_ZLIB_NG
+#include <zlib-ng.h>
+#else
 #include <zlib.h>
+#endif
+#ifdef WITH_LIBDEFLATE
+#include <libdeflate.h>
+#endif
 #include <bzlib.h>
 #include <lzma.h>
 #ifdef WITH_ZCHUNK
@@ -57,6 +65,17 @@
 #define GZ_STRATEGY             Z_DEFAULT_STRATEGY
 #define GZ_BUFFER_SIZE          (1024*128)
 
+/* With libdeflate the output is compressed by whole buffers of this size,
+ * every buffer is written as a separate gzip member */
+#define GZ_DEFLATE_MEMBER_SIZE  (1024*1024*2)
+#define GZ_DEFLATE_DEFAULT_LEVEL 6
+
+/* Rsyncable mode - a boundary is found where the top bits of a gear
+ * rolling hash (which depends on the last 32 bytes only) are zero.
+ * 15 bits give boundaries every 32 KiB on average */
+#define RSYNC_MASK              0xfffe0000
+#define RSYNC_GEAR_SEED         0x2545f491
+
 #define BZ2_VERBOSITY           0
 #define BZ2_BLOCKSIZE100K       5  // Higher gives better compression but takes
                                    // more memory
@@ -86,7 +105,17 @@ LZMA_CHECK_SHA256
 #define XZ_DECODER_FLAGS        0
 #define XZ_BUFFER_SIZE          (1024*32)
 
-#if ZLIB_VERNUM < 0x1240
+#ifdef WITH_ZLIB_NG
+// Native zlib-ng API
+#define gzflush                 zng_gzflush
+#define gzopen                  zng_gzopen
+#define gzsetparams             zng_gzsetparams
+#define gzbuffer                zng_gzbuffer
+#define gzread                  zng_gzread
+#define gzwrite                 zng_gzwrite
+#define gzclose                 zng_gzclose
+#define gzerror                 zng_gzerror
+#elif ZLIB_VERNUM < 0x1240
 // XXX: Zlib has gzbuffer since 1.2.4
 #define gzbuffer(a,b) 0
 #endif
@@ -121,8 +150,170 @@ typedef struct {
     lzma_stream stream;
     FILE *file;
     unsigned char buffer[XZ_BUFFER_SIZE];
+    // Seekable mode (the content is written as independent blocks)
+    lzma_index *index;              /*!< Written blocks (NULL if the file
+                                         is not seekable) */
+    lzma_block block;               /*!< The current block */
+    lzma_filter filters[2];         /*!< Filters of the blocks */
+    lzma_options_lzma options;      /*!< Options of the LZMA2 filter */
+    gboolean in_block;              /*!< A block was started */
+    gint64 block_offset;            /*!< Offset of the current block */
+    gint64 block_in;                /*!< Uncompressed size of the block */
+    gint64 offset;                  /*!< Size of the written output */
 } XzFile;
 
+/** Write the output of the xz stream into the file */
+static gboolean
+cr_xz_write_output(XzFile *xz_file, GError **err)
+{
+    size_t out_len = XZ_BUFFER_SIZE - xz_file->stream.avail_out;
+
+    if (fwrite(xz_file->buffer, 1, out_len, xz_file->file) != out_len) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: fwrite(): %s", g_strerror(errno));
+        return FALSE;
+    }
+
+    xz_file->offset += out_len;
+    return TRUE;
+}
+
+/** Run the xz coder until it reports LZMA_STREAM_END */
+static gboolean
+cr_xz_code_to_end(XzFile *xz_file, lzma_action action, GError **err)
+{
+    lzma_stream *stream = &(xz_file->stream);
+
+    while (1) {
+        lzma_ret rc;
+
+        stream->next_out = xz_file->buffer;
+        stream->avail_out = XZ_BUFFER_SIZE;
+        rc = lzma_code(stream, action);
+        if (rc != LZMA_OK && rc != LZMA_STREAM_END) {
+            g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                        "XZ: lzma_code() error (%d)", rc);
+            return FALSE;
+        }
+
+        if (!cr_xz_write_output(xz_file, err))
+            return FALSE;
+
+        if (rc == LZMA_STREAM_END)
+            return TRUE;
+    }
+}
+
+/** Write a block header and start the block encoder */
+static gboolean
+cr_xz_block_start(XzFile *xz_file, GError **err)
+{
+    lzma_block *block = &(xz_file->block);
+    uint8_t header[LZMA_BLOCK_HEADER_SIZE_MAX];
+    lzma_ret rc;
+
+    memset(block, 0, sizeof(lzma_block));
+    block->version = 0;
+    block->check = XZ_CHECK;
+    block->filters = xz_file->filters;
+    block->compressed_size = LZMA_VLI_UNKNOWN;
+    block->uncompressed_size = LZMA_VLI_UNKNOWN;
+
+    rc = lzma_block_header_size(block);
+    if (rc == LZMA_OK)
+        rc = lzma_block_header_encode(block, header);
+    if (rc != LZMA_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: Cannot encode block header (%d)", rc);
+        return FALSE;
+    }
+
+    xz_file->block_offset = xz_file->offset;
+    if (fwrite(header, 1, block->header_size, xz_file->file)
+            != block->header_size) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: fwrite(): %s", g_strerror(errno));
+        return FALSE;
+    }
+    xz_file->offset += block->header_size;
+
+    rc = lzma_block_encoder(&(xz_file->stream), block);
+    if (rc != LZMA_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: lzma_block_encoder() error (%d)", rc);
+        return FALSE;
+    }
+
+    xz_file->in_block = TRUE;
+    xz_file->block_in = 0;
+    return TRUE;
+}
+
+/** Finish the current block and add it to the index.
+ * Returns the total size of the block or -1 on error */
+static gint64
+cr_xz_block_end(XzFile *xz_file, GError **err)
+{
+    lzma_block *block = &(xz_file->block);
+    lzma_ret rc;
+
+    if (!xz_file->in_block)
+        return 0;
+
+    if (!cr_xz_code_to_end(xz_file, LZMA_FINISH, err))
+        return -1;
+
+    rc = lzma_index_append(xz_file->index, NULL,
+                           lzma_block_unpadded_size(block),
+                           block->uncompressed_size);
+    if (rc != LZMA_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: lzma_index_append() error (%d)", rc);
+        return -1;
+    }
+
+    xz_file->in_block = FALSE;
+    xz_file->block_in = 0;
+    return (gint64) lzma_block_total_size(block);
+}
+
+/** Finish a seekable xz stream - the last block, index and stream footer */
+static int
+cr_xz_seekable_finish(XzFile *xz_file, GError **err)
+{
+    lzma_stream_flags flags = { .version = 0, .check = XZ_CHECK };
+    uint8_t footer[LZMA_STREAM_HEADER_SIZE];
+    lzma_ret rc;
+
+    if (cr_xz_block_end(xz_file, err) < 0)
+        return CRE_XZ;
+
+    rc = lzma_index_encoder(&(xz_file->stream), xz_file->index);
+    if (rc != LZMA_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: lzma_index_encoder() error (%d)", rc);
+        return CRE_XZ;
+    }
+    if (!cr_xz_code_to_end(xz_file, LZMA_RUN, err))
+        return CRE_XZ;
+
+    flags.backward_size = lzma_index_size(xz_file->index);
+    rc = lzma_stream_footer_encode(&flags, footer);
+    if (rc != LZMA_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: Cannot encode stream footer (%d)", rc);
+        return CRE_XZ;
+    }
+    if (fwrite(footer, 1, LZMA_STREAM_HEADER_SIZE, xz_file->file)
+            != LZMA_STREAM_HEADER_SIZE) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: fwrite(): %s", g_strerror(errno));
+        return CRE_XZ;
+    }
+
+    return CRE_OK;
+}
+
 cr_CompressionType
 cr_detect_compression(const char *filename, GError **err)
 {
@@ -293,6 +484,191 @@ cr_gz_strerror(gzFile f)
     return msg;
 }
 
+#ifdef WITH_LIBDEFLATE
+/** Gzip file written via libdeflate.
+ * libdeflate compresses only whole buffers, so the data are collected
+ * into a buffer which is then compressed as one gzip member.
+ * Concatenated gzip members are a valid gzip file.
+ */
+typedef struct {
+    FILE *f;
+    struct libdeflate_compressor *compressor;
+    char *buf;          /*!< Uncompressed data of the current member */
+    size_t len;         /*!< Length of the data in buf */
+    char *out;          /*!< Compressed member */
+    size_t out_size;    /*!< Size of the out buffer */
+    gint64 members;     /*!< Number of written members */
+} CR_GZDEFLATE;
+
+static void
+cr_gzdeflate_free(CR_GZDEFLATE *gz)
+{
+    if (!gz)
+        return;
+    if (gz->compressor)
+        libdeflate_free_compressor(gz->compressor);
+    g_free(gz->buf);
+    g_free(gz->out);
+    g_free(gz);
+}
+
+static CR_GZDEFLATE *
+cr_gzdeflate_open(const char *filename, int level, GError **err)
+{
+    CR_GZDEFLATE *gz = g_new0(CR_GZDEFLATE, 1);
+
+    if (level < 0)
+        level = GZ_DEFLATE_DEFAULT_LEVEL;
+
+    gz->compressor = libdeflate_alloc_compressor(level);
+    if (!gz->compressor) {
+        g_set_error(err, ERR_DOMAIN, CRE_GZ,
+                    "libdeflate_alloc_compressor() failed");
+        cr_gzdeflate_free(gz);
+        return NULL;
+    }
+
+    gz->f = fopen(filename, "wb");
+    if (!gz->f) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "fopen(): %s", g_strerror(errno));
+        cr_gzdeflate_free(gz);
+        return NULL;
+    }
+
+    gz->buf = g_malloc(GZ_DEFLATE_MEMBER_SIZE);
+    gz->out_size = libdeflate_gzip_compress_bound(gz->compressor,
+                                                  GZ_DEFLATE_MEMBER_SIZE);
+    gz->out = g_malloc(gz->out_size);
+
+    return gz;
+}
+
+/** Compress the buffered data and write them as a gzip member */
+static gboolean
+cr_gzdeflate_flush(CR_GZDEFLATE *gz, GError **err)
+{
+    size_t out_len;
+
+    out_len = libdeflate_gzip_compress(gz->compressor, gz->buf, gz->len,
+                                       gz->out, gz->out_size);
+    if (out_len == 0) {
+        g_set_error(err, ERR_DOMAIN, CRE_GZ,
+                    "libdeflate_gzip_compress() failed");
+        return FALSE;
+    }
+
+    if (fwrite(gz->out, 1, out_len, gz->f) != out_len) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "fwrite(): %s", g_strerror(errno));
+        return FALSE;
+    }
+
+    gz->len = 0;
+    gz->members++;
+    return TRUE;
+}
+
+static int
+cr_gzdeflate_write(CR_GZDEFLATE *gz,
+                   const void *buffer,
+                   unsigned int len,
+                   GError **err)
+{
+    const char *data = buffer;
+    size_t remaining = len;
+
+    while (remaining) {
+        size_t chunk = MIN(remaining, GZ_DEFLATE_MEMBER_SIZE - gz->len);
+        memcpy(gz->buf + gz->len, data, chunk);
+        gz->len += chunk;
+        data += chunk;
+        remaining -= chunk;
+
+        if (gz->len == GZ_DEFLATE_MEMBER_SIZE && !cr_gzdeflate_flush(gz, err))
+            return CR_CW_ERR;
+    }
+
+    return (int) len;
+}
+
+static int
+cr_gzdeflate_close(CR_GZDEFLATE *gz, GError **err)
+{
+    int ret = CRE_OK;
+    GError *tmp_err = NULL;
+
+    // Even an empty file must contain one (empty) member
+    if ((gz->len || !gz->members) && !cr_gzdeflate_flush(gz, &tmp_err)) {
+        ret = tmp_err->code;
+        g_propagate_error(err, tmp_err);
+    }
+
+    if (fclose(gz->f) != 0 && ret == CRE_OK) {
+        ret = CRE_IO;
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "fclose(): %s", g_strerror(errno));
+    }
+
+    gz->f = NULL;
+    cr_gzdeflate_free(gz);
+    return ret;
+}
+#endif  // WITH_LIBDEFLATE
+
+/** State of the rsyncable mode.
+ * The rolling hash depends only on the last 32 bytes of the content,
+ * so the boundaries are the same for the same content regardless
+ * of what precedes it.
+ */
+typedef struct {
+    guint32 gear[256];  /*!< Random value for every byte */
+    guint32 hash;       /*!< Rolling hash */
+} CR_RSYNC;
+
+static CR_RSYNC *
+cr_rsync_new(void)
+{
+    CR_RSYNC *rsync = g_new0(CR_RSYNC, 1);
+
+    // Fixed xorshift sequence - boundaries must not differ between runs
+    guint32 x = RSYNC_GEAR_SEED;
+    for (int i = 0; i < 256; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        rsync->gear[i] = x;
+    }
+
+    return rsync;
+}
+
+/** Feed the buffer into the rolling hash until the first boundary.
+ * @return      Number of consumed bytes (the boundary is after the last one)
+ *              or len if there is no boundary in the buffer.
+ */
+static size_t
+cr_rsync_scan(CR_RSYNC *rsync,
+              const unsigned char *buf,
+              size_t len,
+              gboolean *boundary)
+{
+    guint32 hash = rsync->hash;
+
+    for (size_t x = 0; x < len; x++) {
+        hash = (hash << 1) + rsync->gear[buf[x]];
+        if ((hash & RSYNC_MASK) == 0) {
+            rsync->hash = hash;
+            *boundary = TRUE;
+            return x + 1;
+        }
+    }
+
+    rsync->hash = hash;
+    *boundary = FALSE;
+    return len;
+}
+
 #ifdef WITH_ZCHUNK
 cr_ChecksumType
 cr_cktype_from_zck(zckCtx *zck, GError **err)
@@ -397,6 +773,14 @@ cr_sopen(const char *filename,
             break;
 
         case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
+#ifdef WITH_LIBDEFLATE
+            if (mode == CR_CW_MODE_WRITE) {
+                file->FILE = (void *) cr_gzdeflate_open(filename,
+                                                CR_CW_GZ_COMPRESSION_LEVEL,
+                                                err);
+                break;
+            }
+#endif
             file->FILE = (void *) gzopen(filename, mode_str);
             if (!file->FILE) {
                 g_set_error(err, ERR_DOMAIN, CRE_GZ,
@@ -472,7 +856,7 @@ cr_sopen(const char *filename,
 
         case (CR_CW_XZ_COMPRESSION): { // -------------------------------------
             int ret;
-            XzFile *xz_file = g_malloc(sizeof(XzFile));
+            XzFile *xz_file = g_malloc0(sizeof(XzFile));
             lzma_stream *stream = &(xz_file->stream);
             memset(stream, 0, sizeof(lzma_stream));
             /* ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^ XXX: This part
@@ -744,6 +1128,12 @@ cr_close(CR_FILE *cr_file, GError **err)
             break;
 
         case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
+#ifdef WITH_LIBDEFLATE
+            if (cr_file->mode == CR_CW_MODE_WRITE) {
+                ret = cr_gzdeflate_close((CR_GZDEFLATE *) cr_file->FILE, err);
+                break;
+            }
+#endif
             rc = gzclose((gzFile) cr_file->FILE);
             if (rc == Z_OK)
                 ret = CRE_OK;
@@ -808,7 +1198,10 @@ cr_close(CR_FILE *cr_file, GError **err)
             XzFile *xz_file = (XzFile *) cr_file->FILE;
             lzma_stream *stream = &(xz_file->stream);
 
-            if (cr_file->mode == CR_CW_MODE_WRITE) {
+            if (cr_file->mode == CR_CW_MODE_WRITE && xz_file->index) {
+                // Seekable file - the last block, index and footer
+                ret = cr_xz_seekable_finish(xz_file, err);
+            } else if (cr_file->mode == CR_CW_MODE_WRITE) {
                 // Write out rest of buffer
                 while (1) {
                     stream->next_out = (uint8_t*) xz_file->buffer;
@@ -873,6 +1266,8 @@ cr_close(CR_FILE *cr_file, GError **err)
 
             fclose(xz_file->file);
             lzma_end(stream);
+            if (xz_file->index)
+                lzma_index_end(xz_file->index, NULL);
             g_free(stream);
             break;
         }
@@ -937,6 +1332,7 @@ cr_close(CR_FILE *cr_file, GError **err)
             cr_file->stat->checksum = NULL;
     }
 
+    g_free(cr_file->rsync);
     g_free(cr_file);
 
     assert(!err || (ret != CRE_OK && *err != NULL)
@@ -1204,18 +1600,57 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
             }
             break;
 
-        case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
-            if (len == 0) {
-                ret = 0;
-                break;
-            }
+        case (CR_CW_GZ_COMPRESSION): { // -------------------------------------
+            const unsigned char *data = buffer;
+            size_t rest = len;
 
-            if ((ret = gzwrite((gzFile) cr_file->FILE, buffer, len)) == 0) {
-                ret = CR_CW_ERR;
-                g_set_error(err, ERR_DOMAIN, CRE_GZ,
-                    "gzwrite(): %s", cr_gz_strerror((gzFile) cr_file->FILE));
+            ret = len;
+            while (rest > 0) {
+                // In rsyncable mode the compressor is reset right after
+                // every boundary, so the reset points depend only on
+                // the content and not on the sizes of the writes
+                gboolean boundary = FALSE;
+                size_t part = rest;
+                if (cr_file->rsync)
+                    part = cr_rsync_scan(cr_file->rsync, data, rest, &boundary);
+
+#ifdef WITH_LIBDEFLATE
+                if (cr_gzdeflate_write((CR_GZDEFLATE *) cr_file->FILE,
+                                       data, part, err) == CR_CW_ERR) {
+                    ret = CR_CW_ERR;
+                    break;
+                }
+#else
+                if (gzwrite((gzFile) cr_file->FILE, data, part) == 0) {
+                    ret = CR_CW_ERR;
+                    g_set_error(err, ERR_DOMAIN, CRE_GZ,
+                        "gzwrite(): %s", cr_gz_strerror((gzFile) cr_file->FILE));
+                    break;
+                }
+#endif
+                data += part;
+                rest -= part;
+
+                if (!boundary)
+                    continue;
+#ifdef WITH_LIBDEFLATE
+                // Every member is compressed independently
+                CR_GZDEFLATE *gz = cr_file->FILE;
+                if (gz->len && !cr_gzdeflate_flush(gz, err)) {
+                    ret = CR_CW_ERR;
+                    break;
+                }
+#else
+                if (gzflush((gzFile) cr_file->FILE, Z_FULL_FLUSH) != Z_OK) {
+                    ret = CR_CW_ERR;
+                    g_set_error(err, ERR_DOMAIN, CRE_GZ,
+                        "gzflush(): %s", cr_gz_strerror((gzFile) cr_file->FILE));
+                    break;
+                }
+#endif
             }
             break;
+        }
 
         case (CR_CW_BZ2_COMPRESSION): // --------------------------------------
             BZ2_bzWrite(&bzerror, (BZFILE *) cr_file->FILE, (void *) buffer, len);
@@ -1250,9 +1685,14 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
             XzFile *xz_file = (XzFile *) cr_file->FILE;
             lzma_stream *stream = &(xz_file->stream);
 
+            if (xz_file->index && !xz_file->in_block
+                && !cr_xz_block_start(xz_file, err))
+                break;
+
             ret = len;
             stream->next_in = buffer;
             stream->avail_in = len;
+            xz_file->block_in += len;
 
             while (stream->avail_in) {
                 int lret;
@@ -1301,6 +1741,7 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
                                 "XZ: fwrite(): %s", g_strerror(errno));
                     break;   // Error while writing
                 }
+                xz_file->offset += out_len;
             }
 
             break;
@@ -1547,6 +1988,251 @@ cr_printf(GError **err, CR_FILE *cr_file, const char *format, ...)
     return ret;
 }
 
+int
+cr_set_rsyncable(CR_FILE *cr_file, gboolean rsyncable, GError **err)
+{
+    assert(cr_file);
+    assert(!err || *err == NULL);
+
+    if (cr_file->mode != CR_CW_MODE_WRITE) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "File is not opened in write mode");
+        return CR_CW_ERR;
+    }
+
+    switch (cr_file->type) {
+        case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
+            if (rsyncable && !cr_file->rsync)
+                cr_file->rsync = cr_rsync_new();
+            else if (!rsyncable)
+                g_clear_pointer(&cr_file->rsync, g_free);
+            break;
+        case (CR_CW_NO_COMPRESSION): // ---------------------------------------
+        case (CR_CW_BZ2_COMPRESSION): // --------------------------------------
+        case (CR_CW_XZ_COMPRESSION): // ---------------------------------------
+        case (CR_CW_ZCK_COMPRESSION): // --------------------------------------
+            break;
+        default: // -----------------------------------------------------------
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "Bad compressed file type");
+            return CR_CW_ERR;
+    }
+
+    return CRE_OK;
+}
+
+int
+cr_set_seekable(CR_FILE *cr_file, GError **err)
+{
+    XzFile *xz_file;
+    lzma_stream_flags flags = { .version = 0, .check = XZ_CHECK };
+    uint8_t header[LZMA_STREAM_HEADER_SIZE];
+
+    assert(cr_file);
+    assert(!err || *err == NULL);
+
+    if (cr_file->mode != CR_CW_MODE_WRITE) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "File is not opened in write mode");
+        return CR_CW_ERR;
+    }
+
+    if (cr_file->type != CR_CW_XZ_COMPRESSION) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Seekable mode is supported only for xz compression");
+        return CR_CW_ERR;
+    }
+
+    xz_file = (XzFile *) cr_file->FILE;
+    if (xz_file->index)
+        return CRE_OK;
+
+    if (xz_file->stream.total_in || xz_file->stream.total_out) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Seekable mode must be set before the first write");
+        return CR_CW_ERR;
+    }
+
+    if (lzma_lzma_preset(&(xz_file->options), CR_CW_XZ_COMPRESSION_LEVEL)) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: Unsupported preset %d", CR_CW_XZ_COMPRESSION_LEVEL);
+        return CR_CW_ERR;
+    }
+    xz_file->filters[0].id = LZMA_FILTER_LZMA2;
+    xz_file->filters[0].options = &(xz_file->options);
+    xz_file->filters[1].id = LZMA_VLI_UNKNOWN;
+    xz_file->filters[1].options = NULL;
+
+    // The blocks are encoded one by one by the block encoder,
+    // the stream header, index and footer are written here
+    if (lzma_stream_header_encode(&flags, header) != LZMA_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: Cannot encode stream header");
+        return CR_CW_ERR;
+    }
+    if (fwrite(header, 1, LZMA_STREAM_HEADER_SIZE, xz_file->file)
+            != LZMA_STREAM_HEADER_SIZE) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: fwrite(): %s", g_strerror(errno));
+        return CR_CW_ERR;
+    }
+    xz_file->offset = LZMA_STREAM_HEADER_SIZE;
+
+    xz_file->index = lzma_index_init(NULL);
+    if (!xz_file->index) {
+        g_set_error(err, ERR_DOMAIN, CRE_MEMORY,
+                    "XZ: lzma_index_init() failed");
+        return CR_CW_ERR;
+    }
+
+    return CRE_OK;
+}
+
+gint64
+cr_frame_tell(CR_FILE *cr_file, gint64 *frame_offset)
+{
+    assert(cr_file);
+
+    if (cr_file->mode != CR_CW_MODE_WRITE
+        || cr_file->type != CR_CW_XZ_COMPRESSION)
+        return -1;
+
+    XzFile *xz_file = (XzFile *) cr_file->FILE;
+    if (!xz_file->index)
+        return -1;
+
+    // The next block starts at the end of the output
+    if (frame_offset)
+        *frame_offset = xz_file->in_block ? xz_file->block_offset
+                                          : xz_file->offset;
+    return xz_file->block_in;
+}
+
+gint64
+cr_end_frame(CR_FILE *cr_file, GError **err)
+{
+    assert(cr_file);
+    assert(!err || *err == NULL);
+
+    if (cr_frame_tell(cr_file, NULL) < 0) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "File is not opened in seekable mode");
+        return CR_CW_ERR;
+    }
+
+    gint64 size = cr_xz_block_end((XzFile *) cr_file->FILE, err);
+    return (size < 0) ? CR_CW_ERR : size;
+}
+
+char *
+cr_read_frame(const char *filename,
+              gint64 frame_offset,
+              gint64 frame_size,
+              gsize *length,
+              GError **err)
+{
+    FILE *f;
+    uint8_t header[LZMA_STREAM_HEADER_SIZE];
+    lzma_stream_flags flags;
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block block;
+    lzma_stream stream = LZMA_STREAM_INIT;
+    uint8_t *in = NULL;
+    GString *out = NULL;
+    lzma_ret rc;
+
+    assert(filename);
+    assert(!err || *err == NULL);
+
+    f = fopen(filename, "rb");
+    if (!f) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot open %s: %s", filename, g_strerror(errno));
+        return NULL;
+    }
+
+    // The check type of the blocks is in the stream header
+    if (fread(header, LZMA_STREAM_HEADER_SIZE, 1, f) != 1
+        || lzma_stream_header_decode(&flags, header) != LZMA_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "%s is not a xz file", filename);
+        goto error;
+    }
+
+    if (frame_offset < LZMA_STREAM_HEADER_SIZE || frame_size <= 0
+        || fseeko(f, (off_t) frame_offset, SEEK_SET)) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Bad frame %"G_GINT64_FORMAT" (%"G_GINT64_FORMAT
+                    " bytes) of %s", frame_offset, frame_size, filename);
+        goto error;
+    }
+
+    in = g_malloc(frame_size);
+    if (fread(in, frame_size, 1, f) != 1) {
+        g_set_error(err, ERR_DOMAIN, CRE_IO,
+                    "Cannot read frame of %s: %s", filename,
+                    feof(f) ? "Unexpected end of file" : g_strerror(errno));
+        goto error;
+    }
+
+    memset(&block, 0, sizeof(block));
+    block.version = 0;
+    block.check = flags.check;
+    block.filters = filters;
+    block.header_size = lzma_block_header_size_decode(in[0]);
+    if (in[0] == 0x00 || block.header_size > frame_size
+        || lzma_block_header_decode(&block, NULL, in) != LZMA_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "Bad block header at %"G_GINT64_FORMAT" of %s",
+                    frame_offset, filename);
+        goto error;
+    }
+
+    rc = lzma_block_decoder(&stream, &block);
+    // The decoder has its own copy of the filter options
+    for (int x = 0; filters[x].id != LZMA_VLI_UNKNOWN; x++)
+        free(filters[x].options);
+    if (rc != LZMA_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: lzma_block_decoder() error (%d)", rc);
+        goto error;
+    }
+
+    out = g_string_sized_new(XZ_BUFFER_SIZE);
+    stream.next_in = in + block.header_size;
+    stream.avail_in = frame_size - block.header_size;
+    do {
+        gsize done = out->len;
+        g_string_set_size(out, done + XZ_BUFFER_SIZE);
+        stream.next_out = (uint8_t *) out->str + done;
+        stream.avail_out = XZ_BUFFER_SIZE;
+        rc = lzma_code(&stream, LZMA_FINISH);
+        g_string_set_size(out, done + XZ_BUFFER_SIZE - stream.avail_out);
+    } while (rc == LZMA_OK);
+
+    if (rc != LZMA_STREAM_END) {
+        g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                    "XZ: Error while decoding frame at %"G_GINT64_FORMAT
+                    " of %s (%d)", frame_offset, filename, rc);
+        goto error;
+    }
+
+    lzma_end(&stream);
+    g_free(in);
+    fclose(f);
+    if (length)
+        *length = out->len;
+    return g_string_free(out, FALSE);
+
+error:
+    lzma_end(&stream);
+    if (out)
+        g_string_free(out, TRUE);
+    g_free(in);
+    fclose(f);
+    return NULL;
+}
+
 ssize_t 
 cr_get_zchunk_with_index(CR_FILE *cr_file, ssize_t zchunk_index, char **copy_buf, GError **err)
 {
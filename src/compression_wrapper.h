@@ -87,6 +87,7 @@ typedef struct {
     cr_OpenMode         mode;           /*!< Mode */
     cr_ContentStat      *stat;          /*!< Content stats */
     cr_ChecksumCtx      *checksum_ctx;  /*!< Checksum contenxt */
+    void                *rsync;         /*!< Rsyncable mode state or NULL */
 } CR_FILE;
 
 #define CR_CW_ERR       -1      /*!< Return value - Error */
@@ -190,6 +191,65 @@ int cr_end_chunk(CR_FILE *cr_file, GError **err);
  */
 int cr_set_autochunk(CR_FILE *cr_file, gboolean auto_chunk, GError **err);
 
+/** Set rsyncable mode (like gzip --rsyncable). Compressor state is reset
+ * at content-defined boundaries, so unchanged regions of the content
+ * are compressed into identical bytes across runs. A boundary is placed
+ * after every byte where a rolling hash of the last 32 bytes of the
+ * content hits a fixed pattern (every 32 KiB on average). The boundaries
+ * therefore depend only on the content, not on the sizes of the writes
+ * or on the buffering. Supported for gzip only,
+ * for other compressions this is a no-op (zchunk has its own chunking).
+ * Must be done before first byte is written.
+ * @param cr_file       CR_FILE pointer
+ * @param rsyncable     Whether rsyncable mode should be enabled
+ * @param err           GError **
+ * @return              CRE_OK or CR_CW_ERR
+ */
+int cr_set_rsyncable(CR_FILE *cr_file, gboolean rsyncable, GError **err);
+
+/** Set seekable mode. The content is compressed into independent frames
+ * (blocks of a single xz stream), every frame is ended by cr_end_frame().
+ * The file stays a regular xz file, but a frame can be decompressed
+ * alone by cr_read_frame(). Supported for xz only.
+ * Must be done before first byte is written.
+ * @param cr_file       CR_FILE pointer
+ * @param err           GError **
+ * @return              CRE_OK or CR_CW_ERR
+ */
+int cr_set_seekable(CR_FILE *cr_file, GError **err);
+
+/** Get the position in the current frame of a seekable file.
+ * @param cr_file       CR_FILE pointer
+ * @param frame_offset  Output - offset of the current frame in the
+ *                      compressed file
+ * @return              Number of uncompressed bytes written into the
+ *                      current frame or -1 if the file is not seekable
+ */
+gint64 cr_frame_tell(CR_FILE *cr_file, gint64 *frame_offset);
+
+/** End the current frame of a seekable file.
+ * @param cr_file       CR_FILE pointer
+ * @param err           GError **
+ * @return              Compressed size of the ended frame (0 if nothing
+ *                      was written into the frame) or CR_CW_ERR
+ */
+gint64 cr_end_frame(CR_FILE *cr_file, GError **err);
+
+/** Decompress a single frame of a seekable file.
+ * @param filename      Path to the file
+ * @param frame_offset  Offset of the frame in the file
+ * @param frame_size    Compressed size of the frame
+ * @param length        Output - length of the decompressed data
+ * @param err           GError **
+ * @return              Decompressed data (free it with g_free())
+ *                      or NULL on error
+ */
+char *cr_read_frame(const char *filename,
+                    gint64 frame_offset,
+                    gint64 frame_size,
+                    gsize *length,
+                    GError **err);
+
 /** Get specific zchunks data indentified by index
  * @param cr_file       CR_FILE pointer
  * @param zchunk_index  Index of wanted zchunk
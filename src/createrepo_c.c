@@ -38,6 +38,7 @@
 #include "checksum.h"
 #include "cleanup.h"
 #include "error.h"
+#include "globset.h"
 #include "helpers.h"
 #include "load_metadata.h"
 #include "metadata_internal.h"
@@ -50,37 +51,27 @@
 #include "version.h"
 #include "xml_dump.h"
 #include "xml_file.h"
+#include "xml_parser.h"
 
 #ifdef WITH_LIBMODULEMD
 #include <modulemd.h>
 #endif /* WITH_LIBMODULEMD */
 
 #define OUTDELTADIR "drpms/"
+#define ADDITIONAL_METADATA_WORKERS 2 // Threads for additional metadata
 
 /** Check if the filename is excluded by any exclude mask.
  * @param filename      Filename (basename).
- * @param exclude_masks List of exclude masks
+ * @param exclude_masks Set of exclude masks or NULL
  * @return              TRUE if file should be included, FALSE otherwise
  */
 static gboolean
-allowed_file(const gchar *filename, GSList *exclude_masks)
+allowed_file(const gchar *filename, cr_GlobSet *exclude_masks)
 {
     // Check file against exclude glob masks
-    if (exclude_masks) {
-        int str_len = strlen(filename);
-        gchar *reversed_filename = g_utf8_strreverse(filename, str_len);
-
-        GSList *element = exclude_masks;
-        for (; element; element=g_slist_next(element)) {
-            if (g_pattern_match((GPatternSpec *) element->data,
-                                str_len, filename, reversed_filename))
-            {
-                g_free(reversed_filename);
-                g_debug("Exclude masks hit - skipping: %s", filename);
-                return FALSE;
-            }
-        }
-        g_free(reversed_filename);
+    if (exclude_masks && cr_globset_match(exclude_masks, filename)) {
+        g_debug("Exclude masks hit - skipping: %s", filename);
+        return FALSE;
     }
     return TRUE;
 }
@@ -136,6 +127,43 @@ task_cmp(gconstpointer a_p, gconstpointer b_p, G_GNUC_UNUSED gpointer user_data)
 }
 
 
+/** Stat the task's file, if the walker didn't do it already. The stat data
+ * are used to detect paths leading to the same file and by the dumper
+ * (update checks, size and mtime of the package). They are left invalid
+ * if stat() fails - the error is reported later when the file is loaded.
+ *
+ * @param task              Task with full_path filled
+ */
+static void
+pool_task_stat(struct PoolTask *task)
+{
+    if (stat(task->full_path, &(task->stat_buf)) == 0)
+        task->stat_valid = TRUE;
+}
+
+
+/** Check if the directory entry is a symbolic link.
+ * The type from readdir() is used, lstat() is only needed when
+ * the filesystem doesn't provide it.
+ *
+ * @param dir_fd            File descriptor of the directory
+ * @param entry             Entry of the directory
+ * @return                  TRUE if the entry is a symlink
+ */
+static gboolean
+dir_entry_is_symlink(int dir_fd, const struct dirent *entry)
+{
+    struct stat st;
+
+    if (entry->d_type != DT_UNKNOWN)
+        return entry->d_type == DT_LNK;
+
+    if (fstatat(dir_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+        return FALSE;
+    return S_ISLNK(st.st_mode);
+}
+
+
 /** Recursively walkt throught the input directory and add push the found
  * rpms to the thread pool (create a PoolTask and push it to the pool).
  * If the filelists is supplied then no recursive walk is done and only
@@ -188,23 +216,35 @@ fill_pool(GThreadPool *pool,
         char *dirname;
         while ((dirname = g_queue_pop_head(sub_dirs))) {
             // Open dir
-            GDir *dirp;
-            dirp = g_dir_open (dirname, 0, NULL);
+            DIR *dirp;
+            dirp = opendir(dirname);
             if (!dirp) {
                 g_warning("Cannot open directory: %s", dirname);
                 continue;
             }
+            int dir_fd = dirfd(dirp);
+
+            struct dirent *entry;
+            while ((entry = readdir(dirp))) {
+                const gchar *filename = entry->d_name;
+                struct stat st;
+
+                if (!strcmp(filename, ".") || !strcmp(filename, ".."))
+                    continue;
 
-            const gchar *filename;
-            while ((filename = g_dir_read_name(dirp))) {
                 if (!allowed_file(filename, cmd_options->exclude_masks)) {
                     continue;
                 }
 
+                // The only stat of the file, done relative to the directory.
+                // The result is kept in the task and used by the dumper.
+                if (fstatat(dir_fd, filename, &st, 0) == -1)
+                    continue;   // E.g. a broken symlink
+
                 gchar *full_path = g_strconcat(dirname, "/", filename, NULL);
 
-                if (!g_file_test(full_path, G_FILE_TEST_IS_REGULAR)) {
-                    if (g_file_test(full_path, G_FILE_TEST_IS_DIR)) {
+                if (!S_ISREG(st.st_mode)) {
+                    if (S_ISDIR(st.st_mode)) {
                         // Directory
                         gchar *sub_dir_in_chunk;
                         sub_dir_in_chunk = g_string_chunk_insert(sub_dirs_chunk,
@@ -218,14 +258,17 @@ fill_pool(GThreadPool *pool,
 
                 // Skip symbolic links if --skip-symlinks arg is used
                 if (cmd_options->skip_symlinks
-                    && g_file_test(full_path, G_FILE_TEST_IS_SYMLINK))
+                    && dir_entry_is_symlink(dir_fd, entry))
                 {
                     g_debug("Skipped symlink: %s", full_path);
                     g_free(full_path);
                     continue;
                 }
 
-                if (allowed_modulemd_module_metadata_file(full_path)) {
+                // Packages are never module metadata, the check is skipped
+                // for them as it has to open the file to detect compression
+                if (!g_str_has_suffix(filename, ".rpm")
+                    && allowed_modulemd_module_metadata_file(full_path)) {
 #ifdef WITH_LIBMODULEMD
                     cmd_options->modulemd_metadata = g_slist_prepend(
                         cmd_options->modulemd_metadata,
@@ -253,10 +296,12 @@ fill_pool(GThreadPool *pool,
                 if (allowed_file(repo_relative_path, cmd_options->exclude_masks)) {
                     // FINALLY! Add file into pool
                     g_debug("Adding pkg: %s", full_path);
-                    task = g_malloc(sizeof(struct PoolTask));
+                    task = g_new0(struct PoolTask, 1);
                     task->full_path = full_path;
                     task->filename = g_strdup(filename);
                     task->path = g_strdup(dirname);
+                    task->stat_buf = st;
+                    task->stat_valid = TRUE;
                     *current_pkglist = g_slist_prepend(*current_pkglist, task->filename);
                     // TODO: One common path for all tasks with the same path?
                     g_queue_insert_sorted(&queue, task, task_cmp, NULL);
@@ -266,7 +311,7 @@ fill_pool(GThreadPool *pool,
             }
 
             // Cleanup
-            g_dir_close (dirp);
+            closedir(dirp);
         }
 
         g_string_chunk_free (sub_dirs_chunk);
@@ -281,7 +326,8 @@ fill_pool(GThreadPool *pool,
             gchar *relative_path = (gchar *) element->data;
             //     ^^^ path from pkglist e.g. packages/i386/foobar.rpm
 
-            if (allowed_modulemd_module_metadata_file(relative_path)) {
+            if (!g_str_has_suffix(relative_path, ".rpm")
+                && allowed_modulemd_module_metadata_file(relative_path)) {
 #ifdef WITH_LIBMODULEMD
                 cmd_options->modulemd_metadata = g_slist_prepend(
                     cmd_options->modulemd_metadata,
@@ -310,24 +356,40 @@ fill_pool(GThreadPool *pool,
                 gchar *full_path = g_strconcat(in_dir, relative_path, NULL);
                 //     ^^^ /path/to/in_repo/packages/i386/foobar.rpm
                 g_debug("Adding pkg: %s", full_path);
-                task = g_malloc(sizeof(struct PoolTask));
+                task = g_new0(struct PoolTask, 1);
                 task->full_path = full_path;
                 task->filename  = g_strdup(filename);         // foobar.rpm
                 task->path      = strndup(relative_path, x);  // packages/i386/
+                pool_task_stat(task);
                 *current_pkglist = g_slist_prepend(*current_pkglist, task->filename);
                 g_queue_insert_sorted(&queue, task, task_cmp, NULL);
             }
         }
     }
 
-    // Push sorted tasks into the thread pool
-    while ((task = g_queue_pop_head(&queue)) != NULL) {
-        task->id = *task_count;
+    // IDs of the sorted tasks determine the order of packages in metadata
+    for (GList *elem = queue.head; elem; elem = g_list_next(elem)) {
+        task = elem->data;
+        task->id = (*task_count)++;
         task->media_id = media_id;
-        g_thread_pool_push(pool, task, NULL);
-        ++*task_count;
     }
 
+    // Dispatch the biggest packages first, so they don't end up
+    // as a long serial tail of the run
+    if (cmd_options->largest_first)
+        cr_pool_tasks_largest_first(&queue, cmd_options->reorder_window);
+
+    // Paths which lead to the same file (hardlinks, symlinks) are loaded
+    // only once
+    long shared_count = cr_pool_tasks_share_files(&queue);
+    if (shared_count)
+        g_message("%ld packages are hardlinks or symlinks of another "
+                  "package - they will be loaded only once", shared_count);
+
+    // Push tasks into the thread pool
+    while ((task = g_queue_pop_head(&queue)) != NULL)
+        g_thread_pool_push(pool, task, NULL);
+
     return *task_count;
 }
 
@@ -384,100 +446,235 @@ prepare_cache_dir(struct CmdOptions *cmd_options,
     return TRUE;
 }
 
-/** Adds groupfile cr_RepomdRecords to additional_metadata_rec list.
+/** Zchunk version of a record of additional metadata
+ */
+typedef struct {
+    cr_RepomdRecord *source;    // Record of the file which is compressed
+    cr_RepomdRecord *record;    // Record of the zchunk file
+} AdditionalMetadataZck;
+
+/** Processing (compression, checksums, zchunk) of one additional
+ *  metadatum. Tasks are processed in a background pool which runs
+ *  during the package processing.
+ */
+typedef struct {
+    const char *type;               // Type of the metadatum
+    const char *name;               // Path to the metadatum
+    cr_RepomdRecord *record;        // Record of the metadatum
+    cr_RepomdRecord *crecord;       // Record of the compressed copy or NULL
+    cr_CompressionType compression; // Compression of the copy
+    GSList *zck;                    // List of AdditionalMetadataZck
+    GError *err;
+} AdditionalMetadataTask;
+
+static AdditionalMetadataTask *
+additional_metadata_task_new(const cr_Metadatum *metadatum,
+                             GHashTable *owners,
+                             GSList **additional_metadata_rec)
+{
+    AdditionalMetadataTask *task = g_new0(AdditionalMetadataTask, 1);
+    task->type = metadatum->type;
+    task->name = metadatum->name;
+    task->record = cr_repomd_record_new(metadatum->type, metadatum->name);
+    *additional_metadata_rec = g_slist_prepend(*additional_metadata_rec,
+                                               task->record);
+    g_hash_table_insert(owners, task->record, task);
+    return task;
+}
+
+static void
+additional_metadata_task_free(AdditionalMetadataTask *task)
+{
+    g_slist_free_full(task->zck, g_free);
+    g_clear_error(&task->err);
+    g_free(task);
+}
+
+/** Creates cr_RepomdRecords for additional metadata (cr_Metadatum)
+ *  and the groupfile and prepares tasks which fill them.
  *  Groupfile is a special case, because it's the only metadatum
  *  that can be inputed to createrepo_c via command line option.
+ *  The groupfile and its compressed copy are added to the
+ *  additional_metadata list.
  *
- * @param group_metadatum           Cr_Metadatum for used groupfile
- * @param additional_metadata_rec   GSList of cr_RepomdRecords
- * @param comp_type                 Groupfile compression type
- * @param repomd_checksum_type
+ * @param additional_metadata       List of cr_Metadatum
+ * @param group_metadatum           Cr_Metadatum for used groupfile or NULL
+ * @param group_compression         Groupfile compression type
+ * @param zck_compression           Prepare zchunk versions of the metadata
+ * @param additional_metadata_rec   New GSList of cr_RepomdRecords
  *
- * @return                          GSList with added cr_RepomdRecords for
- *                                  groupfile
+ * @return                          GSList of AdditionalMetadataTask
  */
-GSList*
-cr_create_repomd_records_for_groupfile_metadata(const cr_Metadatum *group_metadatum,
-                                                GSList *additional_metadata_rec,
-                                                cr_CompressionType comp_type,
-                                                cr_ChecksumType repomd_checksum_type)
+static GSList*
+cr_create_additional_metadata_tasks(GSList **additional_metadata,
+                                    cr_Metadatum *group_metadatum,
+                                    cr_CompressionType group_compression,
+                                    gboolean zck_compression,
+                                    GSList **additional_metadata_rec)
 {
     GError *tmp_err = NULL;
-    char *compression_suffix = g_strdup(cr_compression_suffix(comp_type));
-    compression_suffix[0] = '_'; //replace '.'
-    additional_metadata_rec = g_slist_prepend(additional_metadata_rec,
-                                              cr_repomd_record_new(
-                                                  group_metadatum->type,
-                                                  group_metadatum->name
-                                              ));
-
-    gchar *compressed_record_type = g_strconcat(group_metadatum->type, compression_suffix, NULL);
-    additional_metadata_rec = g_slist_prepend(additional_metadata_rec,
-                                              cr_repomd_record_new(
-                                                  compressed_record_type,
-                                                  NULL
-                                              ));
-
-    cr_repomd_record_compress_and_fill(additional_metadata_rec->next->data,
-                                       additional_metadata_rec->data,
-                                       repomd_checksum_type,
-                                       comp_type,
-                                       NULL,
-                                       &tmp_err);
+    GSList *tasks = NULL;
+    cr_Metadatum *compressed_group_metadatum = NULL;
 
-    if (tmp_err) {
-        g_critical("Cannot process %s %s: %s",
-                   group_metadatum->type,
-                   group_metadatum->name,
-                   tmp_err->message);
-        g_free(compression_suffix);
+    // Task of every record (record -> AdditionalMetadataTask)
+    GHashTable *owners = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    *additional_metadata_rec = NULL;
+
+    GSList *element = *additional_metadata;
+    for (; element; element=g_slist_next(element)) {
+        tasks = g_slist_prepend(tasks,
+                                additional_metadata_task_new(element->data,
+                                                             owners,
+                                                             additional_metadata_rec));
+    }
+
+    if (group_metadatum) {
+        AdditionalMetadataTask *task;
+        char *compression_suffix = g_strdup(cr_compression_suffix(group_compression));
+        compression_suffix[0] = '_'; //replace '.'
+
+        task = additional_metadata_task_new(group_metadatum, owners,
+                                            additional_metadata_rec);
+        gchar *compressed_record_type = g_strconcat(group_metadatum->type, compression_suffix, NULL);
+        task->compression = group_compression;
+        task->crecord = cr_repomd_record_new(compressed_record_type, NULL);
         g_free(compressed_record_type);
-        g_clear_error(&tmp_err);
-        exit(EXIT_FAILURE);
+        *additional_metadata_rec = g_slist_prepend(*additional_metadata_rec,
+                                                   task->crecord);
+        g_hash_table_insert(owners, task->crecord, task);
+        tasks = g_slist_prepend(tasks, task);
+        g_free(compression_suffix);
+
+        //NOTE(amatej): Now we can add groupfile metadata to the additional_metadata list, for unified handlig while zck compressing
+        *additional_metadata = g_slist_prepend(*additional_metadata, group_metadatum);
+        compressed_group_metadatum = g_malloc0(sizeof(cr_Metadatum));
+        compressed_group_metadatum->name = g_strconcat(group_metadatum->name,
+                                                       cr_compression_suffix(group_compression),
+                                                       NULL);
+        compressed_group_metadatum->type = g_strdup(task->crecord->type);
+        *additional_metadata = g_slist_prepend(*additional_metadata, compressed_group_metadatum);
+    }
+
+    //ZCK for additional metadata
+    element = zck_compression ? *additional_metadata : NULL;
+    for (; element; element=g_slist_next(element)) {
+        cr_CompressionType com_type;
+        if (element->data == compressed_group_metadatum)
+            // The compressed groupfile doesn't exist yet
+            com_type = group_compression;
+        else
+            com_type = cr_detect_compression(((cr_Metadatum *) element->data)->name, &tmp_err);
+        gchar *elem_type = g_strdup(((cr_Metadatum *) element->data)->type);
+        gchar *elem_name = g_strdup(((cr_Metadatum *) element->data)->name);
+        if (com_type != CR_CW_NO_COMPRESSION){
+            const gchar *compression_suffix = cr_compression_suffix(com_type);
+            //remove suffixes if present
+            if (g_str_has_suffix(elem_name, compression_suffix)){
+                gchar *tmp = elem_name;
+                elem_name = g_strndup(elem_name, (strlen(elem_name) - strlen(compression_suffix)));
+                g_free(tmp);
+            }
+            gchar *type_compression_suffix = g_strdup(compression_suffix);
+            type_compression_suffix[0] = '_'; //replace '.'
+            if (g_str_has_suffix(elem_type, type_compression_suffix)){
+                gchar *tmp = elem_type;
+                elem_type = g_strndup(elem_type, (strlen(elem_type) - strlen(type_compression_suffix)));
+                g_free(tmp);
+            }
+            g_free(type_compression_suffix);
+        }
+        gchar *additional_metadatum_rec_zck_type = g_strconcat(elem_type, "_zck", NULL);
+        gchar *additional_metadatum_rec_zck_name = g_strconcat(elem_name, ".zck", NULL);
+        g_free(elem_name);
+        g_free(elem_type);
+        if (tmp_err) {
+            g_critical("Cannot detect compression type of %s: %s",
+                   ((cr_Metadatum *) element->data)->name, tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+        /* Only create additional_metadata_zck if additional_metadata isn't already zchunk
+         * and its zck version doesn't yet exists */
+        if (com_type != CR_CW_ZCK_COMPRESSION &&
+            !g_slist_find_custom(*additional_metadata_rec, additional_metadatum_rec_zck_type, cr_cmp_repomd_record_type)) {
+            GSList *additional_metadatum_rec_elem = g_slist_find_custom(*additional_metadata_rec,
+                                                                        ((cr_Metadatum *) element->data)->type,
+                                                                        cr_cmp_repomd_record_type);
+
+            AdditionalMetadataZck *zck = g_new0(AdditionalMetadataZck, 1);
+            zck->source = additional_metadatum_rec_elem->data;
+            zck->record = cr_repomd_record_new(additional_metadatum_rec_zck_type,
+                                               additional_metadatum_rec_zck_name);
+            *additional_metadata_rec = g_slist_prepend(*additional_metadata_rec,
+                                                       zck->record);
+
+            // Zchunk file is created by the task which fills the source
+            // record, so every record is touched by a single thread only
+            AdditionalMetadataTask *task = g_hash_table_lookup(owners, zck->source);
+            task->zck = g_slist_append(task->zck, zck);
+        }
+        g_free(additional_metadatum_rec_zck_type);
+        g_free(additional_metadatum_rec_zck_name);
     }
 
-    g_free(compressed_record_type);
-    g_free(compression_suffix);
+    g_hash_table_destroy(owners);
 
-    return additional_metadata_rec;
+    return g_slist_reverse(tasks);
 }
 
-/** Creates list of cr_RepomdRecords from list
- *  of additional metadata (cr_Metadatum) 
- *
- * @param additional_metadata       List of cr_Metadatum
- * @param repomd_checksum_type      
+/** Function for GThread Pool - fills records of one additional metadatum
+ */
+static void
+cr_additional_metadata_thread(gpointer data, gpointer user_data)
+{
+    AdditionalMetadataTask *task = data;
+    struct CmdOptions *cmd_options = user_data;
+
+    if (task->crecord)
+        cr_repomd_record_compress_and_fill(task->record,
+                                           task->crecord,
+                                           cmd_options->repomd_checksum_type,
+                                           task->compression,
+                                           NULL,
+                                           &task->err);
+    else
+        cr_repomd_record_fill(task->record,
+                              cmd_options->repomd_checksum_type,
+                              &task->err);
+
+    for (GSList *elem = task->zck; elem && !task->err; elem = g_slist_next(elem)) {
+        AdditionalMetadataZck *zck = elem->data;
+        cr_repomd_record_compress_and_fill(zck->source,
+                                           zck->record,
+                                           cmd_options->repomd_checksum_type,
+                                           CR_CW_ZCK_COMPRESSION,
+                                           cmd_options->zck_dict_dir,
+                                           &task->err);
+    }
+}
+
+/** Waits till all additional metadata tasks are finished,
+ *  exits on error.
  *
- * @return                          New GSList of cr_RepomdRecords
+ * @param pool                      Pool with AdditionalMetadataTasks
+ * @param tasks                     List of AdditionalMetadataTask
  */
-static GSList*
-cr_create_repomd_records_for_additional_metadata(GSList *additional_metadata,
-                                                 cr_ChecksumType repomd_checksum_type)
+static void
+cr_wait_for_additional_metadata(GThreadPool *pool, GSList *tasks)
 {
-    GError *tmp_err = NULL;
-    GSList *additional_metadata_rec = NULL; 
-    GSList *element = additional_metadata;
-    for (; element; element=g_slist_next(element)) {
-        additional_metadata_rec = g_slist_prepend(additional_metadata_rec,
-                                                  cr_repomd_record_new(
-                                                      ((cr_Metadatum *) element->data)->type,
-                                                      ((cr_Metadatum *) element->data)->name
-                                                  ));
-        cr_repomd_record_fill(additional_metadata_rec->data,
-                              repomd_checksum_type,
-                              &tmp_err);
+    g_thread_pool_free(pool, FALSE, TRUE);
 
-        if (tmp_err) {
+    for (GSList *elem = tasks; elem; elem = g_slist_next(elem)) {
+        AdditionalMetadataTask *task = elem->data;
+        if (task->err) {
             g_critical("Cannot process %s %s: %s",
-                       ((cr_Metadatum *) element->data)->type,
-                       ((cr_Metadatum *) element->data)->name,
-                       tmp_err->message);
-            g_clear_error(&tmp_err);
+                       task->type, task->name, task->err->message);
             exit(EXIT_FAILURE);
         }
     }
 
-    return additional_metadata_rec;
+    g_slist_free_full(tasks, (GDestroyNotify) additional_metadata_task_free);
 }
 
 /** Check if task finished without error, if yes
@@ -502,6 +699,38 @@ error_check_and_set_content_stat(cr_CompressionTask *task, char *filename, int *
     }
 }
 
+/** String describing inputs and options of the run which affect
+ * the generated package metadata. A checkpoint is used only by a run
+ * with the same fingerprint.
+ *
+ * @param cmd_options       Commandline options
+ * @param argc              Number of input directories + 1
+ * @param argv              Input directories (from argv[1])
+ * @return                  Fingerprint
+ */
+static gchar *
+checkpoint_fingerprint(struct CmdOptions *cmd_options, int argc, char **argv)
+{
+    GString *fingerprint = g_string_new(NULL);
+
+    g_string_append_printf(fingerprint, "version %d.%d.%d\n",
+                           CR_VERSION_MAJOR, CR_VERSION_MINOR,
+                           CR_VERSION_PATCH);
+    for (int x = 1; x < argc; x++) {
+        _cleanup_free_ gchar *in_dir = cr_normalize_dir_path(argv[x]);
+        g_string_append_printf(fingerprint, "input %s\n", in_dir);
+    }
+    g_string_append_printf(fingerprint, "checksum %s\n",
+                           cr_checksum_name_str(cmd_options->checksum_type));
+    g_string_append_printf(fingerprint, "changelog-limit %d\n",
+                           cmd_options->changelog_limit);
+    g_string_append_printf(fingerprint,
+                           "changelog-size-limit %"G_GINT64_FORMAT"\n",
+                           cmd_options->changelog_size_limit);
+
+    return g_string_free(fingerprint, FALSE);
+}
+
 static void
 load_old_metadata(cr_Metadata **md,
                   struct cr_MetadataLocation **md_location,
@@ -565,6 +794,44 @@ load_old_metadata(cr_Metadata **md,
               g_hash_table_size(cr_metadata_hashtable(*md)));
 }
 
+#ifdef CR_DELTA_RPM_SUPPORT
+/** Return path to the prestodelta.xml of the existing repodata
+ * in the out_dir or NULL.
+ */
+static gchar *
+find_old_prestodelta(const gchar *out_dir)
+{
+    gchar *path = NULL;
+    GError *tmp_err = NULL;
+    gchar *repomd_path = g_build_filename(out_dir, "repodata", "repomd.xml", NULL);
+
+    if (!g_file_test(repomd_path, G_FILE_TEST_IS_REGULAR)) {
+        g_free(repomd_path);
+        return NULL;
+    }
+
+    cr_Repomd *repomd = cr_repomd_new();
+    if (cr_xml_parse_repomd(repomd_path, repomd, NULL, NULL, &tmp_err) != CRE_OK) {
+        g_debug("Cannot parse %s: %s", repomd_path, tmp_err->message);
+        g_clear_error(&tmp_err);
+    } else {
+        cr_RepomdRecord *rec = cr_repomd_get_record(repomd, "prestodelta");
+        if (rec && rec->location_href && !rec->location_base) {
+            path = g_build_filename(out_dir, rec->location_href, NULL);
+            if (!g_file_test(path, G_FILE_TEST_IS_REGULAR))
+                g_clear_pointer(&path, g_free);
+        }
+    }
+
+    if (path)
+        g_debug("Previous prestodelta: %s", path);
+
+    cr_repomd_free(repomd);
+    g_free(repomd_path);
+    return path;
+}
+#endif
+
 int
 main(int argc, char **argv)
 {
@@ -707,6 +974,12 @@ main(int argc, char **argv)
     }
 
 
+    // Set allocator for libxml2
+    if (!cr_allocator_setup(cmd_options->xml_allocator_type, &tmp_err)) {
+        g_printerr("%s\n", tmp_err->message);
+        exit(EXIT_FAILURE);
+    }
+
     // Init package parser
     cr_package_parser_init();
     cr_xml_dump_init();
@@ -781,6 +1054,32 @@ main(int argc, char **argv)
                               tmp_err);
     }
 
+    // Resume from the checkpoint of an interrupted run - packages recorded
+    // in the checkpoint are reused like the old metadata with --update
+    cr_Checkpoint *checkpoint = NULL;
+    if (cmd_options->checkpoint) {
+        _cleanup_free_ gchar *fingerprint = NULL;
+        _cleanup_free_ gchar *checkpoint_path = NULL;
+        long resumed = 0;
+
+        fingerprint = checkpoint_fingerprint(cmd_options, argc, argv);
+        checkpoint_path = g_build_filename(out_dir, CR_CHECKPOINT_FILENAME, NULL);
+        if (!old_metadata)
+            old_metadata = cr_metadata_new(CR_HT_KEY_HREF, 0, NULL);
+
+        checkpoint = cr_checkpoint_open(checkpoint_path, fingerprint,
+                                        old_metadata, &resumed, &tmp_err);
+        if (!checkpoint) {
+            g_critical("%s", tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+
+        if (resumed)
+            g_message("Resuming from checkpoint %s: %ld packages already done",
+                      checkpoint_path, resumed);
+    }
+
     g_slist_free(current_pkglist);
     current_pkglist = NULL;
     GSList *additional_metadata = NULL;
@@ -959,6 +1258,25 @@ main(int argc, char **argv)
     cr_metadatalocation_free(old_metadata_location);
     old_metadata_location = NULL;
 
+    // Additional metadata (groupfile, modules, ...) are compressed and
+    // checksummed in background while packages are processed
+    GSList *additional_metadata_rec = NULL; // List of cr_RepomdRecords
+    GSList *additional_metadata_tasks = NULL;
+    GThreadPool *additional_metadata_pool = NULL;
+
+    additional_metadata_tasks = cr_create_additional_metadata_tasks(&additional_metadata,
+                                                                    new_groupfile_metadatum,
+                                                                    compression,
+                                                                    cmd_options->zck_compression,
+                                                                    &additional_metadata_rec);
+    additional_metadata_pool = g_thread_pool_new(cr_additional_metadata_thread,
+                                                 cmd_options,
+                                                 ADDITIONAL_METADATA_WORKERS,
+                                                 FALSE,
+                                                 NULL);
+    for (GSList *elem = additional_metadata_tasks; elem; elem = g_slist_next(elem))
+        g_thread_pool_push(additional_metadata_pool, elem->data, NULL);
+
     // Create and open new compressed files
     cr_XmlFile *pri_cr_file;
     cr_XmlFile *fil_cr_file;
@@ -1036,6 +1354,43 @@ main(int argc, char **argv)
         exit(EXIT_FAILURE);
     }
 
+    if (cmd_options->rsyncable) {
+        cr_set_rsyncable(pri_cr_file->f, TRUE, NULL);
+        cr_set_rsyncable(fil_cr_file->f, TRUE, NULL);
+        cr_set_rsyncable(oth_cr_file->f, TRUE, NULL);
+    }
+
+    // Chunks are compressed in large blocks
+    cr_xmlfile_set_buffer_size(pri_cr_file, CR_XMLFILE_DEFAULT_BUFFER_SIZE, NULL);
+    cr_xmlfile_set_buffer_size(fil_cr_file, CR_XMLFILE_DEFAULT_BUFFER_SIZE, NULL);
+    cr_xmlfile_set_buffer_size(oth_cr_file, CR_XMLFILE_DEFAULT_BUFFER_SIZE, NULL);
+
+    // Seekable filelists and other xml with indexes of their packages
+    gchar *fil_index_filename = NULL;
+    gchar *oth_index_filename = NULL;
+    cr_ContentStat *fil_index_stat = NULL;
+    cr_ContentStat *oth_index_stat = NULL;
+
+    if (cmd_options->seekable_metadata) {
+        fil_index_filename = g_strconcat(tmp_out_repo, "/filelists_index.txt",
+                                         xml_compression_suffix, NULL);
+        oth_index_filename = g_strconcat(tmp_out_repo, "/other_index.txt",
+                                         xml_compression_suffix, NULL);
+        fil_index_stat = cr_contentstat_new(cmd_options->repomd_checksum_type, NULL);
+        oth_index_stat = cr_contentstat_new(cmd_options->repomd_checksum_type, NULL);
+
+        cr_xmlfile_set_seekable(fil_cr_file, fil_index_filename,
+                                xml_compression, fil_index_stat, &tmp_err);
+        if (!tmp_err)
+            cr_xmlfile_set_seekable(oth_cr_file, oth_index_filename,
+                                    xml_compression, oth_index_stat, &tmp_err);
+        if (tmp_err) {
+            g_critical("Cannot write seekable metadata: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     // Set number of packages
     g_debug("Setting number of packages");
     cr_xmlfile_set_num_of_pkgs(pri_cr_file, task_count, NULL);
@@ -1273,20 +1628,29 @@ main(int argc, char **argv)
     } else {
       user_data.changelog_limit   = cmd_options->changelog_limit;
     }
+    user_data.changelog_size_limit = cmd_options->changelog_size_limit;
     user_data.location_base     = cmd_options->location_base;
     user_data.checksum_type_str = cr_checksum_name_str(cmd_options->checksum_type);
     user_data.checksum_type     = cmd_options->checksum_type;
     user_data.checksum_cachedir = cmd_options->checksum_cachedir;
+    user_data.checksum_batch    = NULL;
+    user_data.checksum_manifest = NULL;
+    user_data.checkpoint        = checkpoint;
     user_data.skip_symlinks     = cmd_options->skip_symlinks;
     user_data.repodir_name_len  = strlen(in_dir);
     user_data.task_count        = task_count;
     user_data.package_count     = 0;
     user_data.skip_stat         = cmd_options->skip_stat;
     user_data.old_metadata      = old_metadata;
+    user_data.old_metadata_moved = NULL;
+    if (cmd_options->update && old_metadata)
+        user_data.old_metadata_moved = cr_moved_packages_index(old_metadata);
     user_data.id_pri            = 0;
     user_data.id_fil            = 0;
     user_data.id_oth            = 0;
     user_data.buffer            = g_queue_new();
+    user_data.reorder_window    = cmd_options->largest_first
+                                    ? cmd_options->reorder_window : 0;
     user_data.deltas            = cmd_options->deltas;
     user_data.max_delta_rpm_size= cmd_options->max_delta_rpm_size;
     user_data.deltatargetpackages = NULL;
@@ -1294,6 +1658,7 @@ main(int argc, char **argv)
     user_data.location_prefix   = cmd_options->location_prefix;
     user_data.had_errors        = 0;
     user_data.output_pkg_list   = output_pkg_list;
+    user_data.numa              = cmd_options->numa;
 
     g_mutex_init(&(user_data.mutex_output_pkg_list));
     g_mutex_init(&(user_data.mutex_pri));
@@ -1306,15 +1671,69 @@ main(int argc, char **argv)
     g_mutex_init(&(user_data.mutex_old_md));
     g_mutex_init(&(user_data.mutex_deltatargetpackages));
 
+    if (user_data.numa) {
+        guint numa_nodes = cr_dumper_numa_init(&user_data);
+        if (numa_nodes)
+            g_message("NUMA mode: workers spread over %u nodes", numa_nodes);
+    }
+
+    if (cmd_options->workers > 1
+        && cr_checksum_batch_supported(cmd_options->checksum_type,
+                                       cmd_options->checksum_batch_mode))
+    {
+        user_data.checksum_batch = cr_checksum_batch_new(cmd_options->checksum_type,
+                                                         cmd_options->workers);
+        g_debug("Multi-buffer checksum calculation enabled");
+    }
+
+    if (cmd_options->checksum_manifest) {
+        user_data.checksum_manifest = cr_checksum_manifest_load(
+                                            cmd_options->checksum_manifest,
+                                            cmd_options->checksum_type,
+                                            &tmp_err);
+        if (!user_data.checksum_manifest) {
+            g_critical("Cannot load checksum manifest: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+        cr_checksum_manifest_set_verify(user_data.checksum_manifest,
+                                        cmd_options->checksum_manifest_verify);
+    }
+
     g_debug("Thread pool user data ready");
 
     // Start pool
+    GTimer *pool_timer = g_timer_new();
     g_thread_pool_set_max_threads(pool, cmd_options->workers, NULL);
     g_message("Pool started (with %d workers)", cmd_options->workers);
 
     // Wait until pool is finished
     g_thread_pool_free(pool, FALSE, TRUE);
 
+    gdouble pool_elapsed = g_timer_elapsed(pool_timer, NULL);
+    g_timer_destroy(pool_timer);
+    g_debug("Pool throughput: %ld packages in %.2f s (%.1f packages/s%s)",
+              user_data.package_count, pool_elapsed,
+              pool_elapsed > 0 ? user_data.package_count / pool_elapsed : 0.0,
+              user_data.numa ? ", NUMA mode" : "");
+    cr_dumper_numa_cleanup(&user_data);
+    if (user_data.checksum_batch) {
+        cr_checksum_batch_log_stats(user_data.checksum_batch);
+        cr_checksum_batch_free(user_data.checksum_batch);
+    }
+    if (user_data.checksum_manifest) {
+        // Metadata with wrong checksums must not replace the old ones
+        gboolean verified = cr_checksum_manifest_finish(
+                                        user_data.checksum_manifest, &tmp_err);
+        cr_checksum_manifest_log_stats(user_data.checksum_manifest);
+        cr_checksum_manifest_free(user_data.checksum_manifest);
+        if (!verified) {
+            g_critical("%s", tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     // if there were any errors, exit nonzero
     if ( cmd_options->error_exit_val && user_data.had_errors ) {
 	exit_val = 2;
@@ -1370,6 +1789,17 @@ main(int argc, char **argv)
     if (user_data.package_count != user_data.task_count){
         g_message("Warning: There were some invalid packages: we have to recompress other, filelists and primary xml metadata files in order to have correct package counts");
 
+        // The recompressed files are not seekable and the offsets
+        // in the package indexes would be wrong
+        if (cmd_options->seekable_metadata) {
+            g_warning("Package indexes of filelists and other xml are "
+                      "not generated because of the invalid packages");
+            g_remove(fil_index_filename);
+            g_remove(oth_index_filename);
+            g_clear_pointer(&fil_index_filename, g_free);
+            g_clear_pointer(&oth_index_filename, g_free);
+        }
+
         GThreadPool *rewrite_pkg_count_pool = g_thread_pool_new(cr_rewrite_pkg_count_thread,
                                                                 &user_data, 3, FALSE, NULL);
 
@@ -1485,9 +1915,9 @@ main(int argc, char **argv)
     cr_RepomdRecord *oth_zck_rec              = NULL;
     cr_RepomdRecord *prestodelta_rec          = NULL;
     cr_RepomdRecord *prestodelta_zck_rec      = NULL;
+    cr_RepomdRecord *fil_index_rec            = NULL;
+    cr_RepomdRecord *oth_index_rec            = NULL;
 
-    // List of cr_RepomdRecords
-    GSList *additional_metadata_rec           = NULL; 
 
     // XML
     cr_repomd_record_load_contentstat(pri_xml_rec, pri_stat);
@@ -1498,6 +1928,18 @@ main(int argc, char **argv)
     cr_contentstat_free(fil_stat, NULL);
     cr_contentstat_free(oth_stat, NULL);
 
+    // Package indexes
+    if (fil_index_filename && oth_index_filename) {
+        fil_index_rec = cr_repomd_record_new("filelists_index", fil_index_filename);
+        oth_index_rec = cr_repomd_record_new("other_index", oth_index_filename);
+        cr_repomd_record_load_contentstat(fil_index_rec, fil_index_stat);
+        cr_repomd_record_load_contentstat(oth_index_rec, oth_index_stat);
+        cr_repomd_record_fill(fil_index_rec, cmd_options->repomd_checksum_type, NULL);
+        cr_repomd_record_fill(oth_index_rec, cmd_options->repomd_checksum_type, NULL);
+    }
+    cr_contentstat_free(fil_index_stat, NULL);
+    cr_contentstat_free(oth_index_stat, NULL);
+
     GThreadPool *fill_pool = g_thread_pool_new(cr_repomd_record_fill_thread,
                                                NULL, 3, FALSE, NULL);
 
@@ -1521,22 +1963,9 @@ main(int argc, char **argv)
     g_thread_pool_push(fill_pool, oth_fill_task, NULL);
 
 
-    additional_metadata_rec = cr_create_repomd_records_for_additional_metadata(additional_metadata,
-                                                                               cmd_options->repomd_checksum_type);
-
-    if (new_groupfile_metadatum) {
-        additional_metadata_rec = cr_create_repomd_records_for_groupfile_metadata(new_groupfile_metadatum,
-                                                                                  additional_metadata_rec,
-                                                                                  compression,
-                                                                                  cmd_options->repomd_checksum_type);
-
-        //NOTE(amatej): Now we can add groupfile metadata to the additional_metadata list, for unified handlig while zck compressing
-        additional_metadata = g_slist_prepend(additional_metadata, new_groupfile_metadatum);
-        cr_Metadatum *compressed_new_groupfile_metadatum = g_malloc0(sizeof(cr_Metadatum));
-        compressed_new_groupfile_metadatum->name = g_strdup(((cr_RepomdRecord *) additional_metadata_rec->data)->location_real);
-        compressed_new_groupfile_metadatum->type = g_strdup(((cr_RepomdRecord *) additional_metadata_rec->data)->type);
-        additional_metadata = g_slist_prepend(additional_metadata, compressed_new_groupfile_metadatum);
-    }
+    // Wait till additional metadata are processed
+    cr_wait_for_additional_metadata(additional_metadata_pool,
+                                    additional_metadata_tasks);
 
     // Wait till repomd record fill task of xml files ends.
     g_thread_pool_free(fill_pool, FALSE, TRUE);
@@ -1699,72 +2128,6 @@ main(int argc, char **argv)
         cr_repomdrecordfilltask_free(pri_zck_fill_task, NULL);
         cr_repomdrecordfilltask_free(fil_zck_fill_task, NULL);
         cr_repomdrecordfilltask_free(oth_zck_fill_task, NULL);
-
-        //ZCK for additional metadata
-        GSList *element = additional_metadata;
-        for (; element; element=g_slist_next(element)) {
-            cr_CompressionType com_type = cr_detect_compression(((cr_Metadatum *) element->data)->name, &tmp_err);
-            gchar *elem_type = g_strdup(((cr_Metadatum *) element->data)->type);
-            gchar *elem_name = g_strdup(((cr_Metadatum *) element->data)->name);
-            if (com_type != CR_CW_NO_COMPRESSION){
-                const gchar *compression_suffix = cr_compression_suffix(com_type);
-                //remove suffixes if present
-                if (g_str_has_suffix(elem_name, compression_suffix)){
-                    gchar *tmp = elem_name;
-                    elem_name = g_strndup(elem_name, (strlen(elem_name) - strlen(compression_suffix)));
-                    g_free(tmp);
-                }
-                gchar *type_compression_suffix = g_strdup(compression_suffix);
-                type_compression_suffix[0] = '_'; //replace '.'
-                if (g_str_has_suffix(elem_type, type_compression_suffix)){
-                    gchar *tmp = elem_type;
-                    elem_type = g_strndup(elem_type, (strlen(elem_type) - strlen(type_compression_suffix)));
-                    g_free(tmp);
-                }
-                g_free(type_compression_suffix);
-            }
-            gchar *additional_metadatum_rec_zck_type = g_strconcat(elem_type, "_zck", NULL);
-            gchar *additional_metadatum_rec_zck_name = g_strconcat(elem_name, ".zck", NULL);
-            g_free(elem_name);
-            g_free(elem_type);
-            if (tmp_err) {
-                g_critical("Cannot detect compression type of %s: %s",
-                       ((cr_Metadatum *) element->data)->name, tmp_err->message);
-                g_clear_error(&tmp_err);
-                exit(EXIT_FAILURE);
-            }
-            /* Only create additional_metadata_zck if additional_metadata isn't already zchunk 
-             * and its zck version doesn't yet exists */
-            if (com_type != CR_CW_ZCK_COMPRESSION && 
-                !g_slist_find_custom(additional_metadata_rec, additional_metadatum_rec_zck_type, cr_cmp_repomd_record_type)) {
-                GSList *additional_metadatum_rec_elem = g_slist_find_custom(additional_metadata_rec,
-                                                                            ((cr_Metadatum *) element->data)->type,
-                                                                            cr_cmp_repomd_record_type);
-
-                additional_metadata_rec = g_slist_prepend(additional_metadata_rec,
-                                                          cr_repomd_record_new(
-                                                              additional_metadatum_rec_zck_type,
-                                                              additional_metadatum_rec_zck_name
-                                                          ));
-
-                cr_repomd_record_compress_and_fill(additional_metadatum_rec_elem->data,
-                                                   additional_metadata_rec->data,
-                                                   cmd_options->repomd_checksum_type,
-                                                   CR_CW_ZCK_COMPRESSION,
-                                                   cmd_options->zck_dict_dir,
-                                                   &tmp_err);
-                if (tmp_err) {
-                    g_critical("Cannot process %s %s: %s",
-                            ((cr_Metadatum *) element->data)->type,
-                            ((cr_Metadatum *) element->data)->name,
-                            tmp_err->message);
-                    g_clear_error(&tmp_err);
-                    exit(EXIT_FAILURE);
-                }
-            }
-            g_free(additional_metadatum_rec_zck_type);
-            g_free(additional_metadatum_rec_zck_name);
-        }
     }
 
     cr_contentstat_free(pri_zck_stat, NULL);
@@ -1777,6 +2140,7 @@ main(int argc, char **argv)
         gchar *filename, *outdeltadir = NULL;
         gchar *prestodelta_xml_filename = NULL;
         gchar *prestodelta_zck_filename = NULL;
+        gchar *old_prestodelta = NULL;
 
         GHashTable *ht_oldpackagedirs = NULL;
         cr_XmlFile *prestodelta_cr_file = NULL;
@@ -1862,7 +2226,8 @@ main(int argc, char **argv)
             }
         }
 
-        ret = cr_deltarpms_generate_prestodelta_file(
+        old_prestodelta = find_old_prestodelta(out_dir);
+        ret = cr_deltarpms_generate_prestodelta_file_with_old(
                         outdeltadir,
                         prestodelta_cr_file,
                         prestodelta_cr_zck_file,
@@ -1870,6 +2235,7 @@ main(int argc, char **argv)
                         CR_CHECKSUM_SHA256, // Createrepo always uses SHA256
                         cmd_options->workers,
                         out_dir,
+                        old_prestodelta,
                         &tmp_err);
         if (!ret) {
             g_critical("Cannot generate %s: %s", prestodelta_xml_filename,
@@ -1899,6 +2265,7 @@ deltaerror:
         g_free(outdeltadir);
         g_free(prestodelta_xml_filename);
         g_free(prestodelta_zck_filename);
+        g_free(old_prestodelta);
         cr_xmlfile_close(prestodelta_cr_file, NULL);
         cr_xmlfile_close(prestodelta_cr_zck_file, NULL);
         cr_contentstat_free(prestodelta_stat, NULL);
@@ -1921,6 +2288,8 @@ deltaerror:
         cr_repomd_record_rename_file(oth_zck_rec, NULL);
         cr_repomd_record_rename_file(prestodelta_rec, NULL);
         cr_repomd_record_rename_file(prestodelta_zck_rec, NULL);
+        cr_repomd_record_rename_file(fil_index_rec, NULL);
+        cr_repomd_record_rename_file(oth_index_rec, NULL);
         GSList *element = additional_metadata_rec;
         for (; element; element=g_slist_next(element)) {
             cr_repomd_record_rename_file(element->data, NULL);
@@ -1937,6 +2306,8 @@ deltaerror:
         cr_repomd_record_set_timestamp(fil_db_rec, revision);
         cr_repomd_record_set_timestamp(oth_db_rec, revision);
         cr_repomd_record_set_timestamp(prestodelta_rec, revision);
+        cr_repomd_record_set_timestamp(fil_index_rec, revision);
+        cr_repomd_record_set_timestamp(oth_index_rec, revision);
         GSList *element = additional_metadata_rec;
         for (; element; element=g_slist_next(element)) {
             cr_repomd_record_set_timestamp(element->data, revision);
@@ -1955,6 +2326,8 @@ deltaerror:
     cr_repomd_set_record(repomd_obj, oth_zck_rec);
     cr_repomd_set_record(repomd_obj, prestodelta_rec);
     cr_repomd_set_record(repomd_obj, prestodelta_zck_rec);
+    cr_repomd_set_record(repomd_obj, fil_index_rec);
+    cr_repomd_set_record(repomd_obj, oth_index_rec);
     GSList *elem = additional_metadata_rec;
     for (; elem; elem=g_slist_next(elem)) {
         cr_repomd_set_record(repomd_obj, elem->data);
@@ -2071,6 +2444,14 @@ deltaerror:
     // Disable path stored for exit handler
     cr_unset_cleanup_handler(NULL);
 
+    // The run is done, nothing to resume
+    if (user_data.checkpoint
+        && !cr_checkpoint_remove(user_data.checkpoint, &tmp_err))
+    {
+        g_warning("%s", tmp_err->message);
+        g_clear_error(&tmp_err);
+    }
+
     sigprocmask(SIG_SETMASK, &old_mask, NULL);
 
     // === End of section that has to be maximally atomic ===
@@ -2089,6 +2470,8 @@ deltaerror:
     // Clean up
     g_debug("Memory cleanup");
 
+    if (user_data.old_metadata_moved)
+        g_hash_table_destroy(user_data.old_metadata_moved);
     if (old_metadata)
         cr_metadata_free(old_metadata);
 
@@ -2110,12 +2493,17 @@ deltaerror:
     g_free(pri_zck_filename);
     g_free(fil_zck_filename);
     g_free(oth_zck_filename);
+    g_free(fil_index_filename);
+    g_free(oth_index_filename);
     g_slist_free_full(additional_metadata, (GDestroyNotify) cr_metadatum_free);
     g_slist_free(additional_metadata_rec);
 
     free_options(cmd_options);
     cr_package_parser_cleanup();
 
+    cr_allocator_log_stats(NULL);
+    cr_allocator_cleanup();
+
     g_debug("All done");
     exit(exit_val);
 }
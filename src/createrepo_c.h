@@ -39,10 +39,15 @@ extern "C" {
  */
 
 #include <glib.h>
+#include "allocator.h"
 #include "checksum.h"
+#include "checkpoint.h"
+#include "checksum_batch.h"
+#include "checksum_manifest.h"
 #include "compression_wrapper.h"
 #include "deltarpms.h"
 #include "error.h"
+#include "globset.h"
 #include "load_metadata.h"
 #include "locate_metadata.h"
 #include "misc.h"
@@ -53,6 +58,8 @@ extern "C" {
 #include "sqlite.h"
 #include "threads.h"
 #include "updateinfo.h"
+#include "url_stream.h"
+#include "verifyrepo_shared.h"
 #include "version.h"
 #include "xml_dump.h"
 #include "xml_file.h"
@@ -34,6 +34,9 @@
 #include "parsepkg.h"
 #include "misc.h"
 #include "error.h"
+#include "xml_dump.h"
+#include "xml_parser.h"
+#include "xml_parser_internal.h"
 
 
 #define ERR_DOMAIN      CREATEREPO_C_ERROR
@@ -49,11 +52,10 @@ cr_drpm_support(void)
 
 #ifdef    CR_DELTA_RPM_SUPPORT
 
-char *
-cr_drpm_create(cr_DeltaTargetPackage *old,
-               cr_DeltaTargetPackage *new,
-               const char *destdir,
-               GError **err)
+static gchar *
+cr_drpm_path(cr_DeltaTargetPackage *old,
+             cr_DeltaTargetPackage *new,
+             const char *destdir)
 {
     gchar *drpmfn, *drpmpath;
 
@@ -62,6 +64,151 @@ cr_drpm_create(cr_DeltaTargetPackage *old,
                              new->version, new->release, old->arch);
     drpmpath = g_build_filename(destdir, drpmfn, NULL);
     g_free(drpmfn);
+    return drpmpath;
+}
+
+/** Compare NEVR string from a drpm with the package */
+static gboolean
+cr_drpm_nevr_matches(const char *strnevr, cr_DeltaTargetPackage *tpkg)
+{
+    gboolean ret;
+    cr_NEVR *nevr;
+
+    if (!strnevr)
+        return FALSE;
+
+    nevr = cr_str_to_nevr(strnevr);
+    ret = !g_strcmp0(nevr->name, tpkg->name)
+          && !cr_cmp_evr(nevr->epoch, nevr->version, nevr->release,
+                         tpkg->epoch, tpkg->version, tpkg->release);
+    cr_nevr_free(nevr);
+    return ret;
+}
+
+/** Path to the file with the header checksums of the packages
+ * the drpm was made from (a hidden file next to the drpm) */
+static gchar *
+cr_drpm_sources_path(const char *drpmpath)
+{
+    gchar *dirname = g_path_get_dirname(drpmpath);
+    gchar *basename = g_path_get_basename(drpmpath);
+    gchar *filename = g_strconcat(".", basename, ".sources", NULL);
+    gchar *path = g_build_filename(dirname, filename, NULL);
+    g_free(dirname);
+    g_free(basename);
+    g_free(filename);
+    return path;
+}
+
+/** Header checksums (hdrid) of the old and the new package.
+ * Only headers of the packages are read. */
+static gchar *
+cr_drpm_sources(cr_DeltaTargetPackage *old, cr_DeltaTargetPackage *new)
+{
+    gchar *sources = NULL;
+    cr_Package *old_pkg, *new_pkg;
+
+    old_pkg = cr_package_from_rpm_base(old->path, 0, CR_HDRR_LOADHDRID, NULL);
+    new_pkg = cr_package_from_rpm_base(new->path, 0, CR_HDRR_LOADHDRID, NULL);
+    if (old_pkg && new_pkg && old_pkg->hdrid && new_pkg->hdrid)
+        sources = g_strdup_printf("%s %s\n", old_pkg->hdrid, new_pkg->hdrid);
+    cr_package_free(old_pkg);
+    cr_package_free(new_pkg);
+    return sources;
+}
+
+gboolean
+cr_drpm_write_sources(const char *drpmpath,
+                      cr_DeltaTargetPackage *old,
+                      cr_DeltaTargetPackage *new,
+                      GError **err)
+{
+    gboolean ret;
+    gchar *path, *sources;
+
+    assert(!err || *err == NULL);
+
+    sources = cr_drpm_sources(old, new);
+    if (!sources) {
+        g_set_error(err, ERR_DOMAIN, CRE_DELTARPM,
+                    "Cannot read header checksums of %s and %s",
+                    old->path, new->path);
+        return FALSE;
+    }
+
+    path = cr_drpm_sources_path(drpmpath);
+    ret = g_file_set_contents(path, sources, -1, err);
+    g_free(path);
+    g_free(sources);
+    return ret;
+}
+
+gboolean
+cr_drpm_is_uptodate(const char *drpmpath,
+                    cr_DeltaTargetPackage *old,
+                    cr_DeltaTargetPackage *new)
+{
+    struct stat st_drpm, st_new;
+    struct drpm *delta = NULL;
+    char *str = NULL;
+    gchar *path, *recorded = NULL, *sources = NULL;
+    unsigned long tgtsize = 0;
+    gboolean ret = FALSE;
+
+    if (stat(drpmpath, &st_drpm) || !S_ISREG(st_drpm.st_mode))
+        return FALSE;
+    if (stat(new->path, &st_new))
+        return FALSE;
+
+    // The drpm must be made from the same packages
+    path = cr_drpm_sources_path(drpmpath);
+    g_file_get_contents(path, &recorded, NULL, NULL);
+    g_free(path);
+    if (!recorded)
+        return FALSE;
+    sources = cr_drpm_sources(old, new);
+    if (!sources || strcmp(sources, recorded)) {
+        g_free(recorded);
+        g_free(sources);
+        return FALSE;
+    }
+    g_free(recorded);
+    g_free(sources);
+
+    if (drpm_read(&delta, drpmpath) != DRPM_ERR_OK)
+        return FALSE;
+
+    // Source and target NEVRs
+    if (drpm_get_string(delta, DRPM_TAG_SRCNEVR, &str) != DRPM_ERR_OK
+        || !cr_drpm_nevr_matches(str, old))
+        goto exit;
+    free(str);
+    str = NULL;
+
+    if (drpm_get_string(delta, DRPM_TAG_TGTNEVR, &str) != DRPM_ERR_OK
+        || !cr_drpm_nevr_matches(str, new))
+        goto exit;
+
+    // Target package size
+    if (drpm_get_ulong(delta, DRPM_TAG_TGTSIZE, &tgtsize) != DRPM_ERR_OK
+        || (gint64) tgtsize != (gint64) st_new.st_size)
+        goto exit;
+
+    ret = TRUE;
+
+exit:
+    free(str);
+    drpm_destroy(&delta);
+    return ret;
+}
+
+char *
+cr_drpm_create(cr_DeltaTargetPackage *old,
+               cr_DeltaTargetPackage *new,
+               const char *destdir,
+               GError **err)
+{
+    gchar *drpmpath = cr_drpm_path(old, new, destdir);
 
     drpm_make_options *opts;
     drpm_make_options_init(&opts);
@@ -251,6 +398,8 @@ typedef struct {
     gint64 active_work_size;
     gint active_tasks;
     GCond cond_task_finished;
+    gint generated;     // Number of newly generated drpms
+    gint reused;        // Number of reused (up to date) drpms
 } cr_DeltaThreadUserData;
 
 
@@ -326,18 +475,43 @@ cr_delta_thread(gpointer data, gpointer udata)
         for (GSList *lelem = local_candidates; lelem; lelem = g_slist_next(lelem)){
             GError *tmp_err = NULL;
             cr_DeltaTargetPackage *old = lelem->data;
+            gchar *drpmpath = cr_drpm_path(old, tpkg, user_data->outdeltadir);
+
+            // Reuse the drpm from a previous run if it is up to date
+            if (g_file_test(drpmpath, G_FILE_TEST_EXISTS)) {
+                if (cr_drpm_is_uptodate(drpmpath, old, tpkg)) {
+                    g_debug("Reusing delta %s", drpmpath);
+                    g_free(drpmpath);
+                    g_atomic_int_inc(&(user_data->reused));
+                    if (++x == user_data->num_deltas)
+                        break;
+                    continue;
+                }
+            }
+            g_free(drpmpath);
 
             g_debug("Generating delta %s -> %s", old->path, tpkg->path);
-            cr_drpm_create(old, tpkg, user_data->outdeltadir, &tmp_err);
+            drpmpath = cr_drpm_create(old, tpkg, user_data->outdeltadir, &tmp_err);
             if (tmp_err) {
                 g_warning("Cannot generate delta %s -> %s : %s",
                           old->path, tpkg->path, tmp_err->message);
                 g_error_free(tmp_err);
                 continue;
             }
+            // Remember the packages for the next run
+            if (!cr_drpm_write_sources(drpmpath, old, tpkg, &tmp_err)) {
+                g_warning("Cannot record sources of %s (it won't be reused): %s",
+                          drpmpath, tmp_err->message);
+                g_clear_error(&tmp_err);
+            }
+            g_free(drpmpath);
+            g_atomic_int_inc(&(user_data->generated));
             if (++x == user_data->num_deltas)
                 break;
         }
+
+        cr_slist_free_full(local_candidates,
+                           (GDestroyNotify) cr_deltatargetpackage_free);
     }
 
     g_debug("Deltas for \"%s\" (%"G_GINT64_FORMAT") generated",
@@ -399,6 +573,8 @@ cr_deltarpms_parallel_deltas(GSList *targetpackages,
     user_data.oldpackages           = oldpackages;
     user_data.active_work_size      = G_GINT64_CONSTANT(0);
     user_data.active_tasks          = 0;
+    user_data.generated             = 0;
+    user_data.reused                = 0;
 
     g_mutex_init(&(user_data.mutex));
     g_cond_init(&(user_data.cond_task_finished));
@@ -471,6 +647,9 @@ cr_deltarpms_parallel_deltas(GSList *targetpackages,
     g_mutex_clear(&(user_data.mutex));
     g_cond_clear(&(user_data.cond_task_finished));
 
+    g_message("Deltas: %d generated, %d reused from previous runs",
+              user_data.generated, user_data.reused);
+
     return TRUE;
 }
 
@@ -618,6 +797,8 @@ typedef struct {
     cr_ChecksumType checksum_type;
     const gchar *prefix_to_strip;
     size_t prefix_len;
+    GHashTable *old_deltas;     // Deltas from the previous prestodelta.xml
+    time_t old_mtime;           // mtime of the previous prestodelta.xml
 } cr_PrestoDeltaUserData;
 
 void
@@ -629,6 +810,273 @@ cr_prestodeltatask_free(cr_PrestoDeltaTask *task)
     g_free(task);
 }
 
+/*
+ * Parser of a previous prestodelta.xml
+ * Deltas are loaded into a table location_href -> cr_DeltaPackage
+ */
+
+typedef enum {
+    STATE_START,
+    STATE_PRESTODELTA,
+    STATE_NEWPACKAGE,
+    STATE_DELTA,
+    STATE_FILENAME,
+    STATE_SEQUENCE,
+    STATE_SIZE,
+    STATE_CHECKSUM,
+    NUMSTATES
+} cr_PrestoDeltaState;
+
+static cr_StatesSwitch stateswitches[] = {
+    { STATE_START,       "prestodelta",  STATE_PRESTODELTA,  0 },
+    { STATE_PRESTODELTA, "newpackage",   STATE_NEWPACKAGE,   0 },
+    { STATE_NEWPACKAGE,  "delta",        STATE_DELTA,        0 },
+    { STATE_DELTA,       "filename",     STATE_FILENAME,     1 },
+    { STATE_DELTA,       "sequence",     STATE_SEQUENCE,     1 },
+    { STATE_DELTA,       "size",         STATE_SIZE,         1 },
+    { STATE_DELTA,       "checksum",     STATE_CHECKSUM,     1 },
+    { NUMSTATES,         NULL, NUMSTATES, 0 }
+};
+
+typedef struct {
+    GHashTable *deltas;     // location_href -> cr_DeltaPackage
+    cr_DeltaPackage *dpkg;  // Currently parsed delta
+    GStringChunk *chunk;    // Attributes of the current newpackage
+    const char *name;
+    const char *epoch;
+    const char *version;
+    const char *release;
+    const char *arch;
+} cr_OldPrestoDelta;
+
+static void
+cr_prestodelta_start_handler(void *pdata,
+                             const xmlChar *element,
+                             const xmlChar **attr)
+{
+    cr_ParserData *pd = pdata;
+    cr_OldPrestoDelta *old = pd->pkgcb_data;
+    cr_StatesSwitch *sw;
+
+    if (pd->err)
+        return;
+
+    if (pd->depth != pd->statedepth) {
+        pd->depth++;
+        return;
+    }
+    pd->depth++;
+
+    if (!pd->swtab[pd->state])
+        return;
+
+    for (sw = pd->swtab[pd->state]; sw->from == pd->state; sw++)
+        if (!strcmp((char *) element, sw->ename))
+            break;
+    if (sw->from != pd->state)
+        return;  // Unknown element
+
+    pd->state      = sw->to;
+    pd->docontent  = sw->docontent;
+    pd->statedepth = pd->depth;
+    pd->lcontent   = 0;
+    pd->content[0] = '\0';
+
+    switch (pd->state) {
+    case STATE_PRESTODELTA:
+        pd->main_tag_found = TRUE;
+        break;
+
+    case STATE_NEWPACKAGE:
+        old->name    = cr_safe_string_chunk_insert_null(old->chunk,
+                                    cr_find_attr("name", attr));
+        old->epoch   = cr_safe_string_chunk_insert_null(old->chunk,
+                                    cr_find_attr("epoch", attr));
+        old->version = cr_safe_string_chunk_insert_null(old->chunk,
+                                    cr_find_attr("version", attr));
+        old->release = cr_safe_string_chunk_insert_null(old->chunk,
+                                    cr_find_attr("release", attr));
+        old->arch    = cr_safe_string_chunk_insert_null(old->chunk,
+                                    cr_find_attr("arch", attr));
+        break;
+
+    case STATE_DELTA: {
+        cr_DeltaPackage *dpkg = g_new0(cr_DeltaPackage, 1);
+        dpkg->chunk = g_string_chunk_new(0);
+        dpkg->package = cr_package_new();
+        cr_Package *pkg = dpkg->package;
+        pkg->name    = cr_safe_string_chunk_insert_null(pkg->chunk, old->name);
+        pkg->epoch   = cr_safe_string_chunk_insert_null(pkg->chunk, old->epoch);
+        pkg->version = cr_safe_string_chunk_insert_null(pkg->chunk, old->version);
+        pkg->release = cr_safe_string_chunk_insert_null(pkg->chunk, old->release);
+        pkg->arch    = cr_safe_string_chunk_insert_null(pkg->chunk, old->arch);
+        old->dpkg = dpkg;
+        break;
+    }
+
+    case STATE_CHECKSUM:
+        if (old->dpkg)
+            old->dpkg->package->checksum_type = cr_safe_string_chunk_insert_null(
+                                    old->dpkg->package->chunk,
+                                    cr_find_attr("type", attr));
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void
+cr_prestodelta_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
+{
+    cr_ParserData *pd = pdata;
+    cr_OldPrestoDelta *old = pd->pkgcb_data;
+    cr_DeltaPackage *dpkg = old->dpkg;
+    unsigned int state = pd->state;
+
+    if (pd->err)
+        return;
+
+    if (pd->depth != pd->statedepth) {
+        pd->depth--;
+        return;
+    }
+
+    pd->depth--;
+    pd->statedepth--;
+    pd->state = pd->sbtab[pd->state];
+    pd->docontent = 0;
+
+    if (!dpkg)
+        return;
+
+    switch (state) {
+    case STATE_FILENAME:
+        dpkg->package->location_href = cr_safe_string_chunk_insert_null(
+                                    dpkg->package->chunk, pd->content);
+        break;
+
+    case STATE_SEQUENCE: {
+        // The sequence is "<nevr>-<sequence>"
+        char *sep = strrchr(pd->content, '-');
+        if (!sep)
+            break;
+        dpkg->sequence = cr_safe_string_chunk_insert_null(dpkg->chunk, sep+1);
+        *sep = '\0';
+        dpkg->nevr = cr_safe_string_chunk_insert_null(dpkg->chunk, pd->content);
+        break;
+    }
+
+    case STATE_SIZE:
+        dpkg->package->size_package = g_ascii_strtoll(pd->content, NULL, 10);
+        break;
+
+    case STATE_CHECKSUM:
+        dpkg->package->pkgId = cr_safe_string_chunk_insert_null(
+                                    dpkg->package->chunk, pd->content);
+        break;
+
+    case STATE_DELTA:
+        old->dpkg = NULL;
+        if (dpkg->package->name && dpkg->package->location_href
+            && dpkg->nevr && dpkg->sequence && dpkg->package->pkgId
+            && dpkg->package->checksum_type && dpkg->package->size_package > 0)
+            g_hash_table_replace(old->deltas,
+                                 dpkg->package->location_href,
+                                 dpkg);
+        else
+            cr_deltapackage_free(dpkg);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/** Load deltas from a previous prestodelta.xml.
+ * @param path      Path to the (possibly compressed) prestodelta.xml
+ * @param err       GError **
+ * @return          Table location_href -> cr_DeltaPackage or NULL
+ */
+static GHashTable *
+cr_load_old_prestodelta(const char *path, GError **err)
+{
+    cr_ParserData *pd;
+    cr_OldPrestoDelta old;
+    GError *tmp_err = NULL;
+    int ret;
+
+    memset(&old, 0, sizeof(old));
+    old.deltas = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                       (GDestroyNotify) cr_deltapackage_free);
+    old.chunk = g_string_chunk_new(1024);
+
+    xmlSAXHandler sax;
+    memset(&sax, 0, sizeof(sax));
+    sax.startElement = cr_prestodelta_start_handler;
+    sax.endElement = cr_prestodelta_end_handler;
+    sax.characters = cr_char_handler;
+
+    pd = cr_xml_parser_data(NUMSTATES);
+
+    xmlParserCtxtPtr parser;
+    parser = xmlCreatePushParserCtxt(&sax, pd, NULL, 0, NULL);
+
+    pd->parser = parser;
+    pd->state = STATE_START;
+    pd->pkgcb_data = &old;
+    for (cr_StatesSwitch *sw = stateswitches; sw->from != NUMSTATES; sw++) {
+        if (!pd->swtab[sw->from])
+            pd->swtab[sw->from] = sw;
+        pd->sbtab[sw->to] = sw->from;
+    }
+
+    ret = cr_xml_parser_generic(parser, pd, path, &tmp_err);
+    if (ret == CRE_OK && !pd->main_tag_found)
+        g_set_error(&tmp_err, ERR_DOMAIN, CRE_XMLPARSER,
+                    "%s doesn't contain the <prestodelta> element", path);
+
+    cr_deltapackage_free(old.dpkg);
+    g_string_chunk_free(old.chunk);
+    cr_xml_parser_data_free(pd);
+    xmlFreeParserCtxt(parser);
+
+    if (tmp_err) {
+        g_propagate_error(err, tmp_err);
+        g_hash_table_destroy(old.deltas);
+        return NULL;
+    }
+
+    return old.deltas;
+}
+
+/** Find reusable delta from the previous prestodelta.xml.
+ * The drpm must have the same size and it must not be modified
+ * after the previous prestodelta.xml was written.
+ */
+static cr_DeltaPackage *
+cr_find_old_delta(cr_PrestoDeltaUserData *user_data,
+                  const char *location_href,
+                  struct stat *st)
+{
+    cr_DeltaPackage *dpkg;
+
+    if (!user_data->old_deltas)
+        return NULL;
+
+    dpkg = g_hash_table_lookup(user_data->old_deltas, location_href);
+    if (!dpkg)
+        return NULL;
+
+    if (dpkg->package->size_package != (gint64) st->st_size
+        || st->st_mtime >= user_data->old_mtime
+        || g_strcmp0(dpkg->package->checksum_type,
+                     cr_checksum_name_str(user_data->checksum_type)))
+        return NULL;
+
+    return dpkg;
+}
+
 static gboolean
 walk_drpmsdir(const gchar *drpmsdir, GSList **inlist, GError **err)
 {
@@ -701,13 +1149,37 @@ cr_prestodelta_thread(gpointer data, gpointer udata)
     cr_PrestoDeltaTask *task          = data;
     cr_PrestoDeltaUserData *user_data = udata;
 
-    cr_DeltaPackage *dpkg = NULL;
+    cr_DeltaPackage *dpkg = NULL, *old_dpkg = NULL;
     struct stat st;
     gchar *xml_chunk = NULL, *key = NULL, *checksum = NULL;
+    const gchar *location_href = task->full_path + user_data->prefix_len;
+    gpointer pkey = NULL, pval = NULL;
     GError *tmp_err = NULL;
 
     printf("%s\n", task->full_path);
 
+    // Stat the package (to get the size)
+    if (stat(task->full_path, &st) == -1) {
+        g_warning("%s: stat(%s) error (%s)", __func__,
+                  task->full_path, g_strerror(errno));
+        goto exit;
+    }
+
+    // Unchanged drpm already listed in the previous prestodelta.xml
+    old_dpkg = cr_find_old_delta(user_data, location_href, &st);
+    if (old_dpkg) {
+        g_debug("Reusing prestodelta entry for %s", task->full_path);
+        xml_chunk = cr_xml_dump_deltapackage(old_dpkg, &tmp_err);
+        if (tmp_err) {
+            g_warning("Cannot generate xml for drpm %s: %s",
+                      task->full_path, tmp_err->message);
+            g_error_free(tmp_err);
+            goto exit;
+        }
+        key = cr_package_nevra(old_dpkg->package);
+        goto insert;
+    }
+
     // Load delta package
     dpkg = cr_deltapackage_from_drpm_base(task->full_path, 0, 0, &tmp_err);
     if (!dpkg) {
@@ -719,16 +1191,8 @@ cr_prestodelta_thread(gpointer data, gpointer udata)
     // Set the filename
     dpkg->package->location_href = cr_safe_string_chunk_insert(
                                     dpkg->package->chunk,
-                                    task->full_path + user_data->prefix_len);
-
-    // Stat the package (to get the size)
-    if (stat(task->full_path, &st) == -1) {
-        g_warning("%s: stat(%s) error (%s)", __func__,
-                  task->full_path, g_strerror(errno));
-        goto exit;
-    } else {
-        dpkg->package->size_package = st.st_size;
-    }
+                                    location_href);
+    dpkg->package->size_package = st.st_size;
 
     // Calculate the checksum
     checksum = cr_checksum_file(task->full_path,
@@ -756,10 +1220,10 @@ cr_prestodelta_thread(gpointer data, gpointer udata)
         goto exit;
     }
 
-    // Put the XML into the shared hash table
-    gpointer pkey = NULL;
-    gpointer pval = NULL;
     key = cr_package_nevra(dpkg->package);
+
+insert:
+    // Put the XML into the shared hash table
     g_mutex_lock(&(user_data->mutex));
     if (g_hash_table_lookup_extended(user_data->ht, key, &pkey, &pval)) {
         // Key exists in the table
@@ -821,6 +1285,23 @@ cr_deltarpms_generate_prestodelta_file(const gchar *drpmsdir,
                                        gint workers,
                                        const gchar *prefix_to_strip,
                                        GError **err)
+{
+    return cr_deltarpms_generate_prestodelta_file_with_old(drpmsdir, f, zck_f,
+                                                           checksum_type,
+                                                           workers,
+                                                           prefix_to_strip,
+                                                           NULL, err);
+}
+
+gboolean
+cr_deltarpms_generate_prestodelta_file_with_old(const gchar *drpmsdir,
+                                                cr_XmlFile *f,
+                                                cr_XmlFile *zck_f,
+                                                cr_ChecksumType checksum_type,
+                                                gint workers,
+                                                const gchar *prefix_to_strip,
+                                                const gchar *old_prestodelta,
+                                                GError **err)
 {
     gboolean ret = TRUE;
     GSList *candidates = NULL;
@@ -835,6 +1316,8 @@ cr_deltarpms_generate_prestodelta_file(const gchar *drpmsdir,
     assert(f);
     assert(!err || *err == NULL);
 
+    memset(&user_data, 0, sizeof(user_data));
+
     // Walk the drpms directory
 
     if (!walk_drpmsdir(drpmsdir, &candidates, &tmp_err)) {
@@ -854,8 +1337,26 @@ cr_deltarpms_generate_prestodelta_file(const gchar *drpmsdir,
     user_data.checksum_type     = checksum_type;
     user_data.prefix_to_strip   = prefix_to_strip,
     user_data.prefix_len        = prefix_to_strip ? strlen(prefix_to_strip) : 0;
+    user_data.old_deltas        = NULL;
+    user_data.old_mtime         = 0;
     g_mutex_init(&(user_data.mutex));
 
+    // Load the previous prestodelta.xml (its entries for unchanged
+    // drpms are reused without reading and checksumming the drpms)
+    if (old_prestodelta) {
+        struct stat st;
+        if (stat(old_prestodelta, &st) == 0) {
+            user_data.old_mtime = st.st_mtime;
+            user_data.old_deltas = cr_load_old_prestodelta(old_prestodelta,
+                                                           &tmp_err);
+        }
+        if (tmp_err) {
+            g_warning("Cannot load previous %s (it won't be used): %s",
+                      old_prestodelta, tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+    }
+
     pool = g_thread_pool_new(cr_prestodelta_thread,
                              &user_data,
                              workers,
@@ -892,7 +1393,7 @@ cr_deltarpms_generate_prestodelta_file(const gchar *drpmsdir,
         /* Write out zchunk file */
         if (zck_f) {
             cr_xmlfile_add_chunk(zck_f, chunk, NULL);
-            cr_end_chunk(zck_f->f, &tmp_err);
+            cr_xmlfile_end_chunk(zck_f, &tmp_err);
             if (tmp_err) {
                 g_free(chunk);
                 g_propagate_prefixed_error(err, tmp_err,
@@ -907,7 +1408,10 @@ cr_deltarpms_generate_prestodelta_file(const gchar *drpmsdir,
 exit:
     g_slist_free_full(candidates, (GDestroyNotify) cr_prestodeltatask_free);
     g_mutex_clear(&(user_data.mutex));
-    g_hash_table_destroy(ht);
+    if (ht)
+        g_hash_table_destroy(ht);
+    if (user_data.old_deltas)
+        g_hash_table_destroy(user_data.old_deltas);
 
     return ret;
 }
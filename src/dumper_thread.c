@@ -17,6 +17,7 @@
  * USA.
  */
 
+#define _GNU_SOURCE
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <errno.h>
@@ -35,6 +36,10 @@
 #include "parsepkg.h"
 #include "xml_dump.h"
 #include <fcntl.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #define MAX_TASK_BUFFER_LEN         20
 #define CACHEDCHKSUM_BUFFER_LEN     2048
@@ -104,7 +109,7 @@ write_pkg(long id,
     }
     if (udata->pri_zck) {
         if (new_pkg) {
-            cr_end_chunk(udata->pri_zck->f, &tmp_err);
+            cr_xmlfile_end_chunk(udata->pri_zck, &tmp_err);
             if (tmp_err) {
                 g_critical("Unable to end primary zchunk: %s", tmp_err->message);
                 udata->had_errors = TRUE;
@@ -128,7 +133,8 @@ write_pkg(long id,
     while (udata->id_fil != id)
         g_cond_wait (&(udata->cond_fil), &(udata->mutex_fil));
     ++udata->id_fil;
-    cr_xmlfile_add_chunk(udata->fil_f, (const char *) res.filelists, &tmp_err);
+    cr_xmlfile_add_indexed_chunk(udata->fil_f, pkg->pkgId,
+                                 (const char *) res.filelists, &tmp_err);
     if (tmp_err) {
         g_critical("Cannot add filelists chunk:\n%s\nError: %s",
                    res.filelists, tmp_err->message);
@@ -147,7 +153,7 @@ write_pkg(long id,
     }
     if (udata->fil_zck) {
         if (new_pkg) {
-            cr_end_chunk(udata->fil_zck->f, &tmp_err);
+            cr_xmlfile_end_chunk(udata->fil_zck, &tmp_err);
             if (tmp_err) {
                 g_critical("Unable to end filelists zchunk: %s", tmp_err->message);
                 udata->had_errors = TRUE;
@@ -171,7 +177,8 @@ write_pkg(long id,
     while (udata->id_oth != id)
         g_cond_wait (&(udata->cond_oth), &(udata->mutex_oth));
     ++udata->id_oth;
-    cr_xmlfile_add_chunk(udata->oth_f, (const char *) res.other, &tmp_err);
+    cr_xmlfile_add_indexed_chunk(udata->oth_f, pkg->pkgId,
+                                 (const char *) res.other, &tmp_err);
     if (tmp_err) {
         g_critical("Cannot add other chunk:\n%s\nError: %s",
                    res.other, tmp_err->message);
@@ -190,7 +197,7 @@ write_pkg(long id,
     }
     if (udata->oth_zck) {
         if (new_pkg) {
-            cr_end_chunk(udata->oth_zck->f, &tmp_err);
+            cr_xmlfile_end_chunk(udata->oth_zck, &tmp_err);
             if (tmp_err) {
                 g_critical("Unable to end other zchunk: %s", tmp_err->message);
                 udata->had_errors = TRUE;
@@ -205,15 +212,76 @@ write_pkg(long id,
             g_clear_error(&tmp_err);
         }
     }
+
+    // Record the package to the checkpoint (in the order of metadata)
+    if (udata->checkpoint
+        && !cr_checkpoint_add(udata->checkpoint, pkg, &res, &tmp_err))
+    {
+        g_warning("Checkpoint disabled: %s", tmp_err->message);
+        g_clear_error(&tmp_err);
+        cr_checkpoint_free(udata->checkpoint);
+        udata->checkpoint = NULL;
+    }
+
     g_cond_broadcast(&(udata->cond_oth));
     g_mutex_unlock(&(udata->mutex_oth));
 }
 
+/** Path of the file with the cached checksum of the package.
+ * The package must be loaded with CR_HDRR_LOADHDRID and
+ * CR_HDRR_LOADSIGNATURES flags and have location_href and time_file set.
+ */
+static char *
+checksum_cache_filename(cr_Package *pkg,
+                        cr_ChecksumType type,
+                        const char *cachedir,
+                        GError **err)
+{
+    char *key, *cachefn;
+    cr_ChecksumCtx *ctx = cr_checksum_new(type, err);
+    if (!ctx) return NULL;
+
+    if (pkg->siggpg)
+        cr_checksum_update(ctx, pkg->siggpg->data, pkg->siggpg->size, NULL);
+    if (pkg->sigpgp)
+        cr_checksum_update(ctx, pkg->sigpgp->data, pkg->sigpgp->size, NULL);
+    if (pkg->hdrid)
+        cr_checksum_update(ctx, pkg->hdrid, strlen(pkg->hdrid), NULL);
+
+    key = cr_checksum_final(ctx, err);
+    if (!key) return NULL;
+
+    cachefn = g_strdup_printf("%s%s-%s-%"G_GINT64_FORMAT"-%"G_GINT64_FORMAT,
+                              cachedir,
+                              cr_get_filename(pkg->location_href),
+                              key, pkg->size_installed, pkg->time_file);
+    free(key);
+    return cachefn;
+}
+
+/** Checksum from the cache file or NULL. */
+static char *
+checksum_cache_load(const char *cachefn)
+{
+    char *checksum = NULL;
+    FILE *f = fopen(cachefn, "r");
+    if (f) {
+        char buf[CACHEDCHKSUM_BUFFER_LEN];
+        size_t readed = fread(buf, 1, CACHEDCHKSUM_BUFFER_LEN, f);
+        if (!ferror(f) && readed > 0) {
+            checksum = g_strndup(buf, readed);
+        }
+        fclose(f);
+    }
+    return checksum;
+}
+
 static char *
 get_checksum(const char *filename,
              cr_ChecksumType type,
              cr_Package *pkg,
              const char *cachedir,
+             cr_ChecksumBatch *batch,
              GError **err)
 {
     GError *tmp_err = NULL;
@@ -222,37 +290,11 @@ get_checksum(const char *filename,
 
     if (cachedir) {
         // Prepare cache fn
-        char *key;
-        cr_ChecksumCtx *ctx = cr_checksum_new(type, err);
-        if (!ctx) return NULL;
-
-        if (pkg->siggpg)
-            cr_checksum_update(ctx, pkg->siggpg->data, pkg->siggpg->size, NULL);
-        if (pkg->sigpgp)
-            cr_checksum_update(ctx, pkg->sigpgp->data, pkg->sigpgp->size, NULL);
-        if (pkg->hdrid)
-            cr_checksum_update(ctx, pkg->hdrid, strlen(pkg->hdrid), NULL);
-
-        key = cr_checksum_final(ctx, err);
-        if (!key) return NULL;
-
-        cachefn = g_strdup_printf("%s%s-%s-%"G_GINT64_FORMAT"-%"G_GINT64_FORMAT,
-                                  cachedir,
-                                  cr_get_filename(pkg->location_href),
-                                  key, pkg->size_installed, pkg->time_file);
-        free(key);
+        cachefn = checksum_cache_filename(pkg, type, cachedir, err);
+        if (!cachefn) return NULL;
 
         // Try to load checksum
-        FILE *f = fopen(cachefn, "r");
-        if (f) {
-            char buf[CACHEDCHKSUM_BUFFER_LEN];
-            size_t readed = fread(buf, 1, CACHEDCHKSUM_BUFFER_LEN, f);
-            if (!ferror(f) && readed > 0) {
-                checksum = g_strndup(buf, readed);
-            }
-            fclose(f);
-        }
-
+        checksum = checksum_cache_load(cachefn);
         if (checksum) {
             g_debug("Cached checksum used: %s: \"%s\"", cachefn, checksum);
             goto exit;
@@ -260,7 +302,10 @@ get_checksum(const char *filename,
     }
 
     // Calculate checksum
-    checksum = cr_checksum_file(filename, type, &tmp_err);
+    if (batch)
+        checksum = cr_checksum_batch_file(batch, filename, &tmp_err);
+    else
+        checksum = cr_checksum_file(filename, type, &tmp_err);
     if (!checksum) {
         g_propagate_prefixed_error(err, tmp_err,
                                    "Error while checksum calculation: ");
@@ -290,6 +335,46 @@ exit:
     return checksum;
 }
 
+/** Increment the counters for a task which has nothing to write.
+ * Waits until it's turn of the task.
+ */
+static void
+skip_pkg(long id, struct UserData *udata)
+{
+    g_mutex_lock(&(udata->mutex_pri));
+    while (udata->id_pri != id)
+        g_cond_wait (&(udata->cond_pri), &(udata->mutex_pri));
+    ++udata->id_pri;
+    g_cond_broadcast(&(udata->cond_pri));
+    g_mutex_unlock(&(udata->mutex_pri));
+
+    g_mutex_lock(&(udata->mutex_fil));
+    while (udata->id_fil != id)
+        g_cond_wait (&(udata->cond_fil), &(udata->mutex_fil));
+    ++udata->id_fil;
+    g_cond_broadcast(&(udata->cond_fil));
+    g_mutex_unlock(&(udata->mutex_fil));
+
+    g_mutex_lock(&(udata->mutex_oth));
+    while (udata->id_oth != id)
+        g_cond_wait (&(udata->cond_oth), &(udata->mutex_oth));
+    ++udata->id_oth;
+    g_cond_broadcast(&(udata->cond_oth));
+    g_mutex_unlock(&(udata->mutex_oth));
+}
+
+/** Max number of done tasks waiting in the buffer for their turn.
+ * When the tasks are dispatched out of href order, the buffer must hold
+ * a whole reorder window. Otherwise a worker could wait for a task which
+ * no worker has picked up yet.
+ */
+static guint
+buffer_max_len(struct UserData *udata)
+{
+    return udata->reorder_window ? (guint) udata->reorder_window
+                                 : MAX_TASK_BUFFER_LEN;
+}
+
 gchar *
 prepare_split_media_baseurl(int media_id, const char *location_base)
 {
@@ -312,9 +397,13 @@ static cr_Package *
 load_rpm(const char *fullpath,
          cr_ChecksumType checksum_type,
          const char *checksum_cachedir,
+         cr_ChecksumBatch *checksum_batch,
+         cr_ChecksumManifest *checksum_manifest,
+         const char *repo_href,
          const char *location_href,
          const char *location_base,
          int changelog_limit,
+         gint64 changelog_size_limit,
          struct stat *stat_buf,
          cr_HeaderReadingFlags hdrrflags,
          GError **err)
@@ -326,7 +415,8 @@ load_rpm(const char *fullpath,
     assert(!err || *err == NULL);
 
     // Get a package object
-    pkg = cr_package_from_rpm_base(fullpath, changelog_limit, hdrrflags, err);
+    pkg = cr_package_from_rpm_base_limited(fullpath, changelog_limit,
+                                           changelog_size_limit, hdrrflags, err);
     if (!pkg)
         goto errexit;
 
@@ -355,9 +445,15 @@ load_rpm(const char *fullpath,
         pkg->size_package = stat_buf->st_size;
     }
 
-    // Compute checksum
-    char *checksum = get_checksum(fullpath, checksum_type, pkg,
-                                  checksum_cachedir, &tmp_err);
+    // Use the checksum from the manifest or compute it
+    char *checksum = NULL;
+    if (checksum_manifest)
+        checksum = cr_checksum_manifest_lookup(checksum_manifest, fullpath,
+                                               repo_href, pkg->size_package,
+                                               pkg->time_file);
+    if (!checksum)
+        checksum = get_checksum(fullpath, checksum_type, pkg,
+                                checksum_cachedir, checksum_batch, &tmp_err);
     if (!checksum) {
         g_propagate_error(err, tmp_err);
         goto errexit;
@@ -384,6 +480,515 @@ errexit:
     return NULL;
 }
 
+static gchar *
+moved_package_key(const char *location_href, gint64 size, gint64 mtime)
+{
+    return g_strdup_printf("%s %"G_GINT64_FORMAT" %"G_GINT64_FORMAT,
+                           cr_get_filename(location_href), size, mtime);
+}
+
+GHashTable *
+cr_moved_packages_index(cr_Metadata *md)
+{
+    GHashTable *index = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              g_free, NULL);
+    GHashTableIter iter;
+    gpointer value;
+
+    g_hash_table_iter_init(&iter, cr_metadata_hashtable(md));
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        cr_Package *pkg = value;
+        if (!pkg->location_href)
+            continue;
+
+        gchar *key = moved_package_key(pkg->location_href, pkg->size_package,
+                                       pkg->time_file);
+        if (g_hash_table_contains(index, key))
+            // Several packages look the same, none of them is reused
+            g_hash_table_replace(index, key, NULL);
+        else
+            g_hash_table_insert(index, key, pkg);
+    }
+
+    return index;
+}
+
+/** Check that the package from old metadata, which has the same basename,
+ * size and mtime as the file of the task, describes the file.
+ * Basename, size and mtime alone are not enough (another build could
+ * match them), that is true only if:
+ *  - the file at the old location is the same file (hardlink)
+ *  - or the checksum cache has the checksum of the file and it matches
+ */
+static gboolean
+moved_package_matches(struct PoolTask *task,
+                      cr_Package *md,
+                      struct stat *stat_buf,
+                      struct UserData *udata)
+{
+    if (g_strcmp0(udata->checksum_type_str, md->checksum_type))
+        return FALSE;
+
+    // Old location is only known if the hrefs are not modified
+    if (!udata->cut_dirs && !udata->location_prefix) {
+        struct stat old_stat;
+        gchar *repodir = g_strndup(task->full_path, udata->repodir_name_len);
+        gchar *old_path = g_strconcat(repodir,
+                                      cr_get_cleaned_href(md->location_href),
+                                      NULL);
+        g_free(repodir);
+        int rc = stat(old_path, &old_stat);
+        g_free(old_path);
+
+        if (rc == 0
+            && old_stat.st_dev == stat_buf->st_dev
+            && old_stat.st_ino == stat_buf->st_ino)
+            return TRUE;
+    }
+
+    if (udata->checksum_cachedir) {
+        gboolean match = FALSE;
+        cr_Package *hdr = cr_package_from_rpm_base(task->full_path, 0,
+                                    CR_HDRR_LOADHDRID | CR_HDRR_LOADSIGNATURES,
+                                    NULL);
+        if (!hdr)
+            return FALSE;
+
+        hdr->location_href = task->filename;
+        hdr->time_file = stat_buf->st_mtime;
+        char *cachefn = checksum_cache_filename(hdr, udata->checksum_type,
+                                                udata->checksum_cachedir, NULL);
+        hdr->location_href = NULL;
+        if (cachefn) {
+            char *checksum = checksum_cache_load(cachefn);
+            match = checksum && !strcmp(checksum, md->pkgId);
+            g_free(checksum);
+            g_free(cachefn);
+        }
+        cr_package_free(hdr);
+        return match;
+    }
+
+    return FALSE;
+}
+
+/** Find a package of old metadata which was moved to the location
+ * of the task. The package is removed from the old metadata.
+ */
+static cr_Package *
+moved_package_get(struct PoolTask *task,
+                  struct stat *stat_buf,
+                  struct UserData *udata)
+{
+    cr_Package *md;
+    GHashTable *ht = cr_metadata_hashtable(udata->old_metadata);
+    gchar *key = moved_package_key(task->filename, stat_buf->st_size,
+                                   stat_buf->st_mtime);
+
+    // Take the package from both tables first, the task of its old
+    // location (hardlink, copy) could take it and free it otherwise
+    g_mutex_lock(&(udata->mutex_old_md));
+    md = g_hash_table_lookup(udata->old_metadata_moved, key);
+    if (md && g_hash_table_lookup(ht, cr_get_cleaned_href(md->location_href)) == md) {
+        g_hash_table_remove(udata->old_metadata_moved, key);
+        g_hash_table_steal(ht, cr_get_cleaned_href(md->location_href));
+    } else {
+        md = NULL;
+    }
+    g_mutex_unlock(&(udata->mutex_old_md));
+
+    if (md && !moved_package_matches(task, md, stat_buf, udata)) {
+        // Not the same package, give it back
+        g_mutex_lock(&(udata->mutex_old_md));
+        g_hash_table_insert(ht, cr_get_cleaned_href(md->location_href), md);
+        g_hash_table_insert(udata->old_metadata_moved, key, md);
+        g_mutex_unlock(&(udata->mutex_old_md));
+        return NULL;
+    }
+
+    g_free(key);
+    return md;
+}
+
+#define NUMA_SYSFS_NODE_PATH    "/sys/devices/system/node"
+
+#ifdef __linux__
+/** Parse a list string (e.g. "0-3,8-11") of CPUs or nodes into a set.
+ * Returns FALSE if the string is malformed or the set is empty.
+ */
+static gboolean
+numa_parse_cpulist(const gchar *cpulist, cpu_set_t *cpus)
+{
+    gchar **ranges = g_strsplit(cpulist, ",", 0);
+    gboolean ret = TRUE;
+
+    CPU_ZERO(cpus);
+
+    for (gchar **range = ranges; *range && ret; range++) {
+        gchar *endptr = NULL;
+        gchar *str = g_strstrip(*range);
+        guint64 first, last;
+
+        if (*str == '\0')
+            continue;
+
+        first = g_ascii_strtoull(str, &endptr, 10);
+        last = first;
+        if (endptr == str) {
+            ret = FALSE;
+            break;
+        }
+        if (*endptr == '-') {
+            gchar *end = endptr + 1;
+            last = g_ascii_strtoull(end, &endptr, 10);
+            if (endptr == end)
+                ret = FALSE;
+        }
+
+        for (guint64 cpu = first; ret && cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET((int) cpu, cpus);
+    }
+
+    g_strfreev(ranges);
+    return ret && CPU_COUNT(cpus) > 0;
+}
+#endif
+
+/** Number of cr_dumper_numa_init() calls, tells the pools apart */
+static volatile gint numa_generation = 0;
+
+guint
+cr_dumper_numa_init(struct UserData *udata)
+{
+    assert(udata);
+
+    udata->numa_nodes = NULL;
+    udata->numa_next_worker = 0;
+    udata->numa_generation = g_atomic_int_add(&numa_generation, 1) + 1;
+
+    if (!udata->numa)
+        return 0;
+
+#ifdef __linux__
+    GPtrArray *nodes = g_ptr_array_new_with_free_func(g_free);
+    gchar *online = NULL;
+    cpu_set_t online_nodes, allowed;
+
+    // Node numbers don't have to be contiguous
+    CPU_ZERO(&online_nodes);
+    if (g_file_get_contents(NUMA_SYSFS_NODE_PATH "/online", &online, NULL, NULL))
+        numa_parse_cpulist(online, &online_nodes);
+    g_free(online);
+
+    // CPUs the process may run on (taskset, cgroup cpuset)
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        g_debug("%s: sched_getaffinity(): %s", __func__, g_strerror(errno));
+        CPU_ZERO(&allowed);
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, &allowed);
+    }
+
+    for (int node = 0; node < CPU_SETSIZE; node++) {
+        if (!CPU_ISSET(node, &online_nodes))
+            continue;
+
+        gchar *contents = NULL;
+        gchar *path = g_strdup_printf(NUMA_SYSFS_NODE_PATH "/node%d/cpulist",
+                                      node);
+        gboolean exists = g_file_get_contents(path, &contents, NULL, NULL);
+        g_free(path);
+        if (!exists)
+            continue;
+
+        cpu_set_t *cpus = g_new0(cpu_set_t, 1);
+        if (numa_parse_cpulist(contents, cpus))
+            CPU_AND(cpus, cpus, &allowed);
+        if (CPU_COUNT(cpus) > 0) {
+            g_ptr_array_add(nodes, cpus);
+        } else {
+            // Memory-only node, node without allowed CPUs or unparsable
+            // list - nothing to bind to
+            g_debug("%s: NUMA node %d has no usable CPUs", __func__, node);
+            g_free(cpus);
+        }
+        g_free(contents);
+    }
+
+    if (nodes->len > 1) {
+        udata->numa_nodes = nodes;
+        g_debug("%s: %u NUMA nodes detected", __func__, nodes->len);
+        return nodes->len;
+    }
+
+    g_ptr_array_free(nodes, TRUE);
+#endif
+
+    g_message("NUMA mode requested but less than two NUMA nodes "
+              "are available - NUMA mode disabled");
+    udata->numa = FALSE;
+    return 0;
+}
+
+void
+cr_dumper_numa_cleanup(struct UserData *udata)
+{
+    if (!udata || !udata->numa_nodes)
+        return;
+    g_ptr_array_free(udata->numa_nodes, TRUE);
+    udata->numa_nodes = NULL;
+}
+
+#ifdef __linux__
+/** NUMA binding of a worker thread. Threads of a GThreadPool may be
+ * reused by another pool, so the binding remembers which one it is for.
+ */
+typedef struct {
+    gint generation;    /*!< numa_generation of the pool the thread is
+                             bound for, 0 if it is not bound */
+    cpu_set_t orig;     /*!< Affinity of the thread before it was bound */
+} NumaBinding;
+
+static GPrivate numa_binding = G_PRIVATE_INIT(g_free);
+#endif
+
+/** Bind the calling worker thread to the CPUs of one NUMA node.
+ * Each thread is bound once per pool - when it gets its first task.
+ * A thread bound by an earlier pool gets its original affinity back
+ * if the current pool doesn't use the NUMA mode.
+ */
+static void
+numa_bind_worker(G_GNUC_UNUSED struct UserData *udata)
+{
+#ifdef __linux__
+    NumaBinding *binding = g_private_get(&numa_binding);
+    gint generation = udata->numa ? udata->numa_generation : 0;
+    int rc;
+
+    if (binding ? binding->generation == generation : generation == 0)
+        return;
+
+    if (!binding) {
+        binding = g_new0(NumaBinding, 1);
+        rc = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                    &binding->orig);
+        if (rc != 0) {
+            g_warning("Cannot get affinity of a worker: %s", g_strerror(rc));
+            g_free(binding);
+            return;
+        }
+        g_private_set(&numa_binding, binding);
+    }
+
+    if (generation == 0) {
+        rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                    &binding->orig);
+        if (rc != 0)
+            g_warning("Cannot unbind a worker from its NUMA node: %s",
+                      g_strerror(rc));
+        binding->generation = 0;
+        return;
+    }
+
+    binding->generation = generation;
+
+    gint worker = g_atomic_int_add(&udata->numa_next_worker, 1);
+    guint node = (guint) worker % udata->numa_nodes->len;
+    // The CPUs of the nodes are already restricted to the CPUs
+    // the process may run on (see cr_dumper_numa_init())
+    cpu_set_t *cpus = g_ptr_array_index(udata->numa_nodes, node);
+    if (CPU_COUNT(cpus) == 0) {
+        g_debug("Worker %d not bound: no allowed CPU on NUMA node %u",
+                worker, node);
+        cpus = &binding->orig;
+    }
+
+    rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), cpus);
+    if (rc != 0)
+        g_warning("Cannot bind worker %d to NUMA node %u: %s",
+                  worker, node, g_strerror(rc));
+    else if (cpus != &binding->orig)
+        g_debug("Worker %d bound to NUMA node %u", worker, node);
+#endif
+}
+
+static guint
+pool_task_file_hash(gconstpointer key)
+{
+    const struct PoolTask *task = key;
+    guint64 ino = (guint64) task->stat_buf.st_ino;
+    return (guint) (ino ^ (ino >> 32) ^ (guint64) task->stat_buf.st_dev);
+}
+
+static gboolean
+pool_task_file_equal(gconstpointer a, gconstpointer b)
+{
+    const struct PoolTask *task_a = a;
+    const struct PoolTask *task_b = b;
+    return task_a->stat_buf.st_dev == task_b->stat_buf.st_dev
+           && task_a->stat_buf.st_ino == task_b->stat_buf.st_ino;
+}
+
+static gint64
+pool_task_cost(const struct PoolTask *task)
+{
+    return task->stat_valid ? (gint64) task->stat_buf.st_size : 0;
+}
+
+static gint
+pool_task_cost_cmp(gconstpointer a, gconstpointer b)
+{
+    const struct PoolTask *task_a = *((struct PoolTask * const *) a);
+    const struct PoolTask *task_b = *((struct PoolTask * const *) b);
+    gint64 cost_a = pool_task_cost(task_a);
+    gint64 cost_b = pool_task_cost(task_b);
+
+    // The biggest first, the same size in the order of IDs
+    if (cost_a != cost_b)
+        return cost_a > cost_b ? -1 : 1;
+    if (task_a->id != task_b->id)
+        return task_a->id < task_b->id ? -1 : 1;
+    return 0;
+}
+
+void
+cr_pool_tasks_largest_first(GQueue *tasks, long window)
+{
+    GQueue reordered = G_QUEUE_INIT;
+    GPtrArray *chunk;
+
+    if (window < 1)
+        return;
+
+    chunk = g_ptr_array_sized_new(MIN(window, (long) tasks->length));
+    while (!g_queue_is_empty(tasks)) {
+        while (chunk->len < (guint) window && !g_queue_is_empty(tasks))
+            g_ptr_array_add(chunk, g_queue_pop_head(tasks));
+
+        g_ptr_array_sort(chunk, pool_task_cost_cmp);
+        for (guint x = 0; x < chunk->len; x++)
+            g_queue_push_tail(&reordered, g_ptr_array_index(chunk, x));
+        g_ptr_array_set_size(chunk, 0);
+    }
+    g_ptr_array_free(chunk, TRUE);
+
+    *tasks = reordered;
+}
+
+long
+cr_pool_tasks_share_files(GQueue *tasks)
+{
+    GHashTable *files;  // Key and value: the first task of the file
+    long shared_count = 0;
+
+    files = g_hash_table_new(pool_task_file_hash, pool_task_file_equal);
+
+    for (GList *elem = tasks->head; elem; elem = g_list_next(elem)) {
+        struct PoolTask *task = elem->data;
+        struct PoolTask *leader;
+
+        if (!task->stat_valid)
+            continue;
+
+        leader = g_hash_table_lookup(files, task);
+        if (!leader) {
+            g_hash_table_insert(files, task, task);
+            continue;
+        }
+
+        if (!leader->shared) {
+            leader->shared = g_new0(struct PoolTaskShared, 1);
+            g_mutex_init(&(leader->shared->mutex));
+            g_cond_init(&(leader->shared->cond));
+            leader->shared->refs = 1;
+            leader->shared_leader = TRUE;
+        }
+
+        g_debug("%s is the same file as %s - it will be loaded only once",
+                task->full_path, leader->full_path);
+        task->shared = leader->shared;
+        task->shared->refs++;
+        shared_count++;
+    }
+
+    g_hash_table_destroy(files);
+    return shared_count;
+}
+
+/** Copy of the package with the same order of files and changelogs
+ * (cr_package_copy() reverses them).
+ */
+static cr_Package *
+shared_package_clone(cr_Package *orig)
+{
+    cr_Package *pkg = cr_package_copy(orig);
+    pkg->files = g_slist_reverse(pkg->files);
+    pkg->changelogs = g_slist_reverse(pkg->changelogs);
+    return pkg;
+}
+
+/** Make the package loaded by the leader available to the other tasks
+ * of the same file. Only the first call has an effect.
+ */
+static void
+shared_package_publish(struct PoolTaskShared *shared, cr_Package *pkg)
+{
+    g_mutex_lock(&(shared->mutex));
+    if (!shared->done) {
+        shared->pkg = pkg ? shared_package_clone(pkg) : NULL;
+        shared->done = TRUE;
+        g_cond_broadcast(&(shared->cond));
+    }
+    g_mutex_unlock(&(shared->mutex));
+}
+
+/** Wait for the leader and get a copy of its package with own locations.
+ * Returns NULL if the leader failed to load the package.
+ */
+static cr_Package *
+shared_package_get(struct PoolTaskShared *shared,
+                   const char *location_href,
+                   const char *location_base)
+{
+    cr_Package *pkg;
+
+    g_mutex_lock(&(shared->mutex));
+    while (!shared->done)
+        g_cond_wait(&(shared->cond), &(shared->mutex));
+    g_mutex_unlock(&(shared->mutex));
+
+    if (!shared->pkg)
+        return NULL;
+
+    pkg = shared_package_clone(shared->pkg);
+    pkg->location_href = cr_safe_string_chunk_insert(pkg->chunk, location_href);
+    pkg->location_base = cr_safe_string_chunk_insert(pkg->chunk, location_base);
+    return pkg;
+}
+
+static void
+pool_task_free(struct PoolTask *task)
+{
+    struct PoolTaskShared *shared = task->shared;
+
+    if (shared) {
+        // Don't let the other tasks wait forever if the leader failed
+        if (task->shared_leader)
+            shared_package_publish(shared, NULL);
+
+        if (g_atomic_int_dec_and_test(&(shared->refs))) {
+            cr_package_free(shared->pkg);
+            g_mutex_clear(&(shared->mutex));
+            g_cond_clear(&(shared->cond));
+            g_free(shared);
+        }
+    }
+
+    g_free(task->full_path);
+    g_free(task->filename);
+    g_free(task->path);
+    g_free(task);
+}
+
 void
 cr_dumper_thread(gpointer data, gpointer user_data)
 {
@@ -392,12 +997,15 @@ cr_dumper_thread(gpointer data, gpointer user_data)
     cr_Package *md  = NULL;     // Package from loaded MetaData
     cr_Package *pkg = NULL;     // Package from file
     struct stat stat_buf;       // Struct with info from stat() on file
+    struct stat *stat_ptr = NULL;
     struct cr_XmlStruct res;    // Structure for generated XML
     cr_HeaderReadingFlags hdrrflags = CR_HDRR_NONE;
 
     struct UserData *udata = (struct UserData *) user_data;
     struct PoolTask *task  = (struct PoolTask *) data;
 
+    numa_bind_worker(udata);
+
     // get location_href without leading part of path (path to repo)
     // including '/' char
     _cleanup_free_ gchar *location_href = NULL;
@@ -431,12 +1039,15 @@ cr_dumper_thread(gpointer data, gpointer user_data)
     if (udata->checksum_cachedir)
         hdrrflags = CR_HDRR_LOADHDRID | CR_HDRR_LOADSIGNATURES;
 
-    // Get stat info about file
-    if (udata->old_metadata && !(udata->skip_stat)) {
+    // Get stat info about file (the walker usually did it already)
+    if (task->stat_valid) {
+        stat_ptr = &(task->stat_buf);
+    } else if (udata->old_metadata && !(udata->skip_stat)) {
         if (stat(task->full_path, &stat_buf) == -1) {
             g_critical("Stat() on %s: %s", task->full_path, g_strerror(errno));
             goto task_cleanup;
         }
+        stat_ptr = &stat_buf;
     }
 
     // Update stuff
@@ -452,15 +1063,31 @@ cr_dumper_thread(gpointer data, gpointer user_data)
         // thread can use it as CACHE, because later we modify it destructively
         g_hash_table_steal(cr_metadata_hashtable(udata->old_metadata),
                                                  cache_key);
+        if (md && udata->old_metadata_moved) {
+            // Not available as a moved package anymore
+            gchar *key = moved_package_key(md->location_href,
+                                           md->size_package, md->time_file);
+            if (g_hash_table_lookup(udata->old_metadata_moved, key) == md)
+                g_hash_table_remove(udata->old_metadata_moved, key);
+            g_free(key);
+        }
         g_mutex_unlock(&(udata->mutex_old_md));
 
+        // Package could be moved from another directory
+        if (!md && udata->old_metadata_moved && stat_ptr) {
+            md = moved_package_get(task, stat_ptr, udata);
+            if (md)
+                g_debug("CACHE HIT %s (moved from %s)", task->filename,
+                        md->location_href);
+        }
+
         if (md) {
             g_debug("CACHE HIT %s", task->filename);
 
             if (udata->skip_stat) {
                 old_used = TRUE;
-            } else if (stat_buf.st_mtime == md->time_file
-                       && stat_buf.st_size == md->size_package
+            } else if (stat_ptr->st_mtime == md->time_file
+                       && stat_ptr->st_size == md->size_package
                        && !strcmp(udata->checksum_type_str, md->checksum_type))
             {
                 old_used = TRUE;
@@ -484,11 +1111,21 @@ cr_dumper_thread(gpointer data, gpointer user_data)
 
     // Load package and gen XML metadata
     if (!old_used) {
+        // Use the package loaded by another task of the same file
+        if (task->shared && !task->shared_leader)
+            pkg = shared_package_get(task->shared, location_href,
+                                     location_base);
+
         // Load package from file
-        pkg = load_rpm(task->full_path, udata->checksum_type,
-                       udata->checksum_cachedir, location_href,
-                       location_base, udata->changelog_limit,
-                       NULL, hdrrflags, &tmp_err);
+        if (!pkg)
+            pkg = load_rpm(task->full_path, udata->checksum_type,
+                           udata->checksum_cachedir, udata->checksum_batch,
+                           udata->checksum_manifest,
+                           task->full_path + udata->repodir_name_len,
+                           location_href,
+                           location_base, udata->changelog_limit,
+                           udata->changelog_size_limit, stat_ptr, hdrrflags,
+                           &tmp_err);
         assert(pkg || tmp_err);
 
         if (!pkg) {
@@ -526,6 +1163,9 @@ cr_dumper_thread(gpointer data, gpointer user_data)
         }
     }
 
+    if (task->shared_leader)
+        shared_package_publish(task->shared, pkg);
+
 #ifdef CR_DELTA_RPM_SUPPORT
     // Delta candidate
     if (udata->deltas
@@ -552,14 +1192,15 @@ cr_dumper_thread(gpointer data, gpointer user_data)
     // Buffering stuff
     g_mutex_lock(&(udata->mutex_buffer));
 
-    if (g_queue_get_length(udata->buffer) < MAX_TASK_BUFFER_LEN
+    if (g_queue_get_length(udata->buffer) < buffer_max_len(udata)
         && udata->id_pri != task->id
-        && udata->task_count > (task->id + 1))
+        && (udata->reorder_window || udata->task_count > (task->id + 1)))
     {
         // If:
         //  * this isn't our turn
         //  * the buffer isn't full
-        //  * this isn't the last task
+        //  * this isn't the last task (in href order only, otherwise
+        //    the last task may be done before all the others start)
         // Then: save the task to the buffer
 
         struct BufferedTask *buf_task = malloc(sizeof(struct BufferedTask));
@@ -582,10 +1223,7 @@ cr_dumper_thread(gpointer data, gpointer user_data)
         g_queue_insert_sorted(udata->buffer, buf_task, buf_task_sort_func, NULL);
         g_mutex_unlock(&(udata->mutex_buffer));
 
-        g_free(task->full_path);
-        g_free(task->filename);
-        g_free(task->path);
-        g_free(task);
+        pool_task_free(task);
 
         return;
     }
@@ -602,34 +1240,29 @@ cr_dumper_thread(gpointer data, gpointer user_data)
     g_free(res.other);
 
 task_cleanup:
+    // Tasks of the same file don't wait for a failed leader
+    if (task->shared_leader)
+        shared_package_publish(task->shared, NULL);
+
     if (udata->id_pri <= task->id) {
-        // An error was encountered and we have to wait to increment counters
-        g_mutex_lock(&(udata->mutex_pri));
-        while (udata->id_pri != task->id)
-            g_cond_wait (&(udata->cond_pri), &(udata->mutex_pri));
-        ++udata->id_pri;
-        g_cond_broadcast(&(udata->cond_pri));
-        g_mutex_unlock(&(udata->mutex_pri));
-
-        g_mutex_lock(&(udata->mutex_fil));
-        while (udata->id_fil != task->id)
-            g_cond_wait (&(udata->cond_fil), &(udata->mutex_fil));
-        ++udata->id_fil;
-        g_cond_broadcast(&(udata->cond_fil));
-        g_mutex_unlock(&(udata->mutex_fil));
-
-        g_mutex_lock(&(udata->mutex_oth));
-        while (udata->id_oth != task->id)
-            g_cond_wait (&(udata->cond_oth), &(udata->mutex_oth));
-        ++udata->id_oth;
-        g_cond_broadcast(&(udata->cond_oth));
-        g_mutex_unlock(&(udata->mutex_oth));
+        // An error was encountered and we have to increment counters
+        // when it's our turn - buffer the failed task if it's not
+        // our turn yet, or wait
+        g_mutex_lock(&(udata->mutex_buffer));
+        if (g_queue_get_length(udata->buffer) < buffer_max_len(udata)
+            && udata->id_pri != task->id)
+        {
+            struct BufferedTask *buf_task = g_new0(struct BufferedTask, 1);
+            buf_task->id = task->id;
+            g_queue_insert_sorted(udata->buffer, buf_task, buf_task_sort_func, NULL);
+            g_mutex_unlock(&(udata->mutex_buffer));
+        } else {
+            g_mutex_unlock(&(udata->mutex_buffer));
+            skip_pkg(task->id, udata);
+        }
     }
 
-    g_free(task->full_path);
-    g_free(task->filename);
-    g_free(task->path);
-    g_free(task);
+    pool_task_free(task);
 
     // Try to write all results from buffer which was waiting for us
     while (1) {
@@ -639,8 +1272,11 @@ task_cleanup:
         if (buf_task && buf_task->id == udata->id_pri) {
             buf_task = g_queue_pop_head (udata->buffer);
             g_mutex_unlock(&(udata->mutex_buffer));
-            // Dump XML and SQLite
-            write_pkg(buf_task->id, buf_task->res, buf_task->pkg, udata);
+            // Dump XML and SQLite (nothing for a failed task)
+            if (buf_task->pkg)
+                write_pkg(buf_task->id, buf_task->res, buf_task->pkg, udata);
+            else
+                skip_pkg(buf_task->id, udata);
             // Clean up
             cr_package_free(buf_task->pkg);
             g_free(buf_task->res.primary);
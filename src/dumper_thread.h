@@ -25,7 +25,12 @@ extern "C" {
 #endif
 
 #include <glib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <rpm/rpmlib.h>
+#include "checkpoint.h"
+#include "checksum_batch.h"
+#include "checksum_manifest.h"
 #include "load_metadata.h"
 #include "locate_metadata.h"
 #include "misc.h"
@@ -38,12 +43,31 @@ extern "C" {
  *  @{
  */
 
+/** Package shared by the tasks of paths which lead to the same file
+ * (hardlinks, symlinks). Only the first of the tasks (the leader) loads
+ * the package, the others wait for it and use a copy with their own
+ * location.
+ */
+struct PoolTaskShared {
+    GMutex mutex;
+    GCond cond;
+    gboolean done;                  // Leader has finished loading
+    cr_Package *pkg;                // Loaded package or NULL if the leader
+                                    // failed (the others load the file
+                                    // themselves then)
+    gint refs;                      // Number of tasks using the struct
+};
+
 struct PoolTask {
     long  id;                       // ID of the task
     long  media_id;                 // ID of media in split mode, 0 if not in split mode
     char* full_path;                // Complete path - /foo/bar/packages/foo.rpm
     char* filename;                 // Just filename - foo.rpm
     char* path;                     // Just path     - /foo/bar/packages
+    struct stat stat_buf;           // stat() of the file taken by the walker
+    gboolean stat_valid;            // The stat_buf is filled
+    struct PoolTaskShared *shared;  // Shared with tasks of the same file or NULL
+    gboolean shared_leader;         // This task loads the shared package
 };
 
 struct UserData {
@@ -59,12 +83,16 @@ struct UserData {
     char *prev_srpm;                // Previous srpm
     char *cur_srpm;                 // Current srpm
     int changelog_limit;            // Max number of changelogs for a package
+    gint64 changelog_size_limit;    // Max size of changelogs for a package
     const char *location_base;      // Base location url
     int repodir_name_len;           // Len of path to repo /foo/bar/repodata
                                     //       This part     |<----->|
     const char *checksum_type_str;  // Name of selected checksum
     cr_ChecksumType checksum_type;  // Constant representing selected checksum
     const char *checksum_cachedir;  // Dir with cached checksums
+    cr_ChecksumBatch *checksum_batch; // Multi-buffer checksums or NULL
+    cr_ChecksumManifest *checksum_manifest; // Trusted checksums or NULL
+    cr_Checkpoint *checkpoint;      // Checkpoint of written packages or NULL
     gboolean skip_symlinks;         // Skip symlinks
     long task_count;                // Total number of task to process
     long package_count;             // Total number of packages processed
@@ -73,6 +101,9 @@ struct UserData {
     gboolean skip_stat;             // Skip stat() while updating
     cr_Metadata *old_metadata;      // Loaded metadata
     GMutex mutex_old_md;           // Mutex for accessing old metadata
+    GHashTable *old_metadata_moved; // Index of old metadata for packages
+                                    // moved to another directory or NULL
+                                    // (see cr_moved_packages_index())
 
     // Thread serialization
     GMutex mutex_pri;              // Mutex for primary metadata
@@ -87,6 +118,9 @@ struct UserData {
 
     // Buffering
     GQueue *buffer;                 // Buffer for done tasks
+    long reorder_window;            // Max number of buffered tasks when
+                                    // the tasks are not dispatched in
+                                    // href order (0 - href order)
     GMutex mutex_buffer;           // Mutex for accessing the buffer
 
     // Delta generation
@@ -105,12 +139,82 @@ struct UserData {
 
     FILE *output_pkg_list;          // File where a list of read packages is written
     GMutex mutex_output_pkg_list;   // Mutex for output_pkg_list file
+
+    // NUMA placement
+    gboolean numa;                  // Pin workers to NUMA nodes?
+    GPtrArray *numa_nodes;          // CPU sets of the detected nodes
+    volatile gint numa_next_worker; // Counter used to spread workers
+                                    // among the nodes
+    gint numa_generation;           // Tells apart pools reusing threads
 };
 
 
 void
 cr_dumper_thread(gpointer data, gpointer user_data);
 
+/** Index packages of old metadata by their basename, size and mtime.
+ * A task whose location isn't in the old metadata reuses a package from
+ * the index (with the new location) if the file is a hardlink of the file
+ * at its old location, or if the checksum cache (--cachedir) has the same
+ * checksum for the file. So reorganization of directories doesn't need
+ * the moved packages to be loaded again.
+ * Keys shared by several packages are stored with a NULL value,
+ * such packages are never reused this way.
+ * @param md            Old metadata (with CR_HT_KEY_HREF key)
+ * @return              Hash table "basename size mtime" -> cr_Package
+ *                      (the packages are owned by the md)
+ */
+GHashTable *
+cr_moved_packages_index(cr_Metadata *md);
+
+/** Find tasks of paths which lead to the same file (by device and inode
+ * from the stat_buf of the task) and let them share one loaded package.
+ * Must be called before the tasks are pushed into the pool.
+ * @param tasks         Queue of struct PoolTask in the order in which they
+ *                      are going to be pushed to the pool
+ * @return              Number of tasks which will reuse a package loaded
+ *                      by another task
+ */
+long
+cr_pool_tasks_share_files(GQueue *tasks);
+
+/** Reorder the tasks so that the biggest packages are dispatched first.
+ * The queue is split into windows of consecutive tasks and only tasks
+ * inside a window are reordered. The tasks of a window are all picked up
+ * by the workers before any task of the next window, so the results which
+ * are done out of order never exceed the window. The UserData
+ * reorder_window must be set to the same value, results are buffered up
+ * to this limit to be written in the order of task IDs.
+ * Must be called after the IDs are assigned and before
+ * cr_pool_tasks_share_files().
+ * @param tasks         Queue of struct PoolTask ordered by ID
+ * @param window        Number of tasks in a window
+ */
+void
+cr_pool_tasks_largest_first(GQueue *tasks, long window);
+
+/** Detect NUMA nodes of the machine and prepare the UserData for
+ * node-local worker placement. Every worker thread of the pool binds
+ * itself to the CPUs of one node when it gets its first task, workers
+ * are spread over the nodes in a round-robin fashion. As the worker
+ * allocates and dumps its packages itself, memory of the packages and
+ * generated XML chunks stays on the node of the worker.
+ * Only the CPUs the process may run on (its affinity mask at the time
+ * of the call) are used, nodes without such CPUs are skipped.
+ * @param udata         UserData with numa set to TRUE
+ * @return              Number of detected nodes. If less than two nodes
+ *                      are available, the NUMA mode is disabled
+ *                      (udata->numa is set to FALSE).
+ */
+guint
+cr_dumper_numa_init(struct UserData *udata);
+
+/** Free the NUMA related data from the UserData.
+ * @param udata         UserData
+ */
+void
+cr_dumper_numa_cleanup(struct UserData *udata);
+
 /** @} */
 
 #ifdef __cplusplus
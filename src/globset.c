@@ -0,0 +1,387 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <string.h>
+#include "globset.h"
+
+#define UTF8_MAX_SKIP           6       // Longest sequence of g_utf8_skip
+#define DFA_MAX_STATES          4096    // The DFA cache is flushed then
+#define DFA_UNKNOWN             -1      // Transition not computed yet
+#define DFA_DEAD                -2      // No pattern can match anymore
+
+/*
+ * Patterns which are not a literal, a literal prefix or a literal suffix
+ * are compiled into one NFA:
+ *
+ *  NFA_CHAR    consumes the byte c
+ *  NFA_ANY     consumes the first byte of a UTF-8 character ('?'),
+ *              it is followed by UTF8_MAX_SKIP-1 NFA_SKIP states which
+ *              consume the rest of the character (like g_utf8_next_char())
+ *  NFA_SKIP    consumes any byte
+ *  NFA_STAR    consumes any byte and stays, or is skipped ('*')
+ *  NFA_MATCH   end of a pattern
+ *
+ * DFA states (sets of NFA states) are built lazily during matching.
+ */
+
+typedef enum {
+    NFA_CHAR,
+    NFA_ANY,
+    NFA_SKIP,
+    NFA_STAR,
+    NFA_MATCH,
+} NfaType;
+
+typedef struct {
+    NfaType type;
+    guchar c;       // NFA_CHAR only
+    gint next;      // Next state (not used by NFA_MATCH)
+} NfaState;
+
+typedef struct {
+    GBytes *set;            // Bitset of NFA states
+    gboolean accept;        // Contains NFA_MATCH
+    gint next[256];         // Transitions (index, DFA_UNKNOWN or DFA_DEAD)
+} DfaState;
+
+struct _cr_GlobSet {
+    guint size;             // Number of added patterns
+    gboolean match_all;     // A pattern consisting of '*' only
+    GHashTable *exact;      // Literal patterns
+    GHashTable *prefixes;   // Literal prefixes ("foo*")
+    GHashTable *suffixes;   // Literal suffixes ("*.rpm")
+    GArray *prefix_lens;    // Distinct lengths of the prefixes
+    GArray *suffix_lens;    // Distinct lengths of the suffixes
+    GArray *nfa;            // NfaState
+    GArray *starts;         // First NFA state of every pattern
+    GMutex mutex;           // Guards the DFA and the buf
+    GHashTable *dfa_index;  // Bitset -> index to dfa
+    GPtrArray *dfa;         // DfaState
+    gint dfa_start;         // Start state or DFA_UNKNOWN
+    GString *buf;           // Buffer for prefix lookups
+};
+
+static void
+dfa_state_free(DfaState *state)
+{
+    g_bytes_unref(state->set);
+    g_free(state);
+}
+
+cr_GlobSet *
+cr_globset_new(void)
+{
+    cr_GlobSet *set = g_new0(cr_GlobSet, 1);
+    set->exact = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    set->prefixes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    set->suffixes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    set->prefix_lens = g_array_new(FALSE, FALSE, sizeof(gsize));
+    set->suffix_lens = g_array_new(FALSE, FALSE, sizeof(gsize));
+    set->nfa = g_array_new(FALSE, FALSE, sizeof(NfaState));
+    set->starts = g_array_new(FALSE, FALSE, sizeof(gint));
+    g_mutex_init(&set->mutex);
+    set->dfa_index = g_hash_table_new(g_bytes_hash, g_bytes_equal);
+    set->dfa = g_ptr_array_new_with_free_func((GDestroyNotify) dfa_state_free);
+    set->dfa_start = DFA_UNKNOWN;
+    set->buf = g_string_new(NULL);
+    return set;
+}
+
+void
+cr_globset_free(cr_GlobSet *set)
+{
+    if (!set)
+        return;
+    g_hash_table_destroy(set->exact);
+    g_hash_table_destroy(set->prefixes);
+    g_hash_table_destroy(set->suffixes);
+    g_array_free(set->prefix_lens, TRUE);
+    g_array_free(set->suffix_lens, TRUE);
+    g_array_free(set->nfa, TRUE);
+    g_array_free(set->starts, TRUE);
+    g_mutex_clear(&set->mutex);
+    g_hash_table_destroy(set->dfa_index);
+    g_ptr_array_free(set->dfa, TRUE);
+    g_string_free(set->buf, TRUE);
+    g_free(set);
+}
+
+guint
+cr_globset_size(cr_GlobSet *set)
+{
+    assert(set);
+    return set->size;
+}
+
+static void
+add_literal(GHashTable *table, GArray *lens, const char *str, gsize len)
+{
+    g_hash_table_add(table, g_strndup(str, len));
+
+    for (guint x = 0; x < lens->len; x++)
+        if (g_array_index(lens, gsize, x) == len)
+            return;
+    g_array_append_val(lens, len);
+}
+
+static gint
+nfa_append(cr_GlobSet *set, NfaType type, guchar c)
+{
+    NfaState state = { type, c, set->nfa->len + 1 };
+    g_array_append_val(set->nfa, state);
+    return set->nfa->len - 1;
+}
+
+static void
+add_generic(cr_GlobSet *set, const char *pattern)
+{
+    gint start = set->nfa->len;
+    g_array_append_val(set->starts, start);
+
+    for (const char *p = pattern; *p; p++) {
+        if (*p == '*') {
+            // Consecutive stars are the same as one
+            if (p != pattern && *(p-1) == '*')
+                continue;
+            nfa_append(set, NFA_STAR, 0);
+        } else if (*p == '?') {
+            nfa_append(set, NFA_ANY, 0);
+            for (int x = 1; x < UTF8_MAX_SKIP; x++)
+                nfa_append(set, NFA_SKIP, 0);
+        } else {
+            nfa_append(set, NFA_CHAR, (guchar) *p);
+        }
+    }
+
+    nfa_append(set, NFA_MATCH, 0);
+}
+
+void
+cr_globset_add(cr_GlobSet *set, const char *pattern)
+{
+    assert(set);
+    assert(pattern);
+    assert(set->dfa_start == DFA_UNKNOWN);
+
+    set->size++;
+
+    // Split the pattern to leading stars, inner part and trailing stars
+    const char *inner = pattern;
+    while (*inner == '*')
+        inner++;
+    gsize inner_len = strlen(inner);
+    gboolean trailing = FALSE;
+    while (inner_len && inner[inner_len-1] == '*') {
+        inner_len--;
+        trailing = TRUE;
+    }
+    gboolean leading = (inner != pattern);
+
+    if (memchr(inner, '*', inner_len) || memchr(inner, '?', inner_len)) {
+        add_generic(set, pattern);
+    } else if (inner_len == 0 && (leading || trailing)) {
+        set->match_all = TRUE;
+    } else if (!leading && !trailing) {
+        g_hash_table_add(set->exact, g_strdup(inner));
+    } else if (!leading) {
+        add_literal(set->prefixes, set->prefix_lens, inner, inner_len);
+    } else if (!trailing) {
+        add_literal(set->suffixes, set->suffix_lens, inner, inner_len);
+    } else {
+        // "*foo*"
+        add_generic(set, pattern);
+    }
+}
+
+/** Add the state and states reachable without consuming a byte */
+static void
+nfa_closure(cr_GlobSet *set, guint8 *bits, gint s)
+{
+    while (1) {
+        bits[s / 8] |= 1 << (s % 8);
+        if (g_array_index(set->nfa, NfaState, s).type != NFA_STAR)
+            break;
+        s = g_array_index(set->nfa, NfaState, s).next;
+    }
+}
+
+/** Return index of the DFA state for the bitset (takes ownership) */
+static gint
+dfa_intern(cr_GlobSet *set, guint8 *bits, gsize len)
+{
+    gboolean empty = TRUE;
+    for (gsize x = 0; x < len; x++)
+        if (bits[x]) {
+            empty = FALSE;
+            break;
+        }
+    if (empty) {
+        g_free(bits);
+        return DFA_DEAD;
+    }
+
+    GBytes *key = g_bytes_new_take(bits, len);
+    gpointer value;
+    if (g_hash_table_lookup_extended(set->dfa_index, key, NULL, &value)) {
+        g_bytes_unref(key);
+        return GPOINTER_TO_INT(value);
+    }
+
+    DfaState *state = g_new(DfaState, 1);
+    state->set = key;
+    state->accept = FALSE;
+    for (int x = 0; x < 256; x++)
+        state->next[x] = DFA_UNKNOWN;
+    for (guint s = 0; s < set->nfa->len; s++)
+        if ((bits[s / 8] & (1 << (s % 8)))
+            && g_array_index(set->nfa, NfaState, s).type == NFA_MATCH)
+        {
+            state->accept = TRUE;
+            break;
+        }
+
+    gint index = set->dfa->len;
+    g_ptr_array_add(set->dfa, state);
+    g_hash_table_insert(set->dfa_index, key, GINT_TO_POINTER(index));
+    return index;
+}
+
+static gint
+dfa_start(cr_GlobSet *set)
+{
+    gsize len = (set->nfa->len + 7) / 8;
+    guint8 *bits = g_malloc0(len);
+    for (guint x = 0; x < set->starts->len; x++)
+        nfa_closure(set, bits, g_array_index(set->starts, gint, x));
+    return dfa_intern(set, bits, len);
+}
+
+static gint
+dfa_step(cr_GlobSet *set, gint index, guchar byte)
+{
+    DfaState *state = g_ptr_array_index(set->dfa, index);
+    gsize len;
+    const guint8 *cur = g_bytes_get_data(state->set, &len);
+    guint8 *bits = g_malloc0(len);
+
+    for (guint s = 0; s < set->nfa->len; s++) {
+        if (!(cur[s / 8] & (1 << (s % 8))))
+            continue;
+
+        NfaState *nfa = &g_array_index(set->nfa, NfaState, s);
+        switch (nfa->type) {
+            case NFA_CHAR:
+                if (nfa->c == byte)
+                    nfa_closure(set, bits, nfa->next);
+                break;
+            case NFA_ANY:
+                // Jump over the NFA_SKIPs not needed by the UTF-8 character
+                nfa_closure(set, bits, s + UTF8_MAX_SKIP + 1 - g_utf8_skip[byte]);
+                break;
+            case NFA_SKIP:
+                nfa_closure(set, bits, nfa->next);
+                break;
+            case NFA_STAR:
+                nfa_closure(set, bits, s);
+                break;
+            case NFA_MATCH:
+                break;
+        }
+    }
+
+    return dfa_intern(set, bits, len);
+}
+
+static gboolean
+dfa_match(cr_GlobSet *set, const char *string)
+{
+    if (set->dfa_start == DFA_UNKNOWN)
+        set->dfa_start = dfa_start(set);
+
+    gint cur = set->dfa_start;
+    for (const guchar *p = (const guchar *) string; *p && cur >= 0; p++) {
+        DfaState *state = g_ptr_array_index(set->dfa, cur);
+        gint next = state->next[*p];
+
+        if (next == DFA_UNKNOWN) {
+            if (set->dfa->len >= DFA_MAX_STATES) {
+                // Flush the cache, keep only the current state
+                gsize len;
+                const guint8 *bits = g_bytes_get_data(state->set, &len);
+                guint8 *copy = g_malloc(len);
+                memcpy(copy, bits, len);
+                g_hash_table_remove_all(set->dfa_index);
+                g_ptr_array_set_size(set->dfa, 0);
+                set->dfa_start = DFA_UNKNOWN;
+                cur = dfa_intern(set, copy, len);
+                set->dfa_start = dfa_start(set);
+                state = g_ptr_array_index(set->dfa, cur);
+            }
+            next = dfa_step(set, cur, *p);
+            state->next[*p] = next;
+        }
+
+        cur = next;
+    }
+
+    return cur >= 0 && ((DfaState *) g_ptr_array_index(set->dfa, cur))->accept;
+}
+
+gboolean
+cr_globset_match(cr_GlobSet *set, const char *string)
+{
+    assert(set);
+    assert(string);
+
+    if (set->match_all)
+        return TRUE;
+
+    gsize len = strlen(string);
+
+    if (g_hash_table_size(set->exact)
+        && g_hash_table_contains(set->exact, string))
+        return TRUE;
+
+    for (guint x = 0; x < set->suffix_lens->len; x++) {
+        gsize suffix_len = g_array_index(set->suffix_lens, gsize, x);
+        if (suffix_len <= len
+            && g_hash_table_contains(set->suffixes, string + len - suffix_len))
+            return TRUE;
+    }
+
+    gboolean ret = FALSE;
+    g_mutex_lock(&set->mutex);
+
+    for (guint x = 0; !ret && x < set->prefix_lens->len; x++) {
+        gsize prefix_len = g_array_index(set->prefix_lens, gsize, x);
+        if (prefix_len > len)
+            continue;
+        g_string_truncate(set->buf, 0);
+        g_string_append_len(set->buf, string, prefix_len);
+        ret = g_hash_table_contains(set->prefixes, set->buf->str);
+    }
+
+    if (!ret && set->starts->len)
+        ret = dfa_match(set, string);
+
+    g_mutex_unlock(&set->mutex);
+    return ret;
+}
@@ -0,0 +1,88 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_GLOBSET_H__
+#define __C_CREATEREPOLIB_GLOBSET_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+
+/** \defgroup   globset     Set of glob patterns compiled into one matcher.
+ *  \addtogroup globset
+ *  @{
+ */
+
+/** Set of glob patterns with the same semantics as GPatternSpec
+ * ('*' matches any string including '/', '?' matches exactly one
+ * UTF-8 character, the whole string has to match).
+ *
+ * Literal patterns, literal prefixes ("foo*") and literal suffixes ("*.rpm")
+ * are looked up in hash tables. All other patterns are compiled into
+ * a single automaton which is lazily converted into a DFA, so the cost of
+ * a match doesn't grow with the number of patterns.
+ *
+ * Matching is thread-safe, adding patterns is not.
+ */
+typedef struct _cr_GlobSet cr_GlobSet;
+
+/** Create an empty set.
+ * @return              New cr_GlobSet
+ */
+cr_GlobSet *
+cr_globset_new(void);
+
+/** Add a glob pattern to the set.
+ * Patterns must be added before the first cr_globset_match() call.
+ * @param set           cr_GlobSet
+ * @param pattern       Glob pattern
+ */
+void
+cr_globset_add(cr_GlobSet *set, const char *pattern);
+
+/** Number of patterns in the set.
+ * @param set           cr_GlobSet
+ * @return              Number of added patterns
+ */
+guint
+cr_globset_size(cr_GlobSet *set);
+
+/** Check if the string matches any pattern in the set.
+ * @param set           cr_GlobSet
+ * @param string        UTF-8 string
+ * @return              TRUE if any pattern matches the string
+ */
+gboolean
+cr_globset_match(cr_GlobSet *set, const char *string);
+
+/** Free the set.
+ * @param set           cr_GlobSet or NULL
+ */
+void
+cr_globset_free(cr_GlobSet *set);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_GLOBSET_H__ */
@@ -28,12 +28,15 @@
 #include <modulemd.h>
 #endif /* WITH_LIBMODULEMD */
 
+#include "compression_wrapper.h"
 #include "error.h"
 #include "package.h"
 #include "misc.h"
 #include "load_metadata.h"
 #include "locate_metadata.h"
+#include "url_stream.h"
 #include "xml_parser.h"
+#include "xml_parser_internal.h"
 
 #define ERR_DOMAIN              CREATEREPO_C_ERROR
 #define STRINGCHUNK_SIZE        16384
@@ -47,6 +50,7 @@ struct _cr_Metadata {
     GHashTable *pkglist_ht; /*!< list of allowed package basenames to load */
     cr_HashTableKeyDupAction dupaction; /*!<
         How to behave in case of duplicated items */
+    gboolean raw_xml;       /*!< Keep original XML of the packages */
 
 #ifdef WITH_LIBMODULEMD
     ModulemdModuleIndex *moduleindex; /*!< Module metadata */
@@ -160,6 +164,12 @@ cr_metadata_set_dupaction(cr_Metadata *md, cr_HashTableKeyDupAction dupaction)
     return TRUE;
 }
 
+void
+cr_metadata_set_raw_xml(cr_Metadata *md, gboolean raw_xml)
+{
+    md->raw_xml = raw_xml;
+}
+
 // Callbacks for XML parsers
 
 typedef enum {
@@ -358,6 +368,7 @@ cr_load_xml_files(GHashTable *hashtable,
                   const char *other_xml_path,
                   GStringChunk *chunk,
                   GHashTable *pkglist_ht,
+                  gboolean raw_xml,
                   GError **err)
 {
     cr_CbData cb_data;
@@ -374,7 +385,8 @@ cr_load_xml_files(GHashTable *hashtable,
                                                     g_free, NULL);
     cb_data.pkgKey          = G_GINT64_CONSTANT(0);
 
-    cr_xml_parse_primary(primary_xml_path,
+    (raw_xml ? cr_xml_parse_primary_raw : cr_xml_parse_primary)(
+                         primary_xml_path,
                          primary_newpkgcb,
                          &cb_data,
                          primary_pkgcb,
@@ -397,7 +409,8 @@ cr_load_xml_files(GHashTable *hashtable,
     cb_data.state = PARSING_FIL;
 
     if (filelists_xml_path) {
-        cr_xml_parse_filelists(filelists_xml_path,
+        (raw_xml ? cr_xml_parse_filelists_raw : cr_xml_parse_filelists)(
+                               filelists_xml_path,
                                newpkgcb,
                                &cb_data,
                                pkgcb,
@@ -416,7 +429,8 @@ cr_load_xml_files(GHashTable *hashtable,
     cb_data.state = PARSING_OTH;
 
     if (other_xml_path) {
-        cr_xml_parse_other(other_xml_path,
+        (raw_xml ? cr_xml_parse_other_raw : cr_xml_parse_other)(
+                           other_xml_path,
                            newpkgcb,
                            &cb_data,
                            pkgcb,
@@ -536,6 +550,15 @@ cr_metadata_load_xml(cr_Metadata *md,
         return CRE_BADARG;
     }
 
+    // Start the download of remote filelists and other xml now,
+    // they are buffered until the primary xml is parsed
+    if (ml->parallel_fetch) {
+        if (cr_url_is_remote(ml->fil_xml_href))
+            cr_url_stream_prefetch(ml->fil_xml_href);
+        if (cr_url_is_remote(ml->oth_xml_href))
+            cr_url_stream_prefetch(ml->oth_xml_href);
+    }
+
     // Load metadata
     intern_hashtable = cr_new_metadata_hashtable();
     result = cr_load_xml_files(intern_hashtable,
@@ -544,8 +567,17 @@ cr_metadata_load_xml(cr_Metadata *md,
                                ml->oth_xml_href,
                                md->chunk,
                                md->pkglist_ht,
+                               md->raw_xml,
                                &tmp_err);
 
+    if (ml->parallel_fetch) {
+        // Prefetched files are not used if the parsing failed
+        if (cr_url_is_remote(ml->fil_xml_href))
+            cr_url_stream_discard(ml->fil_xml_href);
+        if (cr_url_is_remote(ml->oth_xml_href))
+            cr_url_stream_discard(ml->oth_xml_href);
+    }
+
     if (result != CRE_OK) {
         g_critical("%s: Error encountered while parsing", __func__);
         g_propagate_prefixed_error(err, tmp_err,
@@ -673,7 +705,7 @@ cr_metadata_locate_and_load_xml(cr_Metadata *md,
     assert(md);
     assert(repopath);
 
-    ml = cr_locate_metadata(repopath, TRUE, &tmp_err);
+    ml = cr_locate_metadata_stream(repopath, TRUE, FALSE, &tmp_err);
     if (tmp_err) {
         g_clear_pointer(&ml, cr_metadatalocation_free);
         int code = tmp_err->code;
@@ -687,3 +719,293 @@ cr_metadata_locate_and_load_xml(cr_Metadata *md,
 
     return ret;
 }
+
+/** Position of a package in a seekable xml file */
+typedef struct {
+    gint64 frame_offset;
+    gint64 frame_size;
+    gint64 offset;              // Offset in the decompressed frame
+    gint64 length;
+} cr_IndexEntry;
+
+/** Package index of a single seekable xml file */
+typedef struct {
+    gchar *xml_filename;
+    GHashTable *entries;        // pkgId -> cr_IndexEntry
+    gint64 cached_offset;       // Offset of the cached frame or -1
+    gchar *cached_frame;        // The last decompressed frame
+    gsize cached_len;
+} cr_FileIndex;
+
+struct _cr_MetadataIndex {
+    cr_FileIndex *fil;
+    cr_FileIndex *oth;
+};
+
+static void
+cr_file_index_free(cr_FileIndex *index)
+{
+    if (!index)
+        return;
+    g_hash_table_destroy(index->entries);
+    g_free(index->cached_frame);
+    g_free(index->xml_filename);
+    g_free(index);
+}
+
+static gboolean
+cr_parse_index_line(char *line, gchar **pkgId, cr_IndexEntry *entry)
+{
+    gint64 values[4];
+    char *end;
+
+    end = line + strcspn(line, " ");
+    if (end == line || *end != ' ')
+        return FALSE;
+    *end = '\0';
+    *pkgId = line;
+
+    for (int x = 0; x < 4; x++) {
+        line = end + 1;
+        if (!g_ascii_isdigit(*line))
+            return FALSE;
+        values[x] = g_ascii_strtoll(line, &end, 10);
+        if (*end != (x < 3 ? ' ' : '\0'))
+            return FALSE;
+    }
+
+    entry->frame_offset = values[0];
+    entry->frame_size   = values[1];
+    entry->offset       = values[2];
+    entry->length       = values[3];
+    return TRUE;
+}
+
+static cr_FileIndex *
+cr_file_index_load(const char *index_filename,
+                   const char *xml_filename,
+                   GError **err)
+{
+    GError *tmp_err = NULL;
+    GString *content = g_string_new(NULL);
+    cr_FileIndex *index = NULL;
+    gchar **lines = NULL;
+    char buf[8192];
+    int len;
+
+    CR_FILE *f = cr_open(index_filename, CR_CW_MODE_READ,
+                         CR_CW_AUTO_DETECT_COMPRESSION, &tmp_err);
+    if (!f) {
+        g_propagate_prefixed_error(err, tmp_err, "Cannot open %s: ",
+                                   index_filename);
+        goto exit;
+    }
+    while ((len = cr_read(f, buf, sizeof(buf), &tmp_err)) > 0)
+        g_string_append_len(content, buf, len);
+    cr_close(f, NULL);
+    if (tmp_err) {
+        g_propagate_prefixed_error(err, tmp_err, "Cannot read %s: ",
+                                   index_filename);
+        goto exit;
+    }
+
+    index = g_new0(cr_FileIndex, 1);
+    index->xml_filename = g_strdup(xml_filename);
+    index->entries = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                           g_free, g_free);
+    index->cached_offset = -1;
+
+    lines = g_strsplit(content->str, "\n", -1);
+    for (int x = 0; lines[x]; x++) {
+        cr_IndexEntry entry;
+        gchar *pkgId;
+
+        if (!*lines[x] || *lines[x] == '#')
+            continue;
+
+        if (!cr_parse_index_line(lines[x], &pkgId, &entry)) {
+            g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                        "%s:%d: Malformed line of the package index",
+                        index_filename, x + 1);
+            g_clear_pointer(&index, cr_file_index_free);
+            goto exit;
+        }
+
+        cr_IndexEntry *value = g_new(cr_IndexEntry, 1);
+        *value = entry;
+        g_hash_table_replace(index->entries, g_strdup(pkgId), value);
+    }
+
+exit:
+    g_strfreev(lines);
+    g_string_free(content, TRUE);
+    return index;
+}
+
+/** Return the xml chunk of the package (a pointer to the cached frame) */
+static const char *
+cr_file_index_get(cr_FileIndex *index,
+                  const char *pkgId,
+                  gsize *length,
+                  GError **err)
+{
+    cr_IndexEntry *entry = g_hash_table_lookup(index->entries, pkgId);
+    if (!entry)
+        return NULL;
+
+    if (index->cached_offset != entry->frame_offset) {
+        g_clear_pointer(&index->cached_frame, g_free);
+        index->cached_offset = -1;
+        index->cached_frame = cr_read_frame(index->xml_filename,
+                                            entry->frame_offset,
+                                            entry->frame_size,
+                                            &index->cached_len,
+                                            err);
+        if (!index->cached_frame)
+            return NULL;
+        index->cached_offset = entry->frame_offset;
+    }
+
+    if (entry->offset < 0 || entry->length < 0
+        || (gsize) (entry->offset + entry->length) > index->cached_len) {
+        g_set_error(err, ERR_DOMAIN, CRE_XMLDATA,
+                    "Package %s is out of its frame in %s",
+                    pkgId, index->xml_filename);
+        return NULL;
+    }
+
+    *length = entry->length;
+    return index->cached_frame + entry->offset;
+}
+
+cr_MetadataIndex *
+cr_metadata_index_open(struct cr_MetadataLocation *ml, GError **err)
+{
+    cr_MetadataIndex *index;
+
+    assert(ml);
+    assert(!err || *err == NULL);
+
+    if (!(ml->fil_index_href && ml->fil_xml_href)
+        && !(ml->oth_index_href && ml->oth_xml_href)) {
+        g_set_error(err, ERR_DOMAIN, CRE_NOFILE,
+                    "Repository %s has no package index",
+                    ml->original_url ? ml->original_url : ml->local_path);
+        return NULL;
+    }
+
+    index = g_new0(cr_MetadataIndex, 1);
+
+    if (ml->fil_index_href && ml->fil_xml_href) {
+        index->fil = cr_file_index_load(ml->fil_index_href,
+                                        ml->fil_xml_href, err);
+        if (!index->fil)
+            goto error;
+    }
+
+    if (ml->oth_index_href && ml->oth_xml_href) {
+        index->oth = cr_file_index_load(ml->oth_index_href,
+                                        ml->oth_xml_href, err);
+        if (!index->oth)
+            goto error;
+    }
+
+    return index;
+
+error:
+    cr_metadata_index_free(index);
+    return NULL;
+}
+
+static int
+cr_index_newpkgcb(cr_Package **pkg,
+                  const char *pkgId,
+                  G_GNUC_UNUSED const char *name,
+                  G_GNUC_UNUSED const char *arch,
+                  void *cbdata,
+                  GError **err)
+{
+    cr_Package *target = cbdata;
+
+    if (g_strcmp0(pkgId, target->pkgId)) {
+        g_set_error(err, ERR_DOMAIN, CRE_XMLDATA,
+                    "Index points to package %s instead of %s",
+                    pkgId, target->pkgId);
+        return CR_CB_RET_ERR;
+    }
+
+    *pkg = target;
+    return CR_CB_RET_OK;
+}
+
+cr_Package *
+cr_metadata_index_get_package(cr_MetadataIndex *index,
+                              const char *pkgId,
+                              GError **err)
+{
+    GError *tmp_err = NULL;
+    cr_Package *pkg;
+    gboolean found = FALSE;
+
+    assert(index);
+    assert(pkgId);
+    assert(!err || *err == NULL);
+
+    pkg = cr_package_new();
+    pkg->pkgId = g_string_chunk_insert(pkg->chunk, pkgId);
+
+    for (int x = 0; x < 2; x++) {
+        cr_FileIndex *file_index = x ? index->oth : index->fil;
+        const char *chunk;
+        gchar *xml;
+        gsize len;
+
+        if (!file_index)
+            continue;
+
+        chunk = cr_file_index_get(file_index, pkgId, &len, &tmp_err);
+        if (tmp_err)
+            goto error;
+        if (!chunk)
+            continue;
+
+        found = TRUE;
+        xml = g_strndup(chunk, len);
+        if (x)
+            cr_xml_parse_other_snippet(xml, cr_index_newpkgcb, pkg, NULL, NULL,
+                                       NULL, NULL, &tmp_err);
+        else
+            cr_xml_parse_filelists_snippet(xml, cr_index_newpkgcb, pkg, NULL,
+                                           NULL, NULL, NULL, &tmp_err);
+        g_free(xml);
+        if (tmp_err)
+            goto error;
+    }
+
+    if (!found) {
+        cr_package_free(pkg);
+        return NULL;
+    }
+
+    pkg->loadingflags |= CR_PACKAGE_FROM_XML;
+    if (index->fil)
+        pkg->loadingflags |= CR_PACKAGE_LOADED_FIL;
+    if (index->oth)
+        pkg->loadingflags |= CR_PACKAGE_LOADED_OTH;
+    return pkg;
+
+error:
+    g_propagate_error(err, tmp_err);
+    cr_package_free(pkg);
+    return NULL;
+}
+
+void
+cr_metadata_index_free(cr_MetadataIndex *index)
+{
+    if (!index)
+        return;
+    cr_file_index_free(index->fil);
+    cr_file_index_free(index->oth);
+    g_free(index);
+}
@@ -22,6 +22,7 @@
 
 #include <glib.h>
 #include "locate_metadata.h"
+#include "package.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -120,6 +121,17 @@ cr_Metadata *cr_metadata_new(cr_HashTableKey key,
 gboolean
 cr_metadata_set_dupaction(cr_Metadata *md, cr_HashTableKeyDupAction dupaction);
 
+/** Keep the original XML of the loaded packages. The <package> elements
+ * of primary, filelists and other xml are stored into raw_primary,
+ * raw_filelists and raw_other of the packages, so they can be written
+ * out again by cr_xml_dump_raw() without being regenerated.
+ * It takes approximately twice as much memory.
+ * @param md            cr_Metadata object
+ * @param raw_xml       Keep the XML
+ */
+void
+cr_metadata_set_raw_xml(cr_Metadata *md, gboolean raw_xml);
+
 /** Destroy metadata.
  * @param md            cr_Metadata object
  */
@@ -136,6 +148,8 @@ int cr_metadata_load_xml(cr_Metadata *md,
                          GError **err);
 
 /** Locate and load metadata from the specified path.
+ * The xml files of a remote repository are parsed while they are being
+ * downloaded (see cr_locate_metadata_stream()).
  * @param md            metadata object
  * @param repopath      path to repo (to directory with repodata/ subdir)
  * @param err           GError **
@@ -145,6 +159,41 @@ int cr_metadata_locate_and_load_xml(cr_Metadata *md,
                                     const char *repopath,
                                     GError **err);
 
+/** Random access to filelists and other metadata of single packages.
+ * Uses the package indexes (filelists_index and other_index records
+ * in repomd.xml) of metadata written with --seekable-metadata.
+ * Only the frames which contain the requested packages are read
+ * and decompressed. The object is not thread safe.
+ */
+typedef struct _cr_MetadataIndex cr_MetadataIndex;
+
+/** Load package indexes of the metadata.
+ * @param ml            metadata location (local repository)
+ * @param err           GError **
+ * @return              cr_MetadataIndex or NULL on error (e.g. the
+ *                      repository has no package index)
+ */
+cr_MetadataIndex *cr_metadata_index_open(struct cr_MetadataLocation *ml,
+                                         GError **err);
+
+/** Get filelists and other metadata of a package.
+ * The returned package has pkgId, name, arch, version, files and
+ * changelogs filled (other attributes are in primary.xml).
+ * @param index         cr_MetadataIndex object
+ * @param pkgId         checksum of the package
+ * @param err           GError **
+ * @return              new cr_Package or NULL if the package isn't
+ *                      in the index (err is not set) or on error
+ */
+cr_Package *cr_metadata_index_get_package(cr_MetadataIndex *index,
+                                          const char *pkgId,
+                                          GError **err);
+
+/** Destroy the cr_MetadataIndex.
+ * @param index         cr_MetadataIndex object
+ */
+void cr_metadata_index_free(cr_MetadataIndex *index);
+
 /** @} */
 
 #ifdef __cplusplus
@@ -28,6 +28,7 @@
 #include "misc.h"
 #include "locate_metadata.h"
 #include "repomd.h"
+#include "url_stream.h"
 #include "xml_parser.h"
 #include "cleanup.h"
 
@@ -66,6 +67,8 @@ cr_metadatalocation_free(struct cr_MetadataLocation *ml)
     g_free(ml->pri_sqlite_href);
     g_free(ml->fil_sqlite_href);
     g_free(ml->oth_sqlite_href);
+    g_free(ml->fil_index_href);
+    g_free(ml->oth_index_href);
     g_free(ml->repomd);
     g_free(ml->original_url);
     g_free(ml->local_path);
@@ -167,6 +170,10 @@ cr_parse_repomd(const char *repomd_path,
             mdloc->oth_xml_href = full_location_href;
         else if (!g_strcmp0(record->type, "other_db") && !ignore_sqlite)
             mdloc->oth_sqlite_href = full_location_href;
+        else if (!g_strcmp0(record->type, "filelists_index"))
+            mdloc->fil_index_href = full_location_href;
+        else if (!g_strcmp0(record->type, "other_index"))
+            mdloc->oth_index_href = full_location_href;
         else if ( !g_str_has_prefix(record->type, "primary_"   ) &&
                   !g_str_has_prefix(record->type, "filelists_" ) && 
                   !g_str_has_prefix(record->type, "other_"     ) ) 
@@ -211,8 +218,28 @@ cr_get_local_metadata(const char *repopath, gboolean ignore_sqlite)
 }
 
 
+// Xml files which can be parsed while they are being downloaded
+static gboolean
+cr_streamable_href(const char *href)
+{
+    return href && !g_str_has_suffix(href, ".zck");
+}
+
+// Replace the path to a not downloaded xml file by its URL
+static void
+cr_use_remote_href(char **local_href, char **remote_href)
+{
+    if (!cr_streamable_href(*remote_href))
+        return;
+    g_free(*local_href);
+    *local_href = *remote_href;
+    *remote_href = NULL;
+}
+
 static struct cr_MetadataLocation *
-cr_get_remote_metadata(const char *repopath, gboolean ignore_sqlite)
+cr_get_remote_metadata(const char *repopath,
+                       gboolean ignore_sqlite,
+                       gboolean stream_xml)
 {
     CURL *handle = NULL;
     _cleanup_free_ gchar *tmp_dir = NULL;
@@ -287,12 +314,16 @@ cr_get_remote_metadata(const char *repopath, gboolean ignore_sqlite)
         goto get_remote_metadata_cleanup;
     }
 
-    // Download all other repofiles
-    if (r_location->pri_xml_href)
+    // Download all other repofiles (streamed xml files are left
+    // on the server)
+    if (r_location->pri_xml_href
+        && !(stream_xml && cr_streamable_href(r_location->pri_xml_href)))
         cr_download(handle, r_location->pri_xml_href, tmp_repodata, &tmp_err);
-    if (!tmp_err && r_location->fil_xml_href)
+    if (!tmp_err && r_location->fil_xml_href
+        && !(stream_xml && cr_streamable_href(r_location->fil_xml_href)))
         cr_download(handle, r_location->fil_xml_href, tmp_repodata, &tmp_err);
-    if (!tmp_err && r_location->oth_xml_href)
+    if (!tmp_err && r_location->oth_xml_href
+        && !(stream_xml && cr_streamable_href(r_location->oth_xml_href)))
         cr_download(handle, r_location->oth_xml_href, tmp_repodata, &tmp_err);
     if (!tmp_err && r_location->pri_sqlite_href)
         cr_download(handle, r_location->pri_sqlite_href, tmp_repodata, &tmp_err);
@@ -309,8 +340,6 @@ cr_get_remote_metadata(const char *repopath, gboolean ignore_sqlite)
         }
     }
 
-    cr_metadatalocation_free(r_location);
-
     if (tmp_err) {
         g_critical("%s: Error while downloadig files: %s",
                    __func__, tmp_err->message);
@@ -324,8 +353,16 @@ cr_get_remote_metadata(const char *repopath, gboolean ignore_sqlite)
     if (ret)
         ret->tmp = 1;
 
+    if (ret && stream_xml) {
+        cr_use_remote_href(&ret->pri_xml_href, &r_location->pri_xml_href);
+        cr_use_remote_href(&ret->fil_xml_href, &r_location->fil_xml_href);
+        cr_use_remote_href(&ret->oth_xml_href, &r_location->oth_xml_href);
+    }
+
 get_remote_metadata_cleanup:
 
+    cr_metadatalocation_free(r_location);
+
     if (handle)
         curl_easy_cleanup(handle);
     if (!ret) cr_remove_dir(tmp_dir, NULL);
@@ -334,20 +371,20 @@ get_remote_metadata_cleanup:
 }
 
 
-struct cr_MetadataLocation *
-cr_locate_metadata(const char *repopath, gboolean ignore_sqlite, GError **err)
+static struct cr_MetadataLocation *
+cr_locate_metadata_internal(const char *repopath,
+                            gboolean ignore_sqlite,
+                            gboolean stream_xml,
+                            GError **err)
 {
     struct cr_MetadataLocation *ret = NULL;
 
     assert(repopath);
     assert(!err || *err == NULL);
 
-    if (g_str_has_prefix(repopath, "ftp://") ||
-        g_str_has_prefix(repopath, "http://") ||
-        g_str_has_prefix(repopath, "https://"))
-    {
+    if (cr_url_is_remote(repopath)) {
         // Remote metadata - Download them via curl
-        ret = cr_get_remote_metadata(repopath, ignore_sqlite);
+        ret = cr_get_remote_metadata(repopath, ignore_sqlite, stream_xml);
     } else {
         // Local metadata
         if (g_str_has_prefix(repopath, "file:///"))
@@ -375,3 +412,24 @@ cr_locate_metadata(const char *repopath, gboolean ignore_sqlite, GError **err)
 
     return ret;
 }
+
+struct cr_MetadataLocation *
+cr_locate_metadata(const char *repopath, gboolean ignore_sqlite, GError **err)
+{
+    return cr_locate_metadata_internal(repopath, ignore_sqlite, FALSE, err);
+}
+
+struct cr_MetadataLocation *
+cr_locate_metadata_stream(const char *repopath,
+                          gboolean ignore_sqlite,
+                          gboolean parallel_fetch,
+                          GError **err)
+{
+    struct cr_MetadataLocation *ret;
+
+    ret = cr_locate_metadata_internal(repopath, ignore_sqlite, TRUE, err);
+    if (ret)
+        ret->parallel_fetch = parallel_fetch;
+
+    return ret;
+}
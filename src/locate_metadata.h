@@ -50,6 +50,14 @@ struct cr_MetadataLocation {
     int  tmp;                   /*!< if true - metadata were downloaded and
                                      will be removed during
                                      cr_metadata_location_free*/
+    int  parallel_fetch;        /*!< if true - cr_metadata_load_xml()
+                                     downloads remote filelists.xml and
+                                     other.xml while primary.xml is
+                                     being parsed */
+    char *fil_index_href;       /*!< path to the package index of
+                                     seekable filelists.xml */
+    char *oth_index_href;       /*!< path to the package index of
+                                     seekable other.xml */
 };
 
 /** Structure representing additional metadata location and type.
@@ -99,7 +107,7 @@ gint cr_cmp_metadatum_type(gconstpointer metadatum, gconstpointer type);
 gint cr_cmp_repomd_record_type(gconstpointer repomd_record, gconstpointer type);
 
 /** Parses repomd.xml and returns a filled cr_MetadataLocation structure.
- * Remote repodata (repopath with prefix "ftp://" or "http://") are dowloaded
+ * Remote repodata (repopath for which cr_url_is_remote() is TRUE) are dowloaded
  * into a temporary directory and removed when the cr_metadatalocation_free()
  * is called on the cr_MetadataLocation.
  * @param repopath      path to directory with repodata/ subdirectory
@@ -111,6 +119,24 @@ struct cr_MetadataLocation *cr_locate_metadata(const char *repopath,
                                                gboolean ignore_sqlite,
                                                GError **err);
 
+/** Same as cr_locate_metadata() but the primary, filelists and other xml
+ * of a remote repository are not downloaded. Their hrefs in the returned
+ * structure are URLs and the files are streamed by cr_metadata_load_xml()
+ * (the cr_xml_parse_*() functions accept URLs) - they are parsed while
+ * they are being downloaded. Zchunk compressed xml files cannot be streamed
+ * and are downloaded into the temporary directory as usual.
+ * @param repopath          path to directory with repodata/ subdirectory
+ * @param ignore_sqlite     if ignore_sqlite != 0 sqlite dbs are ignored
+ * @param parallel_fetch    download all three xml files at once
+ *                          (see cr_MetadataLocation.parallel_fetch)
+ * @param err               GError **
+ * @return                  filled cr_MetadataLocation structure or NULL
+ */
+struct cr_MetadataLocation *cr_locate_metadata_stream(const char *repopath,
+                                                      gboolean ignore_sqlite,
+                                                      gboolean parallel_fetch,
+                                                      GError **err);
+
 /** Free cr_MetadataLocation. If repodata were downloaded remove
  * a temporary directory with repodata.
  * @param ml            MeatadaLocation
@@ -45,20 +45,23 @@
 #include "cleanup.h"
 #include "koji.h"
 
+#define ERR_DOMAIN                      CREATEREPO_C_ERROR
 #define DEFAULT_OUTPUTDIR               "merged_repo/"
 
 #include "mergerepo_c.h"
 
-struct CmdOptions _cmd_options = {
-        .db_compression_type = DEFAULT_DB_COMPRESSION_TYPE,
-        .groupfile_compression_type = DEFAULT_GROUPFILE_COMPRESSION_TYPE,
-        .merge_method = MM_DEFAULT,
-        .unique_md_filenames = TRUE,
-        .simple_md_filenames = FALSE,
+#define CMD_OPTIONS_DEFAULTS { \
+        .db_compression_type = DEFAULT_DB_COMPRESSION_TYPE, \
+        .groupfile_compression_type = DEFAULT_GROUPFILE_COMPRESSION_TYPE, \
+        .merge_method = MM_DEFAULT, \
+        .unique_md_filenames = TRUE, \
+        .simple_md_filenames = FALSE, \
+        .zck_compression = FALSE, \
+        .zck_dict_dir = NULL, \
+        .xml_allocator_type = CR_ALLOCATOR_DEFAULT, \
+    }
 
-        .zck_compression = FALSE,
-        .zck_dict_dir = NULL,
-    };
+struct CmdOptions _cmd_options = CMD_OPTIONS_DEFAULTS;
 
 // TODO:
 //  - rozvijet architekturu na listy tak jak to dela mergedrepo
@@ -89,6 +92,15 @@ static GOptionEntry cmd_entries[] =
       "Do not merge updateinfo metadata", NULL },
     { "compress-type", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.compress_type),
       "Which compression type to use", "COMPRESS_TYPE" },
+    { "rsyncable", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.rsyncable),
+      "Reset the gzip compressor at content-defined package boundaries, so "
+      "unchanged parts of primary, filelists and other xml are compressed "
+      "into identical bytes across runs (rsync and CDN friendly).", NULL },
+    { "seekable-metadata", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.seekable_metadata),
+      "Write filelists and other xml compressed by xz into independent "
+      "blocks and write indexes of their packages (filelists_index and "
+      "other_index), so metadata of a single package can be read without "
+      "decompressing the whole files.", NULL },
 #ifdef WITH_ZCHUNK
     { "zck", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.zck_compression),
       "Generate zchunk files as well as the standard repodata.", NULL },
@@ -111,6 +123,30 @@ static GOptionEntry cmd_entries[] =
       "Do not include the file's checksum in the metadata filename.", NULL },
     { "omit-baseurl", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.omit_baseurl),
       "Don't add a baseurl to packages that don't have one before." , NULL},
+    { "regenerate-xml", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.regenerate_xml),
+      "Generate primary, filelists and other xml of every package from its "
+      "parsed metadata. By default the original XML of the packages is "
+      "copied from the input repos (only its xml:base is rewritten), "
+      "which is faster but takes more memory.", NULL },
+    { "merge-databases", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.merge_databases),
+      "Build the sqlite databases by copying rows of the merged packages "
+      "from the databases of the input repos instead of inserting every "
+      "parsed package. Packages from repos without databases are "
+      "inserted as usual.", NULL },
+    { "xml-allocator", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.xml_allocator),
+      "Allocator used for libxml2 memory (available: default, counting, "
+      "thread-cache). Non-default allocators report allocation counters "
+      "at the end of the run.", "ALLOCATOR" },
+    { "parallel-fetch", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.parallel_fetch),
+      "Download primary, filelists and other xml of a remote repo at once. "
+      "Data which cannot be parsed yet are buffered in memory.", NULL },
+    { "batch", 0, 0, G_OPTION_ARG_FILENAME, &(_cmd_options.batch),
+      "Run merge jobs listed in the MANIFEST file (one job per line, given by "
+      "mergerepo_c arguments). Every input repo is parsed only once and "
+      "the jobs run concurrently.", "MANIFEST" },
+    { "batch-workers", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.batch_workers),
+      "Number of merge jobs from --batch running at once (default: number "
+      "of CPUs).", "N" },
 
     // -- Options related to Koji-mergerepos behaviour
     { "koji", 'k', 0, G_OPTION_ARG_NONE, &(_cmd_options.koji),
@@ -355,6 +391,34 @@ check_arguments(struct CmdOptions *options)
     if (options->zck_dict_dir)
         options->zck_dict_dir = cr_normalize_dir_path(options->zck_dict_dir);
 
+    // Batch
+    if (options->batch) {
+        if (options->repos) {
+            g_critical("--batch cannot be used together with -r/--repo");
+            ret = FALSE;
+        }
+        if (!g_file_test(options->batch, G_FILE_TEST_IS_REGULAR)) {
+            g_critical("File %s doesn't exists", options->batch);
+            ret = FALSE;
+        }
+    }
+
+    if (options->batch_workers < 0) {
+        g_critical("Number of batch workers must be a positive number");
+        ret = FALSE;
+    }
+
+    // Allocator
+    if (options->xml_allocator) {
+        options->xml_allocator_type = cr_allocator_type(options->xml_allocator);
+        if (options->xml_allocator_type == CR_ALLOCATOR_SENTINEL) {
+            g_critical("Unknown allocator \"%s\": Please choose from: "
+                       "default, counting or thread-cache",
+                       options->xml_allocator);
+            ret = FALSE;
+        }
+    }
+
     return ret;
 }
 
@@ -398,6 +462,8 @@ free_options(struct CmdOptions *options)
     g_free(options->compress_type);
     g_free(options->merge_method_str);
     g_free(options->noarch_repo_url);
+    g_free(options->xml_allocator);
+    g_free(options->batch);
 
     g_free(options->groupfile);
     g_free(options->blocked);
@@ -424,6 +490,34 @@ free_options(struct CmdOptions *options)
 
 
 
+// Shallow copy of a package from the repos shared by all jobs of --batch.
+// Strings and lists belong to the shared package (which must stay
+// untouched), only the chunk (used for location_base) is owned by the copy.
+static cr_Package *
+merged_package_view(cr_Package *pkg)
+{
+    cr_Package *view = g_new(cr_Package, 1);
+    *view = *pkg;
+    view->chunk = g_string_chunk_new(128);
+    return view;
+}
+
+
+
+static void
+merged_package_free(cr_Package *pkg, gboolean shared)
+{
+    if (!shared) {
+        cr_package_free(pkg);
+        return;
+    }
+
+    g_string_chunk_free(pkg->chunk);
+    g_free(pkg);
+}
+
+
+
 void
 free_merged_values(gpointer data)
 {
@@ -437,13 +531,25 @@ free_merged_values(gpointer data)
 
 
 
+static void
+free_merged_views(gpointer data)
+{
+    GSList *element = (GSList *) data;
+    for (; element; element=g_slist_next(element))
+        merged_package_free((cr_Package *) element->data, TRUE);
+    g_slist_free((GSList *) data);
+}
+
+
+
 GHashTable *
-new_merged_metadata_hashtable()
+new_merged_metadata_hashtable(gboolean shared)
 {
     GHashTable *hashtable = g_hash_table_new_full(g_str_hash,
                                                   g_str_equal,
                                                   g_free,
-                                                  free_merged_values);
+                                                  shared ? free_merged_views
+                                                         : free_merged_values);
     return hashtable;
 }
 
@@ -473,7 +579,8 @@ add_package(cr_Package *pkg,
             MergeMethod merge_method,
             struct KojiMergedReposStuff *koji_stuff,
             gboolean omit_baseurl,
-            int repoid)
+            int repoid,
+            gboolean shared)
 {
     GSList *list, *element;
     int ret = 1;
@@ -543,7 +650,7 @@ add_package(cr_Package *pkg,
                 case MM_NEWEST_FROM_IDENTICAL_NA:
                     if (pkg->time_file > c_pkg->time_file) {
                         // Remove older package
-                        cr_package_free(c_pkg);
+                        merged_package_free(c_pkg, shared);
                         // Replace package in element
                         if (!pkg->location_base)
                             pkg->location_base = cr_safe_string_chunk_insert(pkg->chunk,
@@ -575,7 +682,7 @@ add_package(cr_Package *pkg,
 
                     if (pkg_is_newer) {
                         // Remove older package
-                        cr_package_free(c_pkg);
+                        merged_package_free(c_pkg, shared);
                         // Replace package in element
                         if (!pkg->location_base)
                             pkg->location_base = cr_safe_string_chunk_insert(pkg->chunk, repopath);
@@ -651,6 +758,11 @@ add_package:
 }
 
 
+#ifdef WITH_LIBMODULEMD
+// Module indexes of the shared repos are read by all jobs of --batch
+static GMutex modulemd_mutex;
+#endif /* WITH_LIBMODULEMD */
+
 long
 merge_repos(GHashTable *merged,
 #ifdef WITH_LIBMODULEMD
@@ -663,7 +775,10 @@ merge_repos(GHashTable *merged,
             struct KojiMergedReposStuff *koji_stuff,
             gboolean omit_baseurl,
             gchar *repo_prefix_search,
-            gchar *repo_prefix_replace)
+            gchar *repo_prefix_replace,
+            GHashTable *shared_metadata,
+            gboolean raw_xml,
+            GHashTable *pkg_sources)
 {
     long loaded_packages = 0;
     GSList *used_noarch_keys = NULL;
@@ -690,7 +805,6 @@ merge_repos(GHashTable *merged,
             break;
         }
 
-        metadata = cr_metadata_new(CR_HT_KEY_HASH, 0, NULL);
         repopath = cr_normalize_dir_path(ml->original_url);
 
         // Base paths in output of original createrepo doesn't have trailing '/'
@@ -710,8 +824,19 @@ merge_repos(GHashTable *merged,
 
         g_debug("Processing: %s", repopath);
 
-        if (cr_metadata_load_xml(metadata, ml, NULL) != CRE_OK) {
-            cr_metadata_free(metadata);
+        if (shared_metadata) {
+            // Repo already loaded (--batch), its packages are only read
+            metadata = g_hash_table_lookup(shared_metadata, ml);
+        } else {
+            metadata = cr_metadata_new(CR_HT_KEY_HASH, 0, NULL);
+            cr_metadata_set_raw_xml(metadata, raw_xml);
+            if (cr_metadata_load_xml(metadata, ml, NULL) != CRE_OK) {
+                cr_metadata_free(metadata);
+                metadata = NULL;
+            }
+        }
+
+        if (!metadata) {
             g_critical("Cannot load repo: \"%s\"", ml->repomd);
             g_free(repopath);
             break;
@@ -719,8 +844,10 @@ merge_repos(GHashTable *merged,
 
 #ifdef WITH_LIBMODULEMD
         if (cr_metadata_modulemd(metadata)) {
+            g_mutex_lock(&modulemd_mutex);
             modulemd_module_index_merger_associate_index (
                 merger, cr_metadata_modulemd (metadata), 0);
+            g_mutex_unlock(&modulemd_mutex);
         }
 #endif /* WITH_LIBMODULEMD */
 
@@ -750,6 +877,9 @@ merge_repos(GHashTable *merged,
             g_debug("Reading metadata for %s (%s-%s.%s)",
                     pkg->name, pkg->version, pkg->release, pkg->arch);
 
+            if (shared_metadata)
+                pkg = merged_package_view(pkg);
+
             // Add package
             ret = add_package(pkg,
                               repopath,
@@ -758,10 +888,23 @@ merge_repos(GHashTable *merged,
                               merge_method,
                               koji_stuff,
                               omit_baseurl,
-                              repoid);
+                              repoid,
+                              shared_metadata != NULL);
+
+            if (ret == 0 && shared_metadata)
+                merged_package_free(pkg, TRUE);
 
             if (ret > 0) {
-                if (!noarch_pkg_used) {
+                // Remember the repo of the package (--merge-databases),
+                // noarch packages are not from the repo
+                if (pkg_sources)
+                    g_hash_table_insert(pkg_sources, pkg,
+                                        noarch_pkg_used ? NULL : ml);
+
+                if (shared_metadata) {
+                    // The view is owned by the merged hashtable now,
+                    // shared packages stay in the shared metadata
+                } else if (!noarch_pkg_used) {
                     // Original package was added
                     // => remove only record from hashtable
                     g_hash_table_iter_steal(&iter);
@@ -792,15 +935,18 @@ merge_repos(GHashTable *merged,
         }
 
         loaded_packages += repo_loaded_packages;
-        cr_metadata_free(metadata);
+        if (!shared_metadata)
+            cr_metadata_free(metadata);
         g_debug("Repo: %s (Loaded: %ld Used: %ld)", repopath,
                 (unsigned long) original_size, repo_loaded_packages);
         g_free(repopath);
     }
 
 #ifdef WITH_LIBMODULEMD
+    g_mutex_lock(&modulemd_mutex);
     g_autoptr(ModulemdModuleIndex) moduleindex =
         modulemd_module_index_merger_resolve (merger, &err);
+    g_mutex_unlock(&modulemd_mutex);
     g_auto (GStrv) module_names =
         modulemd_module_index_get_module_names_as_strv (moduleindex);
 
@@ -858,6 +1004,96 @@ modulemd_write_handler (void          *data,
 }
 #endif /* WITH_LIBMODULEMD */
 
+/** Decompress a sqlite database into a temporary file.
+ * Returns path to the file or NULL.
+ */
+static gchar *
+decompress_db_to_tmp(const char *path, GError **err)
+{
+    gchar *tmp_path = NULL;
+
+    int fd = g_file_open_tmp("mergerepo_db_XXXXXX", &tmp_path, err);
+    if (fd == -1)
+        return NULL;
+    g_close(fd, NULL);
+
+    if (cr_decompress_file(path, tmp_path,
+                           CR_CW_AUTO_DETECT_COMPRESSION, err) != CRE_OK) {
+        g_unlink(tmp_path);
+        g_free(tmp_path);
+        return NULL;
+    }
+
+    return tmp_path;
+}
+
+/** Fill the output databases (--merge-databases). Packages in db_sources
+ * (cr_MetadataLocation -> GSList of packages with already assigned
+ * pkgKeys) are copied from the databases of their repos, the rest
+ * (db_pkgs) is inserted package by package. If copying from a repo
+ * fails, its packages are inserted package by package too.
+ */
+static void
+copy_merged_databases(cr_SqliteDb *pri_db,
+                      cr_SqliteDb *fil_db,
+                      cr_SqliteDb *oth_db,
+                      GHashTable *db_sources,
+                      GSList *db_pkgs)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+    GSList *fallback = NULL;
+
+    g_hash_table_iter_init(&iter, db_sources);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        struct cr_MetadataLocation *ml = key;
+        GSList *pkgs = value;
+        gchar *pri_path = NULL, *fil_path = NULL, *oth_path = NULL;
+        GError *tmp_err = NULL;
+
+        pri_path = decompress_db_to_tmp(ml->pri_sqlite_href, &tmp_err);
+        if (pri_path)
+            fil_path = decompress_db_to_tmp(ml->fil_sqlite_href, &tmp_err);
+        if (fil_path)
+            oth_path = decompress_db_to_tmp(ml->oth_sqlite_href, &tmp_err);
+        if (oth_path)
+            cr_db_copy_pkgs(pri_db, fil_db, oth_db,
+                            pri_path, fil_path, oth_path,
+                            pkgs, &tmp_err);
+
+        if (tmp_err) {
+            g_warning("Cannot copy packages from databases of %s: %s",
+                      ml->original_url, tmp_err->message);
+            g_clear_error(&tmp_err);
+            fallback = g_slist_concat(g_slist_copy(pkgs), fallback);
+        } else {
+            g_debug("%u packages copied from databases of %s",
+                    g_slist_length(pkgs), ml->original_url);
+        }
+
+        if (pri_path) g_unlink(pri_path);
+        if (fil_path) g_unlink(fil_path);
+        if (oth_path) g_unlink(oth_path);
+        g_free(pri_path);
+        g_free(fil_path);
+        g_free(oth_path);
+        g_slist_free(pkgs);
+        g_hash_table_iter_steal(&iter);
+    }
+
+    // Packages which were not copied, their pkgKeys are assigned
+    // by the insert (after the copied ones)
+    db_pkgs = g_slist_concat(fallback, g_slist_copy(db_pkgs));
+    db_pkgs = g_slist_reverse(db_pkgs);
+    for (GSList *elem = db_pkgs; elem; elem = g_slist_next(elem)) {
+        cr_Package *pkg = elem->data;
+        cr_db_add_pkg(pri_db, pkg, NULL);
+        cr_db_add_pkg(fil_db, pkg, NULL);
+        cr_db_add_pkg(oth_db, pkg, NULL);
+    }
+    g_slist_free(db_pkgs);
+}
+
 int
 dump_merged_metadata(GHashTable *merged_hashtable,
                      long packages,
@@ -865,7 +1101,8 @@ dump_merged_metadata(GHashTable *merged_hashtable,
 #ifdef WITH_LIBMODULEMD
                      ModulemdModuleIndex *module_index,
 #endif /* WITH_LIBMODULEMD */
-                     struct CmdOptions *cmd_options)
+                     struct CmdOptions *cmd_options,
+                     GHashTable *pkg_sources)
 {
     GError *tmp_err = NULL;
 
@@ -933,10 +1170,22 @@ dump_merged_metadata(GHashTable *merged_hashtable,
 
     gchar *pri_xml_filename = g_strconcat(cmd_options->tmp_out_repo,
                                           "/primary.xml.gz", NULL);
+    // Seekable framing is implemented by xz blocks
+    cr_CompressionType fil_oth_compression = CR_CW_GZ_COMPRESSION;
+    if (cmd_options->seekable_metadata)
+        fil_oth_compression = CR_CW_XZ_COMPRESSION;
+    const char *fil_oth_suffix = cr_compression_suffix(fil_oth_compression);
+
     gchar *fil_xml_filename = g_strconcat(cmd_options->tmp_out_repo,
-                                          "/filelists.xml.gz", NULL);
+                                          "/filelists.xml", fil_oth_suffix,
+                                          NULL);
     gchar *oth_xml_filename = g_strconcat(cmd_options->tmp_out_repo,
-                                          "/other.xml.gz", NULL);
+                                          "/other.xml", fil_oth_suffix,
+                                          NULL);
+    gchar *fil_index_filename = NULL;
+    gchar *oth_index_filename = NULL;
+    cr_ContentStat *fil_index_stat = NULL;
+    cr_ContentStat *oth_index_stat = NULL;
 
     gchar *update_info_filename = NULL;
     if (!cmd_options->noupdateinfo)
@@ -969,7 +1218,7 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     }
 
     fil_f = cr_xmlfile_sopen_filelists(fil_xml_filename,
-                                       CR_CW_GZ_COMPRESSION,
+                                       fil_oth_compression,
                                        fil_stat,
                                        &tmp_err);
     if (tmp_err) {
@@ -993,7 +1242,7 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     }
 
     oth_f = cr_xmlfile_sopen_other(oth_xml_filename,
-                                   CR_CW_GZ_COMPRESSION,
+                                   fil_oth_compression,
                                    oth_stat,
                                    &tmp_err);
     if (tmp_err) {
@@ -1018,6 +1267,40 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     }
 
 
+    if (cmd_options->rsyncable) {
+        cr_set_rsyncable(pri_f->f, TRUE, NULL);
+        cr_set_rsyncable(fil_f->f, TRUE, NULL);
+        cr_set_rsyncable(oth_f->f, TRUE, NULL);
+    }
+
+    // Chunks are compressed in large blocks
+    cr_xmlfile_set_buffer_size(pri_f, CR_XMLFILE_DEFAULT_BUFFER_SIZE, NULL);
+    cr_xmlfile_set_buffer_size(fil_f, CR_XMLFILE_DEFAULT_BUFFER_SIZE, NULL);
+    cr_xmlfile_set_buffer_size(oth_f, CR_XMLFILE_DEFAULT_BUFFER_SIZE, NULL);
+
+    if (cmd_options->seekable_metadata) {
+        fil_index_filename = g_strconcat(cmd_options->tmp_out_repo,
+                                         "/filelists_index.txt",
+                                         fil_oth_suffix, NULL);
+        oth_index_filename = g_strconcat(cmd_options->tmp_out_repo,
+                                         "/other_index.txt",
+                                         fil_oth_suffix, NULL);
+        fil_index_stat = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
+        oth_index_stat = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
+
+        cr_xmlfile_set_seekable(fil_f, fil_index_filename,
+                                fil_oth_compression, fil_index_stat, &tmp_err);
+        if (!tmp_err)
+            cr_xmlfile_set_seekable(oth_f, oth_index_filename,
+                                    fil_oth_compression, oth_index_stat,
+                                    &tmp_err);
+        if (tmp_err) {
+            g_critical("Cannot write seekable metadata: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     cr_xmlfile_set_num_of_pkgs(pri_f, packages, NULL);
     cr_xmlfile_set_num_of_pkgs(fil_f, packages, NULL);
     cr_xmlfile_set_num_of_pkgs(oth_f, packages, NULL);
@@ -1152,17 +1435,27 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     keys = g_list_sort(keys, (GCompareFunc) g_strcmp0);
 
     char *prev_srpm = NULL;
+    gint64 db_pkgkey = 0;
+    GHashTable *db_sources = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GSList *db_pkgs = NULL;
 
     for (key = keys; key; key = g_list_next(key)) {
         gpointer value = g_hash_table_lookup(merged_hashtable, key->data);
         GSList *element = (GSList *) value;
         element = g_slist_sort(element, package_cmp);
+        // Store the sorted list, its head may have changed and the whole
+        // list must be freed with the hashtable
+        g_hash_table_steal(merged_hashtable, key->data);
+        g_hash_table_insert(merged_hashtable, key->data, element);
         for (; element; element=g_slist_next(element)) {
             struct cr_XmlStruct res;
             cr_Package *pkg;
 
             pkg = (cr_Package *) element->data;
-            res = cr_xml_dump(pkg, NULL);
+            if (cmd_options->regenerate_xml)
+                res = cr_xml_dump(pkg, NULL);
+            else
+                res = cr_xml_dump_raw(pkg, NULL);
 
             g_debug("Writing metadata for %s (%s-%s.%s)",
                     pkg->name, pkg->version, pkg->release, pkg->arch);
@@ -1171,9 +1464,9 @@ dump_merged_metadata(GHashTable *merged_hashtable,
                (!prev_srpm || !pkg->rpm_sourcerpm ||
                 strlen(prev_srpm) != strlen(pkg->rpm_sourcerpm) ||
                 strncmp(pkg->rpm_sourcerpm, prev_srpm, strlen(prev_srpm)) != 0)) {
-                cr_end_chunk(pri_cr_zck->f, NULL);
-                cr_end_chunk(fil_cr_zck->f, NULL);
-                cr_end_chunk(oth_cr_zck->f, NULL);
+                cr_xmlfile_end_chunk(pri_cr_zck, NULL);
+                cr_xmlfile_end_chunk(fil_cr_zck, NULL);
+                cr_xmlfile_end_chunk(oth_cr_zck, NULL);
                 g_free(prev_srpm);
                 if (pkg->rpm_sourcerpm)
                     prev_srpm = g_strdup(pkg->rpm_sourcerpm);
@@ -1181,8 +1474,10 @@ dump_merged_metadata(GHashTable *merged_hashtable,
                     prev_srpm = NULL;
             }
             cr_xmlfile_add_chunk(pri_f, (const char *) res.primary, NULL);
-            cr_xmlfile_add_chunk(fil_f, (const char *) res.filelists, NULL);
-            cr_xmlfile_add_chunk(oth_f, (const char *) res.other, NULL);
+            cr_xmlfile_add_indexed_chunk(fil_f, pkg->pkgId,
+                                         (const char *) res.filelists, NULL);
+            cr_xmlfile_add_indexed_chunk(oth_f, pkg->pkgId,
+                                         (const char *) res.other, NULL);
             if (cmd_options->zck_compression) {
                 cr_xmlfile_add_chunk(pri_cr_zck, (const char *) res.primary, NULL);
                 cr_xmlfile_add_chunk(fil_cr_zck, (const char *) res.filelists, NULL);
@@ -1190,9 +1485,26 @@ dump_merged_metadata(GHashTable *merged_hashtable,
             }
 
             if (!cmd_options->no_database) {
-                cr_db_add_pkg(pri_db, pkg, NULL);
-                cr_db_add_pkg(fil_db, pkg, NULL);
-                cr_db_add_pkg(oth_db, pkg, NULL);
+                struct cr_MetadataLocation *ml = NULL;
+                if (pkg_sources)
+                    ml = g_hash_table_lookup(pkg_sources, pkg);
+
+                if (ml && ml->pri_sqlite_href && ml->fil_sqlite_href
+                    && ml->oth_sqlite_href) {
+                    // Copied from the databases of the repo later
+                    pkg->pkgKey = ++db_pkgkey;
+                    GSList *list = g_hash_table_lookup(db_sources, ml);
+                    g_hash_table_insert(db_sources, ml,
+                                        g_slist_prepend(list, pkg));
+                } else if (pkg_sources) {
+                    // Inserted after the copied packages (their pkgKeys
+                    // are already assigned)
+                    db_pkgs = g_slist_prepend(db_pkgs, pkg);
+                } else {
+                    cr_db_add_pkg(pri_db, pkg, NULL);
+                    cr_db_add_pkg(fil_db, pkg, NULL);
+                    cr_db_add_pkg(oth_db, pkg, NULL);
+                }
             }
 
             free(res.primary);
@@ -1203,6 +1515,11 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     g_free(prev_srpm);
     g_list_free(keys);
 
+    if (!cmd_options->no_database && pkg_sources)
+        copy_merged_databases(pri_db, fil_db, oth_db, db_sources, db_pkgs);
+    g_hash_table_destroy(db_sources);
+    g_slist_free(db_pkgs);
+
 
     // Close files
 
@@ -1289,6 +1606,8 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     cr_RepomdRecord *update_info_zck_rec      = NULL;
     cr_RepomdRecord *pkgorigins_rec           = NULL;
     cr_RepomdRecord *pkgorigins_zck_rec       = NULL;
+    cr_RepomdRecord *fil_index_rec            = NULL;
+    cr_RepomdRecord *oth_index_rec            = NULL;
 
 #ifdef WITH_LIBMODULEMD
     cr_RepomdRecord *modulemd_rec = NULL;
@@ -1311,6 +1630,19 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     cr_contentstat_free(fil_stat, NULL);
     cr_contentstat_free(oth_stat, NULL);
 
+    // Package indexes
+
+    if (cmd_options->seekable_metadata) {
+        fil_index_rec = cr_repomd_record_new("filelists_index", fil_index_filename);
+        oth_index_rec = cr_repomd_record_new("other_index", oth_index_filename);
+        cr_repomd_record_load_contentstat(fil_index_rec, fil_index_stat);
+        cr_repomd_record_load_contentstat(oth_index_rec, oth_index_stat);
+        cr_repomd_record_fill(fil_index_rec, CR_CHECKSUM_SHA256, NULL);
+        cr_repomd_record_fill(oth_index_rec, CR_CHECKSUM_SHA256, NULL);
+    }
+    cr_contentstat_free(fil_index_stat, NULL);
+    cr_contentstat_free(oth_index_stat, NULL);
+
     GThreadPool *fill_pool = g_thread_pool_new(cr_repomd_record_fill_thread,
                                                NULL, 3, FALSE, NULL);
 
@@ -1587,6 +1919,8 @@ dump_merged_metadata(GHashTable *merged_hashtable,
         cr_repomd_record_rename_file(pri_zck_rec, NULL);
         cr_repomd_record_rename_file(fil_zck_rec, NULL);
         cr_repomd_record_rename_file(oth_zck_rec, NULL);
+        cr_repomd_record_rename_file(fil_index_rec, NULL);
+        cr_repomd_record_rename_file(oth_index_rec, NULL);
         cr_repomd_record_rename_file(groupfile_rec, NULL);
         cr_repomd_record_rename_file(compressed_groupfile_rec, NULL);
         cr_repomd_record_rename_file(groupfile_zck_rec, NULL);
@@ -1614,6 +1948,8 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     cr_repomd_set_record(repomd_obj, pri_zck_rec);
     cr_repomd_set_record(repomd_obj, fil_zck_rec);
     cr_repomd_set_record(repomd_obj, oth_zck_rec);
+    cr_repomd_set_record(repomd_obj, fil_index_rec);
+    cr_repomd_set_record(repomd_obj, oth_index_rec);
     cr_repomd_set_record(repomd_obj, groupfile_rec);
     cr_repomd_set_record(repomd_obj, compressed_groupfile_rec);
     cr_repomd_set_record(repomd_obj, groupfile_zck_rec);
@@ -1714,6 +2050,8 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     g_free(pri_xml_filename);
     g_free(fil_xml_filename);
     g_free(oth_xml_filename);
+    g_free(fil_index_filename);
+    g_free(oth_index_filename);
     g_free(update_info_filename);
 
 
@@ -1722,93 +2060,168 @@ dump_merged_metadata(GHashTable *merged_hashtable,
 
 
 
-int
-main(int argc, char **argv)
+// Parse one line of the --batch manifest (mergerepo_c arguments) into
+// new options of the job
+static struct CmdOptions *
+parse_job_arguments(const gchar *line, GError **err)
 {
-    _cleanup_error_free_ GError *tmp_err = NULL;
+    gchar **argv = NULL;
+    gchar *cmdline = g_strconcat("mergerepo_c ", line, NULL);
+    struct CmdOptions *options = g_new(struct CmdOptions, 1);
+    GOptionEntry *entries;
+    GOptionContext *context;
+    gboolean ret;
 
-    // Parse arguments
+    *options = (struct CmdOptions) CMD_OPTIONS_DEFAULTS;
 
-    struct CmdOptions *cmd_options;
-    cmd_options = parse_arguments(&argc, &argv);
-    if (!cmd_options) {
-        return 1;
+    ret = g_shell_parse_argv(cmdline, NULL, &argv, err);
+    g_free(cmdline);
+    if (!ret) {
+        g_free(options);
+        return NULL;
     }
 
+    // Entries which store the values into the options of the job
+    // instead of the global _cmd_options
+    entries = g_new(GOptionEntry, G_N_ELEMENTS(cmd_entries));
+    memcpy(entries, cmd_entries, sizeof(cmd_entries));
+    for (gsize x = 0; x < G_N_ELEMENTS(cmd_entries); x++)
+        if (entries[x].arg_data)
+            entries[x].arg_data = (char *) options
+                + ((char *) entries[x].arg_data - (char *) &_cmd_options);
+
+    context = g_option_context_new(NULL);
+    g_option_context_set_help_enabled(context, FALSE);
+    g_option_context_add_main_entries(context, entries, NULL);
+    ret = g_option_context_parse_strv(context, &argv, err);
+    g_option_context_free(context);
+    g_free(entries);
 
-    // Set logging
-
-    cr_setup_logging(FALSE, cmd_options->verbose);
+    if (ret && g_strv_length(argv) > 1) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Unexpected argument: %s", argv[1]);
+        ret = FALSE;
+    }
 
+    if (ret && (options->version || options->batch || options->batch_workers)) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "--version, --batch and --batch-workers cannot be used "
+                    "in a batch job");
+        ret = FALSE;
+    }
 
-    // Check arguments
+    // Repos are located and loaded once for all the jobs, so these
+    // must be the same for the whole batch
+    if (ret && (options->merge_databases || options->parallel_fetch
+                || options->regenerate_xml)) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "--merge-databases, --parallel-fetch and --regenerate-xml "
+                    "cannot be used in a batch job, use them on the command "
+                    "line");
+        ret = FALSE;
+    }
 
-    if (!check_arguments(cmd_options)) {
-        free_options(cmd_options);
-        return 1;
+    if (ret && !check_arguments(options)) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG, "Bad arguments");
+        ret = FALSE;
     }
 
-    if (cmd_options->version) {
-        printf("Version: %s\n", cr_version_string_with_features());
-        free_options(cmd_options);
-        exit(0);
+    if (ret && !options->repo_list) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG, "No repo to merge");
+        ret = FALSE;
     }
 
-    if (g_slist_length(cmd_options->repo_list) < 1) {
-        free_options(cmd_options);
-        g_printerr("Usage: %s [OPTION...] --repo=url --repo=url\n\n"
-                   "%s: take 2 or more repositories and merge their "
-                   "metadata into a new repo\n\n",
-                   cr_get_filename(argv[0]), cr_get_filename(argv[0]));
-        return 1;
+    g_strfreev(argv);
+
+    if (!ret) {
+        free_options(options);
+        g_free(options);
+        return NULL;
     }
 
-    g_debug("Version: %s", cr_version_string_with_features());
+    return options;
+}
+
 
-    // Prepare out_repo
 
+// Create the temporary output repodata directory
+static gboolean
+prepare_tmp_out_repo(struct CmdOptions *cmd_options)
+{
     if (g_file_test(cmd_options->tmp_out_repo, G_FILE_TEST_EXISTS)) {
         g_critical("Temporary repodata directory: %s already exists! ("
                     "Another createrepo process is running?)", cmd_options->tmp_out_repo);
-        free_options(cmd_options);
-        return 1;
+        return FALSE;
     }
 
     if (g_mkdir_with_parents (cmd_options->tmp_out_repo, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)) {
         g_critical("Error while creating temporary repodata directory %s: %s",
                     cmd_options->tmp_out_repo, g_strerror(errno));
-
-        free_options(cmd_options);
-        return 1;
+        return FALSE;
     }
 
+    return TRUE;
+}
 
-    // Download repos
 
-    GSList *local_repos = NULL;
-    GSList *element = NULL;
-    gchar *groupfile = NULL;
-    gboolean cr_download_failed = FALSE;
 
-    for (element = cmd_options->repo_list; element; element = g_slist_next(element)) {
-        struct cr_MetadataLocation *loc = cr_locate_metadata((gchar *) element->data, TRUE, NULL);
-        if (!loc) {
-            g_warning("Downloading of repodata failed: %s", (gchar *) element->data);
-            cr_download_failed = TRUE;
-            break;
-        }
-        local_repos = g_slist_prepend(local_repos, loc);
+// Load the repo of --noarch-repo
+static cr_Metadata *
+load_noarch_repo(struct cr_MetadataLocation *noarch_ml, gboolean raw_xml)
+{
+    cr_Metadata *noarch_metadata;
+    // cr_metadata_hashtable(noarch_metadata):
+    //   Key: CR_HT_KEY_FILENAME aka pkg->location_href
+    //   Value: package
+
+    noarch_metadata = cr_metadata_new(CR_HT_KEY_FILENAME, 0, NULL);
+    cr_metadata_set_raw_xml(noarch_metadata, raw_xml);
+
+    // Base paths in output of original createrepo doesn't have trailing '/'
+    gchar *noarch_repopath = cr_normalize_dir_path(noarch_ml->original_url);
+    if (noarch_repopath && strlen(noarch_repopath) > 1) {
+        noarch_repopath[strlen(noarch_repopath)-1] = '\0';
     }
 
-    if (cr_download_failed) {
-        // Remove downloaded metadata and free structures
-        for (element = local_repos; element; element = g_slist_next(element)) {
-            struct cr_MetadataLocation *loc = (struct cr_MetadataLocation  *) element->data;
-            cr_metadatalocation_free(loc);
-        }
-        return 1;
+    g_debug("Loading noarch_repo: %s", noarch_repopath);
+
+    if (cr_metadata_load_xml(noarch_metadata, noarch_ml, NULL) != CRE_OK) {
+        g_critical("Cannot load noarch repo: \"%s\"", noarch_ml->repomd);
+        cr_metadata_free(noarch_metadata);
+        g_free(noarch_repopath);
+        return NULL;
     }
 
+    // Fill basepath - set proper base path for all packages in noarch hastable
+    GHashTableIter iter;
+    gpointer p_key, p_value;
+
+    g_hash_table_iter_init (&iter, cr_metadata_hashtable(noarch_metadata));
+    while (g_hash_table_iter_next (&iter, &p_key, &p_value)) {
+        cr_Package *pkg = (cr_Package *) p_value;
+        if (!pkg->location_base)
+            pkg->location_base = g_string_chunk_insert(pkg->chunk,
+                                                       noarch_repopath);
+    }
+
+    g_free(noarch_repopath);
+    return noarch_metadata;
+}
+
+
+
+// Merge the repos and dump the merged metadata into the (already created)
+// temporary output repodata directory. Packages of the shared_metadata
+// (loaded once for all jobs of --batch) are not modified.
+static int
+merge_and_dump(struct CmdOptions *cmd_options,
+               GSList *local_repos,
+               cr_Metadata *noarch_metadata,
+               GHashTable *shared_metadata)
+{
+    _cleanup_error_free_ GError *tmp_err = NULL;
+    GSList *element = NULL;
+    gchar *groupfile = NULL;
 
     // Groupfile
     // XXX: There must be a better logic
@@ -1851,56 +2264,6 @@ main(int argc, char **argv)
         }
     }
 
-    // Load noarch repo
-
-    cr_Metadata *noarch_metadata = NULL;
-    // cr_metadata_hashtable(noarch_metadata):
-    //   Key: CR_HT_KEY_FILENAME aka pkg->location_href
-    //   Value: package
-
-    if (cmd_options->noarch_repo_url) {
-        struct cr_MetadataLocation *noarch_ml;
-
-        noarch_ml = cr_locate_metadata(cmd_options->noarch_repo_url, TRUE, NULL);
-        if (!noarch_ml) {
-            g_critical("Cannot locate noarch repo: %s", cmd_options->noarch_repo_url);
-            return 1;
-        }
-
-        noarch_metadata = cr_metadata_new(CR_HT_KEY_FILENAME, 0, NULL);
-
-        // Base paths in output of original createrepo doesn't have trailing '/'
-        gchar *noarch_repopath = cr_normalize_dir_path(noarch_ml->original_url);
-        if (noarch_repopath && strlen(noarch_repopath) > 1) {
-            noarch_repopath[strlen(noarch_repopath)-1] = '\0';
-        }
-
-        g_debug("Loading noarch_repo: %s", noarch_repopath);
-
-        if (cr_metadata_load_xml(noarch_metadata, noarch_ml, NULL) != CRE_OK) {
-            g_critical("Cannot load noarch repo: \"%s\"", noarch_ml->repomd);
-            cr_metadata_free(noarch_metadata);
-            // TODO cleanup
-            cr_metadatalocation_free(noarch_ml);
-            return 1;
-        }
-
-        // Fill basepath - set proper base path for all packages in noarch hastable
-        GHashTableIter iter;
-        gpointer p_key, p_value;
-
-        g_hash_table_iter_init (&iter, cr_metadata_hashtable(noarch_metadata));
-        while (g_hash_table_iter_next (&iter, &p_key, &p_value)) {
-            cr_Package *pkg = (cr_Package *) p_value;
-            if (!pkg->location_base)
-                pkg->location_base = g_string_chunk_insert(pkg->chunk,
-                                                           noarch_repopath);
-        }
-
-        g_free(noarch_repopath);
-        cr_metadatalocation_free(noarch_ml);
-    }
-
 
     // Prepare Koji stuff if needed
 
@@ -1914,10 +2277,16 @@ main(int argc, char **argv)
     // Load metadata
 
     long loaded_packages;
-    GHashTable *merged_hashtable = new_merged_metadata_hashtable();
+    GHashTable *merged_hashtable = new_merged_metadata_hashtable(shared_metadata != NULL);
     // merged_hashtable:
     //   Key: pkg->name
     //   Value: GSList with packages with the same name
+    GHashTable *pkg_sources = NULL;
+    // pkg_sources (--merge-databases):
+    //   Key: package in merged_hashtable
+    //   Value: cr_MetadataLocation of its repo or NULL
+    if (cmd_options->merge_databases && !cmd_options->no_database)
+        pkg_sources = g_hash_table_new(g_direct_hash, g_direct_equal);
 #ifdef WITH_LIBMODULEMD
     g_autoptr(ModulemdModuleIndex) merged_index = NULL;
 #endif
@@ -1935,7 +2304,10 @@ main(int argc, char **argv)
                                   koji_stuff,
                                   cmd_options->omit_baseurl,
                                   cmd_options->repo_prefix_search,
-                                  cmd_options->repo_prefix_replace
+                                  cmd_options->repo_prefix_replace,
+                                  shared_metadata,
+                                  !cmd_options->regenerate_xml,
+                                  pkg_sources
                                  );
 
 
@@ -1952,7 +2324,443 @@ main(int argc, char **argv)
 #ifdef WITH_LIBMODULEMD
                          merged_index,
 #endif
-                         cmd_options);
+                         cmd_options,
+                         pkg_sources);
+
+    g_free(groupfile);
+    destroy_merged_metadata_hashtable(merged_hashtable);
+    if (pkg_sources)
+        g_hash_table_destroy(pkg_sources);
+
+    return 0;
+}
+
+
+
+// Input repo of --batch, located and loaded only once
+typedef struct {
+    gchar *url;                         // Url as used by the jobs
+    gboolean noarch;                    // Repo of --noarch-repo
+    struct cr_MetadataLocation *ml;     // Location of the repodata
+    cr_Metadata *metadata;              // Loaded metadata (read only)
+} SharedRepo;
+
+// Job from the --batch manifest
+typedef struct {
+    int lineno;                         // Line of the manifest
+    struct CmdOptions *options;         // Options of the job
+    int ret;                            // Return code of the job
+} MergeJob;
+
+typedef struct {
+    GHashTable *repos;          // Normalized url -> SharedRepo
+    GHashTable *noarch_repos;   // --noarch-repo url -> SharedRepo
+    GHashTable *metadata;       // struct cr_MetadataLocation * -> cr_Metadata *
+} SharedRepos;
+
+
+
+static void
+shared_repo_free(SharedRepo *repo)
+{
+    if (!repo)
+        return;
+    cr_metadata_free(repo->metadata);
+    cr_metadatalocation_free(repo->ml);
+    g_free(repo->url);
+    g_free(repo);
+}
+
+
+
+// Locate (and download) the repo if it is not used by a previous job
+static gboolean
+shared_repo_locate(GHashTable *repos,
+                   const gchar *url,
+                   gboolean noarch,
+                   gboolean ignore_sqlite,
+                   gboolean parallel_fetch)
+{
+    SharedRepo *repo;
+
+    if (g_hash_table_contains(repos, url))
+        return TRUE;
+
+    repo = g_new0(SharedRepo, 1);
+    repo->url = g_strdup(url);
+    repo->noarch = noarch;
+    repo->ml = cr_locate_metadata_stream(url, ignore_sqlite, parallel_fetch,
+                                         NULL);
+    g_hash_table_insert(repos, repo->url, repo);
+
+    if (!repo->ml) {
+        g_critical("Cannot locate repo: %s", url);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+
+static void
+shared_repo_load_thread(gpointer data, gpointer user_data)
+{
+    SharedRepo *repo = data;
+    struct CmdOptions *cmd_options = user_data;
+
+    if (repo->noarch) {
+        repo->metadata = load_noarch_repo(repo->ml, !cmd_options->regenerate_xml);
+        return;
+    }
+
+    g_debug("Loading: %s", repo->url);
+    repo->metadata = cr_metadata_new(CR_HT_KEY_HASH, 0, NULL);
+    cr_metadata_set_raw_xml(repo->metadata, !cmd_options->regenerate_xml);
+    if (cr_metadata_load_xml(repo->metadata, repo->ml, NULL) != CRE_OK) {
+        g_critical("Cannot load repo: \"%s\"", repo->ml->repomd);
+        cr_metadata_free(repo->metadata);
+        repo->metadata = NULL;
+    }
+}
+
+
+
+static void
+merge_job_thread(gpointer data, gpointer user_data)
+{
+    MergeJob *job = data;
+    SharedRepos *shared = user_data;
+    struct CmdOptions *options = job->options;
+    GSList *local_repos = NULL;
+    cr_Metadata *noarch_metadata = NULL;
+
+    g_debug("Job from line %d: merging into %s", job->lineno, options->out_dir);
+
+    if (!prepare_tmp_out_repo(options)) {
+        job->ret = 1;
+        return;
+    }
+
+    // Same order of repos as without --batch
+    for (GSList *elem = options->repo_list; elem; elem = g_slist_next(elem)) {
+        SharedRepo *repo = g_hash_table_lookup(shared->repos, elem->data);
+        local_repos = g_slist_prepend(local_repos, repo->ml);
+    }
+
+    if (options->noarch_repo_url) {
+        SharedRepo *repo = g_hash_table_lookup(shared->noarch_repos,
+                                               options->noarch_repo_url);
+        noarch_metadata = repo->metadata;
+    }
+
+    job->ret = merge_and_dump(options, local_repos, noarch_metadata,
+                              shared->metadata);
+    g_slist_free(local_repos);
+}
+
+
+
+// Run all jobs from the --batch manifest. Every distinct input repo
+// is parsed once into metadata which are shared (read only) by the jobs.
+static int
+run_batch(struct CmdOptions *cmd_options)
+{
+    _cleanup_error_free_ GError *tmp_err = NULL;
+    gchar *content = NULL;
+    gchar **lines;
+    GPtrArray *jobs;
+    GHashTable *out_dirs;
+    GHashTableIter iter;
+    gpointer value;
+    GThreadPool *pool;
+    SharedRepos shared;
+    GTimer *timer;
+    int workers = cmd_options->batch_workers;
+    int ret = 0;
+
+    if (!workers)
+        workers = g_get_num_processors();
+
+    if (!g_file_get_contents(cmd_options->batch, &content, NULL, &tmp_err)) {
+        g_critical("Cannot read %s: %s", cmd_options->batch, tmp_err->message);
+        return 1;
+    }
+
+
+    // Parse the jobs
+
+    jobs = g_ptr_array_new();
+    out_dirs = g_hash_table_new(g_str_hash, g_str_equal);
+    lines = g_strsplit(content, "\n", -1);
+    g_free(content);
+
+    for (int x = 0; lines[x] && !ret; x++) {
+        gchar *line = g_strstrip(lines[x]);
+        struct CmdOptions *options;
+        MergeJob *job;
+
+        if (*line == '\0' || *line == '#')
+            continue;
+
+        options = parse_job_arguments(line, &tmp_err);
+        if (!options) {
+            g_critical("%s:%d: %s", cmd_options->batch, x+1, tmp_err->message);
+            ret = 1;
+            break;
+        }
+
+        options->merge_databases = cmd_options->merge_databases;
+        options->parallel_fetch = cmd_options->parallel_fetch;
+        options->regenerate_xml = cmd_options->regenerate_xml;
+
+        job = g_new0(MergeJob, 1);
+        job->lineno = x+1;
+        job->options = options;
+        g_ptr_array_add(jobs, job);
+
+        if (g_hash_table_contains(out_dirs, options->out_dir)) {
+            g_critical("%s:%d: Output directory %s is used by another job",
+                       cmd_options->batch, x+1, options->out_dir);
+            ret = 1;
+        }
+        g_hash_table_add(out_dirs, options->out_dir);
+    }
+
+    g_strfreev(lines);
+    g_hash_table_destroy(out_dirs);
+
+    if (!ret && jobs->len == 0) {
+        g_critical("No jobs in %s", cmd_options->batch);
+        ret = 1;
+    }
+
+
+    // Locate (download) every distinct repo
+
+    shared.repos = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                         (GDestroyNotify) shared_repo_free);
+    shared.noarch_repos = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                                (GDestroyNotify) shared_repo_free);
+    shared.metadata = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    for (guint x = 0; x < jobs->len && !ret; x++) {
+        struct CmdOptions *options = ((MergeJob *) jobs->pdata[x])->options;
+
+        for (GSList *elem = options->repo_list; elem; elem = g_slist_next(elem))
+            if (!shared_repo_locate(shared.repos, elem->data, FALSE,
+                                    !cmd_options->merge_databases,
+                                    cmd_options->parallel_fetch))
+                ret = 1;
+
+        if (options->noarch_repo_url
+            && !shared_repo_locate(shared.noarch_repos,
+                                   options->noarch_repo_url, TRUE, TRUE,
+                                   cmd_options->parallel_fetch))
+            ret = 1;
+    }
+
+
+    // Load the repos
+
+    timer = g_timer_new();
+
+    if (!ret) {
+        pool = g_thread_pool_new(shared_repo_load_thread, cmd_options, workers,
+                                 TRUE, NULL);
+        g_hash_table_iter_init(&iter, shared.repos);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+            g_thread_pool_push(pool, value, NULL);
+        g_hash_table_iter_init(&iter, shared.noarch_repos);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+            g_thread_pool_push(pool, value, NULL);
+        g_thread_pool_free(pool, FALSE, TRUE);
+
+        g_hash_table_iter_init(&iter, shared.repos);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            SharedRepo *repo = value;
+            if (!repo->metadata)
+                ret = 1;
+            g_hash_table_insert(shared.metadata, repo->ml, repo->metadata);
+        }
+        g_hash_table_iter_init(&iter, shared.noarch_repos);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+            if (!((SharedRepo *) value)->metadata)
+                ret = 1;
+
+        g_debug("Batch: %u repos loaded in %.2f s",
+                g_hash_table_size(shared.repos)
+                    + g_hash_table_size(shared.noarch_repos),
+                g_timer_elapsed(timer, NULL));
+    }
+
+
+    // Run the jobs
+
+    if (!ret) {
+        g_timer_start(timer);
+        pool = g_thread_pool_new(merge_job_thread, &shared, workers,
+                                 TRUE, NULL);
+        for (guint x = 0; x < jobs->len; x++)
+            g_thread_pool_push(pool, jobs->pdata[x], NULL);
+        g_thread_pool_free(pool, FALSE, TRUE);
+
+        for (guint x = 0; x < jobs->len; x++) {
+            MergeJob *job = jobs->pdata[x];
+            if (job->ret) {
+                g_critical("%s:%d: Merge into %s failed", cmd_options->batch,
+                           job->lineno, job->options->out_dir);
+                ret = 1;
+            }
+        }
+
+        g_debug("Batch: %u jobs done in %.2f s", jobs->len,
+                g_timer_elapsed(timer, NULL));
+    }
+
+
+    // Cleanup
+
+    g_timer_destroy(timer);
+    g_hash_table_destroy(shared.metadata);
+    g_hash_table_destroy(shared.repos);
+    g_hash_table_destroy(shared.noarch_repos);
+
+    for (guint x = 0; x < jobs->len; x++) {
+        MergeJob *job = jobs->pdata[x];
+        free_options(job->options);
+        g_free(job->options);
+        g_free(job);
+    }
+    g_ptr_array_free(jobs, TRUE);
+
+    return ret;
+}
+
+
+
+int
+main(int argc, char **argv)
+{
+    _cleanup_error_free_ GError *tmp_err = NULL;
+
+    // Parse arguments
+
+    struct CmdOptions *cmd_options;
+    cmd_options = parse_arguments(&argc, &argv);
+    if (!cmd_options) {
+        return 1;
+    }
+
+
+    // Set logging
+
+    cr_setup_logging(FALSE, cmd_options->verbose);
+
+
+    // Check arguments
+
+    if (!check_arguments(cmd_options)) {
+        free_options(cmd_options);
+        return 1;
+    }
+
+    if (cmd_options->version) {
+        printf("Version: %s\n", cr_version_string_with_features());
+        free_options(cmd_options);
+        exit(0);
+    }
+
+    if (!cmd_options->batch && g_slist_length(cmd_options->repo_list) < 1) {
+        free_options(cmd_options);
+        g_printerr("Usage: %s [OPTION...] --repo=url --repo=url\n\n"
+                   "%s: take 2 or more repositories and merge their "
+                   "metadata into a new repo\n\n",
+                   cr_get_filename(argv[0]), cr_get_filename(argv[0]));
+        return 1;
+    }
+
+    g_debug("Version: %s", cr_version_string_with_features());
+
+    // Set allocator for libxml2
+
+    if (!cr_allocator_setup(cmd_options->xml_allocator_type, &tmp_err)) {
+        g_critical("%s", tmp_err->message);
+        free_options(cmd_options);
+        return 1;
+    }
+
+    // Run merge jobs from a manifest
+
+    if (cmd_options->batch) {
+        int ret = run_batch(cmd_options);
+        free_options(cmd_options);
+        cr_allocator_log_stats(NULL);
+        cr_allocator_cleanup();
+        return ret;
+    }
+
+    // Prepare out_repo
+
+    if (!prepare_tmp_out_repo(cmd_options)) {
+        free_options(cmd_options);
+        return 1;
+    }
+
+
+    // Download repos
+
+    GSList *local_repos = NULL;
+    GSList *element = NULL;
+    gboolean cr_download_failed = FALSE;
+
+    for (element = cmd_options->repo_list; element; element = g_slist_next(element)) {
+        // Databases are needed only by --merge-databases
+        struct cr_MetadataLocation *loc = cr_locate_metadata_stream((gchar *) element->data,
+                                                                    !cmd_options->merge_databases,
+                                                                    cmd_options->parallel_fetch, NULL);
+        if (!loc) {
+            g_warning("Downloading of repodata failed: %s", (gchar *) element->data);
+            cr_download_failed = TRUE;
+            break;
+        }
+        local_repos = g_slist_prepend(local_repos, loc);
+    }
+
+    if (cr_download_failed) {
+        // Remove downloaded metadata and free structures
+        for (element = local_repos; element; element = g_slist_next(element)) {
+            struct cr_MetadataLocation *loc = (struct cr_MetadataLocation  *) element->data;
+            cr_metadatalocation_free(loc);
+        }
+        return 1;
+    }
+
+
+    // Load noarch repo
+
+    cr_Metadata *noarch_metadata = NULL;
+
+    if (cmd_options->noarch_repo_url) {
+        struct cr_MetadataLocation *noarch_ml;
+
+        noarch_ml = cr_locate_metadata_stream(cmd_options->noarch_repo_url, TRUE,
+                                              cmd_options->parallel_fetch, NULL);
+        if (!noarch_ml) {
+            g_critical("Cannot locate noarch repo: %s", cmd_options->noarch_repo_url);
+            return 1;
+        }
+
+        noarch_metadata = load_noarch_repo(noarch_ml, !cmd_options->regenerate_xml);
+        cr_metadatalocation_free(noarch_ml);
+        if (!noarch_metadata)
+            return 1;
+    }
+
+
+    // Merge and dump metadata
+
+    int ret = merge_and_dump(cmd_options, local_repos, noarch_metadata, NULL);
 
 
     // Remove downloaded repos and free repo location structures
@@ -1966,9 +2774,11 @@ main(int argc, char **argv)
 
     // Cleanup
 
-    g_free(groupfile);
     cr_metadata_free(noarch_metadata);
-    destroy_merged_metadata_hashtable(merged_hashtable);
     free_options(cmd_options);
-    return 0;
+
+    cr_allocator_log_stats(NULL);
+    cr_allocator_cleanup();
+
+    return ret;
 }
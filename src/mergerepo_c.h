@@ -25,6 +25,7 @@
 extern "C" {
 #endif
 
+#include "allocator.h"
 #include "compression_wrapper.h"
 
 #define DEFAULT_DB_COMPRESSION_TYPE             CR_CW_BZ2_COMPRESSION
@@ -57,6 +58,8 @@ struct CmdOptions {
     gboolean nogroups;
     gboolean noupdateinfo;
     char *compress_type;
+    gboolean rsyncable;
+    gboolean seekable_metadata;
     gboolean zck_compression;
     char *zck_dict_dir;
     char *merge_method_str;
@@ -65,6 +68,12 @@ struct CmdOptions {
     gboolean unique_md_filenames;
     gboolean simple_md_filenames;
     gboolean omit_baseurl;
+    gboolean regenerate_xml;
+    gboolean merge_databases;
+    char *xml_allocator;
+    gboolean parallel_fetch;
+    char *batch;
+    int batch_workers;
 
     // Koji mergerepos specific options
     gboolean koji;
@@ -84,6 +93,7 @@ struct CmdOptions {
     cr_CompressionType db_compression_type;
     cr_CompressionType groupfile_compression_type;
     MergeMethod merge_method;
+    cr_AllocatorType xml_allocator_type;
 };
 
 #ifdef __cplusplus
@@ -937,6 +937,116 @@ cr_str_to_version(const char *str)
     return ver;
 }
 
+/* Character classes of the version comparison. The order of the
+ * non-alphanumeric classes is the order in which rpmvercmp() sorts them
+ * against each other. */
+typedef enum {
+    VC_SEP,     /*!< Separator, skipped */
+    VC_TILDE,   /*!< '~', sorts before anything, even the end of string */
+    VC_END,     /*!< End of string */
+    VC_CARET,   /*!< '^', sorts after the end of string but before
+                     a segment (only if supported by librpm) */
+    VC_ALPHA,   /*!< [A-Za-z] */
+    VC_DIGIT,   /*!< [0-9] */
+} VcClass;
+
+static unsigned char vc_classes[256] = {
+    [0]             = VC_END,
+    ['0' ... '9']   = VC_DIGIT,
+    ['A' ... 'Z']   = VC_ALPHA,
+    ['a' ... 'z']   = VC_ALPHA,
+    ['~']           = VC_TILDE,
+    ['^']           = VC_CARET,
+};
+
+#define VC_CLASS(c)     (vc_classes[(unsigned char) (c)])
+#define VC_IS_ALNUM(c)  (VC_CLASS(c) >= VC_ALPHA)
+
+static gpointer
+vc_classes_init_cb(G_GNUC_UNUSED gpointer data)
+{
+    // The caret separator is supported since rpm 4.15, older versions
+    // treat it as any other separator
+    if (rpmvercmp("1^", "1") == 0)
+        vc_classes['^'] = VC_SEP;
+    return NULL;
+}
+
+static void
+vc_classes_init(void)
+{
+    static GOnce vc_classes_once = G_ONCE_INIT;
+    g_once(&vc_classes_once, vc_classes_init_cb, NULL);
+}
+
+int
+cr_vercmp(const char *a, const char *b)
+{
+    const unsigned char *one = (const unsigned char *) a;
+    const unsigned char *two = (const unsigned char *) b;
+
+    vc_classes_init();
+
+    // Skip the common prefix and step back to the beginning of the segment
+    // in which the strings differ
+    while (*one == *two) {
+        if (!*one)
+            return 0;
+        one++;
+        two++;
+    }
+    while (one > (const unsigned char *) a && VC_IS_ALNUM(one[-1])) {
+        one--;
+        two--;
+    }
+
+    for (;;) {
+        const unsigned char *seg1, *seg2;
+        size_t len1, len2;
+        int cls1, cls2, rc;
+
+        while ((cls1 = VC_CLASS(*one)) == VC_SEP) one++;
+        while ((cls2 = VC_CLASS(*two)) == VC_SEP) two++;
+
+        // Tilde, caret or end of string
+        if (cls1 < VC_ALPHA || cls2 < VC_ALPHA) {
+            if (cls1 != cls2)
+                return cls1 < cls2 ? -1 : 1;
+            if (cls1 == VC_END)
+                return 0;
+            one++;
+            two++;
+            continue;
+        }
+
+        // Numeric segments are newer than alpha segments
+        if (cls1 != cls2)
+            return cls1 < cls2 ? -1 : 1;
+
+        if (cls1 == VC_DIGIT) {
+            while (*one == '0') one++;
+            while (*two == '0') two++;
+        }
+
+        seg1 = one;
+        seg2 = two;
+        while (VC_CLASS(*one) == cls1) one++;
+        while (VC_CLASS(*two) == cls1) two++;
+        len1 = one - seg1;
+        len2 = two - seg2;
+
+        // Number with more digits wins
+        if (cls1 == VC_DIGIT && len1 != len2)
+            return len1 < len2 ? -1 : 1;
+
+        rc = memcmp(seg1, seg2, MIN(len1, len2));
+        if (rc)
+            return rc < 0 ? -1 : 1;
+        if (len1 != len2)
+            return len1 < len2 ? -1 : 1;
+    }
+}
+
 static int
 cr_compare_values(const char *str1, const char *str2)
 {
@@ -946,7 +1056,7 @@ cr_compare_values(const char *str1, const char *str2)
         return 1;
     else if (!str1 && str2)
         return -1;
-    return rpmvercmp(str1, str2);
+    return cr_vercmp(str1, str2);
 }
 
 // Return values:
@@ -1279,6 +1389,117 @@ cr_cmp_evr(const char *e1, const char *v1, const char *r1,
     return rc;
 }
 
+/** Append a sort key of the version string to the key. Keys of two
+ * strings compare (memcmp) in the same way as the strings compare
+ * by cr_compare_values(). */
+static void
+vc_append_key(GByteArray *key, const char *str)
+{
+    const unsigned char *ptr = (const unsigned char *) str;
+
+    if (!str) {
+        // NULL is older than any string
+        g_byte_array_append(key, (const guint8 *) "", 1);
+        return;
+    }
+
+    for (;;) {
+        const unsigned char *seg;
+        guint8 cls = VC_CLASS(*ptr);
+
+        if (cls == VC_SEP) {
+            ptr++;
+            continue;
+        }
+
+        g_byte_array_append(key, &cls, 1);
+        if (cls == VC_END)
+            return;
+        if (cls < VC_ALPHA) {
+            ptr++;
+            continue;
+        }
+
+        if (cls == VC_DIGIT)
+            while (*ptr == '0') ptr++;
+        seg = ptr;
+        while (VC_CLASS(*ptr) == cls) ptr++;
+
+        if (cls == VC_DIGIT) {
+            // Length first, number with more digits wins
+            guint32 len = GUINT32_TO_BE((guint32) (ptr - seg));
+            g_byte_array_append(key, (const guint8 *) &len, sizeof(len));
+            g_byte_array_append(key, seg, ptr - seg);
+        } else {
+            // Terminator sorts shorter segment first
+            g_byte_array_append(key, seg, ptr - seg);
+            g_byte_array_append(key, (const guint8 *) "", 1);
+        }
+    }
+}
+
+typedef struct {
+    const guint8 *key;
+    gsize len;
+    gsize index;
+    cr_EVR *evr;
+} EvrSortItem;
+
+static int
+evr_sort_item_cmp(const void *a, const void *b)
+{
+    const EvrSortItem *item1 = a;
+    const EvrSortItem *item2 = b;
+    int rc = memcmp(item1->key, item2->key, MIN(item1->len, item2->len));
+
+    if (!rc && item1->len != item2->len)
+        rc = item1->len < item2->len ? -1 : 1;
+    if (!rc && item1->index != item2->index)
+        rc = item1->index < item2->index ? -1 : 1;
+    return rc;
+}
+
+void
+cr_evr_sort(cr_EVR **evrs, size_t count)
+{
+    GByteArray *keys;
+    EvrSortItem *items;
+
+    if (count < 2)
+        return;
+
+    vc_classes_init();
+
+    keys = g_byte_array_new();
+    items = g_new(EvrSortItem, count);
+
+    for (size_t x = 0; x < count; x++) {
+        cr_EVR *evr = evrs[x];
+        gsize offset = keys->len;
+
+        vc_append_key(keys, evr->epoch ? evr->epoch : "0");
+        vc_append_key(keys, evr->version);
+        vc_append_key(keys, evr->release);
+
+        // Offset for now, the array may be reallocated
+        items[x].key = GSIZE_TO_POINTER(offset);
+        items[x].len = keys->len - offset;
+        items[x].index = x;
+        items[x].evr = evr;
+    }
+
+    for (size_t x = 0; x < count; x++)
+        items[x].key = keys->data + GPOINTER_TO_SIZE(items[x].key);
+
+    qsort(items, count, sizeof(EvrSortItem), evr_sort_item_cmp);
+
+    for (size_t x = 0; x < count; x++)
+        evrs[x] = items[x].evr;
+
+    g_free(items);
+    g_byte_array_free(keys, TRUE);
+}
+
 int
 cr_warning_cb(G_GNUC_UNUSED cr_XmlParserWarningType type,
               char *msg,
@@ -1574,6 +1795,12 @@ cr_version_string_with_features(void)
 #endif
 #ifdef ENABLE_THREADED_XZ_ENCODER
             "ThreadedXzEncoder "
+#endif
+#ifdef WITH_ZLIB_NG
+            "ZlibNg "
+#endif
+#ifdef WITH_LIBDEFLATE
+            "Libdeflate "
 #endif
             ")");
 }
@@ -263,6 +263,15 @@ char *cr_normalize_dir_path(const char *path);
  */
 struct cr_Version cr_str_to_version(const char *str);
 
+/** Compare two version strings in the same way as rpmvercmp() does.
+ * Segments are classified by a lookup table and the common prefix of
+ * the strings is skipped at once.
+ * @param a             first version string
+ * @param b             second version string
+ * @return              0 = same, 1 = first is newer, -1 = second is newer
+ */
+int cr_vercmp(const char *a, const char *b);
+
 /** Compare two version string.
  * @param str1          first version string
  * @param str2          second version string
@@ -342,6 +351,15 @@ cr_NEVRA *cr_split_rpm_filename(const char *filename);
 int cr_cmp_evr(const char *e1, const char *v1, const char *r1,
                const char *e2, const char *v2, const char *r2);
 
+/** Sort EVRs from the oldest to the newest, in the order defined by
+ * cr_cmp_evr(). Every EVR is converted into a binary sort key only once,
+ * which is much faster than sorting with cr_cmp_evr() as a comparator.
+ * EVRs which are the same keep their relative order.
+ * @param evrs          array of pointers to cr_EVR
+ * @param count         number of items in the array
+ */
+void cr_evr_sort(cr_EVR **evrs, size_t count);
+
 
 /** Safe insert into GStringChunk.
  * @param chunk     a GStringChunk
@@ -135,6 +135,14 @@ typedef struct {
 
     cr_PackageLoadingFlags loadingflags; /*!<
         Bitfield flags with information about package loading  */
+
+    char *raw_primary;          /*!< original <package> element from
+                                     primary.xml or NULL (see
+                                     cr_metadata_set_raw_xml()) */
+    char *raw_filelists;        /*!< original <package> element from
+                                     filelists.xml or NULL */
+    char *raw_other;            /*!< original <package> element from
+                                     other.xml or NULL */
 } cr_Package;
 
 /** Create new (empty) dependency structure.
@@ -151,13 +151,439 @@ cr_compare_dependency(const char *dep1, const char *dep2)
 }
 
 
+/*
+ * Header tag readers
+ *
+ * Tags are read either directly from the exported header blob
+ * (the default - the index entries are walked only once and
+ * strings and numbers are read straight from the blob without any
+ * rpmtd copies), or through librpm's headerGet() (CR_HDRR_LIBRPM or
+ * as a fallback for headers the direct decoder doesn't handle).
+ */
+
+#define HDR_ENTRY_INFO_SIZE     16  // tag, type, offset, count (int32 each)
+
+// Tags which are used by cr_package_from_header()
+static rpmTagVal hdr_wanted_tags[] = {
+    RPMTAG_HEADERI18NTABLE,
+    RPMTAG_NAME, RPMTAG_VERSION, RPMTAG_RELEASE, RPMTAG_EPOCH,
+    RPMTAG_SUMMARY, RPMTAG_DESCRIPTION, RPMTAG_BUILDTIME, RPMTAG_BUILDHOST,
+    RPMTAG_SIZE, RPMTAG_LICENSE, RPMTAG_GROUP, RPMTAG_URL, RPMTAG_ARCH,
+    RPMTAG_SOURCERPM, RPMTAG_VENDOR, RPMTAG_PACKAGER, RPMTAG_ARCHIVESIZE,
+    RPMTAG_LONGSIZE, RPMTAG_LONGARCHIVESIZE, RPMTAG_SOURCEPACKAGE,
+    RPMTAG_OLDFILENAMES, RPMTAG_DIRNAMES, RPMTAG_BASENAMES,
+    RPMTAG_DIRINDEXES, RPMTAG_FILEFLAGS, RPMTAG_FILEMODES,
+    RPMTAG_PROVIDENAME, RPMTAG_PROVIDEFLAGS, RPMTAG_PROVIDEVERSION,
+    RPMTAG_CONFLICTNAME, RPMTAG_CONFLICTFLAGS, RPMTAG_CONFLICTVERSION,
+    RPMTAG_OBSOLETENAME, RPMTAG_OBSOLETEFLAGS, RPMTAG_OBSOLETEVERSION,
+    RPMTAG_REQUIRENAME, RPMTAG_REQUIREFLAGS, RPMTAG_REQUIREVERSION,
+#ifdef RPM_WEAK_DEPS_SUPPORT
+    RPMTAG_SUGGESTNAME, RPMTAG_SUGGESTFLAGS, RPMTAG_SUGGESTVERSION,
+    RPMTAG_ENHANCENAME, RPMTAG_ENHANCEFLAGS, RPMTAG_ENHANCEVERSION,
+    RPMTAG_RECOMMENDNAME, RPMTAG_RECOMMENDFLAGS, RPMTAG_RECOMMENDVERSION,
+    RPMTAG_SUPPLEMENTNAME, RPMTAG_SUPPLEMENTFLAGS, RPMTAG_SUPPLEMENTVERSION,
+#ifdef ENABLE_LEGACY_WEAKDEPS
+    RPMTAG_OLDSUGGESTSNAME, RPMTAG_OLDSUGGESTSFLAGS, RPMTAG_OLDSUGGESTSVERSION,
+    RPMTAG_OLDENHANCESNAME, RPMTAG_OLDENHANCESFLAGS, RPMTAG_OLDENHANCESVERSION,
+#endif
+#endif
+    RPMTAG_CHANGELOGTIME, RPMTAG_CHANGELOGNAME, RPMTAG_CHANGELOGTEXT,
+    RPMTAG_SIGGPG, RPMTAG_SIGPGP,
+};
+
+#define HDR_WANTED_TAGS     G_N_ELEMENTS(hdr_wanted_tags)
+
+static rpmTagVal hdr_sorted_tags[HDR_WANTED_TAGS];
+
+static gint
+hdr_tag_cmp(gconstpointer a, gconstpointer b)
+{
+    rpmTagVal ta = *((const rpmTagVal *) a);
+    rpmTagVal tb = *((const rpmTagVal *) b);
+    return (ta > tb) - (ta < tb);
+}
+
+static gpointer
+hdr_sorted_tags_init_cb(gpointer user_data G_GNUC_UNUSED)
+{
+    memcpy(hdr_sorted_tags, hdr_wanted_tags, sizeof(hdr_wanted_tags));
+    qsort(hdr_sorted_tags, HDR_WANTED_TAGS, sizeof(rpmTagVal), hdr_tag_cmp);
+    return NULL;
+}
+
+/** Index of the tag in hdr_sorted_tags or -1 if the tag is not wanted */
+static inline int
+hdr_tag_slot(rpmTagVal tag)
+{
+    rpmTagVal *found = bsearch(&tag, hdr_sorted_tags, HDR_WANTED_TAGS,
+                               sizeof(rpmTagVal), hdr_tag_cmp);
+    return found ? (int) (found - hdr_sorted_tags) : -1;
+}
+
+typedef struct {
+    gboolean present;
+    rpmTagType type;
+    guint32 offset;     // Offset of the data in the data store
+    guint32 count;
+} HdrSlot;
+
+typedef struct {
+    Header hdr;
+    gboolean direct;    // Direct decoding, otherwise librpm is used
+    void *blob;         // Exported header
+    const guchar *store;// Data store of the blob
+    guint32 dl;         // Length of the data store
+    HdrSlot slots[HDR_WANTED_TAGS];
+} HdrReader;
+
+/** Data of one tag - something like a lightweight rpmtd */
+typedef struct {
+    rpmTagType type;
+    guint32 count;
+    gint32 ix;          // Current item or -1
+    rpmtd td;           // librpm reader
+    const guchar *data; // direct reader - first item
+    const guchar *cur;  // direct reader - current item
+    const guchar *next; // direct reader - item after the current string
+    const guchar *end;  // direct reader - end of the data store
+} TagData;
+
+static inline guint64
+hdr_read_be(const guchar *p, gsize size)
+{
+    guint64 val = 0;
+    for (gsize x = 0; x < size; x++)
+        val = (val << 8) | p[x];
+    return val;
+}
+
+static inline gsize
+hdr_type_size(rpmTagType type)
+{
+    switch (type) {
+        case RPM_CHAR_TYPE:
+        case RPM_INT8_TYPE:
+        case RPM_BIN_TYPE:      return 1;
+        case RPM_INT16_TYPE:    return 2;
+        case RPM_INT32_TYPE:    return 4;
+        case RPM_INT64_TYPE:    return 8;
+        default:                return 0;
+    }
+}
+
+static inline gboolean
+hdr_is_string_type(rpmTagType type)
+{
+    return type == RPM_STRING_TYPE
+        || type == RPM_STRING_ARRAY_TYPE
+        || type == RPM_I18NSTRING_TYPE;
+}
+
+/** Check that the data of the slot are inside of the data store */
+static gboolean
+hdr_slot_valid(const HdrReader *r, const HdrSlot *slot)
+{
+    if (slot->offset > r->dl)
+        return FALSE;
+
+    // Strings are checked lazily by tagdata_next() and tagdata_get_string(),
+    // so only the items which are really used (e.g. first N changelogs)
+    // are ever touched
+    if (hdr_is_string_type(slot->type))
+        return slot->count == 0 || slot->offset < r->dl;
+
+    gsize size = hdr_type_size(slot->type);
+    if (!size)
+        return FALSE;
+    return (guint64) slot->count * size <= (guint64) (r->dl - slot->offset);
+}
+
+/** Walk the index entries of the exported header and remember
+ * the wanted tags. Returns FALSE if the header should be read by librpm.
+ */
+static gboolean
+hdr_reader_decode(HdrReader *r)
+{
+    static GOnce sorted_tags_once = G_ONCE_INIT;
+    unsigned int bsize = 0;
+
+    g_once(&sorted_tags_once, hdr_sorted_tags_init_cb, NULL);
+
+    r->blob = headerExport(r->hdr, &bsize);
+    if (!r->blob || bsize < 8)
+        return FALSE;
+
+    const guchar *blob = r->blob;
+    guint32 il = hdr_read_be(blob, 4);
+    guint32 dl = hdr_read_be(blob + 4, 4);
+    if ((guint64) 8 + (guint64) il * HDR_ENTRY_INFO_SIZE + dl > bsize)
+        return FALSE;
+
+    const guchar *pe = blob + 8;
+    r->store = pe + (gsize) il * HDR_ENTRY_INFO_SIZE;
+    r->dl = dl;
+
+    for (guint32 x = 0; x < il; x++, pe += HDR_ENTRY_INFO_SIZE) {
+        int slot = hdr_tag_slot((rpmTagVal) hdr_read_be(pe, 4));
+        if (slot < 0)
+            continue;
+        // Later (dribble) entries take precedence
+        r->slots[slot].present = TRUE;
+        r->slots[slot].type    = (rpmTagType) hdr_read_be(pe + 4, 4);
+        r->slots[slot].offset  = hdr_read_be(pe + 8, 4);
+        r->slots[slot].count   = hdr_read_be(pe + 12, 4);
+    }
+
+    for (guint x = 0; x < HDR_WANTED_TAGS; x++)
+        if (r->slots[x].present && !hdr_slot_valid(r, &r->slots[x]))
+            return FALSE;
+
+    // Translated strings are selected by locale in librpm
+    HdrSlot *i18n = &r->slots[hdr_tag_slot(RPMTAG_HEADERI18NTABLE)];
+    if (i18n->present && i18n->count > 1)
+        return FALSE;
+
+    // Uncompressed (old style) file list is converted by librpm
+    if (r->slots[hdr_tag_slot(RPMTAG_OLDFILENAMES)].present
+        && !r->slots[hdr_tag_slot(RPMTAG_BASENAMES)].present)
+        return FALSE;
+
+    return TRUE;
+}
+
+static void
+hdr_reader_init(HdrReader *r, Header hdr, gboolean direct)
+{
+    memset(r, 0, sizeof(*r));
+    r->hdr = hdr;
+
+    if (direct && hdr_reader_decode(r)) {
+        r->direct = TRUE;
+        return;
+    }
+
+    if (direct)
+        g_debug("%s: Header cannot be decoded directly - using librpm",
+                __func__);
+
+    free(r->blob);
+    memset(r, 0, sizeof(*r));
+    r->hdr = hdr;
+}
+
+static void
+hdr_reader_clear(HdrReader *r)
+{
+    free(r->blob);
+    r->blob = NULL;
+}
+
+static void
+tagdata_init(TagData *t)
+{
+    memset(t, 0, sizeof(*t));
+    t->ix = -1;
+}
+
+/** Load the tag. Returns FALSE if the tag is not present in the header. */
+static gboolean
+hdr_reader_get(HdrReader *r, rpmTagVal tag, TagData *t)
+{
+    if (t->td)
+        rpmtdFreeData(t->td);
+    else
+        t->td = r->direct ? NULL : rpmtdNew();
+
+    t->ix = -1;
+    t->count = 0;
+
+    if (!r->direct) {
+        if (!headerGet(r->hdr, tag, t->td, HEADERGET_MINMEM | HEADERGET_EXT))
+            return FALSE;
+        t->type = rpmtdType(t->td);
+        t->count = rpmtdCount(t->td);
+        return TRUE;
+    }
+
+    int slot = hdr_tag_slot(tag);
+    if (slot < 0 || !r->slots[slot].present)
+        return FALSE;
+
+    t->type  = r->slots[slot].type;
+    t->count = r->slots[slot].count;
+    t->data  = r->store + r->slots[slot].offset;
+    t->cur   = NULL;
+    t->next  = NULL;
+    t->end   = r->store + r->dl;
+    return TRUE;
+}
+
+static void
+tagdata_clear(TagData *t)
+{
+    if (t->td) {
+        rpmtdFreeData(t->td);
+        rpmtdFree(t->td);
+    }
+    tagdata_init(t);
+}
+
+static void
+tagdata_rewind(TagData *t)
+{
+    t->ix = -1;
+    t->cur = NULL;
+    t->next = NULL;
+    if (t->td)
+        rpmtdInit(t->td);
+}
+
+/** Move to the next item. Returns -1 at the end. */
+static inline int
+tagdata_next(TagData *t)
+{
+    if (t->td)
+        return (t->ix = rpmtdNext(t->td));
+
+    if ((guint32) (t->ix + 1) >= t->count)
+        return -1;
+
+    if (hdr_is_string_type(t->type)) {
+        const guchar *p = t->cur ? t->next : t->data;
+        const guchar *nul = memchr(p, '\0', t->end - p);
+        if (!nul)
+            return -1;  // Unterminated string - behave like end of data
+        t->cur = p;
+        t->next = nul + 1;
+    } else {
+        t->cur = t->data + (gsize) (t->ix + 1) * hdr_type_size(t->type);
+    }
+
+    return ++t->ix;
+}
+
+static inline const char *
+tagdata_get_string(TagData *t)
+{
+    if (t->td)
+        return rpmtdGetString(t->td);
+    if (!hdr_is_string_type(t->type) || !t->count)
+        return NULL;
+    if (t->cur)
+        return (const char *) t->cur;
+    if (!memchr(t->data, '\0', t->end - t->data))
+        return NULL;
+    return (const char *) t->data;
+}
+
+static inline guint64
+tagdata_get_number(TagData *t)
+{
+    if (t->td)
+        return rpmtdGetNumber(t->td);
+    gsize size = hdr_type_size(t->type);
+    if (!size || t->type == RPM_BIN_TYPE || !t->count)
+        return 0;
+    return hdr_read_be(t->cur ? t->cur : t->data, size);
+}
+
+/** Scalar string (first item for arrays and i18n strings) or NULL */
+static const char *
+hdr_reader_get_string(HdrReader *r, rpmTagVal tag)
+{
+    if (!r->direct)
+        return headerGetString(r->hdr, tag);
+
+    TagData t;
+    tagdata_init(&t);
+    if (!hdr_reader_get(r, tag, &t))
+        return NULL;
+    return tagdata_get_string(&t);
+}
+
+/** Scalar number or 0 */
+static guint64
+hdr_reader_get_number(HdrReader *r, rpmTagVal tag)
+{
+    if (!r->direct)
+        return headerGetNumber(r->hdr, tag);
+
+    TagData t;
+    tagdata_init(&t);
+    if (!hdr_reader_get(r, tag, &t))
+        return 0;
+    return tagdata_get_number(&t);
+}
+
+/** Scalar number of a 64bit tag with fallback to its 32bit variant
+ * (the same thing that HEADERGET_EXT does for RPMTAG_LONGSIZE, ...) */
+static guint64
+hdr_reader_get_long_number(HdrReader *r, rpmTagVal longtag, rpmTagVal tag)
+{
+    if (!r->direct) {
+        guint64 val = 0;
+        rpmtd td = rpmtdNew();
+        if (headerGet(r->hdr, longtag, td, HEADERGET_MINMEM | HEADERGET_EXT))
+            val = rpmtdGetNumber(td);
+        rpmtdFreeData(td);
+        rpmtdFree(td);
+        return val;
+    }
+
+    if (r->slots[hdr_tag_slot(longtag)].present)
+        return hdr_reader_get_number(r, longtag);
+    return hdr_reader_get_number(r, tag);
+}
+
+/** Binary data of the tag (pointer into the header data) or NULL */
+static const void *
+hdr_reader_get_binary(HdrReader *r,
+                      rpmTagVal tag,
+                      cr_HeaderReadingFlags hdrrflags,
+                      guint32 *count,
+                      rpmtd *td_out)
+{
+    *count = 0;
+
+    if (!r->direct) {
+        rpmtd td = rpmtdNew();
+        *td_out = td;
+        // Keep the original behaviour - flags are passed to headerGet()
+        if (!headerGet(r->hdr, tag, td, hdrrflags & ~CR_HDRR_LIBRPM))
+            return NULL;
+        *count = td->count;
+        return td->data;
+    }
+
+    *td_out = NULL;
+    int slot = hdr_tag_slot(tag);
+    if (slot < 0 || !r->slots[slot].present
+        || r->slots[slot].type != RPM_BIN_TYPE)
+        return NULL;
+    *count = r->slots[slot].count;
+    return r->store + r->slots[slot].offset;
+}
+
+
 cr_Package *
 cr_package_from_header(Header hdr,
                        int changelog_limit,
                        cr_HeaderReadingFlags hdrrflags,
-                       G_GNUC_UNUSED GError **err)
+                       GError **err)
+{
+    return cr_package_from_header_limited(hdr, changelog_limit, -1,
+                                          hdrrflags, err);
+}
+
+cr_Package *
+cr_package_from_header_limited(Header hdr,
+                               int changelog_limit,
+                               gint64 changelog_size_limit,
+                               cr_HeaderReadingFlags hdrrflags,
+                               G_GNUC_UNUSED GError **err)
 {
     cr_Package *pkg;
+    HdrReader reader;
 
     assert(hdr);
     assert(!err || *err == NULL);
@@ -171,114 +597,98 @@ cr_package_from_header(Header hdr,
     pkg->loadingflags |= CR_PACKAGE_LOADED_OTH;
 
 
-    // Create rpm tag data container
+    // Prepare the header reader
 
-    rpmtd td = rpmtdNew();
-    headerGetFlags flags = HEADERGET_MINMEM | HEADERGET_EXT;
+    hdr_reader_init(&reader, hdr, !(hdrrflags & CR_HDRR_LIBRPM));
 
 
     // Fill package structure
 
-    pkg->name = cr_safe_string_chunk_insert(pkg->chunk, headerGetString(hdr, RPMTAG_NAME));
+    pkg->name = cr_safe_string_chunk_insert(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_NAME));
 
-    gint64 is_src = headerGetNumber(hdr, RPMTAG_SOURCEPACKAGE);
+    gint64 is_src = hdr_reader_get_number(&reader, RPMTAG_SOURCEPACKAGE);
     if (is_src) {
         pkg->arch = cr_safe_string_chunk_insert(pkg->chunk, "src");
     } else {
-        pkg->arch = cr_safe_string_chunk_insert(pkg->chunk, headerGetString(hdr, RPMTAG_ARCH));
+        pkg->arch = cr_safe_string_chunk_insert(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_ARCH));
     }
 
-    pkg->version = cr_safe_string_chunk_insert(pkg->chunk, headerGetString(hdr, RPMTAG_VERSION));
+    pkg->version = cr_safe_string_chunk_insert(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_VERSION));
 
 #define MAX_STR_INT_LEN 24
     char tmp_epoch[MAX_STR_INT_LEN];
-    if (snprintf(tmp_epoch, MAX_STR_INT_LEN, "%llu", (long long unsigned int) headerGetNumber(hdr, RPMTAG_EPOCH)) <= 0) {
+    if (snprintf(tmp_epoch, MAX_STR_INT_LEN, "%llu", (long long unsigned int) hdr_reader_get_number(&reader, RPMTAG_EPOCH)) <= 0) {
         tmp_epoch[0] = '\0';
     }
     pkg->epoch = g_string_chunk_insert_len(pkg->chunk, tmp_epoch, MAX_STR_INT_LEN);
 
-    pkg->release = cr_safe_string_chunk_insert(pkg->chunk, headerGetString(hdr, RPMTAG_RELEASE));
-    pkg->summary = cr_safe_string_chunk_insert(pkg->chunk, headerGetString(hdr, RPMTAG_SUMMARY));
-    pkg->description = cr_safe_string_chunk_insert_null(pkg->chunk, headerGetString(hdr, RPMTAG_DESCRIPTION));
-    pkg->url = cr_safe_string_chunk_insert(pkg->chunk, headerGetString(hdr, RPMTAG_URL));
-    if (headerGet(hdr, RPMTAG_BUILDTIME, td, flags)) {
-        pkg->time_build = rpmtdGetNumber(td);
-    }
-    pkg->rpm_license = cr_safe_string_chunk_insert(pkg->chunk, headerGetString(hdr, RPMTAG_LICENSE));
-    pkg->rpm_vendor = cr_safe_string_chunk_insert(pkg->chunk, headerGetString(hdr, RPMTAG_VENDOR));
-    pkg->rpm_group = cr_safe_string_chunk_insert(pkg->chunk, headerGetString(hdr, RPMTAG_GROUP));
-    pkg->rpm_buildhost = cr_safe_string_chunk_insert(pkg->chunk, headerGetString(hdr, RPMTAG_BUILDHOST));
-    pkg->rpm_sourcerpm = cr_safe_string_chunk_insert(pkg->chunk, headerGetString(hdr, RPMTAG_SOURCERPM));
-    pkg->rpm_packager = cr_safe_string_chunk_insert(pkg->chunk, headerGetString(hdr, RPMTAG_PACKAGER));
-    // RPMTAG_LONGSIZE is allways present (is emulated for small packages because HEADERGET_EXT flag was used)
-    if (headerGet(hdr, RPMTAG_LONGSIZE, td, flags)) {
-        pkg->size_installed = rpmtdGetNumber(td);
-    }
-    rpmtdFreeData(td);
-    // RPMTAG_LONGARCHIVESIZE is allways present (is emulated for small packages because HEADERGET_EXT flag was used)
-    if (headerGet(hdr, RPMTAG_LONGARCHIVESIZE, td, flags)) {
-        pkg->size_archive = rpmtdGetNumber(td);
-    }
-
-    rpmtdFreeData(td);
-    rpmtdFree(td);
+    pkg->release = cr_safe_string_chunk_insert(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_RELEASE));
+    pkg->summary = cr_safe_string_chunk_insert(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_SUMMARY));
+    pkg->description = cr_safe_string_chunk_insert_null(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_DESCRIPTION));
+    pkg->url = cr_safe_string_chunk_insert(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_URL));
+    pkg->time_build = hdr_reader_get_number(&reader, RPMTAG_BUILDTIME);
+    pkg->rpm_license = cr_safe_string_chunk_insert(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_LICENSE));
+    pkg->rpm_vendor = cr_safe_string_chunk_insert(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_VENDOR));
+    pkg->rpm_group = cr_safe_string_chunk_insert(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_GROUP));
+    pkg->rpm_buildhost = cr_safe_string_chunk_insert(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_BUILDHOST));
+    pkg->rpm_sourcerpm = cr_safe_string_chunk_insert(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_SOURCERPM));
+    pkg->rpm_packager = cr_safe_string_chunk_insert(pkg->chunk, hdr_reader_get_string(&reader, RPMTAG_PACKAGER));
+    // RPMTAG_LONGSIZE is allways present (is emulated for small packages)
+    pkg->size_installed = hdr_reader_get_long_number(&reader, RPMTAG_LONGSIZE, RPMTAG_SIZE);
+    // RPMTAG_LONGARCHIVESIZE is allways present (is emulated for small packages)
+    pkg->size_archive = hdr_reader_get_long_number(&reader, RPMTAG_LONGARCHIVESIZE, RPMTAG_ARCHIVESIZE);
 
 
     //
     // Fill files
     //
 
-    rpmtd full_filenames = rpmtdNew(); // Only for filenames_hashtable
-    rpmtd indexes   = rpmtdNew();
-    rpmtd filenames = rpmtdNew();
-    rpmtd fileflags = rpmtdNew();
-    rpmtd filemodes = rpmtdNew();
-
-    GHashTable *filenames_hashtable = g_hash_table_new(g_str_hash, g_str_equal);
+    TagData indexes, filenames, fileflags, filemodes, dirnames;
+    tagdata_init(&indexes);
+    tagdata_init(&filenames);
+    tagdata_init(&fileflags);
+    tagdata_init(&filemodes);
+    tagdata_init(&dirnames);
 
-    rpmtd dirnames = rpmtdNew();
+    // Full paths of the files - filled lazily (only if a require of
+    // a primary file is found) by the dir_list and files
+    GHashTable *filenames_hashtable = NULL;
 
 
     // Create list of pointer to directory names
 
-    int dir_count;
+    int dir_count = 0;
     char **dir_list = NULL;
-    if (headerGet(hdr, RPMTAG_DIRNAMES, dirnames,  flags) && (dir_count = rpmtdCount(dirnames))) {
+    if (hdr_reader_get(&reader, RPMTAG_DIRNAMES, &dirnames) && (dir_count = dirnames.count)) {
         int x = 0;
         dir_list = malloc(sizeof(char *) * dir_count);
-        while (rpmtdNext(dirnames) != -1) {
-            dir_list[x] = cr_safe_string_chunk_insert(pkg->chunk, rpmtdGetString(dirnames));
+        while (tagdata_next(&dirnames) != -1) {
+            dir_list[x] = cr_safe_string_chunk_insert(pkg->chunk, tagdata_get_string(&dirnames));
             x++;
         }
         assert(x == dir_count);
     }
 
-    if (headerGet(hdr, RPMTAG_FILENAMES,  full_filenames,  flags) &&
-        headerGet(hdr, RPMTAG_DIRINDEXES, indexes,  flags) &&
-        headerGet(hdr, RPMTAG_BASENAMES,  filenames, flags) &&
-        headerGet(hdr, RPMTAG_FILEFLAGS,  fileflags, flags) &&
-        headerGet(hdr, RPMTAG_FILEMODES,  filemodes, flags))
+    if (hdr_reader_get(&reader, RPMTAG_DIRINDEXES, &indexes) &&
+        hdr_reader_get(&reader, RPMTAG_BASENAMES,  &filenames) &&
+        hdr_reader_get(&reader, RPMTAG_FILEFLAGS,  &fileflags) &&
+        hdr_reader_get(&reader, RPMTAG_FILEMODES,  &filemodes))
     {
-        rpmtdInit(full_filenames);
-        rpmtdInit(indexes);
-        rpmtdInit(filenames);
-        rpmtdInit(fileflags);
-        rpmtdInit(filemodes);
-        while ((rpmtdNext(full_filenames) != -1)   &&
-               (rpmtdNext(indexes) != -1)   &&
-               (rpmtdNext(filenames) != -1) &&
-               (rpmtdNext(fileflags) != -1) &&
-               (rpmtdNext(filemodes) != -1))
+        while ((tagdata_next(&indexes) != -1)   &&
+               (tagdata_next(&filenames) != -1) &&
+               (tagdata_next(&fileflags) != -1) &&
+               (tagdata_next(&filemodes) != -1))
         {
+            guint64 dir_index = tagdata_get_number(&indexes);
             cr_PackageFile *packagefile = cr_package_file_new();
             packagefile->name = cr_safe_string_chunk_insert(pkg->chunk,
-                                                         rpmtdGetString(filenames));
-            packagefile->path = (dir_list) ? dir_list[(int) rpmtdGetNumber(indexes)] : "";
+                                                         tagdata_get_string(&filenames));
+            packagefile->path = (dir_list && dir_index < (guint64) dir_count) ? dir_list[dir_index] : "";
 
-            if (S_ISDIR(rpmtdGetNumber(filemodes))) {
+            if (S_ISDIR(tagdata_get_number(&filemodes))) {
                 // Directory
                 packagefile->type = cr_safe_string_chunk_insert(pkg->chunk, "dir");
-            } else if (rpmtdGetNumber(fileflags) & RPMFILE_GHOST) {
+            } else if (tagdata_get_number(&fileflags) & RPMFILE_GHOST) {
                 // Ghost
                 packagefile->type = cr_safe_string_chunk_insert(pkg->chunk, "ghost");
             } else {
@@ -286,23 +696,14 @@ cr_package_from_header(Header hdr,
                 packagefile->type = cr_safe_string_chunk_insert(pkg->chunk, "");
             }
 
-            g_hash_table_replace(filenames_hashtable,
-                                 (gpointer) rpmtdGetString(full_filenames),
-                                 (gpointer) rpmtdGetString(full_filenames));
             pkg->files = g_slist_prepend(pkg->files, packagefile);
         }
         pkg->files = g_slist_reverse (pkg->files);
-
-        rpmtdFreeData(dirnames);
-        rpmtdFreeData(indexes);
-        rpmtdFreeData(filenames);
-        rpmtdFreeData(fileflags);
-        rpmtdFreeData(filemodes);
     }
 
-    rpmtdFree(dirnames);
-    rpmtdFree(indexes);
-    rpmtdFree(filemodes);
+    tagdata_clear(&dirnames);
+    tagdata_clear(&indexes);
+    tagdata_clear(&filemodes);
 
     if (dir_list) {
         free((void *) dir_list);
@@ -313,7 +714,8 @@ cr_package_from_header(Header hdr,
     // PCOR (provides, conflicts, obsoletes, requires)
     //
 
-    rpmtd fileversions = rpmtdNew();
+    TagData fileversions;
+    tagdata_init(&fileversions);
 
     // Struct used as value in ap_hashtable
     struct ap_value_struct {
@@ -335,27 +737,27 @@ cr_package_from_header(Header hdr,
                                                      free);
 
     for (int deptype=0; dep_items[deptype].type != DEP_SENTINEL; deptype++) {
-        if (headerGet(hdr, dep_items[deptype].nametag, filenames, flags) &&
-            headerGet(hdr, dep_items[deptype].flagstag, fileflags, flags) &&
-            headerGet(hdr, dep_items[deptype].versiontag, fileversions, flags))
+        if (hdr_reader_get(&reader, dep_items[deptype].nametag, &filenames) &&
+            hdr_reader_get(&reader, dep_items[deptype].flagstag, &fileflags) &&
+            hdr_reader_get(&reader, dep_items[deptype].versiontag, &fileversions))
         {
 
             // Because we have to select only libc.so with highest version
             // e.g. libc.so.6(GLIBC_2.4)
             cr_Dependency *libc_require_highest = NULL;
 
-            rpmtdInit(filenames);
-            rpmtdInit(fileflags);
-            rpmtdInit(fileversions);
-            while ((rpmtdNext(filenames) != -1) &&
-                   (rpmtdNext(fileflags) != -1) &&
-                   (rpmtdNext(fileversions) != -1))
+            tagdata_rewind(&filenames);
+            tagdata_rewind(&fileflags);
+            tagdata_rewind(&fileversions);
+            while ((tagdata_next(&filenames) != -1) &&
+                   (tagdata_next(&fileflags) != -1) &&
+                   (tagdata_next(&fileversions) != -1))
             {
                 int pre = 0;
-                const char *filename = rpmtdGetString(filenames);
-                guint64 num_flags = rpmtdGetNumber(fileflags);
+                const char *filename = tagdata_get_string(&filenames);
+                guint64 num_flags = tagdata_get_number(&fileflags);
                 const char *flags = cr_flag_to_str(num_flags);
-                const char *full_version = rpmtdGetString(fileversions);
+                const char *full_version = tagdata_get_string(&fileversions);
 
                 _cleanup_free_ char *depnfv = NULL;  // Dep NameFlagsVersion
                 depnfv = g_strconcat(filename,
@@ -371,10 +773,20 @@ cr_package_from_header(Header hdr,
                     }
 
                     // Skip package primary files
-                    if (*filename == '/' && g_hash_table_lookup_extended(filenames_hashtable, filename, NULL, NULL)) {
-                        if (cr_is_primary(filename)) {
-                            continue;
+                    if (*filename == '/' && cr_is_primary(filename)) {
+                        if (!filenames_hashtable) {
+                            filenames_hashtable = g_hash_table_new_full(g_str_hash,
+                                                                        g_str_equal,
+                                                                        g_free,
+                                                                        NULL);
+                            for (GSList *elem = pkg->files; elem; elem = g_slist_next(elem)) {
+                                cr_PackageFile *file = elem->data;
+                                g_hash_table_add(filenames_hashtable,
+                                                 g_strconcat(file->path, file->name, NULL));
+                            }
                         }
+                        if (g_hash_table_contains(filenames_hashtable, filename))
+                            continue;
                     }
 
                     // Skip files which are provided
@@ -509,9 +921,6 @@ cr_package_from_header(Header hdr,
             // XXX: libc.so filtering - END ////////////////////////////////
         }
 
-        rpmtdFreeData(filenames);
-        rpmtdFreeData(fileflags);
-        rpmtdFreeData(fileversions);
     }
 
     pkg->provides    = g_slist_reverse (pkg->provides);
@@ -523,51 +932,52 @@ cr_package_from_header(Header hdr,
     pkg->recommends  = g_slist_reverse (pkg->recommends);
     pkg->supplements = g_slist_reverse (pkg->supplements);
 
-    g_hash_table_remove_all(filenames_hashtable);
-    g_hash_table_remove_all(provided_hashtable);
-    g_hash_table_remove_all(ap_hashtable);
-
-    g_hash_table_unref(filenames_hashtable);
+    if (filenames_hashtable)
+        g_hash_table_unref(filenames_hashtable);
     g_hash_table_unref(provided_hashtable);
     g_hash_table_unref(ap_hashtable);
 
-    rpmtdFree(filenames);
-    rpmtdFree(fileflags);
-    rpmtdFree(fileversions);
-
-    rpmtdFreeData(full_filenames);
-    rpmtdFree(full_filenames);
+    tagdata_clear(&filenames);
+    tagdata_clear(&fileflags);
+    tagdata_clear(&fileversions);
 
 
     //
     // Changelogs
     //
 
-    rpmtd changelogtimes = rpmtdNew();
-    rpmtd changelognames = rpmtdNew();
-    rpmtd changelogtexts = rpmtdNew();
+    TagData changelogtimes, changelognames, changelogtexts;
+    tagdata_init(&changelogtimes);
+    tagdata_init(&changelognames);
+    tagdata_init(&changelogtexts);
 
-    if (headerGet(hdr, RPMTAG_CHANGELOGTIME, changelogtimes, flags) &&
-        headerGet(hdr, RPMTAG_CHANGELOGNAME, changelognames, flags) &&
-        headerGet(hdr, RPMTAG_CHANGELOGTEXT, changelogtexts, flags))
+    if (hdr_reader_get(&reader, RPMTAG_CHANGELOGTIME, &changelogtimes) &&
+        hdr_reader_get(&reader, RPMTAG_CHANGELOGNAME, &changelognames) &&
+        hdr_reader_get(&reader, RPMTAG_CHANGELOGTEXT, &changelogtexts))
     {
         gint64 last_time = G_GINT64_CONSTANT(0);
-        rpmtdInit(changelogtimes);
-        rpmtdInit(changelognames);
-        rpmtdInit(changelogtexts);
-        while ((rpmtdNext(changelogtimes) != -1) &&
-               (rpmtdNext(changelognames) != -1) &&
-               (rpmtdNext(changelogtexts) != -1) &&
-               (changelog_limit > 0 || changelog_limit == -1))
+        gint64 changelog_size = G_GINT64_CONSTANT(0);
+        // Only the used entries are decoded (the limit is checked first)
+        while ((changelog_limit > 0 || changelog_limit == -1) &&
+               (tagdata_next(&changelogtimes) != -1) &&
+               (tagdata_next(&changelognames) != -1) &&
+               (tagdata_next(&changelogtexts) != -1))
         {
-            gint64 time = rpmtdGetNumber(changelogtimes);
+            gint64 time = tagdata_get_number(&changelogtimes);
+            const char *author = tagdata_get_string(&changelognames);
+            const char *text = tagdata_get_string(&changelogtexts);
+
+            // The first (the newest) entry is always loaded
+            changelog_size += (author ? strlen(author) : 0)
+                              + (text ? strlen(text) : 0);
+            if (changelog_size_limit >= 0 && pkg->changelogs
+                && changelog_size > changelog_size_limit)
+                break;
 
             cr_ChangelogEntry *changelog = cr_changelog_entry_new();
-            changelog->author    = cr_safe_string_chunk_insert(pkg->chunk,
-                                            rpmtdGetString(changelognames));
+            changelog->author    = cr_safe_string_chunk_insert(pkg->chunk, author);
             changelog->date      = time;
-            changelog->changelog = cr_safe_string_chunk_insert(pkg->chunk,
-                                            rpmtdGetString(changelogtexts));
+            changelog->changelog = cr_safe_string_chunk_insert(pkg->chunk, text);
 
             // Remove space from end of author name
             if (changelog->author) {
@@ -605,13 +1015,9 @@ cr_package_from_header(Header hdr,
         //pkg->changelogs = g_slist_reverse (pkg->changelogs);
     }
 
-    rpmtdFreeData(changelogtimes);
-    rpmtdFreeData(changelognames);
-    rpmtdFreeData(changelogtexts);
-
-    rpmtdFree(changelogtimes);
-    rpmtdFree(changelognames);
-    rpmtdFree(changelogtexts);
+    tagdata_clear(&changelogtimes);
+    tagdata_clear(&changelognames);
+    tagdata_clear(&changelogtexts);
 
 
     //
@@ -623,32 +1029,30 @@ cr_package_from_header(Header hdr,
                                                  headerGetString(hdr, RPMTAG_HDRID));
 
     if (hdrrflags & CR_HDRR_LOADSIGNATURES) {
-        rpmtd gpgtd = rpmtdNew();
-        rpmtd pgptd = rpmtdNew();
+        guint32 count;
+        rpmtd td;
+        const void *data;
 
-        if (headerGet(hdr, RPMTAG_SIGGPG, gpgtd, hdrrflags)
-            && gpgtd->count > 0)
-        {
+        data = hdr_reader_get_binary(&reader, RPMTAG_SIGGPG, hdrrflags, &count, &td);
+        if (data && count > 0) {
             pkg->siggpg = cr_binary_data_new();
-            pkg->siggpg->size = gpgtd->count;
-            pkg->siggpg->data = g_string_chunk_insert_len(pkg->chunk,
-                                                          gpgtd->data,
-                                                          gpgtd->count);
+            pkg->siggpg->size = count;
+            pkg->siggpg->data = g_string_chunk_insert_len(pkg->chunk, data, count);
         }
+        if (td)
+            rpmtdFree(td);
 
-        if (headerGet(hdr, RPMTAG_SIGPGP, pgptd, hdrrflags)
-            && pgptd->count > 0)
-        {
+        data = hdr_reader_get_binary(&reader, RPMTAG_SIGPGP, hdrrflags, &count, &td);
+        if (data && count > 0) {
             pkg->sigpgp = cr_binary_data_new();
-            pkg->sigpgp->size = pgptd->count;
-            pkg->sigpgp->data = g_string_chunk_insert_len(pkg->chunk,
-                                                          pgptd->data,
-                                                          pgptd->count);
+            pkg->sigpgp->size = count;
+            pkg->sigpgp->data = g_string_chunk_insert_len(pkg->chunk, data, count);
         }
-
-        rpmtdFree(gpgtd);
-        rpmtdFree(pgptd);
+        if (td)
+            rpmtdFree(td);
     }
 
+    hdr_reader_clear(&reader);
+
     return pkg;
 }
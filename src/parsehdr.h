@@ -39,6 +39,10 @@ typedef enum {
     CR_HDRR_NONE            = (1 << 0),
     CR_HDRR_LOADHDRID       = (1 << 1), /*!< Load hdrid */
     CR_HDRR_LOADSIGNATURES  = (1 << 2), /*!< Load siggpg and siggpg */
+    CR_HDRR_LIBRPM          = (1 << 3), /*!< Read tags via librpm headerGet()
+                                             instead of decoding the header
+                                             blob directly (slower, used
+                                             for verification) */
 } cr_HeaderReadingFlags;
 
 /** Read data from header and return filled cr_Package structure.
@@ -54,6 +58,25 @@ cr_Package *cr_package_from_header(Header hdr,
                                    cr_HeaderReadingFlags flags,
                                    GError **err);
 
+/** Same as cr_package_from_header() but the changelogs are limited
+ * also by their total size. Changelog entries (author + text) are
+ * loaded from the newest one until the changelog_limit entries or
+ * changelog_size_limit bytes is reached. The newest entry is always
+ * loaded. Only the loaded entries are decoded from the header.
+ * @param hdr                   Header
+ * @param changelog_limit       number of changelog entries (-1 = all)
+ * @param changelog_size_limit  max size of changelogs in bytes
+ *                              (-1 = unlimited)
+ * @param flags                 Flags for header reading
+ * @param err                   GError **
+ * @return                      Newly allocated cr_Package or NULL on error
+ */
+cr_Package *cr_package_from_header_limited(Header hdr,
+                                           int changelog_limit,
+                                           gint64 changelog_size_limit,
+                                           cr_HeaderReadingFlags flags,
+                                           GError **err);
+
 /** @} */
 
 #ifdef __cplusplus
@@ -129,6 +129,17 @@ cr_package_from_rpm_base(const char *filename,
                          int changelog_limit,
                          cr_HeaderReadingFlags flags,
                          GError **err)
+{
+    return cr_package_from_rpm_base_limited(filename, changelog_limit, -1,
+                                            flags, err);
+}
+
+cr_Package *
+cr_package_from_rpm_base_limited(const char *filename,
+                                 int changelog_limit,
+                                 gint64 changelog_size_limit,
+                                 cr_HeaderReadingFlags flags,
+                                 GError **err)
 {
     Header hdr;
     cr_Package *pkg;
@@ -139,7 +150,8 @@ cr_package_from_rpm_base(const char *filename,
     if (!read_header(filename, &hdr, err))
         return NULL;
 
-    pkg = cr_package_from_header(hdr, changelog_limit, flags, err);
+    pkg = cr_package_from_header_limited(hdr, changelog_limit,
+                                         changelog_size_limit, flags, err);
     headerFree(hdr);
     return pkg;
 }
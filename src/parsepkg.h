@@ -61,6 +61,23 @@ cr_package_from_rpm_base(const char *filename,
                          cr_HeaderReadingFlags flags,
                          GError **err);
 
+/** Same as cr_package_from_rpm_base() but the changelogs are limited
+ * also by their total size (see cr_package_from_header_limited()).
+ * @param filename              filename
+ * @param changelog_limit       number of changelogs that will be loaded
+ * @param changelog_size_limit  max size of changelogs in bytes
+ *                              (-1 = unlimited)
+ * @param flags                 Flags for header reading
+ * @param err                   GError **
+ * @return                      cr_Package or NULL on error
+ */
+cr_Package *
+cr_package_from_rpm_base_limited(const char *filename,
+                                 int changelog_limit,
+                                 gint64 changelog_size_limit,
+                                 cr_HeaderReadingFlags flags,
+                                 GError **err);
+
 /** Generate a package object from a package file.
  * @param filename              filename
  * @param checksum_type         type of checksum to be used
@@ -80,6 +80,7 @@ typedef struct {
     PyObject_HEAD
     CR_FILE *f;
     PyObject *py_stat;
+    int busy;   /*!< a call is running without the GIL */
 } _CrFileObject;
 
 static PyObject * py_close(_CrFileObject *self, void *nothing);
@@ -97,6 +98,53 @@ check_CrFileStatus(const _CrFileObject *self)
     return 0;
 }
 
+/** Mark the file as used by a call which releases the GIL.
+ * CR_FILE isn't thread safe, so concurrent calls from other threads
+ * fail instead of using the file at the same time.
+ * Must be called with the GIL held.
+ */
+static int
+crfile_acquire(_CrFileObject *self)
+{
+    if (self->busy) {
+        PyErr_SetString(CrErr_Exception,
+            "CrFile is being used by another thread");
+        return -1;
+    }
+    self->busy = 1;
+    return 0;
+}
+
+// Max length of a single cr_read()/cr_write() call (len is unsigned int)
+#define CRFILE_MAX_IO_LEN   (1024*1024*1024)
+
+/** Read into the buffer without holding the GIL.
+ * Returns number of read bytes (0 on EOF) or -1 with exception set.
+ */
+static Py_ssize_t
+crfile_read_into(_CrFileObject *self, char *buf, Py_ssize_t len)
+{
+    int ret;
+    GError *tmp_err = NULL;
+
+    if (len > CRFILE_MAX_IO_LEN)
+        len = CRFILE_MAX_IO_LEN;
+
+    if (crfile_acquire(self))
+        return -1;
+    Py_BEGIN_ALLOW_THREADS
+    ret = cr_read(self->f, buf, (unsigned int) len, &tmp_err);
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+
+    if (tmp_err) {
+        nice_exception(&tmp_err, NULL);
+        return -1;
+    }
+
+    return ret;
+}
+
 /* Function on the type */
 
 static PyObject *
@@ -108,6 +156,7 @@ crfile_new(PyTypeObject *type,
     if (self) {
         self->f = NULL;
         self->py_stat = NULL;
+        self->busy = 0;
     }
     return (PyObject *)self;
 }
@@ -199,23 +248,63 @@ crfile_repr(_CrFileObject *self)
 /* CrFile methods */
 
 PyDoc_STRVAR(write__doc__,
-"write() -> None\n\n"
-"Write a data to the file");
+"write(data) -> None\n\n"
+"Write a data to the file. The data can be a str or any object\n"
+"supporting the buffer protocol (bytes, bytearray, memoryview, ...),\n"
+"buffers are written without copying.");
 
 static PyObject *
 py_write(_CrFileObject *self, PyObject *args)
 {
-    char *str;
+    PyObject *data;
+    Py_buffer view;
+    const char *buf;
     Py_ssize_t len;
+    int ret = 0;
     GError *tmp_err = NULL;
 
-    if (!PyArg_ParseTuple(args, "s#:set_num_of_pkgs", &str, &len))
+    if (!PyArg_ParseTuple(args, "O:write", &data))
         return NULL;
 
     if (check_CrFileStatus(self))
         return NULL;
 
-    cr_write(self->f, str, len, &tmp_err);
+    view.obj = NULL;
+    if (PyUnicode_Check(data)) {
+        buf = PyUnicode_AsUTF8AndSize(data, &len);
+        if (!buf)
+            return NULL;
+        // Keep the str alive while the GIL is released
+        Py_INCREF(data);
+    } else {
+        if (PyObject_GetBuffer(data, &view, PyBUF_SIMPLE) < 0)
+            return NULL;
+        buf = view.buf;
+        len = view.len;
+    }
+
+    if (crfile_acquire(self)) {
+        if (view.obj)
+            PyBuffer_Release(&view);
+        else
+            Py_DECREF(data);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    while (len > 0 && ret != CR_CW_ERR) {
+        unsigned int chunk = (len > CRFILE_MAX_IO_LEN) ? CRFILE_MAX_IO_LEN : len;
+        ret = cr_write(self->f, buf, chunk, &tmp_err);
+        buf += chunk;
+        len -= chunk;
+    }
+    Py_END_ALLOW_THREADS
+    self->busy = 0;
+
+    if (view.obj)
+        PyBuffer_Release(&view);
+    else
+        Py_DECREF(data);
+
     if (tmp_err) {
         nice_exception(&tmp_err, NULL);
         return NULL;
@@ -224,6 +313,95 @@ py_write(_CrFileObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+PyDoc_STRVAR(read__doc__,
+"read([size]) -> bytes\n\n"
+"Read at most size bytes (everything till EOF if size is negative\n"
+"or omitted). An empty bytes object is returned on EOF.");
+
+static PyObject *
+py_read(_CrFileObject *self, PyObject *args)
+{
+    Py_ssize_t size = -1, len = 0, ret;
+    PyObject *bytes;
+
+    if (!PyArg_ParseTuple(args, "|n:read", &size))
+        return NULL;
+
+    if (check_CrFileStatus(self))
+        return NULL;
+
+    if (size >= 0) {
+        // Decompress directly into the returned object
+        bytes = PyBytes_FromStringAndSize(NULL, size);
+        if (!bytes)
+            return NULL;
+        while (len < size) {
+            ret = crfile_read_into(self, PyBytes_AS_STRING(bytes) + len,
+                                   size - len);
+            if (ret < 0) {
+                Py_DECREF(bytes);
+                return NULL;
+            }
+            if (ret == 0)
+                break;
+            len += ret;
+        }
+    } else {
+        Py_ssize_t alloc = 64*1024;
+        bytes = PyBytes_FromStringAndSize(NULL, alloc);
+        if (!bytes)
+            return NULL;
+        while (1) {
+            if (len == alloc) {
+                alloc *= 2;
+                if (_PyBytes_Resize(&bytes, alloc) < 0)
+                    return NULL;
+            }
+            ret = crfile_read_into(self, PyBytes_AS_STRING(bytes) + len,
+                                   alloc - len);
+            if (ret < 0) {
+                Py_DECREF(bytes);
+                return NULL;
+            }
+            if (ret == 0)
+                break;
+            len += ret;
+        }
+    }
+
+    if (len != PyBytes_GET_SIZE(bytes) && _PyBytes_Resize(&bytes, len) < 0)
+        return NULL;
+
+    return bytes;
+}
+
+PyDoc_STRVAR(readinto__doc__,
+"readinto(buffer) -> int\n\n"
+"Read data directly into a writable buffer (bytearray, memoryview, ...)\n"
+"without any intermediate copy. Returns number of read bytes, 0 on EOF.");
+
+static PyObject *
+py_readinto(_CrFileObject *self, PyObject *args)
+{
+    Py_buffer view;
+    Py_ssize_t ret;
+
+    if (!PyArg_ParseTuple(args, "w*:readinto", &view))
+        return NULL;
+
+    if (check_CrFileStatus(self)) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+
+    ret = crfile_read_into(self, view.buf, view.len);
+    PyBuffer_Release(&view);
+    if (ret < 0)
+        return NULL;
+
+    return PyLong_FromSsize_t(ret);
+}
+
 PyDoc_STRVAR(close__doc__,
 "close() -> None\n\n"
 "Close the file");
@@ -233,6 +411,12 @@ py_close(_CrFileObject *self, G_GNUC_UNUSED void *nothing)
 {
     GError *tmp_err = NULL;
 
+    if (self->busy) {
+        PyErr_SetString(CrErr_Exception,
+            "CrFile is being used by another thread");
+        return NULL;
+    }
+
     if (self->f) {
         cr_close(self->f, &tmp_err);
         self->f = NULL;
@@ -251,6 +435,8 @@ py_close(_CrFileObject *self, G_GNUC_UNUSED void *nothing)
 
 static struct PyMethodDef crfile_methods[] = {
     {"write", (PyCFunction)py_write, METH_VARARGS, write__doc__},
+    {"read", (PyCFunction)py_read, METH_VARARGS, read__doc__},
+    {"readinto", (PyCFunction)py_readinto, METH_VARARGS, readinto__doc__},
     {"close", (PyCFunction)py_close, METH_NOARGS, close__doc__},
     {NULL, NULL, 0, NULL} /* sentinel */
 };
@@ -133,6 +133,27 @@ class CrFile(_createrepo_c.CrFile):
         :arg stat: ContentStat object or None"""
         _createrepo_c.CrFile.__init__(self, filename, mode, comtype, stat)
 
+    def iter_chunks(self, size=1024*1024, ring=2):
+        """Iterate over the decompressed content of the file.
+
+        Yields memoryviews over a ring of ring internal buffers of the
+        given size, the data are read into the buffers by readinto()
+        without any copy. A yielded view is only valid until the ring
+        wraps (ring-1 following iterations), copy it (bytes(view))
+        if it has to be kept longer.
+
+        :arg size: Size of a buffer
+        :arg ring: Number of buffers in the ring"""
+        buffers = [bytearray(size) for _ in range(max(ring, 1))]
+        views = [memoryview(buf) for buf in buffers]
+        x = 0
+        while True:
+            length = self.readinto(views[x])
+            if not length:
+                return
+            yield views[x][:length]
+            x = (x + 1) % len(views)
+
 # Metadata class
 
 Metadata = _createrepo_c.Metadata
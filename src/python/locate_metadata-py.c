@@ -161,6 +161,10 @@ getitem(_MetadataLocationObject *self, PyObject *pykey)
         value = self->ml->fil_sqlite_href;
     } else if (!strcmp(key, "other_db")) {
         value = self->ml->oth_sqlite_href;
+    } else if (!strcmp(key, "filelists_index")) {
+        value = self->ml->fil_index_href;
+    } else if (!strcmp(key, "other_index")) {
+        value = self->ml->oth_index_href;
     } else if (!strcmp(key, "group")) {   //NOTE(amatej): Preserve old API for these specific files (group, group_gz, updateinfo)
         if (self->ml->additional_metadata){
             GSList *m = g_slist_find_custom(self->ml->additional_metadata, "group", cr_cmp_metadatum_type);
@@ -239,6 +239,37 @@ add_chunk(_XmlFileObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+PyDoc_STRVAR(set_buffer_size__doc__,
+"set_buffer_size(size) -> None\n\n"
+"Set size of the buffer in which chunks are collected before they are\n"
+"compressed and written. 0 disables the buffering (default)");
+
+static PyObject *
+set_buffer_size(_XmlFileObject *self, PyObject *args)
+{
+    Py_ssize_t size;
+    GError *err = NULL;
+
+    if (!PyArg_ParseTuple(args, "n:set_buffer_size", &size))
+        return NULL;
+
+    if (size < 0) {
+        PyErr_SetString(PyExc_ValueError, "Buffer size must be >= 0");
+        return NULL;
+    }
+
+    if (check_XmlFileStatus(self))
+        return NULL;
+
+    cr_xmlfile_set_buffer_size(self->xmlfile, (gsize) size, &err);
+    if (err) {
+        nice_exception(&err, NULL);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
 PyDoc_STRVAR(close__doc__,
 "close() -> None\n\n"
 "Close the XML file");
@@ -271,6 +302,8 @@ static struct PyMethodDef xmlfile_methods[] = {
         add_pkg__doc__},
     {"add_chunk", (PyCFunction)add_chunk, METH_VARARGS,
         add_chunk__doc__},
+    {"set_buffer_size", (PyCFunction)set_buffer_size, METH_VARARGS,
+        set_buffer_size__doc__},
     {"close", (PyCFunction)xmlfile_close, METH_NOARGS,
         close__doc__},
     {NULL, NULL, 0, NULL} /* sentinel */
@@ -1719,3 +1719,307 @@ cr_db_add_pkg(cr_SqliteDb *sqlitedb, cr_Package *pkg, GError **err)
 
     return CRE_OK;
 }
+
+
+/*
+ * Copy of packages from input databases
+ */
+
+#define COPY_DEPS_SQL(TABLE, PRE_COLUMN, PRE_VALUE) \
+    "INSERT INTO " TABLE " (name, flags, epoch, version, release, pkgKey" \
+    PRE_COLUMN ") " \
+    "SELECT d.name, d.flags, d.epoch, d.version, d.release, m.pkgKey" \
+    PRE_VALUE " " \
+    "FROM input." TABLE " d" \
+    "  JOIN input.packages p ON p.pkgKey = d.pkgKey" \
+    "  JOIN merged_pkgs m ON m.pkgId = p.pkgId " \
+    "ORDER BY m.pkgKey, d.rowid"
+
+static const char *copy_primary_sql[] = {
+    "INSERT INTO packages ("
+    "  pkgKey, pkgId, name, arch, version, epoch, release, summary,"
+    "  description, url, time_file, time_build, rpm_license, rpm_vendor,"
+    "  rpm_group, rpm_buildhost, rpm_sourcerpm, rpm_header_start,"
+    "  rpm_header_end, rpm_packager, size_package, size_installed,"
+    "  size_archive, location_href, location_base, checksum_type) "
+    "SELECT m.pkgKey, p.pkgId, p.name, p.arch, p.version, p.epoch,"
+    "  p.release, p.summary, p.description, p.url, p.time_file,"
+    "  p.time_build, p.rpm_license, p.rpm_vendor, p.rpm_group,"
+    "  p.rpm_buildhost, p.rpm_sourcerpm, p.rpm_header_start,"
+    "  p.rpm_header_end, p.rpm_packager, p.size_package, p.size_installed,"
+    "  p.size_archive, p.location_href, m.location_base, p.checksum_type "
+    "FROM input.packages p"
+    "  JOIN merged_pkgs m ON m.pkgId = p.pkgId "
+    "ORDER BY m.pkgKey",
+    "INSERT INTO files (name, type, pkgKey) "
+    "SELECT f.name, f.type, m.pkgKey "
+    "FROM input.files f"
+    "  JOIN input.packages p ON p.pkgKey = f.pkgKey"
+    "  JOIN merged_pkgs m ON m.pkgId = p.pkgId "
+    "ORDER BY m.pkgKey, f.rowid",
+    COPY_DEPS_SQL("requires", ", pre", ", d.pre"),
+    COPY_DEPS_SQL("provides", "", ""),
+    COPY_DEPS_SQL("conflicts", "", ""),
+    COPY_DEPS_SQL("obsoletes", "", ""),
+    COPY_DEPS_SQL("suggests", "", ""),
+    COPY_DEPS_SQL("enhances", "", ""),
+    COPY_DEPS_SQL("recommends", "", ""),
+    COPY_DEPS_SQL("supplements", "", ""),
+    NULL,
+};
+
+static const char *copy_filelists_sql[] = {
+    "INSERT INTO packages (pkgKey, pkgId) "
+    "SELECT m.pkgKey, p.pkgId "
+    "FROM input.packages p"
+    "  JOIN merged_pkgs m ON m.pkgId = p.pkgId "
+    "ORDER BY m.pkgKey",
+    "INSERT INTO filelist (pkgKey, dirname, filenames, filetypes) "
+    "SELECT m.pkgKey, f.dirname, f.filenames, f.filetypes "
+    "FROM input.filelist f"
+    "  JOIN input.packages p ON p.pkgKey = f.pkgKey"
+    "  JOIN merged_pkgs m ON m.pkgId = p.pkgId "
+    "ORDER BY m.pkgKey, f.rowid",
+    NULL,
+};
+
+static const char *copy_other_sql[] = {
+    "INSERT INTO packages (pkgKey, pkgId) "
+    "SELECT m.pkgKey, p.pkgId "
+    "FROM input.packages p"
+    "  JOIN merged_pkgs m ON m.pkgId = p.pkgId "
+    "ORDER BY m.pkgKey",
+    "INSERT INTO changelog (pkgKey, author, date, changelog) "
+    "SELECT m.pkgKey, c.author, c.date, c.changelog "
+    "FROM input.changelog c"
+    "  JOIN input.packages p ON p.pkgKey = c.pkgKey"
+    "  JOIN merged_pkgs m ON m.pkgId = p.pkgId "
+    "ORDER BY m.pkgKey, c.rowid",
+    NULL,
+};
+
+
+static gboolean
+db_attach_input(sqlite3 *db, const char *path, GError **err)
+{
+    int rc;
+    sqlite3_stmt *handle = NULL;
+
+    assert(!err || *err == NULL);
+
+    // ATTACH is not allowed inside of a transaction
+    sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+
+    rc = sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS input", -1, &handle,
+                            NULL);
+    if (rc == SQLITE_OK) {
+        cr_sqlite3_bind_text(handle, 1, path, -1, SQLITE_STATIC);
+        rc = sqlite3_step(handle);
+    }
+    sqlite3_finalize(handle);
+
+    sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+
+    if (rc != SQLITE_DONE) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot attach %s: %s", path, sqlite3_errmsg(db));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+static void
+db_detach_input(sqlite3 *db)
+{
+    sqlite3_exec(db, "DROP TABLE IF EXISTS temp.merged_pkgs", NULL, NULL, NULL);
+    sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    sqlite3_exec(db, "DETACH DATABASE input", NULL, NULL, NULL);
+    sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+}
+
+
+// Fill the merged_pkgs table (pkgId -> pkgKey in the output database)
+// and check that the attached input database contains all the packages
+static gboolean
+db_input_prepare(sqlite3 *db,
+                 const char *path,
+                 GSList *packages,
+                 GError **err)
+{
+    int rc;
+    sqlite3_stmt *handle = NULL;
+    gint64 num = 0;
+
+    assert(!err || *err == NULL);
+
+    rc = sqlite3_exec(db,
+            "CREATE TEMP TABLE merged_pkgs ("
+            "  pkgId TEXT PRIMARY KEY,"
+            "  pkgKey INTEGER,"
+            "  location_base TEXT)", NULL, NULL, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_prepare_v2(db,
+                "INSERT INTO merged_pkgs (pkgId, pkgKey, location_base) "
+                "VALUES (?, ?, ?)", -1, &handle, NULL);
+    if (rc != SQLITE_OK) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot create merged_pkgs table: %s",
+                    sqlite3_errmsg(db));
+        sqlite3_finalize(handle);
+        return FALSE;
+    }
+
+    for (GSList *elem = packages; elem; elem = g_slist_next(elem), num++) {
+        cr_Package *pkg = elem->data;
+        cr_sqlite3_bind_text(handle, 1, pkg->pkgId, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(handle, 2, pkg->pkgKey);
+        cr_sqlite3_bind_text(handle, 3, force_null(pkg->location_base), -1,
+                             SQLITE_STATIC);
+        rc = sqlite3_step(handle);
+        sqlite3_reset(handle);
+        if (rc != SQLITE_DONE) {
+            g_set_error(err, ERR_DOMAIN, CRE_DB,
+                        "Cannot add package %s to merged_pkgs: %s",
+                        pkg->pkgId, sqlite3_errmsg(db));
+            sqlite3_finalize(handle);
+            return FALSE;
+        }
+    }
+    sqlite3_finalize(handle);
+    handle = NULL;
+
+    // Every package must be in the input exactly once
+    rc = sqlite3_prepare_v2(db,
+            "SELECT (SELECT dbversion FROM input.db_info),"
+            "  COUNT(*), COUNT(DISTINCT m.pkgId) "
+            "FROM input.packages p"
+            "  JOIN merged_pkgs m ON m.pkgId = p.pkgId", -1, &handle, NULL);
+    if (rc == SQLITE_OK)
+        rc = sqlite3_step(handle);
+    if (rc != SQLITE_ROW) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Cannot read packages from %s: %s",
+                    path, sqlite3_errmsg(db));
+        sqlite3_finalize(handle);
+        return FALSE;
+    }
+
+    gint64 dbversion = sqlite3_column_int64(handle, 0);
+    gint64 count = sqlite3_column_int64(handle, 1);
+    gint64 distinct = sqlite3_column_int64(handle, 2);
+    sqlite3_finalize(handle);
+
+    if (dbversion != CR_DB_CACHE_DBVERSION) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "Unsupported version of %s: %"G_GINT64_FORMAT,
+                    path, dbversion);
+        return FALSE;
+    }
+
+    if (count != num || distinct != num) {
+        g_set_error(err, ERR_DOMAIN, CRE_DB,
+                    "%s doesn't match the packages (%"G_GINT64_FORMAT
+                    " of %"G_GINT64_FORMAT" found)", path, count, num);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+int
+cr_db_copy_pkgs(cr_SqliteDb *pri_db,
+                cr_SqliteDb *fil_db,
+                cr_SqliteDb *oth_db,
+                const char *pri_path,
+                const char *fil_path,
+                const char *oth_path,
+                GSList *packages,
+                GError **err)
+{
+    int ret = CRE_OK;
+    int attached = 0;
+    GError *tmp_err = NULL;
+    cr_SqliteDb *dbs[] = { pri_db, fil_db, oth_db };
+    const char *paths[] = { pri_path, fil_path, oth_path };
+    const char **sqls[] = { copy_primary_sql, copy_filelists_sql,
+                            copy_other_sql };
+    GPtrArray *handles;
+
+    assert(pri_db && fil_db && oth_db);
+    assert(pri_path && fil_path && oth_path);
+    assert(!err || *err == NULL);
+
+    if (!packages)
+        return CRE_OK;
+
+    handles = g_ptr_array_new();
+
+    // Check all the inputs and compile the statements first, the output
+    // databases are not modified if some of the inputs cannot be used
+    for (int x = 0; x < 3 && !tmp_err; x++) {
+        sqlite3 *db = dbs[x]->db;
+
+        if (!db_attach_input(db, paths[x], &tmp_err))
+            break;
+        attached++;
+
+        if (!db_input_prepare(db, paths[x], packages, &tmp_err))
+            break;
+
+        for (const char **sql = sqls[x]; *sql; sql++) {
+            sqlite3_stmt *handle = NULL;
+            if (sqlite3_prepare_v2(db, *sql, -1, &handle, NULL) != SQLITE_OK) {
+                g_set_error(&tmp_err, ERR_DOMAIN, CRE_DB,
+                            "Cannot prepare copy from %s: %s",
+                            paths[x], sqlite3_errmsg(db));
+                sqlite3_finalize(handle);
+                break;
+            }
+            g_ptr_array_add(handles, handle);
+        }
+    }
+
+    // Copy the rows, a failed copy is rolled back in all the databases
+    gboolean savepoint = !tmp_err;
+    if (savepoint)
+        for (int x = 0; x < 3; x++)
+            sqlite3_exec(dbs[x]->db, "SAVEPOINT copy_pkgs", NULL, NULL, NULL);
+
+    for (guint x = 0; x < handles->len && !tmp_err; x++) {
+        sqlite3_stmt *handle = g_ptr_array_index(handles, x);
+        if (sqlite3_step(handle) != SQLITE_DONE) {
+            sqlite3 *db = sqlite3_db_handle(handle);
+            g_set_error(&tmp_err, ERR_DOMAIN, CRE_DB,
+                        "Error copying packages to db: %s",
+                        sqlite3_errmsg(db));
+        }
+    }
+
+    // Statements must be finalized before the rollback and before
+    // the input is detached
+    for (guint x = 0; x < handles->len; x++)
+        sqlite3_finalize(g_ptr_array_index(handles, x));
+
+    if (savepoint) {
+        for (int x = 0; x < 3; x++) {
+            if (tmp_err)
+                sqlite3_exec(dbs[x]->db, "ROLLBACK TO copy_pkgs",
+                             NULL, NULL, NULL);
+            sqlite3_exec(dbs[x]->db, "RELEASE copy_pkgs", NULL, NULL, NULL);
+        }
+    }
+
+    g_ptr_array_free(handles, TRUE);
+    for (int x = 0; x < attached; x++)
+        db_detach_input(dbs[x]->db);
+
+    if (tmp_err) {
+        ret = tmp_err->code;
+        g_propagate_error(err, tmp_err);
+    }
+
+    return ret;
+}
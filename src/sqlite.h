@@ -152,6 +152,34 @@ int cr_db_add_pkg(cr_SqliteDb *sqlitedb,
                   cr_Package *pkg,
                   GError **err);
 
+/** Copy packages from the databases of an input repository. Rows of
+ * the packages (dependencies, files, changelogs, ...) are copied by
+ * INSERT ... SELECT from the attached input databases, so neither of them
+ * has to be loaded. Packages are identified by their pkgId, pkgKey and
+ * location_base (primary only) are taken from the package objects.
+ * If some of the input databases doesn't contain exactly the packages
+ * (or it is of an unsupported version) or the copying fails, CRE_DB is
+ * returned and none of the output databases is modified.
+ * @param pri_db                open primary db connection
+ * @param fil_db                open filelists db connection
+ * @param oth_db                open other db connection
+ * @param pri_path              path to uncompressed input primary db
+ * @param fil_path              path to uncompressed input filelists db
+ * @param oth_path              path to uncompressed input other db
+ * @param packages              list of cr_Package with pkgKeys unused
+ *                              in the output databases
+ * @param err                   **GError
+ * @return                      cr_Error code
+ */
+int cr_db_copy_pkgs(cr_SqliteDb *pri_db,
+                    cr_SqliteDb *fil_db,
+                    cr_SqliteDb *oth_db,
+                    const char *pri_path,
+                    const char *fil_path,
+                    const char *oth_path,
+                    GSList *packages,
+                    GError **err);
+
 /** Insert record into the updateinfo table
  * @param sqlitedb              open db connection
  * @param checksum              compressed xml file checksum
@@ -0,0 +1,566 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <string.h>
+#include <curl/curl.h>
+#ifdef WITH_ZLIB_NG
+#include <zlib-ng.h>
+#else
+#include <zlib.h>
+#endif
+#include <bzlib.h>
+#include <lzma.h>
+#include "error.h"
+#include "compression_wrapper.h"
+#include "url_stream.h"
+
+#define ERR_DOMAIN              CREATEREPO_C_ERROR
+
+#define MAGIC_LEN               6   // Longest magic we detect (xz)
+#define MAX_REDIRS              6
+
+#ifdef WITH_ZLIB_NG
+#define z_stream                zng_stream
+#define inflateInit2            zng_inflateInit2
+#define inflate                 zng_inflate
+#define inflateReset            zng_inflateReset
+#define inflateEnd              zng_inflateEnd
+#endif
+
+struct _cr_UrlStream {
+    gchar               *url;
+    GThread             *thread;    /*!< Download thread */
+
+    // Shared by the download thread and the reader
+
+    GMutex              mutex;
+    GCond               cond;
+    GQueue              chunks;     /*!< Downloaded, not yet read GBytes */
+    gsize               queued;     /*!< Size of the data in chunks */
+    gboolean            finished;   /*!< Download thread has finished */
+    gboolean            cancelled;  /*!< Download should be aborted */
+    GError              *download_err;
+
+    // Used only by the reader
+
+    cr_CompressionType  type;       /*!< UNKNOWN until the first read */
+    GBytes              *chunk;     /*!< Chunk being decompressed */
+    const guchar        *in;        /*!< Unprocessed data of the chunk */
+    gsize               in_len;
+    gboolean            in_eof;     /*!< All downloaded data were taken */
+    gboolean            out_eof;    /*!< All data were decompressed */
+    gboolean            member_end; /*!< Decoder is between two gzip members
+                                         or bzip2 streams */
+    z_stream            gz;
+    bz_stream           bz;
+    lzma_stream         xz;
+};
+
+static GMutex prefetched_mutex;         // Guards prefetched
+static GHashTable *prefetched = NULL;   // url -> cr_UrlStream
+
+gboolean
+cr_url_is_remote(const char *path)
+{
+    return path && (g_str_has_prefix(path, "http://") ||
+                    g_str_has_prefix(path, "https://") ||
+                    g_str_has_prefix(path, "ftp://"));
+}
+
+static size_t
+url_stream_write_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    cr_UrlStream *stream = userdata;
+    size_t len = size * nmemb;
+
+    g_mutex_lock(&stream->mutex);
+    while (stream->queued >= CR_URL_STREAM_READAHEAD && !stream->cancelled)
+        g_cond_wait(&stream->cond, &stream->mutex);
+
+    if (stream->cancelled) {
+        // Returning less than len makes curl abort the transfer
+        g_mutex_unlock(&stream->mutex);
+        return 0;
+    }
+
+    g_queue_push_tail(&stream->chunks, g_bytes_new(ptr, len));
+    stream->queued += len;
+    g_cond_broadcast(&stream->cond);
+    g_mutex_unlock(&stream->mutex);
+
+    return len;
+}
+
+static int
+url_stream_progress_cb(void *clientp,
+                       G_GNUC_UNUSED curl_off_t dltotal,
+                       G_GNUC_UNUSED curl_off_t dlnow,
+                       G_GNUC_UNUSED curl_off_t ultotal,
+                       G_GNUC_UNUSED curl_off_t ulnow)
+{
+    cr_UrlStream *stream = clientp;
+    gboolean cancelled;
+
+    // Abort also a transfer which doesn't receive any data
+    g_mutex_lock(&stream->mutex);
+    cancelled = stream->cancelled;
+    g_mutex_unlock(&stream->mutex);
+
+    return cancelled ? 1 : 0;
+}
+
+static gpointer
+url_stream_download_thread(gpointer data)
+{
+    cr_UrlStream *stream = data;
+    CURL *handle;
+    CURLcode rcode;
+    char errorbuf[CURL_ERROR_SIZE];
+    GError *tmp_err = NULL;
+
+    errorbuf[0] = '\0';
+    handle = curl_easy_init();
+    if (!handle) {
+        g_set_error(&tmp_err, ERR_DOMAIN, CRE_CURL,
+                    "curl_easy_init() failed");
+        goto download_thread_end;
+    }
+
+    if (curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, errorbuf) != CURLE_OK
+        || curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1) != CURLE_OK
+        || curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1) != CURLE_OK
+        || curl_easy_setopt(handle, CURLOPT_MAXREDIRS, MAX_REDIRS) != CURLE_OK
+        || curl_easy_setopt(handle, CURLOPT_URL, stream->url) != CURLE_OK
+        || curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION,
+                            url_stream_write_cb) != CURLE_OK
+        || curl_easy_setopt(handle, CURLOPT_WRITEDATA, stream) != CURLE_OK
+        || curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0) != CURLE_OK
+        || curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION,
+                            url_stream_progress_cb) != CURLE_OK
+        || curl_easy_setopt(handle, CURLOPT_XFERINFODATA, stream) != CURLE_OK)
+    {
+        g_set_error(&tmp_err, ERR_DOMAIN, CRE_CURL,
+                    "curl_easy_setopt failed");
+        goto download_thread_end;
+    }
+
+    rcode = curl_easy_perform(handle);
+    if (rcode != CURLE_OK)
+        g_set_error(&tmp_err, ERR_DOMAIN, CRE_CURL,
+                    "Cannot download %s: %s", stream->url,
+                    *errorbuf ? errorbuf : curl_easy_strerror(rcode));
+
+download_thread_end:
+
+    if (handle)
+        curl_easy_cleanup(handle);
+
+    g_mutex_lock(&stream->mutex);
+    stream->finished = TRUE;
+    stream->download_err = tmp_err;
+    g_cond_broadcast(&stream->cond);
+    g_mutex_unlock(&stream->mutex);
+
+    return NULL;
+}
+
+static cr_UrlStream *
+url_stream_new(const char *url)
+{
+    cr_UrlStream *stream = g_new0(cr_UrlStream, 1);
+
+    stream->url = g_strdup(url);
+    stream->type = CR_CW_UNKNOWN_COMPRESSION;
+    g_mutex_init(&stream->mutex);
+    g_cond_init(&stream->cond);
+    g_queue_init(&stream->chunks);
+
+    g_debug("%s: Streaming %s", __func__, url);
+    stream->thread = g_thread_new("url_stream", url_stream_download_thread,
+                                  stream);
+    return stream;
+}
+
+cr_UrlStream *
+cr_url_stream_open(const char *url, GError **err)
+{
+    cr_UrlStream *stream = NULL;
+
+    assert(url);
+    assert(!err || *err == NULL);
+
+    if (!cr_url_is_remote(url)) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Cannot stream %s: Unsupported protocol", url);
+        return NULL;
+    }
+
+    g_mutex_lock(&prefetched_mutex);
+    if (prefetched) {
+        stream = g_hash_table_lookup(prefetched, url);
+        if (stream)
+            g_hash_table_steal(prefetched, url);
+    }
+    g_mutex_unlock(&prefetched_mutex);
+
+    if (!stream)
+        stream = url_stream_new(url);
+
+    return stream;
+}
+
+void
+cr_url_stream_prefetch(const char *url)
+{
+    assert(cr_url_is_remote(url));
+
+    g_mutex_lock(&prefetched_mutex);
+    if (!prefetched)
+        prefetched = g_hash_table_new(g_str_hash, g_str_equal);
+    if (!g_hash_table_contains(prefetched, url)) {
+        cr_UrlStream *stream = url_stream_new(url);
+        g_hash_table_insert(prefetched, stream->url, stream);
+    }
+    g_mutex_unlock(&prefetched_mutex);
+}
+
+void
+cr_url_stream_discard(const char *url)
+{
+    cr_UrlStream *stream = NULL;
+
+    g_mutex_lock(&prefetched_mutex);
+    if (prefetched) {
+        stream = g_hash_table_lookup(prefetched, url);
+        if (stream)
+            g_hash_table_steal(prefetched, url);
+    }
+    g_mutex_unlock(&prefetched_mutex);
+
+    cr_url_stream_free(stream);
+}
+
+void
+cr_url_stream_free(cr_UrlStream *stream)
+{
+    if (!stream)
+        return;
+
+    g_mutex_lock(&stream->mutex);
+    stream->cancelled = TRUE;
+    g_cond_broadcast(&stream->cond);
+    g_mutex_unlock(&stream->mutex);
+    g_thread_join(stream->thread);
+
+    switch (stream->type) {
+        case CR_CW_GZ_COMPRESSION:
+            inflateEnd(&stream->gz);
+            break;
+        case CR_CW_BZ2_COMPRESSION:
+            BZ2_bzDecompressEnd(&stream->bz);
+            break;
+        case CR_CW_XZ_COMPRESSION:
+            lzma_end(&stream->xz);
+            break;
+        default:
+            break;
+    }
+
+    if (stream->download_err)
+        g_error_free(stream->download_err);
+    while (!g_queue_is_empty(&stream->chunks))
+        g_bytes_unref(g_queue_pop_head(&stream->chunks));
+    if (stream->chunk)
+        g_bytes_unref(stream->chunk);
+    g_mutex_clear(&stream->mutex);
+    g_cond_clear(&stream->cond);
+    g_free(stream->url);
+    g_free(stream);
+}
+
+/** Take the next downloaded chunk, wait for it if necessary.
+ * Sets in_eof when the download is complete and all chunks were taken.
+ */
+static gboolean
+url_stream_next_chunk(cr_UrlStream *stream, GError **err)
+{
+    GBytes *chunk;
+    GError *download_err = NULL;
+
+    if (stream->chunk) {
+        g_bytes_unref(stream->chunk);
+        stream->chunk = NULL;
+    }
+
+    g_mutex_lock(&stream->mutex);
+    while (g_queue_is_empty(&stream->chunks) && !stream->finished)
+        g_cond_wait(&stream->cond, &stream->mutex);
+
+    chunk = g_queue_pop_head(&stream->chunks);
+    if (chunk) {
+        stream->queued -= g_bytes_get_size(chunk);
+        g_cond_broadcast(&stream->cond);
+    } else {
+        download_err = stream->download_err;
+        stream->download_err = NULL;
+    }
+    g_mutex_unlock(&stream->mutex);
+
+    if (!chunk) {
+        stream->in_eof = TRUE;
+        stream->in_len = 0;
+        if (download_err) {
+            // The data are incomplete even if the caller doesn't ask why
+            g_warning("%s: %s", __func__, download_err->message);
+            g_propagate_error(err, download_err);
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    stream->chunk = chunk;
+    stream->in = g_bytes_get_data(chunk, &stream->in_len);
+    return TRUE;
+}
+
+/** Detect the compression from the magic bytes at the beginning of the
+ * data and prepare the decoder.
+ */
+static gboolean
+url_stream_init_decoder(cr_UrlStream *stream, GError **err)
+{
+    GError *tmp_err = NULL;
+    const guchar *magic;
+    int ret;
+
+    // Make sure the first chunk contains the whole magic
+    if (!url_stream_next_chunk(stream, err))
+        return FALSE;
+
+    if (stream->in_len < MAGIC_LEN && !stream->in_eof) {
+        GByteArray *head = g_byte_array_new();
+        while (stream->in_len > 0 && head->len < MAGIC_LEN) {
+            g_byte_array_append(head, stream->in, stream->in_len);
+            if (!url_stream_next_chunk(stream, &tmp_err)) {
+                g_propagate_error(err, tmp_err);
+                g_byte_array_unref(head);
+                return FALSE;
+            }
+        }
+        if (stream->in_len > 0)
+            g_byte_array_append(head, stream->in, stream->in_len);
+        if (stream->chunk)
+            g_bytes_unref(stream->chunk);
+        stream->chunk = g_byte_array_free_to_bytes(head);
+        stream->in = g_bytes_get_data(stream->chunk, &stream->in_len);
+    }
+
+    magic = stream->in;
+    if (stream->in_len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        stream->type = CR_CW_GZ_COMPRESSION;
+    else if (stream->in_len >= 3 && !memcmp(magic, "BZh", 3))
+        stream->type = CR_CW_BZ2_COMPRESSION;
+    else if (stream->in_len >= 6 && !memcmp(magic, "\xfd" "7zXZ\0", 6))
+        stream->type = CR_CW_XZ_COMPRESSION;
+    else if (stream->in_len >= 5 && !memcmp(magic, "\0ZCK1", 5)) {
+        g_set_error(err, ERR_DOMAIN, CRE_UNKNOWNCOMPRESSION,
+                    "Cannot stream %s: Zchunk files cannot be streamed",
+                    stream->url);
+        return FALSE;
+    } else
+        stream->type = CR_CW_NO_COMPRESSION;
+
+    switch (stream->type) {
+        case CR_CW_GZ_COMPRESSION:
+            // 15 + 32 - max window size + gzip/zlib header autodetection
+            if (inflateInit2(&stream->gz, 15 + 32) != Z_OK) {
+                stream->type = CR_CW_NO_COMPRESSION;
+                g_set_error(err, ERR_DOMAIN, CRE_GZ,
+                            "inflateInit2() failed");
+                return FALSE;
+            }
+            break;
+        case CR_CW_BZ2_COMPRESSION:
+            ret = BZ2_bzDecompressInit(&stream->bz, 0, 0);
+            if (ret != BZ_OK) {
+                stream->type = CR_CW_NO_COMPRESSION;
+                g_set_error(err, ERR_DOMAIN, CRE_BZ2,
+                            "BZ2_bzDecompressInit() failed: %d", ret);
+                return FALSE;
+            }
+            break;
+        case CR_CW_XZ_COMPRESSION:
+            ret = lzma_auto_decoder(&stream->xz, UINT64_MAX,
+                                    LZMA_CONCATENATED);
+            if (ret != LZMA_OK) {
+                stream->type = CR_CW_NO_COMPRESSION;
+                g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                            "lzma_auto_decoder() failed: %d", ret);
+                return FALSE;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return TRUE;
+}
+
+/** Decompress as much of the current input as fits into the buffer.
+ * @return              Number of produced bytes, -1 on error
+ */
+static gssize
+url_stream_decode(cr_UrlStream *stream,
+                  guchar *out,
+                  gsize out_len,
+                  GError **err)
+{
+    gsize avail_in = stream->in_len;
+    gsize avail_out = out_len;
+    int ret;
+
+    switch (stream->type) {
+
+        case CR_CW_NO_COMPRESSION:
+            avail_out = out_len - MIN(out_len, stream->in_len);
+            avail_in = stream->in_len - (out_len - avail_out);
+            memcpy(out, stream->in, out_len - avail_out);
+            if (stream->in_eof && avail_in == 0)
+                stream->out_eof = TRUE;
+            break;
+
+        case CR_CW_GZ_COMPRESSION:
+            stream->gz.next_in = (Bytef *) stream->in;
+            stream->gz.avail_in = stream->in_len;
+            stream->gz.next_out = out;
+            stream->gz.avail_out = out_len;
+            ret = inflate(&stream->gz, Z_NO_FLUSH);
+            avail_in = stream->gz.avail_in;
+            avail_out = stream->gz.avail_out;
+            if (ret == Z_STREAM_END) {
+                // Another gzip member may follow
+                stream->member_end = TRUE;
+                inflateReset(&stream->gz);
+            } else if (ret == Z_OK || ret == Z_BUF_ERROR) {
+                if (avail_in != stream->in_len)
+                    stream->member_end = FALSE;
+            } else {
+                g_set_error(err, ERR_DOMAIN, CRE_GZ,
+                            "Cannot decompress %s: %s", stream->url,
+                            stream->gz.msg ? stream->gz.msg : "zlib error");
+                return -1;
+            }
+            break;
+
+        case CR_CW_BZ2_COMPRESSION:
+            stream->bz.next_in = (char *) stream->in;
+            stream->bz.avail_in = stream->in_len;
+            stream->bz.next_out = (char *) out;
+            stream->bz.avail_out = out_len;
+            ret = BZ2_bzDecompress(&stream->bz);
+            avail_in = stream->bz.avail_in;
+            avail_out = stream->bz.avail_out;
+            if (ret == BZ_STREAM_END) {
+                // Another bzip2 stream may follow
+                stream->member_end = TRUE;
+                BZ2_bzDecompressEnd(&stream->bz);
+                ret = BZ2_bzDecompressInit(&stream->bz, 0, 0);
+            } else if (avail_in != stream->in_len) {
+                stream->member_end = FALSE;
+            }
+            if (ret != BZ_OK) {
+                g_set_error(err, ERR_DOMAIN, CRE_BZ2,
+                            "Cannot decompress %s: Bz2 error %d",
+                            stream->url, ret);
+                return -1;
+            }
+            break;
+
+        case CR_CW_XZ_COMPRESSION:
+            stream->xz.next_in = stream->in;
+            stream->xz.avail_in = stream->in_len;
+            stream->xz.next_out = out;
+            stream->xz.avail_out = out_len;
+            ret = lzma_code(&stream->xz,
+                            stream->in_eof ? LZMA_FINISH : LZMA_RUN);
+            avail_in = stream->xz.avail_in;
+            avail_out = stream->xz.avail_out;
+            if (ret == LZMA_STREAM_END) {
+                stream->out_eof = TRUE;
+            } else if (ret != LZMA_OK && ret != LZMA_BUF_ERROR) {
+                g_set_error(err, ERR_DOMAIN, CRE_XZ,
+                            "Cannot decompress %s: XZ error %d",
+                            stream->url, ret);
+                return -1;
+            }
+            break;
+
+        default:
+            assert(0);
+            return -1;
+    }
+
+    stream->in += stream->in_len - avail_in;
+    stream->in_len = avail_in;
+
+    return out_len - avail_out;
+}
+
+int
+cr_url_stream_read(cr_UrlStream *stream,
+                   void *buffer,
+                   unsigned int len,
+                   GError **err)
+{
+    assert(stream);
+    assert(!err || *err == NULL);
+
+    if (stream->type == CR_CW_UNKNOWN_COMPRESSION
+        && !url_stream_init_decoder(stream, err))
+        return -1;
+
+    while (!stream->out_eof && len > 0) {
+        gssize produced;
+
+        if (stream->in_len == 0 && !stream->in_eof
+            && !url_stream_next_chunk(stream, err))
+            return -1;
+
+        produced = url_stream_decode(stream, buffer, len, err);
+        if (produced < 0)
+            return -1;
+        if (produced > 0)
+            return (int) produced;
+
+        if (stream->in_len == 0 && stream->in_eof && !stream->out_eof) {
+            // Nothing more to decode
+            if (!stream->member_end) {
+                g_set_error(err, ERR_DOMAIN, CRE_IO,
+                            "Cannot decompress %s: Unexpected end of data",
+                            stream->url);
+                return -1;
+            }
+            stream->out_eof = TRUE;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_URL_STREAM_H__
+#define __C_CREATEREPOLIB_URL_STREAM_H__
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \defgroup   url_stream  Streaming of remote (compressed) files.
+ *  \addtogroup url_stream
+ *  @{
+ */
+
+/** Max amount of downloaded but not yet read data buffered by a stream.
+ * When it is reached, the download waits for the reader.
+ */
+#define CR_URL_STREAM_READAHEAD     (64*1024*1024)
+
+/** Remote file which is downloaded by a background thread and
+ * decompressed while it is read. The compression (none, gzip, bzip2, xz)
+ * is detected from the first bytes of the data. Zchunk is not supported.
+ */
+typedef struct _cr_UrlStream cr_UrlStream;
+
+/** Check if the path is an URL which can be streamed
+ * (http://, https:// or ftp://).
+ * @param path          Path or URL
+ * @return              TRUE if the path is a remote URL
+ */
+gboolean
+cr_url_is_remote(const char *path);
+
+/** Start the download of the URL.
+ * If the URL was prefetched by cr_url_stream_prefetch() the prefetched
+ * stream (including the already downloaded data) is returned.
+ * @param url           URL
+ * @param err           GError **
+ * @return              Stream or NULL on error
+ */
+cr_UrlStream *
+cr_url_stream_open(const char *url, GError **err);
+
+/** Read decompressed data. Blocks until some data are downloaded.
+ * @param stream        Stream
+ * @param buffer        Target buffer
+ * @param len           Size of the buffer
+ * @param err           GError **
+ * @return              Number of read bytes, 0 at the end of the file,
+ *                      -1 on error (download error, corrupted data, ...)
+ */
+int
+cr_url_stream_read(cr_UrlStream *stream,
+                   void *buffer,
+                   unsigned int len,
+                   GError **err);
+
+/** Abort the download (if it is still running) and free the stream.
+ * @param stream        Stream
+ */
+void
+cr_url_stream_free(cr_UrlStream *stream);
+
+/** Start the download of the URL in the background. The data are buffered
+ * (up to CR_URL_STREAM_READAHEAD bytes) until the URL is opened by
+ * cr_url_stream_open(). Nothing happens if the URL is already prefetched.
+ * @param url           URL
+ */
+void
+cr_url_stream_prefetch(const char *url);
+
+/** Abort the prefetch of the URL if it wasn't opened by
+ * cr_url_stream_open() yet.
+ * @param url           URL
+ */
+void
+cr_url_stream_discard(const char *url);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_URL_STREAM_H__ */
@@ -0,0 +1,215 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "error.h"
+#include "cleanup.h"
+#include "version.h"
+#include "createrepo_shared.h"
+#include "verifyrepo_shared.h"
+
+/**
+ * Command line options
+ */
+typedef struct {
+
+    /* Items filled by cmd option parser */
+
+    gboolean version;           /*!< print program version */
+    gboolean quiet;             /*!< quiet mode */
+    gboolean verbose;           /*!< verbose mode */
+    gboolean packages;          /*!< verify pkgIds of packages */
+    gint workers;               /*!< number of threads */
+    gchar *report;              /*!< path to the JSON report */
+
+} VerifyrepoCmdOptions;
+
+static VerifyrepoCmdOptions *
+verifyrepocmdoptions_new(void)
+{
+    VerifyrepoCmdOptions *options;
+
+    options = g_new(VerifyrepoCmdOptions, 1);
+    options->version = FALSE;
+    options->quiet = FALSE;
+    options->verbose = FALSE;
+    options->packages = FALSE;
+    options->workers = 0;
+    options->report = NULL;
+
+    return options;
+}
+
+static void
+verifyrepocmdoptions_free(VerifyrepoCmdOptions *options)
+{
+    g_free(options->report);
+    g_free(options);
+}
+
+CR_DEFINE_CLEANUP_FUNCTION0(VerifyrepoCmdOptions*, cr_local_verifyrepocmdoptions_free, verifyrepocmdoptions_free)
+#define _cleanup_verifyrepocmdoptions_free_ __attribute__ ((cleanup(cr_local_verifyrepocmdoptions_free)))
+
+/**
+ * Parse commandline arguments for verifyrepo utility
+ */
+static gboolean
+parse_verifyrepo_arguments(int *argc,
+                           char ***argv,
+                           VerifyrepoCmdOptions *options,
+                           GError **err)
+{
+    const GOptionEntry cmd_entries[] = {
+
+        { "version", 'V', 0, G_OPTION_ARG_NONE, &(options->version),
+          "Show program's version number and exit.", NULL},
+        { "quiet", 'q', 0, G_OPTION_ARG_NONE, &(options->quiet),
+          "Run quietly.", NULL },
+        { "verbose", 'v', 0, G_OPTION_ARG_NONE, &(options->verbose),
+          "Run verbosely.", NULL },
+        { "packages", 'p', 0, G_OPTION_ARG_NONE, &(options->packages),
+          "Verify also that checksums of all packages match their pkgIds "
+          "in primary.xml.", NULL },
+        { "workers", '\0', 0, G_OPTION_ARG_INT, &(options->workers),
+          "Number of threads which verify the files "
+          "(default: number of processors).", "INT" },
+        { "report", '\0', 0, G_OPTION_ARG_FILENAME, &(options->report),
+          "Write a report in JSON into the file (\"-\" for stdout).", "FILE" },
+        { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL },
+    };
+
+    // Parse cmd arguments
+    GOptionContext *context;
+    context = g_option_context_new("<repo_directory>");
+    g_option_context_set_summary(context, "Verify integrity of a repository.");
+    g_option_context_add_main_entries(context, cmd_entries, NULL);
+    gboolean ret = g_option_context_parse(context, argc, argv, err);
+    g_option_context_free(context);
+    return ret;
+}
+
+/**
+ * Check parsed arguments.
+ */
+static gboolean
+check_arguments(VerifyrepoCmdOptions *options, GError **err)
+{
+    // --workers
+    if (options->workers < 0) {
+        g_set_error(err, CREATEREPO_C_ERROR, CRE_BADARG,
+                    "Wrong number of workers: %d", options->workers);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+print_failures(GPtrArray *results)
+{
+    for (guint x = 0; x < results->len; x++) {
+        cr_VerifyResult *result = g_ptr_array_index(results, x);
+        if (result->status != CR_VERIFY_FAILED)
+            continue;
+        for (GSList *elem = result->errors; elem; elem = g_slist_next(elem))
+            g_printerr("%s (%s): %s\n", result->target,
+                       result->path ? result->path : "", (char *) elem->data);
+    }
+}
+
+/**
+ * Main
+ */
+int
+main(int argc, char **argv)
+{
+    _cleanup_verifyrepocmdoptions_free_ VerifyrepoCmdOptions *options = NULL;
+    _cleanup_error_free_ GError *tmp_err = NULL;
+
+    // Parse arguments
+    options = verifyrepocmdoptions_new();
+    if (!parse_verifyrepo_arguments(&argc, &argv, options, &tmp_err)) {
+        g_printerr("%s\n", tmp_err->message);
+        exit(EXIT_FAILURE);
+    }
+
+    // Set logging
+    cr_setup_logging(options->quiet, options->verbose);
+
+    // Print version if required
+    if (options->version) {
+        printf("Version: %s\n", cr_version_string_with_features());
+        exit(EXIT_SUCCESS);
+    }
+
+    // Check arguments
+    if (!check_arguments(options, &tmp_err)) {
+        g_printerr("%s\n", tmp_err->message);
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc != 2) {
+        g_printerr("Must specify exactly one repo directory to work on\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Emit debug message with version
+    g_debug("Version: %s", cr_version_string_with_features());
+
+    // Verify the repository
+    cr_VerifyReport *report = cr_verify_repo(argv[1], options->packages,
+                                             options->workers, &tmp_err);
+    if (!report) {
+        g_printerr("%s\n", tmp_err->message);
+        exit(EXIT_FAILURE);
+    }
+
+    if (options->report) {
+        gchar *json = cr_verify_report_to_json(report);
+        if (!g_strcmp0(options->report, "-")) {
+            fputs(json, stdout);
+        } else if (!g_file_set_contents(options->report, json, -1, &tmp_err)) {
+            g_printerr("Cannot write the report: %s\n", tmp_err->message);
+            g_free(json);
+            cr_verify_report_free(report);
+            exit(EXIT_FAILURE);
+        }
+        g_free(json);
+    }
+
+    print_failures(report->metadata);
+    print_failures(report->packages);
+
+    // Messages are printed to stdout, keep it for the report only
+    if (g_strcmp0(options->report, "-"))
+        g_message("Verified %u metadata files and %u packages "
+                  "(%"G_GINT64_FORMAT" bytes) in %.2f s: "
+                  "%"G_GINT64_FORMAT" failed, %"G_GINT64_FORMAT" skipped",
+                  report->metadata->len, report->packages->len,
+                  report->bytes, report->usecs / 1e6,
+                  report->failed, report->skipped);
+
+    gboolean ok = cr_verify_report_ok(report);
+    cr_verify_report_free(report);
+
+    exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,635 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <assert.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+#include "error.h"
+#include "checksum.h"
+#include "compression_wrapper.h"
+#include "misc.h"
+#include "package.h"
+#include "repomd.h"
+#include "sqlite.h"
+#include "verifyrepo_shared.h"
+#include "xml_parser.h"
+
+#define ERR_DOMAIN              CREATEREPO_C_ERROR
+#define BUFFER_SIZE             (256*1024)
+
+typedef struct {
+    cr_VerifyResult *result;
+    cr_RepomdRecord *rec;       // Repomd record or NULL for a package
+    const char *xml_checksum;   // Checksum of the XML of a sqlite database
+    char *pkgid;                // Package only
+    char *checksum_type;        // Package only
+    gint64 size_package;        // Package only
+    dev_t dev;
+    ino_t ino;
+} VerifyJob;
+
+typedef struct {
+    const char *repo_path;
+    GPtrArray *jobs;
+    GPtrArray *results;
+} PackagesData;
+
+static cr_VerifyResult *
+verify_result_new(const char *target, const char *path)
+{
+    cr_VerifyResult *result = g_new0(cr_VerifyResult, 1);
+    result->target = g_strdup(target);
+    result->path = g_strdup(path);
+    result->status = CR_VERIFY_OK;
+    result->size = -1;
+    return result;
+}
+
+static void
+verify_result_free(cr_VerifyResult *result)
+{
+    if (!result)
+        return;
+    g_free(result->target);
+    g_free(result->path);
+    g_slist_free_full(result->errors, g_free);
+    g_free(result);
+}
+
+static void
+verify_failed(cr_VerifyResult *result, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    result->errors = g_slist_append(result->errors,
+                                    g_strdup_vprintf(format, args));
+    va_end(args);
+    result->status = CR_VERIFY_FAILED;
+}
+
+static void
+verify_job_free(VerifyJob *job)
+{
+    g_free(job->pkgid);
+    g_free(job->checksum_type);
+    g_free(job);
+}
+
+static int
+warningcb(G_GNUC_UNUSED cr_XmlParserWarningType type,
+          char *msg,
+          void *cbdata,
+          G_GNUC_UNUSED GError **err)
+{
+    g_warning("XML parser warning (%s): %s", (gchar *) cbdata, msg);
+    return CR_CB_RET_OK;
+}
+
+/** Compare the checksum of the file with the expected one. */
+static void
+verify_checksum(cr_VerifyResult *result,
+                const char *what,
+                const char *type_name,
+                const char *expected,
+                const char *path)
+{
+    GError *tmp_err = NULL;
+    cr_ChecksumType type = cr_checksum_type(type_name);
+
+    if (type == CR_CHECKSUM_UNKNOWN) {
+        verify_failed(result, "Unknown %s type \"%s\"", what,
+                      type_name ? type_name : "");
+        return;
+    }
+
+    char *checksum = cr_checksum_file(path, type, &tmp_err);
+    if (!checksum) {
+        verify_failed(result, "Cannot compute %s: %s", what, tmp_err->message);
+        g_error_free(tmp_err);
+        return;
+    }
+
+    if (g_ascii_strcasecmp(checksum, expected))
+        verify_failed(result, "Wrong %s: %s (expected %s)", what,
+                      checksum, expected);
+    g_free(checksum);
+}
+
+/** Check the db_info table of a decompressed sqlite database. */
+static void
+verify_dbinfo(cr_VerifyResult *result,
+              const char *db_path,
+              const char *xml_checksum,
+              int db_ver)
+{
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+
+    if (sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READONLY, NULL)
+        != SQLITE_OK)
+    {
+        verify_failed(result, "Cannot open the database: %s",
+                      sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return;
+    }
+
+    if (sqlite3_prepare_v2(db, "SELECT dbversion, checksum FROM db_info",
+                           -1, &stmt, NULL) != SQLITE_OK)
+    {
+        verify_failed(result, "Cannot read db_info: %s", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return;
+    }
+
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        verify_failed(result, "Empty db_info");
+    } else {
+        int dbversion = sqlite3_column_int(stmt, 0);
+        const char *checksum = (const char *) sqlite3_column_text(stmt, 1);
+
+        if (dbversion != CR_DB_CACHE_DBVERSION)
+            verify_failed(result, "Unsupported dbversion %d in db_info "
+                          "(expected %d)", dbversion, CR_DB_CACHE_DBVERSION);
+        if (db_ver && dbversion != db_ver)
+            verify_failed(result, "Wrong dbversion %d in db_info "
+                          "(database_version %d in repomd.xml)",
+                          dbversion, db_ver);
+        if (xml_checksum && g_strcmp0(checksum, xml_checksum))
+            verify_failed(result, "Wrong checksum in db_info: %s "
+                          "(checksum of the XML is %s)",
+                          checksum ? checksum : "", xml_checksum);
+    }
+
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+}
+
+/** Verify the uncompressed content of the file. Sqlite databases are
+ * decompressed into a temporary file and their db_info is checked. */
+static void
+verify_content(cr_VerifyResult *result,
+               cr_RepomdRecord *rec,
+               const char *xml_checksum)
+{
+    GError *tmp_err = NULL;
+    gboolean is_db = g_str_has_suffix(rec->type, "_db");
+    gchar *db_path = NULL;
+    cr_ChecksumType type = CR_CHECKSUM_UNKNOWN;
+
+    if (rec->checksum_open) {
+        type = cr_checksum_type(rec->checksum_open_type);
+        if (type == CR_CHECKSUM_UNKNOWN) {
+            verify_failed(result, "Unknown open-checksum type \"%s\"",
+                          rec->checksum_open_type ? rec->checksum_open_type : "");
+            return;
+        }
+    }
+
+    cr_ContentStat *stat = cr_contentstat_new(type, NULL);
+
+    if (is_db) {
+        int fd = g_file_open_tmp("verifyrepo_db_XXXXXX", &db_path, &tmp_err);
+        if (fd == -1) {
+            verify_failed(result, "Cannot create a temporary file: %s",
+                          tmp_err->message);
+            g_error_free(tmp_err);
+            cr_contentstat_free(stat, NULL);
+            return;
+        }
+        close(fd);
+        cr_decompress_file_with_stat(result->path, db_path,
+                                     CR_CW_AUTO_DETECT_COMPRESSION,
+                                     stat, &tmp_err);
+    } else {
+        CR_FILE *f = cr_sopen(result->path, CR_CW_MODE_READ,
+                              CR_CW_AUTO_DETECT_COMPRESSION, stat, &tmp_err);
+        if (f) {
+            gchar *buffer = g_malloc(BUFFER_SIZE);
+            while (cr_read(f, buffer, BUFFER_SIZE, &tmp_err) > 0)
+                ;
+            g_free(buffer);
+            cr_close(f, tmp_err ? NULL : &tmp_err);
+        }
+    }
+
+    if (tmp_err) {
+        verify_failed(result, "Cannot decompress: %s", tmp_err->message);
+        g_error_free(tmp_err);
+        goto cleanup;
+    }
+
+    if (rec->size_open > 0 && stat->size != rec->size_open)
+        verify_failed(result, "Wrong open-size: %"G_GINT64_FORMAT
+                      " (expected %"G_GINT64_FORMAT")",
+                      stat->size, rec->size_open);
+    if (rec->checksum_open && g_ascii_strcasecmp(stat->checksum,
+                                                 rec->checksum_open))
+        verify_failed(result, "Wrong open-checksum: %s (expected %s)",
+                      stat->checksum, rec->checksum_open);
+    if (rec->checksum_header && stat->hdr_checksum
+        && g_ascii_strcasecmp(stat->hdr_checksum, rec->checksum_header))
+        verify_failed(result, "Wrong header-checksum: %s (expected %s)",
+                      stat->hdr_checksum, rec->checksum_header);
+    if (rec->size_header > 0 && stat->hdr_checksum
+        && stat->hdr_size != rec->size_header)
+        verify_failed(result, "Wrong header-size: %"G_GINT64_FORMAT
+                      " (expected %"G_GINT64_FORMAT")",
+                      stat->hdr_size, rec->size_header);
+
+    if (is_db)
+        verify_dbinfo(result, db_path, xml_checksum, rec->db_ver);
+
+cleanup:
+    if (db_path) {
+        g_unlink(db_path);
+        g_free(db_path);
+    }
+    cr_contentstat_free(stat, NULL);
+}
+
+static void
+verify_record(VerifyJob *job)
+{
+    cr_VerifyResult *result = job->result;
+    cr_RepomdRecord *rec = job->rec;
+
+    if (rec->size > 0 && result->size != rec->size)
+        verify_failed(result, "Wrong size: %"G_GINT64_FORMAT
+                      " (expected %"G_GINT64_FORMAT")",
+                      result->size, rec->size);
+
+    if (rec->checksum)
+        verify_checksum(result, "checksum", rec->checksum_type,
+                        rec->checksum, result->path);
+    else
+        verify_failed(result, "Missing checksum in repomd.xml");
+
+    if (rec->checksum_open || rec->size_open > 0 || rec->checksum_header
+        || g_str_has_suffix(rec->type, "_db"))
+        verify_content(result, rec, job->xml_checksum);
+}
+
+static void
+verify_package(VerifyJob *job)
+{
+    cr_VerifyResult *result = job->result;
+
+    if (job->size_package > 0 && result->size != job->size_package)
+        verify_failed(result, "Wrong size: %"G_GINT64_FORMAT
+                      " (expected %"G_GINT64_FORMAT")",
+                      result->size, job->size_package);
+
+    if (job->pkgid)
+        verify_checksum(result, "pkgId", job->checksum_type, job->pkgid,
+                        result->path);
+    else
+        verify_failed(result, "Missing pkgId in primary.xml");
+}
+
+static void
+verify_thread(gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+    VerifyJob *job = data;
+    cr_VerifyResult *result = job->result;
+    gint64 start = g_get_monotonic_time();
+
+    if (result->size < 0) {
+        verify_failed(result, "File doesn't exist");
+    } else if (job->rec) {
+        verify_record(job);
+    } else {
+        verify_package(job);
+    }
+
+    result->usecs = g_get_monotonic_time() - start;
+    if (result->status == CR_VERIFY_FAILED)
+        g_debug("%s: verification failed (%s)", result->path,
+                (char *) result->errors->data);
+    else
+        g_debug("%s: OK", result->path);
+}
+
+/** Stat the file of the job. Returns FALSE if the job should not
+ * be scheduled (the file is not local). */
+static gboolean
+verify_job_prepare(VerifyJob *job, const char *location_base)
+{
+    GStatBuf st;
+
+    if (location_base && *location_base) {
+        job->result->status = CR_VERIFY_SKIPPED;
+        return FALSE;
+    }
+
+    if (g_stat(job->result->path, &st) == 0 && S_ISREG(st.st_mode)) {
+        job->result->size = st.st_size;
+        job->dev = st.st_dev;
+        job->ino = st.st_ino;
+    }
+    return TRUE;
+}
+
+static gint
+cmp_records_by_size(gconstpointer a, gconstpointer b)
+{
+    const VerifyJob *job_a = *((VerifyJob **) a);
+    const VerifyJob *job_b = *((VerifyJob **) b);
+    if (job_a->result->size == job_b->result->size)
+        return 0;
+    return (job_a->result->size > job_b->result->size) ? -1 : 1;
+}
+
+static gint
+cmp_packages_by_inode(gconstpointer a, gconstpointer b)
+{
+    const VerifyJob *job_a = *((VerifyJob **) a);
+    const VerifyJob *job_b = *((VerifyJob **) b);
+    if (job_a->dev != job_b->dev)
+        return (job_a->dev < job_b->dev) ? -1 : 1;
+    if (job_a->ino != job_b->ino)
+        return (job_a->ino < job_b->ino) ? -1 : 1;
+    return 0;
+}
+
+static int
+pkgcb(cr_Package *pkg, void *cbdata, G_GNUC_UNUSED GError **err)
+{
+    PackagesData *data = cbdata;
+    const char *href = pkg->location_href ? pkg->location_href : "";
+    gchar *path = g_build_filename(data->repo_path,
+                                   cr_get_cleaned_href(href), NULL);
+
+    VerifyJob *job = g_new0(VerifyJob, 1);
+    job->result = verify_result_new(href, path);
+    job->pkgid = g_strdup(pkg->pkgId);
+    job->checksum_type = g_strdup(pkg->checksum_type);
+    job->size_package = pkg->size_package;
+    g_ptr_array_add(data->results, job->result);
+
+    if (verify_job_prepare(job, pkg->location_base))
+        g_ptr_array_add(data->jobs, job);
+    else
+        verify_job_free(job);
+
+    g_free(path);
+    cr_package_free(pkg);
+    return CR_CB_RET_OK;
+}
+
+cr_VerifyReport *
+cr_verify_repo(const char *repo_path,
+               gboolean packages,
+               guint workers,
+               GError **err)
+{
+    GError *tmp_err = NULL;
+    gint64 start = g_get_monotonic_time();
+
+    assert(repo_path);
+    assert(!err || *err == NULL);
+
+    // Load repomd.xml
+    gchar *repomd_path = g_build_filename(repo_path, "repodata", "repomd.xml",
+                                          NULL);
+    cr_Repomd *repomd = cr_repomd_new();
+    cr_xml_parse_repomd(repomd_path, repomd, warningcb, repomd_path, &tmp_err);
+    if (tmp_err) {
+        g_propagate_prefixed_error(err, tmp_err, "Cannot load %s: ",
+                                   repomd_path);
+        cr_repomd_free(repomd);
+        g_free(repomd_path);
+        return NULL;
+    }
+    g_free(repomd_path);
+
+    cr_VerifyReport *report = g_new0(cr_VerifyReport, 1);
+    report->repo_path = g_strdup(repo_path);
+    report->metadata = g_ptr_array_new_with_free_func(
+                                (GDestroyNotify) verify_result_free);
+    report->packages = g_ptr_array_new_with_free_func(
+                                (GDestroyNotify) verify_result_free);
+
+    if (!workers)
+        workers = g_get_num_processors();
+    GThreadPool *pool = g_thread_pool_new(verify_thread, NULL, workers,
+                                          TRUE, NULL);
+    GPtrArray *jobs = g_ptr_array_new_with_free_func(
+                                (GDestroyNotify) verify_job_free);
+
+    // Repomd records, the biggest first
+    for (GSList *elem = repomd->records; elem; elem = g_slist_next(elem)) {
+        cr_RepomdRecord *rec = elem->data;
+        const char *href = rec->location_href ? rec->location_href : "";
+        gchar *path = g_build_filename(repo_path, cr_get_cleaned_href(href),
+                                       NULL);
+
+        VerifyJob *job = g_new0(VerifyJob, 1);
+        job->result = verify_result_new(rec->type, path);
+        job->rec = rec;
+        if (rec->type && g_str_has_suffix(rec->type, "_db")) {
+            gchar *xml_type = g_strndup(rec->type, strlen(rec->type) - 3);
+            cr_RepomdRecord *xml_rec = cr_repomd_get_record(repomd, xml_type);
+            if (xml_rec)
+                job->xml_checksum = xml_rec->checksum;
+            g_free(xml_type);
+        }
+        g_ptr_array_add(report->metadata, job->result);
+
+        if (verify_job_prepare(job, rec->location_base))
+            g_ptr_array_add(jobs, job);
+        else
+            verify_job_free(job);
+        g_free(path);
+    }
+
+    g_ptr_array_sort(jobs, cmp_records_by_size);
+    for (guint x = 0; x < jobs->len; x++)
+        g_thread_pool_push(pool, g_ptr_array_index(jobs, x), NULL);
+
+    // Packages, in the order of their inodes. The primary.xml is parsed
+    // while the records are being verified.
+    GPtrArray *pkg_jobs = g_ptr_array_new_with_free_func(
+                                (GDestroyNotify) verify_job_free);
+    cr_RepomdRecord *pri_rec = cr_repomd_get_record(repomd, "primary");
+    if (packages && !pri_rec) {
+        cr_VerifyResult *result = verify_result_new("primary", NULL);
+        verify_failed(result, "Missing primary record in repomd.xml");
+        g_ptr_array_add(report->packages, result);
+    } else if (packages) {
+        gchar *pri_path = g_build_filename(repo_path,
+                            cr_get_cleaned_href(pri_rec->location_href), NULL);
+        PackagesData data = { repo_path, pkg_jobs, report->packages };
+
+        cr_xml_parse_primary(pri_path, NULL, NULL, pkgcb, &data,
+                             warningcb, pri_path, FALSE, &tmp_err);
+        if (tmp_err) {
+            cr_VerifyResult *result = verify_result_new("primary", pri_path);
+            verify_failed(result, "Cannot parse the list of packages: %s",
+                          tmp_err->message);
+            g_ptr_array_add(report->packages, result);
+            g_clear_error(&tmp_err);
+        }
+        g_free(pri_path);
+    }
+
+    g_ptr_array_sort(pkg_jobs, cmp_packages_by_inode);
+    for (guint x = 0; x < pkg_jobs->len; x++)
+        g_thread_pool_push(pool, g_ptr_array_index(pkg_jobs, x), NULL);
+
+    g_thread_pool_free(pool, FALSE, TRUE);
+    g_ptr_array_free(jobs, TRUE);
+    g_ptr_array_free(pkg_jobs, TRUE);
+    cr_repomd_free(repomd);
+
+    // Summary
+    GPtrArray *lists[] = { report->metadata, report->packages };
+    for (gsize l = 0; l < G_N_ELEMENTS(lists); l++) {
+        for (guint x = 0; x < lists[l]->len; x++) {
+            cr_VerifyResult *result = g_ptr_array_index(lists[l], x);
+            if (result->status == CR_VERIFY_FAILED)
+                report->failed++;
+            else if (result->status == CR_VERIFY_SKIPPED)
+                report->skipped++;
+            if (result->size > 0)
+                report->bytes += result->size;
+        }
+    }
+    report->usecs = g_get_monotonic_time() - start;
+
+    return report;
+}
+
+gboolean
+cr_verify_report_ok(cr_VerifyReport *report)
+{
+    assert(report);
+    return report->failed == 0;
+}
+
+static void
+json_append_string(GString *json, const char *str)
+{
+    if (!str) {
+        g_string_append(json, "null");
+        return;
+    }
+
+    g_string_append_c(json, '"');
+    for (const unsigned char *c = (const unsigned char *) str; *c; c++) {
+        switch (*c) {
+            case '"':  g_string_append(json, "\\\""); break;
+            case '\\': g_string_append(json, "\\\\"); break;
+            case '\n': g_string_append(json, "\\n"); break;
+            case '\t': g_string_append(json, "\\t"); break;
+            default:
+                if (*c < 0x20)
+                    g_string_append_printf(json, "\\u%04x", *c);
+                else
+                    g_string_append_c(json, *c);
+        }
+    }
+    g_string_append_c(json, '"');
+}
+
+static const char *
+verify_status_str(cr_VerifyStatus status)
+{
+    switch (status) {
+        case CR_VERIFY_OK:      return "ok";
+        case CR_VERIFY_FAILED:  return "failed";
+        case CR_VERIFY_SKIPPED: return "skipped";
+        default:                return "unknown";
+    }
+}
+
+static void
+json_append_results(GString *json, GPtrArray *results, gboolean all)
+{
+    gboolean first = TRUE;
+
+    g_string_append(json, "[");
+    for (guint x = 0; x < results->len; x++) {
+        cr_VerifyResult *result = g_ptr_array_index(results, x);
+        if (!all && result->status == CR_VERIFY_OK)
+            continue;
+
+        g_string_append(json, first ? "\n    {" : ",\n    {");
+        first = FALSE;
+        g_string_append(json, "\"target\": ");
+        json_append_string(json, result->target);
+        g_string_append(json, ", \"path\": ");
+        json_append_string(json, result->path);
+        g_string_append(json, ", \"status\": ");
+        json_append_string(json, verify_status_str(result->status));
+        g_string_append_printf(json, ", \"size\": %"G_GINT64_FORMAT
+                               ", \"seconds\": %.6f, \"errors\": [",
+                               result->size, result->usecs / 1e6);
+        for (GSList *elem = result->errors; elem; elem = g_slist_next(elem)) {
+            json_append_string(json, elem->data);
+            if (g_slist_next(elem))
+                g_string_append(json, ", ");
+        }
+        g_string_append(json, "]}");
+    }
+    g_string_append(json, first ? "]" : "\n  ]");
+}
+
+gchar *
+cr_verify_report_to_json(cr_VerifyReport *report)
+{
+    assert(report);
+
+    GString *json = g_string_new("{\n  \"repository\": ");
+    json_append_string(json, report->repo_path);
+    g_string_append_printf(json,
+            ",\n  \"ok\": %s"
+            ",\n  \"failed\": %"G_GINT64_FORMAT
+            ",\n  \"skipped\": %"G_GINT64_FORMAT
+            ",\n  \"packages_verified\": %u"
+            ",\n  \"bytes\": %"G_GINT64_FORMAT
+            ",\n  \"seconds\": %.6f"
+            ",\n  \"metadata\": ",
+            cr_verify_report_ok(report) ? "true" : "false",
+            report->failed, report->skipped, report->packages->len,
+            report->bytes, report->usecs / 1e6);
+    json_append_results(json, report->metadata, TRUE);
+    g_string_append(json, ",\n  \"packages\": ");
+    json_append_results(json, report->packages, FALSE);
+    g_string_append(json, "\n}\n");
+
+    return g_string_free(json, FALSE);
+}
+
+void
+cr_verify_report_free(cr_VerifyReport *report)
+{
+    if (!report)
+        return;
+    g_free(report->repo_path);
+    g_ptr_array_free(report->metadata, TRUE);
+    g_ptr_array_free(report->packages, TRUE);
+    g_free(report);
+}
@@ -0,0 +1,119 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_VERIFYREPO_SHARED_H__
+#define __C_CREATEREPOLIB_VERIFYREPO_SHARED_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+
+/** \defgroup   verifyrepo_shared   Verifyrepo API.
+ *
+ * Module which verifies integrity of a local repository. Every file
+ * referenced by repomd.xml is checked against its record (size, checksum,
+ * size and checksum of the uncompressed content, zchunk header checksum,
+ * db_info of sqlite databases) and optionally every package is checked
+ * against its pkgId from primary.xml.
+ *
+ *  \addtogroup verifyrepo_shared
+ *  @{
+ */
+
+/** Result of a verification of a single file.
+ */
+typedef enum {
+    CR_VERIFY_OK,           /*!< File matches the metadata */
+    CR_VERIFY_FAILED,       /*!< File is missing or doesn't match */
+    CR_VERIFY_SKIPPED,      /*!< File is not local (location_base is set) */
+    CR_VERIFY_SENTINEL,     /*!< Sentinel of the list */
+} cr_VerifyStatus;
+
+/** Verification of a single file.
+ */
+typedef struct {
+    gchar *target;          /*!< Record type or location_href of a package */
+    gchar *path;            /*!< Path to the file */
+    cr_VerifyStatus status; /*!< Result */
+    GSList *errors;         /*!< Messages (gchar *) describing the failure */
+    gint64 size;            /*!< Size of the file (-1 if missing) */
+    gint64 usecs;           /*!< Duration of the verification */
+} cr_VerifyResult;
+
+/** Report of a verified repository.
+ */
+typedef struct {
+    gchar *repo_path;       /*!< Path to the repository */
+    GPtrArray *metadata;    /*!< cr_VerifyResult of every repomd record */
+    GPtrArray *packages;    /*!< cr_VerifyResult of every package */
+    gint64 failed;          /*!< Number of failed files */
+    gint64 skipped;         /*!< Number of skipped files */
+    gint64 bytes;           /*!< Number of read bytes */
+    gint64 usecs;           /*!< Duration of the verification */
+} cr_VerifyReport;
+
+/** Verify the repository. Files are verified in parallel: repomd
+ * records are scheduled first, the biggest first (their decompression
+ * takes longest), then the packages in the order of their inodes, so the
+ * reads of the small files follow their on-disk layout as far as possible.
+ * A mismatch doesn't stop the verification, it is only recorded
+ * in the report.
+ * @param repo_path     Path to the repository (directory with repodata/)
+ * @param packages      Verify also pkgIds of packages from primary.xml
+ * @param workers       Number of threads (0 - number of processors)
+ * @param err           GError **
+ * @return              cr_VerifyReport or NULL if the repomd.xml cannot be
+ *                      loaded
+ */
+cr_VerifyReport *
+cr_verify_repo(const char *repo_path,
+               gboolean packages,
+               guint workers,
+               GError **err);
+
+/** Check if all files in the report were verified successfully.
+ * @param report        cr_VerifyReport
+ * @return              TRUE if no file failed
+ */
+gboolean
+cr_verify_report_ok(cr_VerifyReport *report);
+
+/** Report in JSON. Every repomd record is listed, packages only
+ * if they failed or were skipped.
+ * @param report        cr_VerifyReport
+ * @return              Null terminated string (free it with g_free())
+ */
+gchar *
+cr_verify_report_to_json(cr_VerifyReport *report);
+
+/** Free the report.
+ * @param report        cr_VerifyReport or NULL
+ */
+void
+cr_verify_report_free(cr_VerifyReport *report);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_VERIFYREPO_SHARED_H__ */
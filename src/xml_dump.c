@@ -23,6 +23,7 @@
 #include <libxml/xmlwriter.h>
 #include <libxml/parser.h>
 #include <string.h>
+#include "cleanup.h"
 #include "error.h"
 #include "misc.h"
 #include "xml_dump.h"
@@ -320,3 +321,76 @@ cr_xml_dump(cr_Package *pkg, GError **err)
 
     return result;
 }
+
+// Original primary chunk with xml:base of the location set to location_base.
+// NULL if the location isn't in the form written by cr_xml_dump_primary()
+// or the base would be escaped by libxml2.
+static char *
+cr_xml_raw_primary_relocate(const char *raw, const char *location_base)
+{
+    const char *attrs, *href, *end;
+
+    attrs = strstr(raw, "<location ");
+    if (!attrs)
+        return NULL;
+    attrs += strlen("<location ");
+
+    // Escaped attribute values contain neither '"' nor '>'
+    href = strstr(attrs, "href=\"");
+    end = strchr(attrs, '>');
+    if (!href || !end || href > end)
+        return NULL;
+    if (href != attrs) {
+        // Only the xml:base may precede the href
+        const char *value = attrs + strlen("xml:base=\"");
+        if (!g_str_has_prefix(attrs, "xml:base=\"")
+            || strchr(value, '"') != href - 2 || href[-1] != ' ')
+            return NULL;
+    }
+
+    GString *primary = g_string_sized_new(strlen(raw) + 128);
+    g_string_append_len(primary, raw, attrs - raw);
+
+    if (location_base && location_base[0] != '\0') {
+        _cleanup_free_ gchar *base = cr_prepend_protocol(location_base);
+        for (const char *c = base; *c; c++) {
+            if (*c < 0x20 || *c > 0x7e || strchr("\"&<>", *c)) {
+                g_string_free(primary, TRUE);
+                return NULL;
+            }
+        }
+        g_string_append_printf(primary, "xml:base=\"%s\" ", base);
+    }
+
+    g_string_append(primary, href);
+    g_string_append_c(primary, '\n');
+
+    return g_string_free(primary, FALSE);
+}
+
+struct cr_XmlStruct
+cr_xml_dump_raw(cr_Package *pkg, GError **err)
+{
+    struct cr_XmlStruct result;
+
+    assert(!err || *err == NULL);
+
+    result.primary   = NULL;
+    result.filelists = NULL;
+    result.other     = NULL;
+
+    if (!pkg)
+        return result;
+
+    if (pkg->raw_primary && pkg->raw_filelists && pkg->raw_other)
+        result.primary = cr_xml_raw_primary_relocate(pkg->raw_primary,
+                                                     pkg->location_base);
+
+    if (!result.primary)
+        return cr_xml_dump(pkg, err);
+
+    result.filelists = g_strconcat(pkg->raw_filelists, "\n", NULL);
+    result.other     = g_strconcat(pkg->raw_other, "\n", NULL);
+
+    return result;
+}
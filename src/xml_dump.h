@@ -118,6 +118,20 @@ char *cr_xml_dump_other(cr_Package *package, GError **err);
  */
 struct cr_XmlStruct cr_xml_dump(cr_Package *package, GError **err);
 
+/** Generate all three xml chunks (primary, filelists, other) from
+ * the original XML of cr_Package (see cr_metadata_set_raw_xml()).
+ * The original elements are copied, only xml:base of the location
+ * in primary is rewritten to match package->location_base.
+ * If the original XML isn't available (or the location cannot be rewritten
+ * in the same form as by cr_xml_dump()), the chunks are generated
+ * by cr_xml_dump().
+ * Note: Other changes of the package after its loading are ignored.
+ * @param package       cr_Package
+ * @param err           **GError
+ * @return              cr_XmlStruct
+ */
+struct cr_XmlStruct cr_xml_dump_raw(cr_Package *package, GError **err);
+
 /** Generate xml representation of cr_Repomd.
  * @param repomd        cr_Repomd
  * @param err           **GError
@@ -20,6 +20,7 @@
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <assert.h>
+#include <string.h>
 #include "xml_file.h"
 #include <errno.h>
 #include "error.h"
@@ -51,6 +52,99 @@
 #define XML_PRESTODELTA_FOOTER  "</prestodelta>"
 #define XML_UPDATEINFO_FOOTER   "</updates>"
 
+#define XML_INDEX_HEADER        "# pkgId frame_offset frame_size offset length\n"
+
+/** Package in the current frame of a seekable file */
+typedef struct {
+    gchar *pkgId;
+    gint64 offset;              // Offset in the decompressed frame
+    gint64 length;
+} XmlIndexEntry;
+
+/** Index of a seekable file */
+typedef struct {
+    gchar *filename;
+    cr_CompressionType comtype;
+    cr_ContentStat *stat;
+    gint64 frame_offset;        // Offset of the current frame
+    GArray *pending;            // XmlIndexEntry of the current frame
+    GString *lines;             // Index of the finished frames
+} XmlIndex;
+
+static void
+xml_index_free(XmlIndex *index)
+{
+    if (!index)
+        return;
+
+    for (guint x = 0; x < index->pending->len; x++)
+        g_free(g_array_index(index->pending, XmlIndexEntry, x).pkgId);
+    g_array_free(index->pending, TRUE);
+    g_string_free(index->lines, TRUE);
+    g_free(index->filename);
+    g_free(index);
+}
+
+/** End the current frame, the packages in it get their index lines */
+static int
+xml_index_end_frame(cr_XmlFile *f, GError **err)
+{
+    XmlIndex *index = f->index;
+    gint64 frame_size;
+    int ret;
+
+    ret = cr_xmlfile_flush(f, err);
+    if (ret != CRE_OK)
+        return ret;
+
+    frame_size = cr_end_frame(f->f, err);
+    if (frame_size < 0)
+        return CRE_XZ;
+
+    for (guint x = 0; x < index->pending->len; x++) {
+        XmlIndexEntry *entry = &g_array_index(index->pending, XmlIndexEntry, x);
+        g_string_append_printf(index->lines,
+                "%s %"G_GINT64_FORMAT" %"G_GINT64_FORMAT
+                " %"G_GINT64_FORMAT" %"G_GINT64_FORMAT"\n",
+                entry->pkgId, index->frame_offset, frame_size,
+                entry->offset, entry->length);
+        g_free(entry->pkgId);
+    }
+    g_array_set_size(index->pending, 0);
+
+    return CRE_OK;
+}
+
+static int
+xml_index_write(XmlIndex *index, GError **err)
+{
+    GError *tmp_err = NULL;
+    CR_FILE *cr_f = cr_sopen(index->filename, CR_CW_MODE_WRITE,
+                             index->comtype, index->stat, &tmp_err);
+    if (!cr_f) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Cannot open %s: ",
+                                   index->filename);
+        return code;
+    }
+
+    cr_puts(cr_f, XML_INDEX_HEADER, &tmp_err);
+    if (!tmp_err)
+        cr_write(cr_f, index->lines->str, index->lines->len, &tmp_err);
+    if (!tmp_err)
+        cr_close(cr_f, &tmp_err);
+    else
+        cr_close(cr_f, NULL);
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Cannot write %s: ",
+                                   index->filename);
+        return code;
+    }
+
+    return CRE_OK;
+}
+
 cr_XmlFile *
 cr_xmlfile_sopen(const char *filename,
                  cr_XmlFileType type,
@@ -88,10 +182,108 @@ cr_xmlfile_sopen(const char *filename,
     f->header = 0;
     f->footer = 0;
     f->pkgs   = 0;
+    f->buffer = NULL;
+    f->buffer_size = 0;
 
     return f;
 }
 
+int
+cr_xmlfile_flush(cr_XmlFile *f, GError **err)
+{
+    GError *tmp_err = NULL;
+
+    assert(f);
+    assert(!err || *err == NULL);
+
+    if (!f->buffer || f->buffer->len == 0)
+        return CRE_OK;
+
+    cr_write(f->f, f->buffer->str, f->buffer->len, &tmp_err);
+    g_string_truncate(f->buffer, 0);
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Error while write: ");
+        return code;
+    }
+
+    return CRE_OK;
+}
+
+int
+cr_xmlfile_set_buffer_size(cr_XmlFile *f, gsize size, GError **err)
+{
+    int ret;
+
+    assert(f);
+    assert(!err || *err == NULL);
+
+    ret = cr_xmlfile_flush(f, err);
+    if (ret != CRE_OK)
+        return ret;
+
+    if (f->buffer && size == 0) {
+        g_string_free(f->buffer, TRUE);
+        f->buffer = NULL;
+    } else if (!f->buffer && size > 0) {
+        f->buffer = g_string_sized_new(size);
+    }
+    f->buffer_size = size;
+
+    return CRE_OK;
+}
+
+int
+cr_xmlfile_end_chunk(cr_XmlFile *f, GError **err)
+{
+    int ret;
+
+    assert(f);
+    assert(!err || *err == NULL);
+
+    ret = cr_xmlfile_flush(f, err);
+    if (ret != CRE_OK)
+        return ret;
+
+    return cr_end_chunk(f->f, err);
+}
+
+int
+cr_xmlfile_set_seekable(cr_XmlFile *f,
+                        const char *index_filename,
+                        cr_CompressionType index_comtype,
+                        cr_ContentStat *index_stat,
+                        GError **err)
+{
+    XmlIndex *index;
+
+    assert(f);
+    assert(index_filename);
+    assert(!err || *err == NULL);
+
+    if (f->header != 0) {
+        g_set_error(err, ERR_DOMAIN, CRE_BADARG,
+                    "Header was already written");
+        return CRE_BADARG;
+    }
+
+    if (f->index)
+        return CRE_OK;
+
+    if (cr_set_seekable(f->f, err) != CRE_OK)
+        return CRE_BADARG;
+
+    index = g_new0(XmlIndex, 1);
+    index->filename = g_strdup(index_filename);
+    index->comtype = index_comtype;
+    index->stat = index_stat;
+    index->pending = g_array_new(FALSE, FALSE, sizeof(XmlIndexEntry));
+    index->lines = g_string_new(NULL);
+    f->index = index;
+
+    return CRE_OK;
+}
+
 int
 cr_xmlfile_set_num_of_pkgs(cr_XmlFile *f, long num, GError **err)
 {
@@ -191,7 +383,9 @@ cr_xmlfile_write_xml_footer(cr_XmlFile *f, GError **err)
         return CRE_ASSERT;
     }
 
-    cr_puts(f->f, xml_footer, &tmp_err);
+    cr_xmlfile_flush(f, &tmp_err);
+    if (!tmp_err)
+        cr_puts(f->f, xml_footer, &tmp_err);
     if (tmp_err) {
         int code = tmp_err->code;
         g_propagate_prefixed_error(err, tmp_err, "Cannot write XML footer: ");
@@ -240,7 +434,7 @@ cr_xmlfile_add_pkg(cr_XmlFile *f, cr_Package *pkg, GError **err)
     }
 
     if (xml) {
-        cr_xmlfile_add_chunk(f, xml, &tmp_err);
+        cr_xmlfile_add_indexed_chunk(f, pkg->pkgId, xml, &tmp_err);
         g_free(xml);
 
         if (tmp_err) {
@@ -274,7 +468,19 @@ cr_xmlfile_add_chunk(cr_XmlFile *f, const char* chunk, GError **err)
         }
     }
 
-    cr_puts(f->f, chunk, &tmp_err);
+    size_t len = strlen(chunk);
+
+    if (f->buffer && len < f->buffer_size) {
+        g_string_append_len(f->buffer, chunk, len);
+        if (f->buffer->len < f->buffer_size)
+            return CRE_OK;
+        return cr_xmlfile_flush(f, err);
+    }
+
+    // Big chunks are written directly (without a copy)
+    cr_xmlfile_flush(f, &tmp_err);
+    if (!tmp_err)
+        cr_write(f->f, chunk, len, &tmp_err);
     if (tmp_err) {
         int code = tmp_err->code;
         g_propagate_prefixed_error(err, tmp_err, "Error while write: ");
@@ -284,45 +490,97 @@ cr_xmlfile_add_chunk(cr_XmlFile *f, const char* chunk, GError **err)
     return CRE_OK;
 }
 
+int
+cr_xmlfile_add_indexed_chunk(cr_XmlFile *f,
+                             const char *pkgId,
+                             const char *chunk,
+                             GError **err)
+{
+    XmlIndex *index;
+    XmlIndexEntry entry;
+    gint64 pos;
+    size_t len;
+    int ret;
+
+    assert(f);
+    assert(!err || *err == NULL);
+    assert(f->footer == 0);
+
+    index = f->index;
+    if (!index || !pkgId || !chunk)
+        return cr_xmlfile_add_chunk(f, chunk, err);
+
+    if (f->header == 0) {
+        ret = cr_xmlfile_write_xml_header(f, err);
+        if (ret != CRE_OK)
+            return ret;
+    }
+
+    // The package goes to the next frame if it doesn't fit the current one
+    len = strlen(chunk);
+    pos = cr_frame_tell(f->f, NULL) + (f->buffer ? f->buffer->len : 0);
+    if (pos > 0 && pos + (gint64) len > CR_XMLFILE_FRAME_SIZE) {
+        ret = xml_index_end_frame(f, err);
+        if (ret != CRE_OK)
+            return ret;
+        pos = 0;
+    }
+
+    if (index->pending->len == 0)
+        cr_frame_tell(f->f, &index->frame_offset);
+
+    entry.pkgId = g_strdup(pkgId);
+    entry.offset = pos;
+    entry.length = len;
+    g_array_append_val(index->pending, entry);
+
+    return cr_xmlfile_add_chunk(f, chunk, err);
+}
+
 int
 cr_xmlfile_close(cr_XmlFile *f, GError **err)
 {
     GError *tmp_err = NULL;
+    int ret = CRE_OK;
 
     assert(!err || *err == NULL);
 
     if (!f)
         return CRE_OK;
 
-    if (f->header == 0) {
+    if (f->header == 0)
         cr_xmlfile_write_xml_header(f, &tmp_err);
-        if (tmp_err) {
-            int code = tmp_err->code;
-            g_propagate_error(err, tmp_err);
-            return code;
-        }
-    }
 
-    if (f->footer == 0) {
+    if (!tmp_err && f->footer == 0)
         cr_xmlfile_write_xml_footer(f, &tmp_err);
-        if (tmp_err) {
-            int code = tmp_err->code;
-            g_propagate_error(err, tmp_err);
-            return code;
-        }
-    }
 
-    cr_close(f->f, &tmp_err);
+    if (!tmp_err && f->index)
+        xml_index_end_frame(f, &tmp_err);
+
     if (tmp_err) {
-        int code = tmp_err->code;
-        g_propagate_prefixed_error(err, tmp_err,
-                "Error while closing a file: ");
-        return code;
+        // An error already encountered
+        // just close the file without error checking
+        ret = tmp_err->code;
+        g_propagate_error(err, tmp_err);
+        cr_close(f->f, NULL);
+    } else {
+        cr_close(f->f, &tmp_err);
+        if (tmp_err) {
+            ret = tmp_err->code;
+            g_propagate_prefixed_error(err, tmp_err,
+                    "Error while closing a file: ");
+        } else if (f->index) {
+            // The index is complete once the last frame is written
+            ret = xml_index_write(f->index, err);
+        }
     }
 
+    if (f->buffer)
+        g_string_free(f->buffer, TRUE);
+    xml_index_free(f->index);
     g_free(f);
 
-    return CRE_OK;
+    return ret;
 }
 
 static int 
@@ -44,7 +44,16 @@ typedef enum {
     CR_XMLFILE_SENTINEL,    /*!< sentinel of the list */
 } cr_XmlFileType;
 
+/** Recommended size of the staging buffer of cr_XmlFile
+ * (see cr_xmlfile_set_buffer_size()).
+ */
+#define CR_XMLFILE_DEFAULT_BUFFER_SIZE  (256*1024)
+
 /** cr_XmlFile structure.
+ * If the staging buffer is enabled by cr_xmlfile_set_buffer_size(),
+ * chunks are collected in it and written into the compressed file
+ * in large blocks. Then call cr_xmlfile_flush() before writing into
+ * the f directly (e.g. cr_end_chunk()) or use cr_xmlfile_end_chunk().
  */
 typedef struct {
     CR_FILE *f; /*!<
@@ -57,8 +66,19 @@ typedef struct {
         0 if no footer was written yet. */
     long pkgs; /*!<
         Number of packages */
+    GString *buffer; /*!<
+        Staging buffer (NULL if buffering is disabled) */
+    gsize buffer_size; /*!<
+        The buffer is written into the f when it reaches this size */
+    void *index; /*!<
+        Index of packages of a seekable file (NULL if not seekable) */
 } cr_XmlFile;
 
+/** Max uncompressed size of a frame of a seekable XML file (a package
+ * bigger than this gets a frame of its own).
+ */
+#define CR_XMLFILE_FRAME_SIZE  (128*1024)
+
 /** Open a new primary XML file.
  * @param FILENAME      Filename.
  * @param COMTYPE       Type of compression.
@@ -214,6 +234,66 @@ int cr_xmlfile_add_pkg(cr_XmlFile *f, cr_Package *pkg, GError **err);
  */
 int cr_xmlfile_add_chunk(cr_XmlFile *f, const char *chunk, GError **err);
 
+/** Add (write) string with XML chunk of the package into the file.
+ * The package is recorded in the index of a seekable file
+ * (see cr_xmlfile_set_seekable()), otherwise it is the same
+ * as cr_xmlfile_add_chunk().
+ * @param f             An opened cr_XmlFile
+ * @param pkgId         Checksum of the package
+ * @param chunk         String with XML chunk.
+ * @param err           **GError
+ * @return              cr_Error code
+ */
+int cr_xmlfile_add_indexed_chunk(cr_XmlFile *f,
+                                 const char *pkgId,
+                                 const char *chunk,
+                                 GError **err);
+
+/** Write the file in seekable framing (see cr_set_seekable()) and
+ * write an index of its packages when the file is closed.
+ * Packages are grouped into frames of up to CR_XMLFILE_FRAME_SIZE bytes,
+ * a package never crosses a frame boundary. Every line of the index
+ * is "pkgId frame_offset frame_size offset length", where the offset
+ * and length are position of the package in the decompressed frame.
+ * Must be called before any write operation.
+ * @param f             An opened cr_XmlFile (xz compressed)
+ * @param index_filename    Filename of the index
+ * @param index_comtype     Compression of the index
+ * @param index_stat        cr_ContentStat of the index or NULL
+ * @param err           **GError
+ * @return              cr_Error code
+ */
+int cr_xmlfile_set_seekable(cr_XmlFile *f,
+                            const char *index_filename,
+                            cr_CompressionType index_comtype,
+                            cr_ContentStat *index_stat,
+                            GError **err);
+
+/** Set size of the staging buffer. Content of the current buffer is
+ * written into the file first. The buffering is disabled by default.
+ * @param f             An opened cr_XmlFile
+ * @param size          Size of the buffer, 0 disables the buffering
+ *                      (every chunk is written by its own cr_write())
+ * @param err           **GError
+ * @return              cr_Error code
+ */
+int cr_xmlfile_set_buffer_size(cr_XmlFile *f, gsize size, GError **err);
+
+/** Write content of the staging buffer into the file.
+ * @param f             An opened cr_XmlFile
+ * @param err           **GError
+ * @return              cr_Error code
+ */
+int cr_xmlfile_flush(cr_XmlFile *f, GError **err);
+
+/** Write content of the staging buffer into the file and end
+ * the current zchunk chunk (see cr_end_chunk()).
+ * @param f             An opened cr_XmlFile
+ * @param err           **GError
+ * @return              cr_Error code
+ */
+int cr_xmlfile_end_chunk(cr_XmlFile *f, GError **err);
+
 /** Close an opened cr_XmlFile.
  * @param f             An opened cr_XmlFile
  * @param err           **GError
@@ -21,10 +21,12 @@
 #include <glib/gprintf.h>
 #include <assert.h>
 #include <errno.h>
+#include <string.h>
 #include "error.h"
 #include "xml_parser.h"
 #include "xml_parser_internal.h"
 #include "misc.h"
+#include "url_stream.h"
 
 #define ERR_DOMAIN      CREATEREPO_C_ERROR
 
@@ -45,6 +47,8 @@ void
 cr_xml_parser_data_free(cr_ParserData *pd)
 {
     g_free(pd->content);
+    if (pd->raw)
+        g_string_free(pd->raw, TRUE);
     g_free(pd->swtab);
     g_free(pd->sbtab);
     g_free(pd);
@@ -166,7 +170,8 @@ cr_xml_parser_generic(xmlParserCtxtPtr parser,
     /* Note: This function uses .err members of cr_ParserData! */
 
     int ret = CRE_OK;
-    CR_FILE *f;
+    CR_FILE *f = NULL;
+    cr_UrlStream *stream = NULL;
     GError *tmp_err = NULL;
     char buf[XML_BUFFER_SIZE];
 
@@ -175,7 +180,13 @@ cr_xml_parser_generic(xmlParserCtxtPtr parser,
     assert(path);
     assert(!err || *err == NULL);
 
-    f = cr_open(path, CR_CW_MODE_READ, CR_CW_AUTO_DETECT_COMPRESSION, &tmp_err);
+    if (cr_url_is_remote(path)) {
+        // Remote file is parsed while it is being downloaded
+        stream = cr_url_stream_open(path, &tmp_err);
+    } else {
+        f = cr_open(path, CR_CW_MODE_READ, CR_CW_AUTO_DETECT_COMPRESSION,
+                    &tmp_err);
+    }
     if (tmp_err) {
         int code = tmp_err->code;
         g_propagate_prefixed_error(err, tmp_err, "Cannot open %s: ", path);
@@ -184,7 +195,10 @@ cr_xml_parser_generic(xmlParserCtxtPtr parser,
 
     while (1) {
         int len;
-        len = cr_read(f, buf, XML_BUFFER_SIZE, &tmp_err);
+        if (stream)
+            len = cr_url_stream_read(stream, buf, XML_BUFFER_SIZE, &tmp_err);
+        else
+            len = cr_read(f, buf, XML_BUFFER_SIZE, &tmp_err);
         if (tmp_err) {
             ret = tmp_err->code;
             g_critical("%s: Error while reading xml '%s': %s",
@@ -193,6 +207,9 @@ cr_xml_parser_generic(xmlParserCtxtPtr parser,
             break;
         }
 
+        if (pd->raw)
+            g_string_append_len(pd->raw, buf, len);
+
         if (xmlParseChunk(parser, buf, len, len == 0)) {
             ret = CRE_XMLPARSER;
             xmlErrorPtr xml_err = xmlCtxtGetLastError(parser);
@@ -208,6 +225,13 @@ cr_xml_parser_generic(xmlParserCtxtPtr parser,
             break;
         }
 
+        if (pd->raw) {
+            // Drop the input of already ended packages
+            g_string_erase(pd->raw, 0, pd->raw_pos);
+            pd->raw_offset += pd->raw_pos;
+            pd->raw_pos = 0;
+        }
+
         if (pd->err) {
             ret = pd->err->code;
             g_propagate_error(err, pd->err);
@@ -218,7 +242,9 @@ cr_xml_parser_generic(xmlParserCtxtPtr parser,
             break;
     }
 
-    if (ret != CRE_OK) {
+    if (stream) {
+        cr_url_stream_free(stream);
+    } else if (ret != CRE_OK) {
         // An error already encoutentered
         // just close the file without error checking
         cr_close(f, NULL);
@@ -234,6 +260,69 @@ cr_xml_parser_generic(xmlParserCtxtPtr parser,
     return ret;
 }
 
+int
+cr_xml_parser_generic_raw(xmlParserCtxtPtr parser,
+                          cr_ParserData *pd,
+                          const char *path,
+                          GError **err)
+{
+    assert(pd && !pd->raw);
+
+    pd->raw = g_string_sized_new(2 * XML_BUFFER_SIZE);
+    pd->raw_pos = 0;
+    pd->raw_offset = 0;
+
+    return cr_xml_parser_generic(parser, pd, path, err);
+}
+
+char *
+cr_xml_parser_raw_package(cr_ParserData *pd)
+{
+    static const char end_tag[] = "</package>";
+    const gsize end_tag_len = sizeof(end_tag) - 1;
+    const xmlChar *encoding = pd->parser->encoding;
+    const char *start = pd->raw->str + pd->raw_pos;
+    const char *end, *element = NULL;
+    long consumed;
+    gsize end_pos;
+
+    if (encoding && xmlStrcasecmp(encoding, BAD_CAST "UTF-8")) {
+        // The elements would be copied to UTF-8 output unconverted
+        g_string_free(pd->raw, TRUE);
+        pd->raw = NULL;
+        return NULL;
+    }
+
+    // The element ends where the parser is, "</package>" found by
+    // a search could be in a CDATA section or in a comment
+    consumed = xmlByteConsumed(pd->parser);
+    if (consumed < 0 || (gsize) consumed < pd->raw_offset + pd->raw_pos
+        || (gsize) consumed > pd->raw_offset + pd->raw->len) {
+        pd->raw_pos = pd->raw->len;
+        return NULL;
+    }
+    end_pos = consumed - pd->raw_offset;
+    end = pd->raw->str + end_pos;
+    pd->raw_pos = end_pos;
+
+    if (end - start < (gssize) end_tag_len
+        || memcmp(end - end_tag_len, end_tag, end_tag_len))
+        return NULL;
+
+    // Start tag of the element (not <packager>)
+    while (!element && (start = g_strstr_len(start, end - start, "<package"))) {
+        char c = start[strlen("<package")];
+        if (c == ' ' || c == '>' || c == '\t' || c == '\n' || c == '\r')
+            element = start;
+        start += strlen("<package");
+    }
+
+    if (!element || !pd->pkg || !pd->pkg->chunk)
+        return NULL;
+
+    return g_string_chunk_insert_len(pd->pkg->chunk, element, end - element);
+}
+
 int
 cr_xml_parser_generic_from_string(xmlParserCtxtPtr parser,
                                   cr_ParserData *pd,
@@ -227,6 +227,12 @@ cr_end_handler(void *pdata, G_GNUC_UNUSED const xmlChar *element)
         break;
 
     case STATE_PACKAGE:
+        if (pd->raw) {
+            char *raw = cr_xml_parser_raw_package(pd);
+            if (pd->pkg)
+                pd->pkg->raw_filelists = raw;
+        }
+
         if (!pd->pkg)
             return;
 
@@ -373,6 +379,20 @@ cr_xml_parse_filelists(const char *path,
                                            warningcb, warningcb_data, &cr_xml_parser_generic, err);
 }
 
+int
+cr_xml_parse_filelists_raw(const char *path,
+                           cr_XmlParserNewPkgCb newpkgcb,
+                           void *newpkgcb_data,
+                           cr_XmlParserPkgCb pkgcb,
+                           void *pkgcb_data,
+                           cr_XmlParserWarningCb warningcb,
+                           void *warningcb_data,
+                           GError **err)
+{
+    return cr_xml_parse_filelists_internal(path, newpkgcb, newpkgcb_data, pkgcb, pkgcb_data,
+                                           warningcb, warningcb_data, &cr_xml_parser_generic_raw, err);
+}
+
 int
 cr_xml_parse_filelists_snippet(const char *xml_string,
                                cr_XmlParserNewPkgCb newpkgcb,
@@ -112,6 +112,13 @@ typedef struct _cr_ParserData {
         Warning callback */
     cr_Package              *pkg;               /*!<
         The package which is currently loaded. */
+    GString                 *raw;               /*!<
+        NULL or the input which wasn't consumed by
+        cr_xml_parser_raw_package() yet (see cr_xml_parser_generic_raw()) */
+    gsize                   raw_pos;            /*!<
+        Position in raw right after the end of the last package element */
+    gsize                   raw_offset;         /*!<
+        Number of input bytes already dropped from the beginning of raw */
 
     /* Primary related stuff */
 
@@ -224,6 +231,64 @@ cr_xml_parser_generic_from_string(xmlParserCtxtPtr parser,
                                   const char *xml_string,
                                   GError **err);
 
+/** Generic parser which keeps the input of the package elements.
+ * The package end handlers pick it by cr_xml_parser_raw_package().
+ */
+int
+cr_xml_parser_generic_raw(xmlParserCtxtPtr parser,
+                          cr_ParserData *pd,
+                          const char *path,
+                          GError **err);
+
+/** Original package element which has just ended. The element ends
+ * at the current position of the parser and it is searched in the input
+ * since the end of the previous package element. Only UTF-8 input is kept,
+ * for another encoding the capturing is turned off (pd->raw is freed).
+ * @param pd        Parser data
+ * @return          Copy of the element in the chunk of pd->pkg or NULL
+ *                  if there is no package or the element wasn't found
+ *                  (e.g. the input doesn't end by a literal "</package>")
+ */
+char *
+cr_xml_parser_raw_package(cr_ParserData *pd);
+
+/** Same as cr_xml_parse_primary(), but the original package elements are
+ * kept in raw_primary of the packages.
+ */
+int cr_xml_parse_primary_raw(const char *path,
+                             cr_XmlParserNewPkgCb newpkgcb,
+                             void *newpkgcb_data,
+                             cr_XmlParserPkgCb pkgcb,
+                             void *pkgcb_data,
+                             cr_XmlParserWarningCb warningcb,
+                             void *warningcb_data,
+                             int do_files,
+                             GError **err);
+
+/** Same as cr_xml_parse_filelists(), but the original package elements are
+ * kept in raw_filelists of the packages.
+ */
+int cr_xml_parse_filelists_raw(const char *path,
+                               cr_XmlParserNewPkgCb newpkgcb,
+                               void *newpkgcb_data,
+                               cr_XmlParserPkgCb pkgcb,
+                               void *pkgcb_data,
+                               cr_XmlParserWarningCb warningcb,
+                               void *warningcb_data,
+                               GError **err);
+
+/** Same as cr_xml_parse_other(), but the original package elements are
+ * kept in raw_other of the packages.
+ */
+int cr_xml_parse_other_raw(const char *path,
+                           cr_XmlParserNewPkgCb newpkgcb,
+                           void *newpkgcb_data,
+                           cr_XmlParserPkgCb pkgcb,
+                           void *pkgcb_data,
+                           cr_XmlParserWarningCb warningcb,
+                           void *warningcb_data,
+                           GError **err);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,6 +1,7 @@
 import unittest
 import shutil
 import tempfile
+import threading
 import os.path
 import createrepo_c as cr
 
@@ -121,3 +122,77 @@ class TestCaseCrFile(unittest.TestCase):
         with subprocess.Popen(["unzck", "--stdout", path], stdout=subprocess.PIPE, close_fds=False) as p:
             content = p.stdout.read().decode('utf-8')
             self.assertEqual(content, "foobar")
+
+    def test_crfile_buffer_protocol(self):
+        path = os.path.join(self.tmpdir, "foo.gz")
+        content = b"".join(b"<package>%d</package>\n" % x for x in range(5000))
+
+        f = cr.CrFile(path, cr.MODE_WRITE, cr.GZ_COMPRESSION)
+        f.write(bytearray(content[:1000]))
+        f.write(memoryview(content)[1000:50000])
+        f.write(content[50000:])
+        f.close()
+
+        # readinto() a bytearray and a memoryview slice
+        f = cr.CrFile(path, cr.MODE_READ, cr.GZ_COMPRESSION)
+        buf = bytearray(100)
+        self.assertEqual(f.readinto(buf), 100)
+        self.assertEqual(bytes(buf), content[:100])
+        view = memoryview(bytearray(200))
+        self.assertEqual(f.readinto(view[50:]), 150)
+        self.assertEqual(view[50:].tobytes(), content[100:250])
+        self.assertRaises(TypeError, f.readinto, b"read-only")
+
+        # read()
+        self.assertEqual(f.read(10), content[250:260])
+        self.assertEqual(f.read(), content[260:])
+        self.assertEqual(f.read(), b"")
+        self.assertEqual(f.readinto(buf), 0)
+        f.close()
+
+        # iter_chunks()
+        f = cr.CrFile(path, cr.MODE_READ, cr.GZ_COMPRESSION)
+        chunks = [bytes(chunk) for chunk in f.iter_chunks(size=4096)]
+        f.close()
+        self.assertTrue(len(chunks) > 1)
+        self.assertEqual(b"".join(chunks), content)
+
+        self.assertRaises(cr.CreaterepoCError, f.readinto, buf)
+        self.assertRaises(cr.CreaterepoCError, f.read)
+
+    def test_crfile_concurrent_use(self):
+        path = os.path.join(self.tmpdir, "foo.gz")
+        block = 1024*1024
+        written = []
+        errors = []
+
+        f = cr.CrFile(path, cr.MODE_WRITE, cr.GZ_COMPRESSION)
+
+        def writer(byte):
+            for _ in range(10):
+                try:
+                    f.write(bytes([byte]) * block)
+                    written.append(byte)
+                except cr.CreaterepoCError as err:
+                    errors.append(str(err))
+
+        threads = [threading.Thread(target=writer, args=(ord("a") + x,))
+                   for x in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        f.close()
+
+        # Concurrent calls are refused, every write is done as a whole
+        for err in errors:
+            self.assertIn("used by another thread", err)
+        self.assertEqual(len(written) + len(errors), 40)
+
+        f = cr.CrFile(path, cr.MODE_READ, cr.GZ_COMPRESSION)
+        content = f.read()
+        f.close()
+        self.assertEqual(len(content), len(written) * block)
+        for x in range(len(written)):
+            chunk = content[x*block:(x+1)*block]
+            self.assertEqual(chunk, bytes([chunk[0]]) * block)
@@ -1,3 +1,12 @@
+import bz2
+import functools
+import gzip
+import http.server
+import lzma
+import os.path
+import shutil
+import tempfile
+import threading
 import unittest
 import createrepo_c as cr
 
@@ -64,3 +73,96 @@ class TestCaseLoadMetadata(unittest.TestCase):
         del(md)  # in fact, md should not be destroyed yet, because it is
                  # referenced from pkg!
         self.assertEqual(pkg.name, "fake_bash")
+
+
+class QuietHTTPRequestHandler(http.server.SimpleHTTPRequestHandler):
+    def log_message(self, *args):
+        pass
+
+class TestCaseLoadRemoteMetadata(unittest.TestCase):
+    """Remote metadata are parsed while they are being downloaded"""
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tmpdir = tempfile.mkdtemp(prefix="createrepo_ctest-")
+        shutil.copytree(REPO_01_PATH, os.path.join(cls.tmpdir, "repo_01"))
+        shutil.copytree(REPO_02_PATH, os.path.join(cls.tmpdir, "repo_02"))
+
+        # The primary.xml of repo_02 with every supported compression
+        with gzip.open(REPO_02_PRIXML, "rb") as f:
+            cls.primary = f.read()
+        half = len(cls.primary) // 2
+        variants = {
+            "primary.xml": cls.primary,
+            "primary.xml.gz": gzip.compress(cls.primary),
+            # Multiple gzip members (e.g. output of libdeflate)
+            "primary_members.xml.gz": gzip.compress(cls.primary[:half]) +
+                                      gzip.compress(cls.primary[half:]),
+            "primary.xml.bz2": bz2.compress(cls.primary),
+            "primary.xml.xz": lzma.compress(cls.primary),
+            "truncated.xml.gz": gzip.compress(cls.primary)[:-20],
+        }
+        for name, data in variants.items():
+            with open(os.path.join(cls.tmpdir, name), "wb") as f:
+                f.write(data)
+
+        handler = functools.partial(QuietHTTPRequestHandler,
+                                    directory=cls.tmpdir)
+        cls.server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), handler)
+        cls.url = "http://127.0.0.1:%d/" % cls.server.server_address[1]
+        cls.thread = threading.Thread(target=cls.server.serve_forever)
+        cls.thread.daemon = True
+        cls.thread.start()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.server.shutdown()
+        cls.server.server_close()
+        shutil.rmtree(cls.tmpdir)
+
+    def parse_primary_names(self, url):
+        pkgs = []
+        def newpkgcb(pkgId, name, arch):
+            pkg = cr.Package()
+            pkgs.append(pkg)
+            return pkg
+        cr.xml_parse_primary(url, newpkgcb, None, None, 1)
+        return sorted(pkg.name for pkg in pkgs)
+
+    def test_load_remote_metadata_repo01(self):
+        md = cr.Metadata()
+        md.locate_and_load_xml(self.url + "repo_01")
+        self.assertEqual(md.keys(), ['152824bff2aa6d54f429d43e87a3ff3a0286505c6d93ec87692b5e3a9e3b97bf'])
+        pkg = md.get('152824bff2aa6d54f429d43e87a3ff3a0286505c6d93ec87692b5e3a9e3b97bf')
+        self.assertEqual(pkg.name, "super_kernel")
+
+    def test_load_remote_metadata_repo02(self):
+        local_md = cr.Metadata()
+        local_md.locate_and_load_xml(REPO_02_PATH)
+        md = cr.Metadata()
+        md.locate_and_load_xml(self.url + "repo_02/")
+        self.assertEqual(sorted(md.keys()), sorted(local_md.keys()))
+        for key in md.keys():
+            pkg = md.get(key)
+            local_pkg = local_md.get(key)
+            self.assertEqual(pkg.nevra(), local_pkg.nevra())
+            self.assertEqual(pkg.files, local_pkg.files)
+            self.assertEqual(pkg.changelogs, local_pkg.changelogs)
+
+    def test_load_remote_metadata_missing_repo(self):
+        md = cr.Metadata()
+        self.assertRaises(cr.CreaterepoCError, md.locate_and_load_xml,
+                          self.url + "repo_missing")
+
+    def test_xml_parse_primary_url_compressions(self):
+        expected = ["fake_bash", "super_kernel"]
+        for name in ("primary.xml", "primary.xml.gz", "primary_members.xml.gz",
+                     "primary.xml.bz2", "primary.xml.xz"):
+            self.assertEqual(self.parse_primary_names(self.url + name),
+                             expected, name)
+
+    def test_xml_parse_primary_url_errors(self):
+        self.assertRaises(cr.CreaterepoCError, self.parse_primary_names,
+                          self.url + "missing.xml.gz")
+        self.assertRaises(cr.CreaterepoCError, self.parse_primary_names,
+                          self.url + "truncated.xml.gz")
@@ -1,3 +1,4 @@
+import gzip
 import unittest
 import shutil
 import tempfile
@@ -49,6 +50,7 @@ class TestCaseXmlFile(unittest.TestCase):
         self.assertRaises(cr.CreaterepoCError, f.set_num_of_pkgs, 1)
         self.assertRaises(cr.CreaterepoCError, f.add_pkg, pkg)
         self.assertRaises(cr.CreaterepoCError, f.add_chunk, "<chunk>text</chunk>")
+        self.assertRaises(cr.CreaterepoCError, f.set_buffer_size, 0)
         self.assertEqual("<createrepo_c.XmlFile Closed object>", f.__str__())
         f.close() # No error should be raised
         del(f)    # No error should be raised
@@ -359,3 +361,22 @@ class TestCaseXmlFile(unittest.TestCase):
 <otherdata xmlns="http://linux.duke.edu/metadata/other" packages="0">
   <chunk>Some XML chunk</chunk>
 </otherdata>""")
+
+    def test_xmlfile_set_buffer_size(self):
+        chunks = ["  <chunk>%d</chunk>\n" % x for x in range(1000)]
+        contents = []
+
+        for size in (0, 16, 1024*1024):
+            path = os.path.join(self.tmpdir, "primary%d.xml.gz" % size)
+            f = cr.PrimaryXmlFile(path, cr.GZ_COMPRESSION)
+            f.set_buffer_size(size)
+            self.assertRaises(ValueError, f.set_buffer_size, -1)
+            for chunk in chunks:
+                f.add_chunk(chunk)
+            f.close()
+            with gzip.open(path, "rt") as primary:
+                contents.append(primary.read())
+
+        self.assertTrue("".join(chunks) in contents[0])
+        self.assertEqual(contents[0], contents[1])
+        self.assertEqual(contents[0], contents[2])
@@ -0,0 +1,122 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include "fixtures.h"
+#include "createrepo/allocator.h"
+#include "createrepo/error.h"
+#include "createrepo/load_metadata.h"
+#include "createrepo/locate_metadata.h"
+
+#define TEST_XML    "<root><a attr=\"1\">text</a><b>more text</b></root>"
+
+static void
+test_cr_allocator_type(void)
+{
+    g_assert_cmpint(cr_allocator_type("default"), ==, CR_ALLOCATOR_DEFAULT);
+    g_assert_cmpint(cr_allocator_type("counting"), ==, CR_ALLOCATOR_COUNTING);
+    g_assert_cmpint(cr_allocator_type("Thread-Cache"), ==, CR_ALLOCATOR_THREAD_CACHE);
+    g_assert_cmpint(cr_allocator_type("foo"), ==, CR_ALLOCATOR_SENTINEL);
+    g_assert_cmpint(cr_allocator_type(NULL), ==, CR_ALLOCATOR_SENTINEL);
+
+    g_assert_cmpstr(cr_allocator_name_str(CR_ALLOCATOR_COUNTING), ==, "counting");
+    g_assert_cmpstr(cr_allocator_name_str(CR_ALLOCATOR_SENTINEL), ==, NULL);
+}
+
+static void
+test_cr_allocator_thread_cache(void)
+{
+    cr_AllocatorStats before, after;
+    GError *tmp_err = NULL;
+
+    // Memory allocated by the default allocator must be freeable later
+    xmlDocPtr foreign = xmlReadMemory(TEST_XML, strlen(TEST_XML), NULL, NULL, 0);
+    g_assert(foreign);
+
+    g_assert(cr_allocator_setup(CR_ALLOCATOR_THREAD_CACHE, &tmp_err));
+    g_assert(!tmp_err);
+    cr_allocator_stats(&before);
+
+    xmlFreeDoc(foreign);
+
+    for (int x = 0; x < 10; x++) {
+        xmlDocPtr doc = xmlReadMemory(TEST_XML, strlen(TEST_XML), NULL, NULL, 0);
+        g_assert(doc);
+        xmlNodePtr root = xmlDocGetRootElement(doc);
+        g_assert_cmpstr((char *) root->name, ==, "root");
+        xmlFreeDoc(doc);
+    }
+
+    cr_allocator_stats(&after);
+    g_assert_cmpint(after.allocs, >, before.allocs);
+    g_assert_cmpint(after.frees, >, before.frees);
+    g_assert_cmpint(after.bytes, >, before.bytes);
+#ifdef __GLIBC__
+    g_assert_cmpint(cr_allocator_active(), ==, CR_ALLOCATOR_THREAD_CACHE);
+    g_assert_cmpint(after.cache_hits, >, before.cache_hits);
+#endif
+
+    cr_allocator_cleanup();
+    g_assert_cmpint(cr_allocator_active(), ==, CR_ALLOCATOR_DEFAULT);
+}
+
+static void
+test_cr_allocator_load_metadata(void)
+{
+    cr_AllocatorStats stats;
+    struct cr_MetadataLocation *ml;
+    cr_Metadata *metadata;
+    GError *tmp_err = NULL;
+
+    g_assert(cr_allocator_setup(CR_ALLOCATOR_COUNTING, &tmp_err));
+    g_assert(!tmp_err);
+
+    ml = cr_locate_metadata(TEST_REPO_01, TRUE, NULL);
+    g_assert(ml);
+    metadata = cr_metadata_new(CR_HT_KEY_HASH, 0, NULL);
+    g_assert_cmpint(cr_metadata_load_xml(metadata, ml, NULL), ==, CRE_OK);
+    g_assert_cmpint(g_hash_table_size(cr_metadata_hashtable(metadata)), ==, 1);
+    cr_metadata_free(metadata);
+    cr_metadatalocation_free(ml);
+
+    cr_allocator_stats(&stats);
+    g_assert_cmpint(stats.allocs, >, 0);
+    g_assert_cmpint(stats.cache_hits, >=, 0);
+
+    cr_allocator_cleanup();
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/allocator/test_cr_allocator_type",
+            test_cr_allocator_type);
+    g_test_add_func("/allocator/test_cr_allocator_thread_cache",
+            test_cr_allocator_thread_cache);
+    g_test_add_func("/allocator/test_cr_allocator_load_metadata",
+            test_cr_allocator_load_metadata);
+
+    return g_test_run();
+}
@@ -0,0 +1,152 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fixtures.h"
+#include "createrepo/checkpoint.h"
+#include "createrepo/error.h"
+#include "createrepo/load_metadata.h"
+#include "createrepo/misc.h"
+#include "createrepo/package.h"
+#include "createrepo/parsepkg.h"
+#include "createrepo/xml_dump.h"
+
+#define ARCHER_PKG      TEST_PACKAGES_PATH"Archer-3.4.5-6.x86_64.rpm"
+#define EMPTY_PKG       TEST_PACKAGES_PATH"empty-0-0.x86_64.rpm"
+
+static void
+add_package(cr_Checkpoint *cp, const char *path)
+{
+    GError *tmp_err = NULL;
+    cr_Package *pkg = cr_package_from_rpm(path, CR_CHECKSUM_SHA256,
+                                          cr_get_filename(path), NULL, -1,
+                                          NULL, CR_HDRR_NONE, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert(pkg);
+
+    struct cr_XmlStruct res = cr_xml_dump(pkg, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert(cr_checkpoint_add(cp, pkg, &res, &tmp_err));
+    g_assert_no_error(tmp_err);
+
+    g_free(res.primary);
+    g_free(res.filelists);
+    g_free(res.other);
+    cr_package_free(pkg);
+}
+
+static cr_Checkpoint *
+open_checkpoint(const char *path, const char *fingerprint,
+                cr_Metadata **md, long *loaded)
+{
+    GError *tmp_err = NULL;
+    *md = cr_metadata_new(CR_HT_KEY_HREF, 0, NULL);
+    cr_Checkpoint *cp = cr_checkpoint_open(path, fingerprint, *md, loaded,
+                                           &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert(cp);
+    return cp;
+}
+
+static void
+test_cr_checkpoint(void)
+{
+    cr_Checkpoint *cp;
+    cr_Metadata *md;
+    cr_Package *pkg;
+    long loaded;
+    GError *tmp_err = NULL;
+    gchar *tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(tmp_dir));
+    gchar *path = g_build_filename(tmp_dir, CR_CHECKPOINT_FILENAME, NULL);
+
+    // New checkpoint
+    cp = open_checkpoint(path, "fingerprint", &md, &loaded);
+    g_assert_cmpint(loaded, ==, 0);
+    add_package(cp, ARCHER_PKG);
+    add_package(cp, EMPTY_PKG);
+    cr_checkpoint_free(cp);
+    cr_metadata_free(md);
+
+    // Resume - the packages are loaded with all their metadata
+    cp = open_checkpoint(path, "fingerprint", &md, &loaded);
+    g_assert_cmpint(loaded, ==, 2);
+    g_assert_cmpint(g_hash_table_size(cr_metadata_hashtable(md)), ==, 2);
+    pkg = g_hash_table_lookup(cr_metadata_hashtable(md),
+                              "Archer-3.4.5-6.x86_64.rpm");
+    g_assert(pkg);
+    g_assert_cmpstr(pkg->name, ==, "Archer");
+    g_assert_cmpstr(pkg->checksum_type, ==, "sha256");
+    g_assert(pkg->files);
+    g_assert(pkg->changelogs);
+
+    // An unchanged package is not recorded twice
+    add_package(cp, ARCHER_PKG);
+    cr_checkpoint_free(cp);
+    cr_metadata_free(md);
+
+    // A run killed in the middle of writing a record
+    FILE *f = fopen(path, "ab");
+    g_assert(f);
+    fwrite("\x10\x00\x00\x00\x10", 5, 1, f);
+    fclose(f);
+
+    cp = open_checkpoint(path, "fingerprint", &md, &loaded);
+    g_assert_cmpint(loaded, ==, 2);
+    cr_checkpoint_free(cp);
+    cr_metadata_free(md);
+
+    // Different run
+    cp = open_checkpoint(path, "other fingerprint", &md, &loaded);
+    g_assert_cmpint(loaded, ==, 0);
+    g_assert_cmpint(g_hash_table_size(cr_metadata_hashtable(md)), ==, 0);
+    g_assert(cr_checkpoint_remove(cp, &tmp_err));
+    g_assert_no_error(tmp_err);
+    g_assert(!g_file_test(path, G_FILE_TEST_EXISTS));
+    cr_metadata_free(md);
+
+    g_free(path);
+    cr_remove_dir(tmp_dir, NULL);
+    g_free(tmp_dir);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    cr_xml_dump_init();
+    cr_package_parser_init();
+
+    g_test_add_func("/checkpoint/test_cr_checkpoint",
+            test_cr_checkpoint);
+
+    ret = g_test_run();
+
+    cr_package_parser_cleanup();
+    cr_xml_dump_cleanup();
+
+    return ret;
+}
@@ -22,8 +22,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include "fixtures.h"
 #include "createrepo/checksum.h"
+#include "createrepo/checksum_batch.h"
+#include "createrepo/checksum_manifest.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
 
 static void
 test_cr_checksum_file(void)
@@ -129,6 +134,217 @@ test_cr_checksum_name_str(void)
     g_assert_cmpstr(checksum_name, ==, NULL);
 }
 
+static char *
+checksum_buffer(cr_ChecksumType type, const unsigned char *buf, size_t len)
+{
+    cr_ChecksumCtx *ctx = cr_checksum_new(type, NULL);
+    g_assert(ctx);
+    cr_checksum_update(ctx, buf, len, NULL);
+    return cr_checksum_final(ctx, NULL);
+}
+
+static void
+test_cr_checksum_buffers(void)
+{
+    // Lengths around the block boundaries and padding corner cases
+    const cr_ChecksumType types[] = { CR_CHECKSUM_SHA256, CR_CHECKSUM_SHA1,
+                                      CR_CHECKSUM_SHA512 };
+    const size_t count = 300;
+    const unsigned char **buffers = g_new0(const unsigned char *, count);
+    size_t *lens = g_new0(size_t, count);
+    char **checksums = g_new0(char *, count);
+    GRand *rand = g_rand_new_with_seed(1);
+
+    for (size_t i = 0; i < count; i++) {
+        lens[i] = (i < 200) ? i : (size_t) g_rand_int_range(rand, 0, 100000);
+        unsigned char *buf = g_malloc(lens[i] + 1);
+        for (size_t x = 0; x < lens[i]; x++)
+            buf[x] = g_rand_int(rand);
+        buffers[i] = buf;
+    }
+
+    for (size_t t = 0; t < G_N_ELEMENTS(types); t++) {
+        GError *tmp_err = NULL;
+        int ret = cr_checksum_buffers(types[t], buffers, lens, count,
+                                      checksums, &tmp_err);
+        g_assert_no_error(tmp_err);
+        g_assert_cmpint(ret, ==, CRE_OK);
+
+        for (size_t i = 0; i < count; i++) {
+            char *expected = checksum_buffer(types[t], buffers[i], lens[i]);
+            g_assert_cmpstr(checksums[i], ==, expected);
+            g_free(expected);
+            g_free(checksums[i]);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++)
+        g_free((gpointer) buffers[i]);
+    g_free(buffers);
+    g_free(lens);
+    g_free(checksums);
+    g_rand_free(rand);
+}
+
+static void
+test_cr_checksum_batch_mode(void)
+{
+    g_assert_cmpint(cr_checksum_batch_mode("auto"), ==, CR_CHECKSUM_BATCH_AUTO);
+    g_assert_cmpint(cr_checksum_batch_mode("always"), ==, CR_CHECKSUM_BATCH_ALWAYS);
+    g_assert_cmpint(cr_checksum_batch_mode("never"), ==, CR_CHECKSUM_BATCH_NEVER);
+    g_assert_cmpint(cr_checksum_batch_mode("foo"), ==, CR_CHECKSUM_BATCH_SENTINEL);
+    g_assert_cmpint(cr_checksum_batch_mode(NULL), ==, CR_CHECKSUM_BATCH_SENTINEL);
+
+    g_assert(!cr_checksum_batch_supported(CR_CHECKSUM_SHA256,
+                                          CR_CHECKSUM_BATCH_NEVER));
+    g_assert(!cr_checksum_batch_supported(CR_CHECKSUM_MD5,
+                                          CR_CHECKSUM_BATCH_ALWAYS));
+}
+
+static const char *batch_test_files[] = {
+    TEST_EMPTY_FILE,
+    TEST_TEXT_FILE,
+    TEST_BINARY_FILE,
+    NON_EXIST_FILE,
+};
+
+static void
+batch_thread(gpointer data, gpointer user_data)
+{
+    cr_ChecksumBatch *batch = user_data;
+    const char *filename = batch_test_files[GPOINTER_TO_INT(data) - 1];
+    GError *tmp_err = NULL;
+
+    char *checksum = cr_checksum_batch_file(batch, filename, &tmp_err);
+    char *expected = cr_checksum_file(filename, CR_CHECKSUM_SHA256, NULL);
+    g_assert_cmpstr(checksum, ==, expected);
+    g_assert((checksum == NULL) == (tmp_err != NULL));
+
+    g_clear_error(&tmp_err);
+    g_free(checksum);
+    g_free(expected);
+}
+
+static void
+test_cr_checksum_batch_file(void)
+{
+    int threads = 4;
+    cr_ChecksumBatch *batch = cr_checksum_batch_new(CR_CHECKSUM_SHA256, threads);
+    GThreadPool *pool = g_thread_pool_new(batch_thread, batch, threads,
+                                          TRUE, NULL);
+
+    for (int x = 0; x < 200; x++)
+        g_thread_pool_push(pool,
+            GINT_TO_POINTER(x % G_N_ELEMENTS(batch_test_files) + 1), NULL);
+
+    g_thread_pool_free(pool, FALSE, TRUE);
+    cr_checksum_batch_free(batch);
+}
+
+static cr_ChecksumManifest *
+load_manifest(const char *tmpdir, const char *content, GError **err)
+{
+    gchar *filename = g_build_filename(tmpdir, "manifest", NULL);
+    g_assert(g_file_set_contents(filename, content, -1, NULL));
+    cr_ChecksumManifest *manifest = cr_checksum_manifest_load(
+                                        filename, CR_CHECKSUM_SHA256, err);
+    g_free(filename);
+    return manifest;
+}
+
+static void
+test_cr_checksum_manifest(void)
+{
+    struct stat st;
+    char *checksum;
+    gchar *content;
+    GError *tmp_err = NULL;
+    cr_ChecksumManifest *manifest;
+    const char *wrong = "0000000000000000000000000000000000000000000000000000000000000000";
+    gchar *tmpdir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(tmpdir));
+    g_assert(stat(TEST_TEXT_FILE, &st) == 0);
+
+    // Lookup by href and by filename, size and mtime
+    content = g_strdup_printf(
+            "# comment\n"
+            "\n"
+            "%s  ./packages/text_file\n"
+            "%s *other/empty_file\n"
+            "%s text_file %"G_GINT64_FORMAT" %"G_GINT64_FORMAT"\n",
+            TEST_TEXT_FILE_SHA256SUM, wrong, TEST_TEXT_FILE_SHA256SUM,
+            (gint64) st.st_size, (gint64) st.st_mtime);
+    manifest = load_manifest(tmpdir, content, &tmp_err);
+    g_free(content);
+    g_assert_no_error(tmp_err);
+    g_assert(manifest);
+
+    checksum = cr_checksum_manifest_lookup(manifest, TEST_TEXT_FILE,
+                                           "packages/text_file", 1, 1);
+    g_assert_cmpstr(checksum, ==, TEST_TEXT_FILE_SHA256SUM);
+    g_free(checksum);
+    checksum = cr_checksum_manifest_lookup(manifest, TEST_EMPTY_FILE,
+                                           "other/empty_file", 0, 0);
+    g_assert_cmpstr(checksum, ==, wrong);
+    g_free(checksum);
+    checksum = cr_checksum_manifest_lookup(manifest, TEST_TEXT_FILE, NULL,
+                                           st.st_size, st.st_mtime);
+    g_assert_cmpstr(checksum, ==, TEST_TEXT_FILE_SHA256SUM);
+    g_free(checksum);
+    checksum = cr_checksum_manifest_lookup(manifest, TEST_TEXT_FILE, NULL,
+                                           st.st_size + 1, st.st_mtime);
+    g_assert(!checksum);
+    g_assert(cr_checksum_manifest_finish(manifest, &tmp_err));
+    g_assert_no_error(tmp_err);
+    cr_checksum_manifest_free(manifest);
+
+    // Verification of all used checksums
+    content = g_strdup_printf("%s  text_file\n%s  empty_file\n",
+                              TEST_TEXT_FILE_SHA256SUM, wrong);
+    manifest = load_manifest(tmpdir, content, &tmp_err);
+    g_free(content);
+    g_assert(manifest);
+    cr_checksum_manifest_set_verify(manifest, 100.0);
+    checksum = cr_checksum_manifest_lookup(manifest, TEST_TEXT_FILE,
+                                           "text_file", 0, 0);
+    g_free(checksum);
+    g_assert(cr_checksum_manifest_finish(manifest, &tmp_err));
+    g_assert_no_error(tmp_err);
+    cr_checksum_manifest_free(manifest);
+
+    content = g_strdup_printf("%s  empty_file\n", wrong);
+    manifest = load_manifest(tmpdir, content, &tmp_err);
+    g_free(content);
+    g_assert(manifest);
+    cr_checksum_manifest_set_verify(manifest, 100.0);
+    // The verification runs in the background, the message can be
+    // logged before cr_checksum_manifest_lookup() returns
+    g_test_expect_message(NULL, G_LOG_LEVEL_CRITICAL, "*doesn't match*");
+    checksum = cr_checksum_manifest_lookup(manifest, TEST_EMPTY_FILE,
+                                           "empty_file", 0, 0);
+    g_free(checksum);
+    g_assert(!cr_checksum_manifest_finish(manifest, &tmp_err));
+    g_test_assert_expected_messages();
+    g_assert_error(tmp_err, CREATEREPO_C_ERROR, CRE_ERROR);
+    g_clear_error(&tmp_err);
+    cr_checksum_manifest_free(manifest);
+
+    // Malformed manifests
+    manifest = load_manifest(tmpdir, "abcd  text_file\n", &tmp_err);
+    g_assert(!manifest);
+    g_assert_error(tmp_err, CREATEREPO_C_ERROR, CRE_BADARG);
+    g_clear_error(&tmp_err);
+    content = g_strdup_printf("%s\n", TEST_TEXT_FILE_SHA256SUM);
+    manifest = load_manifest(tmpdir, content, &tmp_err);
+    g_free(content);
+    g_assert(!manifest);
+    g_assert_error(tmp_err, CREATEREPO_C_ERROR, CRE_BADARG);
+    g_clear_error(&tmp_err);
+
+    cr_remove_dir(tmpdir, NULL);
+    g_free(tmpdir);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -138,6 +354,14 @@ main(int argc, char *argv[])
             test_cr_checksum_file);
     g_test_add_func("/checksum/test_cr_checksum_name_str",
             test_cr_checksum_name_str);
+    g_test_add_func("/checksum/test_cr_checksum_buffers",
+            test_cr_checksum_buffers);
+    g_test_add_func("/checksum/test_cr_checksum_batch_mode",
+            test_cr_checksum_batch_mode);
+    g_test_add_func("/checksum/test_cr_checksum_batch_file",
+            test_cr_checksum_batch_file);
+    g_test_add_func("/checksum/test_cr_checksum_manifest",
+            test_cr_checksum_manifest);
 
     return g_test_run();
 }
@@ -21,6 +21,7 @@
 #include <glib/gstdio.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include "fixtures.h"
 #include "createrepo/error.h"
@@ -759,6 +760,123 @@ test_cr_get_zchunk_with_index(void)
 
 }
 
+#define RSYNC_TEST_PACKAGES     400
+
+/** Write synthetic package elements, a new package is inserted
+ * before the package at the position extra_pos (if >= 0) */
+static void
+write_rsync_test_file(const char *filename, gboolean rsyncable, int extra_pos)
+{
+    static const char *words[] = { "library", "tool", "devel", "python",
+        "data", "files", "documentation", "runtime", "plugin", "headers",
+        "static", "server", "client", "utils", "common", "extra" };
+    GError *tmp_err = NULL;
+    CR_FILE *f;
+
+    f = cr_open(filename, CR_CW_MODE_WRITE, CR_CW_GZ_COMPRESSION, &tmp_err);
+    g_assert(f);
+    g_assert(!tmp_err);
+    cr_set_rsyncable(f, rsyncable, &tmp_err);
+    g_assert(!tmp_err);
+
+    for (int x = 0; x < RSYNC_TEST_PACKAGES; x++) {
+        if (x == extra_pos) {
+            cr_puts(f, "<package><name>new</name><description>newly added "
+                       "package</description></package>\n", &tmp_err);
+            g_assert(!tmp_err);
+        }
+
+        GRand *rand = g_rand_new_with_seed(x);
+        GString *pkg = g_string_new(NULL);
+        g_string_append_printf(pkg, "<package><name>pkg%05d</name>"
+                                    "<description>", x);
+        for (int w = 0; w < 80; w++)
+            g_string_append_printf(pkg, "%s ",
+                    words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))]);
+        g_string_append(pkg, "</description></package>\n");
+
+        cr_puts(f, pkg->str, &tmp_err);
+        g_assert(!tmp_err);
+        g_string_free(pkg, TRUE);
+        g_rand_free(rand);
+    }
+
+    cr_close(f, &tmp_err);
+    g_assert(!tmp_err);
+}
+
+/** Number of bytes which differ between the files
+ * (size of the bigger file minus common prefix and suffix,
+ * the gzip trailer with CRC and size is ignored) */
+static gsize
+rsync_test_diff(const char *filename_a, const char *filename_b, gsize *size)
+{
+    gchar *a, *b;
+    gsize len_a, len_b, prefix = 0, suffix = 0;
+
+    g_assert(g_file_get_contents(filename_a, &a, &len_a, NULL));
+    g_assert(g_file_get_contents(filename_b, &b, &len_b, NULL));
+    g_assert(len_a > 8 && len_b > 8);
+
+    while (prefix < len_a && prefix < len_b && a[prefix] == b[prefix])
+        prefix++;
+    while (suffix + 8 < len_a - prefix && suffix + 8 < len_b - prefix
+           && a[len_a-9-suffix] == b[len_b-9-suffix])
+        suffix++;
+
+    *size = MAX(len_a, len_b);
+    g_free(a);
+    g_free(b);
+    return *size - prefix - suffix;
+}
+
+static void
+test_cr_rsyncable(void)
+{
+    gchar *filename_a, *filename_b;
+    gsize size, diff, plain_diff;
+    int fd;
+
+    fd = g_file_open_tmp(TMP_FILE_PATTERN, &filename_a, NULL);
+    close(fd);
+    fd = g_file_open_tmp(TMP_FILE_PATTERN, &filename_b, NULL);
+    close(fd);
+
+    // Without rsyncable mode everything after the new package differs
+    write_rsync_test_file(filename_a, FALSE, -1);
+    write_rsync_test_file(filename_b, FALSE, 10);
+    plain_diff = rsync_test_diff(filename_a, filename_b, &size);
+    g_test_message("Default mode: %"G_GSIZE_FORMAT" of %"G_GSIZE_FORMAT
+                   " bytes differ", plain_diff, size);
+    g_assert_cmpuint(plain_diff, >, size / 2);
+
+    // With rsyncable mode only the compressed block with the new package
+    // differs (about 3 KiB here)
+    write_rsync_test_file(filename_a, TRUE, -1);
+    write_rsync_test_file(filename_b, TRUE, 10);
+    diff = rsync_test_diff(filename_a, filename_b, &size);
+    g_test_message("Rsyncable mode: %"G_GSIZE_FORMAT" of %"G_GSIZE_FORMAT
+                   " bytes differ", diff, size);
+    g_assert_cmpuint(diff, <, 8 * 1024);
+
+    // The output is still a valid gzip with the same content
+    char buf[64];
+    GError *tmp_err = NULL;
+    CR_FILE *f = cr_open(filename_b, CR_CW_MODE_READ,
+                         CR_CW_AUTO_DETECT_COMPRESSION, &tmp_err);
+    g_assert(f);
+    g_assert_cmpint(cr_read(f, buf, 25, &tmp_err), ==, 25);
+    g_assert(!tmp_err);
+    g_assert(!strncmp(buf, "<package><name>pkg00000</", 25));
+    cr_close(f, &tmp_err);
+    g_assert(!tmp_err);
+
+    remove(filename_a);
+    remove(filename_b);
+    g_free(filename_a);
+    g_free(filename_b);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -788,6 +906,8 @@ main(int argc, char *argv[])
             test_contentstating_multiwrite, outputtest_teardown);
     g_test_add_func("/compression_wrapper/test_cr_get_zchunk_with_index",
             test_cr_get_zchunk_with_index);
+    g_test_add_func("/compression_wrapper/test_cr_rsyncable",
+            test_cr_rsyncable);
 
     return g_test_run();
 }
@@ -0,0 +1,250 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include "fixtures.h"
+#include "createrepo/checksum.h"
+#include "createrepo/deltarpms.h"
+#include "createrepo/misc.h"
+#include "createrepo/parsepkg.h"
+#include "createrepo/xml_file.h"
+
+#ifdef CR_DELTA_RPM_SUPPORT
+
+#define OLD_PKG     "fake_bash-1.1.1-1.x86_64.rpm"
+#define OTHER_PKG   "super_kernel-6.0.1-2.x86_64.rpm"
+
+typedef struct {
+    gchar *tmp_dir;
+    cr_DeltaTargetPackage *old;
+    cr_DeltaTargetPackage *new;
+    gchar *drpmpath;
+} TestFixtures;
+
+static gchar *
+copy_package(const char *tmp_dir, const char *subdir, const char *name,
+             const char *dst_name)
+{
+    gchar *dir = g_build_filename(tmp_dir, subdir, NULL);
+    g_assert_cmpint(g_mkdir_with_parents(dir, 0755), ==, 0);
+    gchar *src = g_build_filename(TEST_PACKAGES_PATH, name, NULL);
+    gchar *dst = g_build_filename(dir, dst_name, NULL);
+    g_assert(cr_copy_file(src, dst, NULL));
+    g_free(src);
+    g_free(dir);
+    return dst;
+}
+
+static void
+fixtures_setup(TestFixtures *fixtures,
+               G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *tmp_err = NULL;
+    gchar *template = g_strdup(TMPDIR_TEMPLATE);
+    fixtures->tmp_dir = mkdtemp(template);
+    g_assert(fixtures->tmp_dir);
+
+    gchar *old_path = copy_package(fixtures->tmp_dir, "old", OLD_PKG, OLD_PKG);
+    gchar *new_path = copy_package(fixtures->tmp_dir, "new", OLD_PKG, OLD_PKG);
+    fixtures->old = cr_deltatargetpackage_from_rpm(old_path, &tmp_err);
+    g_assert_no_error(tmp_err);
+    fixtures->new = cr_deltatargetpackage_from_rpm(new_path, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_free(old_path);
+    g_free(new_path);
+
+    gchar *drpmsdir = g_build_filename(fixtures->tmp_dir, "drpms", NULL);
+    g_assert_cmpint(g_mkdir(drpmsdir, 0755), ==, 0);
+    fixtures->drpmpath = cr_drpm_create(fixtures->old, fixtures->new,
+                                        drpmsdir, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert(fixtures->drpmpath);
+    g_free(drpmsdir);
+}
+
+static void
+fixtures_teardown(TestFixtures *fixtures,
+                  G_GNUC_UNUSED gconstpointer test_data)
+{
+    cr_deltatargetpackage_free(fixtures->old);
+    cr_deltatargetpackage_free(fixtures->new);
+    g_free(fixtures->drpmpath);
+    cr_remove_dir(fixtures->tmp_dir, NULL);
+    g_free(fixtures->tmp_dir);
+}
+
+static void
+test_cr_drpm_is_uptodate(TestFixtures *fixtures,
+                         G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *tmp_err = NULL;
+
+    // Sources of the drpm are unknown
+    g_assert(!cr_drpm_is_uptodate(fixtures->drpmpath, fixtures->old,
+                                  fixtures->new));
+
+    g_assert(cr_drpm_write_sources(fixtures->drpmpath, fixtures->old,
+                                   fixtures->new, &tmp_err));
+    g_assert_no_error(tmp_err);
+    g_assert(cr_drpm_is_uptodate(fixtures->drpmpath, fixtures->old,
+                                 fixtures->new));
+
+    // Another old package
+    gchar *other_path = copy_package(fixtures->tmp_dir, "other", OTHER_PKG,
+                                     OTHER_PKG);
+    cr_DeltaTargetPackage *other = cr_deltatargetpackage_from_rpm(other_path,
+                                                                  &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert(!cr_drpm_is_uptodate(fixtures->drpmpath, other, fixtures->new));
+    cr_deltatargetpackage_free(other);
+    g_free(other_path);
+
+    // The old package was rebuilt (same NEVR, another header)
+    gchar *sources = g_strconcat(fixtures->tmp_dir, "/drpms/.",
+                                 cr_get_filename(fixtures->drpmpath),
+                                 ".sources", NULL);
+    gchar *content = NULL;
+    g_assert(g_file_get_contents(sources, &content, NULL, NULL));
+    content[0] = (content[0] == '0') ? '1' : '0';
+    g_assert(g_file_set_contents(sources, content, -1, NULL));
+    g_assert(!cr_drpm_is_uptodate(fixtures->drpmpath, fixtures->old,
+                                  fixtures->new));
+    g_free(content);
+    g_free(sources);
+
+    // Missing drpm
+    g_assert_cmpint(g_unlink(fixtures->drpmpath), ==, 0);
+    g_assert(!cr_drpm_is_uptodate(fixtures->drpmpath, fixtures->old,
+                                  fixtures->new));
+}
+
+static gchar *
+generate_prestodelta(TestFixtures *fixtures,
+                     const char *name,
+                     const char *old_prestodelta)
+{
+    GError *tmp_err = NULL;
+    gchar *drpmsdir = g_build_filename(fixtures->tmp_dir, "drpms", NULL);
+    gchar *prefix = g_strconcat(fixtures->tmp_dir, "/", NULL);
+    gchar *path = g_build_filename(fixtures->tmp_dir, name, NULL);
+    gchar *content = NULL;
+
+    cr_XmlFile *f = cr_xmlfile_open_prestodelta(path, CR_CW_NO_COMPRESSION,
+                                                &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert(cr_deltarpms_generate_prestodelta_file_with_old(drpmsdir, f,
+                                        NULL, CR_CHECKSUM_SHA256, 1, prefix,
+                                        old_prestodelta, &tmp_err));
+    g_assert_no_error(tmp_err);
+    cr_xmlfile_close(f, &tmp_err);
+    g_assert_no_error(tmp_err);
+
+    g_assert(g_file_get_contents(path, &content, NULL, NULL));
+    g_free(path);
+    g_free(prefix);
+    g_free(drpmsdir);
+    return content;
+}
+
+static void
+set_mtime(const char *path, time_t mtime)
+{
+    struct utimbuf times = { mtime, mtime };
+    g_assert_cmpint(utime(path, &times), ==, 0);
+}
+
+static void
+test_cr_deltarpms_prestodelta_reuse(TestFixtures *fixtures,
+                                    G_GNUC_UNUSED gconstpointer test_data)
+{
+    struct stat st;
+    gchar *checksum = cr_checksum_file(fixtures->drpmpath, CR_CHECKSUM_SHA256,
+                                       NULL);
+    g_assert(checksum);
+
+    // Without the previous file, the drpm is read and checksummed
+    gchar *content = generate_prestodelta(fixtures, "prestodelta.xml", NULL);
+    g_assert(strstr(content, checksum));
+    g_assert(strstr(content, "drpms/"));
+
+    // Previous file with a fake checksum, so the reuse can be seen
+    gchar *fake = g_strnfill(strlen(checksum), 'f');
+    gchar *pos = strstr(content, checksum);
+    memcpy(pos, fake, strlen(fake));
+    gchar *old_path = g_build_filename(fixtures->tmp_dir,
+                                       "old_prestodelta.xml", NULL);
+    g_assert(g_file_set_contents(old_path, content, -1, NULL));
+    g_free(content);
+    g_assert_cmpint(stat(old_path, &st), ==, 0);
+
+    // Unchanged drpm reuses the previous entry
+    set_mtime(fixtures->drpmpath, st.st_mtime - 10);
+    content = generate_prestodelta(fixtures, "prestodelta_2.xml", old_path);
+    g_assert(strstr(content, fake));
+    g_assert(!strstr(content, checksum));
+    g_free(content);
+
+    // Drpm modified after the previous file was written
+    set_mtime(fixtures->drpmpath, st.st_mtime + 10);
+    content = generate_prestodelta(fixtures, "prestodelta_3.xml", old_path);
+    g_assert(strstr(content, checksum));
+    g_assert(!strstr(content, fake));
+    g_free(content);
+
+    // Previous file which cannot be parsed is ignored
+    g_assert(g_file_set_contents(old_path, "garbage", -1, NULL));
+    set_mtime(fixtures->drpmpath, st.st_mtime - 10);
+    g_test_expect_message(NULL, G_LOG_LEVEL_WARNING, "Cannot load previous*");
+    content = generate_prestodelta(fixtures, "prestodelta_4.xml", old_path);
+    g_test_assert_expected_messages();
+    g_assert(strstr(content, checksum));
+    g_free(content);
+
+    g_free(old_path);
+    g_free(fake);
+    g_free(checksum);
+}
+
+#endif /* CR_DELTA_RPM_SUPPORT */
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+#ifdef CR_DELTA_RPM_SUPPORT
+    cr_package_parser_init();
+
+    g_test_add("/deltarpms/test_cr_drpm_is_uptodate",
+               TestFixtures, NULL, fixtures_setup,
+               test_cr_drpm_is_uptodate, fixtures_teardown);
+    g_test_add("/deltarpms/test_cr_deltarpms_prestodelta_reuse",
+               TestFixtures, NULL, fixtures_setup,
+               test_cr_deltarpms_prestodelta_reuse, fixtures_teardown);
+#endif
+
+    return g_test_run();
+}
@@ -0,0 +1,373 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fixtures.h"
+#include "createrepo/dumper_thread.h"
+#include "createrepo/load_metadata.h"
+#include "createrepo/misc.h"
+#include "createrepo/package.h"
+#include "createrepo/xml_file.h"
+
+static struct PoolTask *
+new_task(const char *dir, const char *filename)
+{
+    struct PoolTask *task = g_new0(struct PoolTask, 1);
+
+    task->full_path = g_build_filename(dir, filename, NULL);
+    task->filename = g_strdup(filename);
+    task->path = g_strdup(dir);
+    if (stat(task->full_path, &(task->stat_buf)) == 0)
+        task->stat_valid = TRUE;
+    return task;
+}
+
+static void
+free_task(struct PoolTask *task)
+{
+    if (task->shared && --task->shared->refs == 0) {
+        g_mutex_clear(&(task->shared->mutex));
+        g_cond_clear(&(task->shared->cond));
+        g_free(task->shared);
+    }
+    g_free(task->full_path);
+    g_free(task->filename);
+    g_free(task->path);
+    g_free(task);
+}
+
+static void
+test_cr_pool_tasks_share_files(void)
+{
+    GQueue tasks = G_QUEUE_INIT;
+    struct PoolTask *a, *a_link, *a_symlink, *b, *b_copy, *missing;
+    gchar *tmp_dir, *path, *link_path;
+
+    tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(tmp_dir));
+
+    path = g_build_filename(tmp_dir, "a.rpm", NULL);
+    g_assert(g_file_set_contents(path, "a", -1, NULL));
+    link_path = g_build_filename(tmp_dir, "a_link.rpm", NULL);
+    g_assert_cmpint(link(path, link_path), ==, 0);
+    g_free(link_path);
+    link_path = g_build_filename(tmp_dir, "a_symlink.rpm", NULL);
+    g_assert_cmpint(symlink(path, link_path), ==, 0);
+    g_free(link_path);
+    g_free(path);
+
+    // Same content but a different file
+    path = g_build_filename(tmp_dir, "b.rpm", NULL);
+    g_assert(g_file_set_contents(path, "b", -1, NULL));
+    g_free(path);
+    path = g_build_filename(tmp_dir, "b_copy.rpm", NULL);
+    g_assert(g_file_set_contents(path, "b", -1, NULL));
+    g_free(path);
+
+    a = new_task(tmp_dir, "a.rpm");
+    a_link = new_task(tmp_dir, "a_link.rpm");
+    a_symlink = new_task(tmp_dir, "a_symlink.rpm");
+    b = new_task(tmp_dir, "b.rpm");
+    b_copy = new_task(tmp_dir, "b_copy.rpm");
+    missing = new_task(tmp_dir, "missing.rpm");
+    g_assert(!missing->stat_valid);
+
+    g_queue_push_tail(&tasks, a_symlink);
+    g_queue_push_tail(&tasks, b);
+    g_queue_push_tail(&tasks, a);
+    g_queue_push_tail(&tasks, missing);
+    g_queue_push_tail(&tasks, b_copy);
+    g_queue_push_tail(&tasks, a_link);
+
+    g_assert_cmpint(cr_pool_tasks_share_files(&tasks), ==, 2);
+
+    // The first task of the file in the queue is the leader
+    g_assert(a_symlink->shared);
+    g_assert(a_symlink->shared_leader);
+    g_assert(a->shared == a_symlink->shared);
+    g_assert(!a->shared_leader);
+    g_assert(a_link->shared == a_symlink->shared);
+    g_assert(!a_link->shared_leader);
+    g_assert_cmpint(a_symlink->shared->refs, ==, 3);
+    g_assert(!a_symlink->shared->done);
+    g_assert(!a_symlink->shared->pkg);
+
+    g_assert(!b->shared);
+    g_assert(!b->shared_leader);
+    g_assert(!b_copy->shared);
+    g_assert(!missing->shared);
+
+    g_queue_foreach(&tasks, (GFunc) free_task, NULL);
+    g_queue_clear(&tasks);
+
+    // Nothing is shared among tasks of different files
+    g_queue_push_tail(&tasks, new_task(tmp_dir, "a.rpm"));
+    g_queue_push_tail(&tasks, new_task(tmp_dir, "b.rpm"));
+    g_assert_cmpint(cr_pool_tasks_share_files(&tasks), ==, 0);
+    g_queue_foreach(&tasks, (GFunc) free_task, NULL);
+    g_queue_clear(&tasks);
+
+    cr_remove_dir(tmp_dir, NULL);
+    g_free(tmp_dir);
+}
+
+static void
+test_cr_pool_tasks_largest_first(void)
+{
+    GQueue tasks = G_QUEUE_INIT;
+    // Sizes of tasks in the order of IDs, -1 means no stat data
+    const gint64 sizes[] = { 10, 300, -1, 300, 5, 7, 1000, 20 };
+    // Expected IDs after reordering in windows of 3 tasks
+    const long expected[] = { 1, 0, 2, 3, 5, 4, 6, 7 };
+
+    for (long x = 0; x < (long) G_N_ELEMENTS(sizes); x++) {
+        struct PoolTask *task = g_new0(struct PoolTask, 1);
+        task->id = x;
+        if (sizes[x] >= 0) {
+            task->stat_buf.st_size = sizes[x];
+            task->stat_valid = TRUE;
+        }
+        g_queue_push_tail(&tasks, task);
+    }
+
+    cr_pool_tasks_largest_first(&tasks, 3);
+
+    g_assert_cmpint(g_queue_get_length(&tasks), ==, G_N_ELEMENTS(expected));
+    for (guint x = 0; x < G_N_ELEMENTS(expected); x++) {
+        struct PoolTask *task = g_queue_peek_nth(&tasks, x);
+        g_assert_cmpint(task->id, ==, expected[x]);
+    }
+
+    g_queue_foreach(&tasks, (GFunc) free_task, NULL);
+    g_queue_clear(&tasks);
+}
+
+static cr_Package *
+add_old_package(cr_Metadata *md, const char *href, gint64 size, gint64 mtime)
+{
+    cr_Package *pkg = cr_package_new();
+    pkg->location_href = cr_safe_string_chunk_insert(pkg->chunk, href);
+    pkg->size_package = size;
+    pkg->time_file = mtime;
+    g_hash_table_insert(cr_metadata_hashtable(md),
+                        (gpointer) cr_get_cleaned_href(pkg->location_href),
+                        pkg);
+    return pkg;
+}
+
+static void
+test_cr_moved_packages_index(void)
+{
+    cr_Metadata *md = cr_metadata_new(CR_HT_KEY_HREF, 0, NULL);
+    cr_Package *foo = add_old_package(md, "a/foo-1.0-1.noarch.rpm", 100, 10);
+    add_old_package(md, "a/bar-1.0-1.noarch.rpm", 200, 20);
+    add_old_package(md, "b/bar-1.0-1.noarch.rpm", 200, 20);
+    cr_Package *bar = add_old_package(md, "c/bar-1.0-1.noarch.rpm", 200, 21);
+
+    GHashTable *index = cr_moved_packages_index(md);
+    g_assert_cmpint(g_hash_table_size(index), ==, 3);
+
+    g_assert(g_hash_table_lookup(index, "foo-1.0-1.noarch.rpm 100 10") == foo);
+    g_assert(g_hash_table_lookup(index, "bar-1.0-1.noarch.rpm 200 21") == bar);
+
+    // Ambiguous
+    g_assert(g_hash_table_contains(index, "bar-1.0-1.noarch.rpm 200 20"));
+    g_assert(!g_hash_table_lookup(index, "bar-1.0-1.noarch.rpm 200 20"));
+
+    g_hash_table_destroy(index);
+    cr_metadata_free(md);
+}
+
+static void
+copy_test_package(const char *tmp_dir, const char *subdir, const char *name)
+{
+    gchar *dir = g_build_filename(tmp_dir, subdir, NULL);
+    g_assert_cmpint(g_mkdir_with_parents(dir, 0755), ==, 0);
+    gchar *src = g_build_filename(TEST_PACKAGES_PATH, name, NULL);
+    gchar *dst = g_build_filename(dir, name, NULL);
+    g_assert(cr_copy_file(src, dst, NULL));
+    g_free(src);
+    g_free(dst);
+    g_free(dir);
+}
+
+static cr_Package *
+add_moved_package(cr_Metadata *md, const char *tmp_dir, const char *href,
+                  const char *name)
+{
+    struct stat st;
+    gchar *path = g_build_filename(tmp_dir, "new", cr_get_filename(href), NULL);
+    g_assert_cmpint(stat(path, &st), ==, 0);
+    g_free(path);
+
+    cr_Package *pkg = add_old_package(md, href, st.st_size, st.st_mtime);
+    pkg->name = cr_safe_string_chunk_insert(pkg->chunk, name);
+    pkg->arch = cr_safe_string_chunk_insert(pkg->chunk, "x86_64");
+    pkg->version = cr_safe_string_chunk_insert(pkg->chunk, "1");
+    pkg->release = cr_safe_string_chunk_insert(pkg->chunk, "1");
+    pkg->epoch = cr_safe_string_chunk_insert(pkg->chunk, "0");
+    pkg->pkgId = cr_safe_string_chunk_insert(pkg->chunk, "123456");
+    pkg->checksum_type = cr_safe_string_chunk_insert(pkg->chunk, "sha256");
+    return pkg;
+}
+
+static void
+test_cr_dumper_thread_moved_package(void)
+{
+    GError *tmp_err = NULL;
+    struct UserData udata;
+    gchar *tmp_dir, *repo_dir, *path, *content;
+    const char *moved = "fake_bash-1.1.1-1.x86_64.rpm";
+    const char *copied = "super_kernel-6.0.1-2.x86_64.rpm";
+    const char *linked = "Archer-3.4.5-6.x86_64.rpm";
+
+    tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(tmp_dir));
+    repo_dir = g_strconcat(tmp_dir, "/", NULL);
+
+    // The first package was moved from old/ to new/ (nothing proves it
+    // is the same file, the old metadata describe a different content
+    // with the same name, size and mtime), the second one was copied
+    // (the old file still exists and it is a different file) and the
+    // third one is a hardlink of the old file
+    copy_test_package(tmp_dir, "new", moved);
+    copy_test_package(tmp_dir, "new", copied);
+    copy_test_package(tmp_dir, "old", copied);
+    copy_test_package(tmp_dir, "new", linked);
+    gchar *link_src = g_build_filename(tmp_dir, "new", linked, NULL);
+    gchar *link_dst = g_build_filename(tmp_dir, "old", linked, NULL);
+    g_assert_cmpint(link(link_src, link_dst), ==, 0);
+    g_free(link_src);
+    g_free(link_dst);
+
+    cr_Metadata *md = cr_metadata_new(CR_HT_KEY_HREF, 0, NULL);
+    cr_Package *moved_md = add_moved_package(md, tmp_dir,
+                                    "old/fake_bash-1.1.1-1.x86_64.rpm",
+                                    "moved_marker");
+    cr_Package *copied_md = add_moved_package(md, tmp_dir,
+                                    "old/super_kernel-6.0.1-2.x86_64.rpm",
+                                    "copied_marker");
+    add_moved_package(md, tmp_dir, "old/Archer-3.4.5-6.x86_64.rpm",
+                      "linked_marker");
+
+    memset(&udata, 0, sizeof(udata));
+    path = g_build_filename(tmp_dir, "primary.xml", NULL);
+    udata.pri_f = cr_xmlfile_open_primary(path, CR_CW_NO_COMPRESSION, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_free(path);
+    path = g_build_filename(tmp_dir, "filelists.xml", NULL);
+    udata.fil_f = cr_xmlfile_open_filelists(path, CR_CW_NO_COMPRESSION, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_free(path);
+    path = g_build_filename(tmp_dir, "other.xml", NULL);
+    udata.oth_f = cr_xmlfile_open_other(path, CR_CW_NO_COMPRESSION, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_free(path);
+    udata.changelog_limit = -1;
+    udata.checksum_type_str = "sha256";
+    udata.checksum_type = CR_CHECKSUM_SHA256;
+    udata.repodir_name_len = strlen(repo_dir);
+    udata.task_count = 3;
+    udata.old_metadata = md;
+    udata.old_metadata_moved = cr_moved_packages_index(md);
+    udata.buffer = g_queue_new();
+    g_mutex_init(&(udata.mutex_output_pkg_list));
+    g_mutex_init(&(udata.mutex_pri));
+    g_mutex_init(&(udata.mutex_fil));
+    g_mutex_init(&(udata.mutex_oth));
+    g_cond_init(&(udata.cond_pri));
+    g_cond_init(&(udata.cond_fil));
+    g_cond_init(&(udata.cond_oth));
+    g_mutex_init(&(udata.mutex_buffer));
+    g_mutex_init(&(udata.mutex_old_md));
+    g_mutex_init(&(udata.mutex_deltatargetpackages));
+
+    gchar *new_dir = g_build_filename(tmp_dir, "new", NULL);
+    struct PoolTask *task = new_task(new_dir, moved);
+    task->id = 0;
+    cr_dumper_thread(task, &udata);
+    task = new_task(new_dir, copied);
+    task->id = 1;
+    cr_dumper_thread(task, &udata);
+    task = new_task(new_dir, linked);
+    task->id = 2;
+    cr_dumper_thread(task, &udata);
+    g_free(new_dir);
+
+    g_assert(!udata.had_errors);
+    g_assert_cmpint(udata.package_count, ==, 3);
+
+    // The hardlinked package was taken from the old metadata
+    GHashTable *ht = cr_metadata_hashtable(md);
+    g_assert(!g_hash_table_lookup(ht, "old/Archer-3.4.5-6.x86_64.rpm"));
+
+    // The moved and the copied ones were given back
+    g_assert(g_hash_table_lookup(ht, "old/fake_bash-1.1.1-1.x86_64.rpm")
+             == moved_md);
+    g_assert(g_hash_table_lookup(ht, "old/super_kernel-6.0.1-2.x86_64.rpm")
+             == copied_md);
+    g_assert_cmpint(g_hash_table_size(udata.old_metadata_moved), ==, 2);
+
+    cr_xmlfile_close(udata.pri_f, &tmp_err);
+    g_assert_no_error(tmp_err);
+    cr_xmlfile_close(udata.fil_f, NULL);
+    cr_xmlfile_close(udata.oth_f, NULL);
+
+    path = g_build_filename(tmp_dir, "primary.xml", NULL);
+    g_assert(g_file_get_contents(path, &content, NULL, NULL));
+    g_free(path);
+    g_assert(strstr(content, "<name>linked_marker</name>"));
+    g_assert(strstr(content, "href=\"new/Archer-3.4.5-6.x86_64.rpm\""));
+    g_assert(!strstr(content, "moved_marker"));
+    g_assert(strstr(content, "<name>fake_bash</name>"));
+    g_assert(!strstr(content, "copied_marker"));
+    g_assert(strstr(content, "<name>super_kernel</name>"));
+    g_free(content);
+
+    g_hash_table_destroy(udata.old_metadata_moved);
+    g_queue_free(udata.buffer);
+    g_free(udata.prev_srpm);
+    g_free(udata.cur_srpm);
+    cr_metadata_free(md);
+    cr_remove_dir(tmp_dir, NULL);
+    g_free(repo_dir);
+    g_free(tmp_dir);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/dumper_thread/test_cr_pool_tasks_share_files",
+            test_cr_pool_tasks_share_files);
+    g_test_add_func("/dumper_thread/test_cr_pool_tasks_largest_first",
+            test_cr_pool_tasks_largest_first);
+    g_test_add_func("/dumper_thread/test_cr_moved_packages_index",
+            test_cr_moved_packages_index);
+    g_test_add_func("/dumper_thread/test_cr_dumper_thread_moved_package",
+            test_cr_dumper_thread_moved_package);
+
+    return g_test_run();
+}
@@ -0,0 +1,200 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include "createrepo/globset.h"
+
+static const char *test_patterns[] = {
+    "Archer-3.4.5-6.x86_64.rpm",
+    "*.src.rpm",
+    "*-debuginfo-*",
+    "kernel*",
+    "*",
+    "**",
+    "fake_?ash*",
+    "ba?icek-*.rpm",
+    "*/old/*",
+    "*žluťoučký*",
+    "k?ň-*",
+    "a*b*c",
+    "",
+    NULL,
+};
+
+static const char *test_strings[] = {
+    "",
+    "Archer-3.4.5-6.x86_64.rpm",
+    "Archer-3.4.5-6.x86_64.rpm.bak",
+    "empty-0-0.src.rpm",
+    "src.rpm",
+    "foo-debuginfo-1.0-1.x86_64.rpm",
+    "kernel",
+    "kernel-6.0.1-2.x86_64.rpm",
+    "fake_bash-1.1.1-1.x86_64.rpm",
+    "fake_ash-1.1.1-1.x86_64.rpm",
+    "balicek-utf8-1.1.1-1.x86_64.rpm",
+    "packages/old/foo.rpm",
+    "packages/old",
+    "žluťoučký-kůň.rpm",
+    "kůň-1.0.rpm",
+    "kůň",
+    "abc",
+    "ac",
+    "aXbYc",
+    "aXbYcZ",
+    NULL,
+};
+
+/* Match the string against a set with the single pattern and compare
+ * the result with GPatternSpec */
+static void
+assert_same_as_gpattern(const char *pattern, const char *string)
+{
+    cr_GlobSet *set = cr_globset_new();
+    cr_globset_add(set, pattern);
+
+    if (cr_globset_match(set, string) != g_pattern_match_simple(pattern, string))
+        g_error("Pattern \"%s\" and string \"%s\": cr_GlobSet %d, "
+                "GPatternSpec %d", pattern, string,
+                cr_globset_match(set, string),
+                g_pattern_match_simple(pattern, string));
+
+    cr_globset_free(set);
+}
+
+static void
+test_cr_globset_empty(void)
+{
+    cr_GlobSet *set = cr_globset_new();
+    g_assert_cmpint(cr_globset_size(set), ==, 0);
+    g_assert(!cr_globset_match(set, ""));
+    g_assert(!cr_globset_match(set, "foo.rpm"));
+    cr_globset_free(set);
+    cr_globset_free(NULL);
+}
+
+static void
+test_cr_globset_single_patterns(void)
+{
+    for (int p = 0; test_patterns[p]; p++)
+        for (int s = 0; test_strings[s]; s++)
+            assert_same_as_gpattern(test_patterns[p], test_strings[s]);
+}
+
+static void
+test_cr_globset_random_patterns(void)
+{
+    // Small alphabet with multibyte characters to exercise '?' and '*'
+    const char *alphabet[] = { "a", "b", "/", "é", "€", "𝄞" };
+    int alphabet_len = G_N_ELEMENTS(alphabet);
+    GRand *rand = g_rand_new_with_seed(42);
+
+    for (int x = 0; x < 5000; x++) {
+        GString *pattern = g_string_new(NULL);
+        GString *string = g_string_new(NULL);
+
+        int len = g_rand_int_range(rand, 0, 7);
+        for (int y = 0; y < len; y++) {
+            int c = g_rand_int_range(rand, 0, alphabet_len + 2);
+            if (c == alphabet_len)
+                g_string_append_c(pattern, '*');
+            else if (c == alphabet_len + 1)
+                g_string_append_c(pattern, '?');
+            else
+                g_string_append(pattern, alphabet[c]);
+        }
+
+        len = g_rand_int_range(rand, 0, 8);
+        for (int y = 0; y < len; y++)
+            g_string_append(string,
+                            alphabet[g_rand_int_range(rand, 0, alphabet_len)]);
+
+        assert_same_as_gpattern(pattern->str, string->str);
+
+        g_string_free(pattern, TRUE);
+        g_string_free(string, TRUE);
+    }
+
+    g_rand_free(rand);
+}
+
+static void
+test_cr_globset_many_patterns(void)
+{
+    // The set matches if any of the patterns matches
+    cr_GlobSet *set = cr_globset_new();
+    GPtrArray *specs = g_ptr_array_new_with_free_func(
+                                    (GDestroyNotify) g_pattern_spec_free);
+
+    for (int x = 0; x < 500; x++) {
+        gchar *pattern;
+        switch (x % 5) {
+            case 0:  pattern = g_strdup_printf("pkg%d-1.0-1.noarch.rpm", x); break;
+            case 1:  pattern = g_strdup_printf("pkg%d-*", x); break;
+            case 2:  pattern = g_strdup_printf("*-%d.x86_64.rpm", x); break;
+            case 3:  pattern = g_strdup_printf("*/dir%d/*", x); break;
+            default: pattern = g_strdup_printf("lib?%d*.rpm", x); break;
+        }
+        cr_globset_add(set, pattern);
+        g_ptr_array_add(specs, g_pattern_spec_new(pattern));
+        g_free(pattern);
+    }
+    g_assert_cmpint(cr_globset_size(set), ==, 500);
+
+    for (int x = 0; x < 1000; x++) {
+        gchar *strings[] = {
+            g_strdup_printf("pkg%d-1.0-1.noarch.rpm", x),
+            g_strdup_printf("foo-%d.x86_64.rpm", x),
+            g_strdup_printf("a/dir%d/b.rpm", x),
+            g_strdup_printf("libé%d-devel.rpm", x),
+            g_strdup_printf("other%d.rpm", x),
+            NULL,
+        };
+
+        for (int s = 0; strings[s]; s++) {
+            gboolean expected = FALSE;
+            for (guint p = 0; !expected && p < specs->len; p++)
+                expected = g_pattern_match_string(specs->pdata[p], strings[s]);
+            g_assert_cmpint(cr_globset_match(set, strings[s]), ==, expected);
+            g_free(strings[s]);
+        }
+    }
+
+    g_ptr_array_free(specs, TRUE);
+    cr_globset_free(set);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/globset/test_cr_globset_empty",
+            test_cr_globset_empty);
+    g_test_add_func("/globset/test_cr_globset_single_patterns",
+            test_cr_globset_single_patterns);
+    g_test_add_func("/globset/test_cr_globset_random_patterns",
+            test_cr_globset_random_patterns);
+    g_test_add_func("/globset/test_cr_globset_many_patterns",
+            test_cr_globset_many_patterns);
+
+    return g_test_run();
+}
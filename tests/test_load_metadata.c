@@ -20,6 +20,7 @@
 #include <glib.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "fixtures.h"
 #include "createrepo/error.h"
 #include "createrepo/package.h"
@@ -27,6 +28,8 @@
 #include "createrepo/load_metadata.h"
 #include "createrepo/locate_metadata.h"
 #include "createrepo/metadata_internal.h"
+#include "createrepo/xml_dump.h"
+#include "createrepo/xml_file.h"
 
 #define REPO_SIZE_00    0
 
@@ -167,6 +170,129 @@ static void test_cr_metadata_locate_and_load_xml_detailed(void)
 }
 
 
+static void
+check_raw_xml_dump(cr_Package *pkg)
+{
+    struct cr_XmlStruct raw, dump;
+
+    raw = cr_xml_dump_raw(pkg, NULL);
+    dump = cr_xml_dump(pkg, NULL);
+    g_assert(raw.primary);
+    g_assert_cmpstr(raw.primary, ==, dump.primary);
+    g_assert_cmpstr(raw.filelists, ==, dump.filelists);
+    g_assert_cmpstr(raw.other, ==, dump.other);
+
+    g_free(raw.primary);
+    g_free(raw.filelists);
+    g_free(raw.other);
+    g_free(dump.primary);
+    g_free(dump.filelists);
+    g_free(dump.other);
+}
+
+
+static void test_cr_metadata_load_raw_xml(void)
+{
+    int ret;
+    GError *tmp_err = NULL;
+    GHashTableIter iter;
+    gpointer value;
+    cr_Metadata *metadata;
+
+    // Input repo written by createrepo_c, one package has a xml:base
+    metadata = cr_metadata_new(CR_HT_KEY_HASH, 0, NULL);
+    ret = cr_metadata_locate_and_load_xml(metadata, TEST_REPO_02, NULL);
+    g_assert_cmpint(ret, ==, CRE_OK);
+
+    gchar *template = g_strdup(TMPDIR_TEMPLATE);
+    gchar *tmp_dir = mkdtemp(template);
+    g_assert(tmp_dir);
+
+    struct cr_MetadataLocation *ml = g_new0(struct cr_MetadataLocation, 1);
+    ml->pri_xml_href = g_build_filename(tmp_dir, "primary.xml", NULL);
+    ml->fil_xml_href = g_build_filename(tmp_dir, "filelists.xml", NULL);
+    ml->oth_xml_href = g_build_filename(tmp_dir, "other.xml", NULL);
+
+    cr_XmlFile *pri_f = cr_xmlfile_open_primary(ml->pri_xml_href,
+                                                CR_CW_NO_COMPRESSION, NULL);
+    cr_XmlFile *fil_f = cr_xmlfile_open_filelists(ml->fil_xml_href,
+                                                  CR_CW_NO_COMPRESSION, NULL);
+    cr_XmlFile *oth_f = cr_xmlfile_open_other(ml->oth_xml_href,
+                                              CR_CW_NO_COMPRESSION, NULL);
+    g_assert(pri_f && fil_f && oth_f);
+
+    g_hash_table_iter_init(&iter, cr_metadata_hashtable(metadata));
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        cr_Package *pkg = value;
+        if (!g_strcmp0(pkg->name, "fake_bash"))
+            pkg->location_base = g_string_chunk_insert(pkg->chunk,
+                                        "http://example.com/repo");
+        struct cr_XmlStruct xml = cr_xml_dump(pkg, NULL);
+        cr_xmlfile_add_chunk(pri_f, xml.primary, NULL);
+        cr_xmlfile_add_chunk(fil_f, xml.filelists, NULL);
+        cr_xmlfile_add_chunk(oth_f, xml.other, NULL);
+        g_free(xml.primary);
+        g_free(xml.filelists);
+        g_free(xml.other);
+    }
+    cr_xmlfile_close(pri_f, NULL);
+    cr_xmlfile_close(fil_f, NULL);
+    cr_xmlfile_close(oth_f, NULL);
+    cr_metadata_free(metadata);
+
+    // Without raw XML
+    metadata = cr_metadata_new(CR_HT_KEY_HASH, 0, NULL);
+    ret = cr_metadata_load_xml(metadata, ml, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_hash_table_iter_init(&iter, cr_metadata_hashtable(metadata));
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        cr_Package *pkg = value;
+        g_assert(!pkg->raw_primary);
+        g_assert(!pkg->raw_filelists);
+        g_assert(!pkg->raw_other);
+    }
+    cr_metadata_free(metadata);
+
+    // With raw XML
+    metadata = cr_metadata_new(CR_HT_KEY_HASH, 0, NULL);
+    cr_metadata_set_raw_xml(metadata, TRUE);
+    ret = cr_metadata_load_xml(metadata, ml, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert_cmpint(g_hash_table_size(cr_metadata_hashtable(metadata)), ==,
+                    REPO_SIZE_02);
+
+    g_hash_table_iter_init(&iter, cr_metadata_hashtable(metadata));
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        cr_Package *pkg = value;
+        g_assert(g_str_has_prefix(pkg->raw_primary, "<package type=\"rpm\">"));
+        g_assert(g_str_has_suffix(pkg->raw_filelists, "</package>"));
+        g_assert(strstr(pkg->raw_other, pkg->pkgId));
+
+        // Original location
+        check_raw_xml_dump(pkg);
+
+        // Added, replaced and removed xml:base
+        pkg->location_base = "/srv/repo";
+        check_raw_xml_dump(pkg);
+        pkg->location_base = "http://example.com/other";
+        check_raw_xml_dump(pkg);
+        pkg->location_base = NULL;
+        check_raw_xml_dump(pkg);
+
+        // Base which would be escaped is generated by cr_xml_dump()
+        pkg->location_base = "http://example.com/?a=1&b=2";
+        check_raw_xml_dump(pkg);
+    }
+    cr_metadata_free(metadata);
+
+    cr_metadatalocation_free(ml);
+    cr_remove_dir(tmp_dir, NULL);
+    g_free(tmp_dir);
+}
+
+
 #ifdef WITH_LIBMODULEMD
 static void test_cr_metadata_locate_and_load_modulemd(void)
 {
@@ -198,6 +324,7 @@ int main(int argc, char *argv[])
     g_test_add_func("/load_metadata/test_cr_metadata_new", test_cr_metadata_new);
     g_test_add_func("/load_metadata/test_cr_metadata_locate_and_load_xml", test_cr_metadata_locate_and_load_xml);
     g_test_add_func("/load_metadata/test_cr_metadata_locate_and_load_xml_detailed", test_cr_metadata_locate_and_load_xml_detailed);
+    g_test_add_func("/load_metadata/test_cr_metadata_load_raw_xml", test_cr_metadata_load_raw_xml);
 
 #ifdef WITH_LIBMODULEMD
     g_test_add_func("/load_metadata/test_cr_metadata_locate_and_load_modulemd", test_cr_metadata_locate_and_load_modulemd);
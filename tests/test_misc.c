@@ -19,8 +19,10 @@
 
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <rpm/rpmlib.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include "fixtures.h"
 #include "createrepo/checksum.h"
@@ -1248,6 +1250,139 @@ test_cr_cmp_evr(void)
 }
 
 
+static void
+test_cr_vercmp(void)
+{
+    // Cases from the rpm test suite (rpmvercmp.at) which do not depend
+    // on the version of the rpm
+    static const struct {
+        const char *a;
+        const char *b;
+        int res;
+    } cases[] = {
+        { "1.0", "1.0", 0 },            { "1.0", "2.0", -1 },
+        { "2.0", "1.0", 1 },            { "2.0.1", "2.0.1", 0 },
+        { "2.0", "2.0.1", -1 },         { "2.0.1", "2.0", 1 },
+        { "2.0.1a", "2.0.1a", 0 },      { "2.0.1a", "2.0.1", 1 },
+        { "2.0.1", "2.0.1a", -1 },      { "5.5p1", "5.5p1", 0 },
+        { "5.5p1", "5.5p2", -1 },       { "5.5p2", "5.5p1", 1 },
+        { "5.5p10", "5.5p10", 0 },      { "5.5p1", "5.5p10", -1 },
+        { "5.5p10", "5.5p1", 1 },       { "10xyz", "10.1xyz", -1 },
+        { "10.1xyz", "10xyz", 1 },      { "xyz10", "xyz10", 0 },
+        { "xyz10", "xyz10.1", -1 },     { "xyz10.1", "xyz10", 1 },
+        { "xyz.4", "xyz.4", 0 },        { "xyz.4", "8", -1 },
+        { "8", "xyz.4", 1 },            { "xyz.4", "2", -1 },
+        { "2", "xyz.4", 1 },            { "5.5p2", "5.6p1", -1 },
+        { "5.6p1", "5.5p2", 1 },        { "5.6p1", "6.5p1", -1 },
+        { "6.5p1", "5.6p1", 1 },        { "6.0.rc1", "6.0", 1 },
+        { "6.0", "6.0.rc1", -1 },       { "10b2", "10a1", 1 },
+        { "10a2", "10b2", -1 },         { "1.0aa", "1.0aa", 0 },
+        { "1.0a", "1.0aa", -1 },        { "1.0aa", "1.0a", 1 },
+        { "10.0001", "10.0001", 0 },    { "10.0001", "10.1", 0 },
+        { "10.1", "10.0001", 0 },       { "10.0001", "10.0039", -1 },
+        { "10.0039", "10.0001", 1 },    { "4.999.9", "5.0", -1 },
+        { "5.0", "4.999.9", 1 },        { "20101121", "20101121", 0 },
+        { "20101121", "20101122", -1 }, { "20101122", "20101121", 1 },
+        { "2_0", "2_0", 0 },            { "2.0", "2_0", 0 },
+        { "2_0", "2.0", 0 },            { "a", "a", 0 },
+        { "a+", "a+", 0 },              { "a+", "a_", 0 },
+        { "a_", "a+", 0 },              { "+a", "+a", 0 },
+        { "+a", "_a", 0 },              { "_a", "+a", 0 },
+        { "+_", "+_", 0 },              { "_+", "+_", 0 },
+        { "_+", "_+", 0 },              { "+", "_", 0 },
+        { "_", "+", 0 },                { "1.0~rc1", "1.0~rc1", 0 },
+        { "1.0~rc1", "1.0", -1 },       { "1.0", "1.0~rc1", 1 },
+        { "1.0~rc1", "1.0~rc2", -1 },   { "1.0~rc2", "1.0~rc1", 1 },
+        { "1.0~rc1~git123", "1.0~rc1~git123", 0 },
+        { "1.0~rc1~git123", "1.0~rc1", -1 },
+        { "1.0~rc1", "1.0~rc1~git123", 1 },
+    };
+
+    for (size_t x = 0; x < G_N_ELEMENTS(cases); x++) {
+        g_assert_cmpint(cr_vercmp(cases[x].a, cases[x].b), ==, cases[x].res);
+        g_assert_cmpint(cr_vercmp(cases[x].a, cases[x].b), ==,
+                        rpmvercmp(cases[x].a, cases[x].b));
+    }
+
+    // Differential test against rpmvercmp() with random versions made
+    // of short digit and alpha runs, leading zeros, separators, tildes,
+    // carets and non-ASCII bytes
+    static const char alphabet[] = "00123999aAbzZ..._-~^+ \x80";
+    GRand *rand = g_rand_new_with_seed(88);
+    char a[16], b[32];
+
+    for (int x = 0; x < 200000; x++) {
+        int len = g_rand_int_range(rand, 0, sizeof(a));
+        for (int y = 0; y < len; y++)
+            a[y] = alphabet[g_rand_int_range(rand, 0, sizeof(alphabet) - 1)];
+        a[len] = '\0';
+
+        if (g_rand_boolean(rand)) {
+            // Similar version with one changed character
+            strcpy(b, a);
+            if (len)
+                b[g_rand_int_range(rand, 0, len)] =
+                    alphabet[g_rand_int_range(rand, 0, sizeof(alphabet) - 1)];
+            if (g_rand_boolean(rand))
+                strcat(b, g_rand_boolean(rand) ? "1" : "~");
+        } else {
+            len = g_rand_int_range(rand, 0, sizeof(a));
+            for (int y = 0; y < len; y++)
+                b[y] = alphabet[g_rand_int_range(rand, 0, sizeof(alphabet) - 1)];
+            b[len] = '\0';
+        }
+
+        int res = rpmvercmp(a, b);
+        if (cr_vercmp(a, b) != res)
+            g_error("cr_vercmp(\"%s\", \"%s\") != %d", a, b, res);
+    }
+
+    g_rand_free(rand);
+}
+
+
+static void
+test_cr_evr_sort(void)
+{
+    static const char *versions[][3] = {
+        { NULL, "1.0", "1" },       { "1", "0.1", "1" },
+        { "0", "1.0", "1" },        { NULL, "1.0~rc1", "1" },
+        { NULL, "1.0", NULL },      { NULL, "1.0", "2.fc38" },
+        { NULL, "1.0", "10" },      { NULL, "1.0.1", "1" },
+        { NULL, "01.0", "1" },      { NULL, "1.0a", "1" },
+        { NULL, "1.0", "1~1" },     { NULL, "1_0", "1" },
+        { NULL, "", "1" },          { "2", "", "" },
+        { NULL, "1.00010", "1" },   { NULL, "1.9", "1" },
+    };
+    cr_EVR evrs[G_N_ELEMENTS(versions)];
+    cr_EVR *sorted[G_N_ELEMENTS(versions)];
+
+    for (size_t x = 0; x < G_N_ELEMENTS(versions); x++) {
+        evrs[x].epoch = (char *) versions[x][0];
+        evrs[x].version = (char *) versions[x][1];
+        evrs[x].release = (char *) versions[x][2];
+        sorted[x] = &evrs[x];
+    }
+
+    cr_evr_sort(sorted, G_N_ELEMENTS(sorted));
+
+    // Order agrees with cr_cmp_evr() and equal EVRs keep their order
+    for (size_t x = 1; x < G_N_ELEMENTS(sorted); x++) {
+        cr_EVR *a = sorted[x-1], *b = sorted[x];
+        int res = cr_cmp_evr(a->epoch, a->version, a->release,
+                             b->epoch, b->version, b->release);
+        g_assert_cmpint(res, <=, 0);
+        if (res == 0)
+            g_assert(a < b);
+    }
+
+    g_assert(sorted[0]->version[0] == '\0');
+    g_assert_cmpstr(sorted[G_N_ELEMENTS(sorted)-1]->epoch, ==, "2");
+
+    cr_evr_sort(NULL, 0);
+}
+
+
 static void
 test_cr_cut_dirs(void)
 {
@@ -1370,6 +1505,10 @@ main(int argc, char *argv[])
             test_cr_str_to_nevra);
     g_test_add_func("/misc/test_cr_cmp_evr",
             test_cr_cmp_evr);
+    g_test_add_func("/misc/test_cr_vercmp",
+            test_cr_vercmp);
+    g_test_add_func("/misc/test_cr_evr_sort",
+            test_cr_evr_sort);
     g_test_add_func("/misc/test_cr_cut_dirs",
             test_cr_cut_dirs);
 
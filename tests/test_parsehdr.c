@@ -0,0 +1,192 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/package.h"
+#include "createrepo/parsehdr.h"
+#include "createrepo/parsepkg.h"
+#include "createrepo/xml_dump.h"
+
+// Packages used for comparison of the direct and the librpm header reader
+static const char *test_packages[] = {
+    TEST_PACKAGES_PATH"Archer-3.4.5-6.x86_64.rpm",
+    TEST_PACKAGES_PATH"Rimmer-1.0.2-2.x86_64.rpm",
+    TEST_PACKAGES_PATH"balicek-iso88591-1.1.1-1.x86_64.rpm",
+    TEST_PACKAGES_PATH"balicek-iso88592-1.1.1-1.x86_64.rpm",
+    TEST_PACKAGES_PATH"balicek-utf8-1.1.1-1.x86_64.rpm",
+    TEST_PACKAGES_PATH"empty-0-0.src.rpm",
+    TEST_PACKAGES_PATH"empty-0-0.x86_64.rpm",
+    TEST_PACKAGES_PATH"fake_bash-1.1.1-1.x86_64.rpm",
+    TEST_PACKAGES_PATH"super_kernel-6.0.1-2.x86_64.rpm",
+    NULL,
+};
+
+static cr_Package *
+load_package(const char *path, cr_HeaderReadingFlags flags)
+{
+    GError *err = NULL;
+    cr_Package *pkg = cr_package_from_rpm(path, CR_CHECKSUM_SHA256, path,
+                                          NULL, -1, NULL, flags, &err);
+    g_assert_no_error(err);
+    g_assert(pkg);
+    return pkg;
+}
+
+static void
+assert_same_binary_data(cr_BinaryData *a, cr_BinaryData *b)
+{
+    if (!a || !b) {
+        g_assert(a == b);
+        return;
+    }
+    g_assert_cmpint(a->size, ==, b->size);
+    g_assert(!memcmp(a->data, b->data, a->size));
+}
+
+static void
+compare_readers(cr_HeaderReadingFlags flags)
+{
+    for (int x = 0; test_packages[x]; x++) {
+        GError *err = NULL;
+        cr_Package *direct = load_package(test_packages[x], flags);
+        cr_Package *librpm = load_package(test_packages[x],
+                                          flags | CR_HDRR_LIBRPM);
+
+        struct cr_XmlStruct direct_xml = cr_xml_dump(direct, &err);
+        g_assert_no_error(err);
+        struct cr_XmlStruct librpm_xml = cr_xml_dump(librpm, &err);
+        g_assert_no_error(err);
+
+        g_assert_cmpstr(direct_xml.primary, ==, librpm_xml.primary);
+        g_assert_cmpstr(direct_xml.filelists, ==, librpm_xml.filelists);
+        g_assert_cmpstr(direct_xml.other, ==, librpm_xml.other);
+
+        g_assert_cmpstr(direct->hdrid, ==, librpm->hdrid);
+        assert_same_binary_data(direct->siggpg, librpm->siggpg);
+        assert_same_binary_data(direct->sigpgp, librpm->sigpgp);
+
+        g_free(direct_xml.primary);
+        g_free(direct_xml.filelists);
+        g_free(direct_xml.other);
+        g_free(librpm_xml.primary);
+        g_free(librpm_xml.filelists);
+        g_free(librpm_xml.other);
+        cr_package_free(direct);
+        cr_package_free(librpm);
+    }
+}
+
+static void
+test_cr_package_from_header_direct_vs_librpm(void)
+{
+    compare_readers(CR_HDRR_NONE);
+}
+
+static void
+test_cr_package_from_header_direct_vs_librpm_signatures(void)
+{
+    compare_readers(CR_HDRR_LOADHDRID | CR_HDRR_LOADSIGNATURES);
+}
+
+static void
+test_cr_package_from_header_changelog_limit(void)
+{
+    GError *err = NULL;
+    const char *path = TEST_PACKAGES_PATH"Archer-3.4.5-6.x86_64.rpm";
+
+    cr_Package *direct = cr_package_from_rpm_base(path, 1, CR_HDRR_NONE, &err);
+    g_assert_no_error(err);
+    cr_Package *librpm = cr_package_from_rpm_base(path, 1, CR_HDRR_LIBRPM, &err);
+    g_assert_no_error(err);
+
+    g_assert_cmpint(g_slist_length(direct->changelogs), ==, 1);
+    g_assert_cmpint(g_slist_length(librpm->changelogs), ==, 1);
+
+    cr_ChangelogEntry *a = direct->changelogs->data;
+    cr_ChangelogEntry *b = librpm->changelogs->data;
+    g_assert_cmpstr(a->author, ==, b->author);
+    g_assert_cmpint(a->date, ==, b->date);
+    g_assert_cmpstr(a->changelog, ==, b->changelog);
+
+    cr_package_free(direct);
+    cr_package_free(librpm);
+}
+
+static void
+test_cr_package_from_header_changelog_size_limit(void)
+{
+    GError *err = NULL;
+    const char *path = TEST_PACKAGES_PATH"Archer-3.4.5-6.x86_64.rpm";
+
+    cr_Package *all = cr_package_from_rpm_base(path, -1, CR_HDRR_NONE, &err);
+    g_assert_no_error(err);
+    g_assert_cmpint(g_slist_length(all->changelogs), >, 1);
+
+    // The newest entry is always loaded
+    cr_Package *one = cr_package_from_rpm_base_limited(path, -1, 1,
+                                                       CR_HDRR_NONE, &err);
+    g_assert_no_error(err);
+    g_assert_cmpint(g_slist_length(one->changelogs), ==, 1);
+    cr_ChangelogEntry *newest = g_slist_last(all->changelogs)->data;
+    cr_ChangelogEntry *loaded = one->changelogs->data;
+    g_assert_cmpstr(newest->changelog, ==, loaded->changelog);
+
+    // Limit big enough for all entries
+    cr_Package *big = cr_package_from_rpm_base_limited(path, -1, 1024*1024,
+                                                       CR_HDRR_LIBRPM, &err);
+    g_assert_no_error(err);
+    g_assert_cmpint(g_slist_length(big->changelogs), ==,
+                    g_slist_length(all->changelogs));
+
+    cr_package_free(all);
+    cr_package_free(one);
+    cr_package_free(big);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    cr_xml_dump_init();
+    cr_package_parser_init();
+
+    g_test_add_func("/parsehdr/test_cr_package_from_header_direct_vs_librpm",
+            test_cr_package_from_header_direct_vs_librpm);
+    g_test_add_func("/parsehdr/test_cr_package_from_header_direct_vs_librpm_signatures",
+            test_cr_package_from_header_direct_vs_librpm_signatures);
+    g_test_add_func("/parsehdr/test_cr_package_from_header_changelog_limit",
+            test_cr_package_from_header_changelog_limit);
+    g_test_add_func("/parsehdr/test_cr_package_from_header_changelog_size_limit",
+            test_cr_package_from_header_changelog_size_limit);
+
+    ret = g_test_run();
+
+    cr_package_parser_cleanup();
+    cr_xml_dump_cleanup();
+
+    return ret;
+}
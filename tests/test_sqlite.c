@@ -24,6 +24,7 @@
 #include <unistd.h>
 #include <sqlite3.h>
 #include "fixtures.h"
+#include "createrepo/error.h"
 #include "createrepo/misc.h"
 #include "createrepo/package.h"
 #include "createrepo/sqlite.h"
@@ -243,6 +244,211 @@ test_all(TestData *testdata,
 
 
 
+static gint64
+count_rows(const char *path, const char *sql)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    gint64 count = -1;
+
+    g_assert_cmpint(sqlite3_open(path, &db), ==, SQLITE_OK);
+    g_assert_cmpint(sqlite3_prepare_v2(db, sql, -1, &stmt, NULL), ==, SQLITE_OK);
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        count = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return count;
+}
+
+
+static void
+create_copy_input(gchar **in_paths, cr_Package *pkg, cr_Package *pkg2)
+{
+    GError *err = NULL;
+    cr_SqliteDb *dbs[3];
+
+    dbs[0] = cr_db_open_primary(in_paths[0], &err);
+    g_assert(dbs[0]);
+    dbs[1] = cr_db_open_filelists(in_paths[1], &err);
+    g_assert(dbs[1]);
+    dbs[2] = cr_db_open_other(in_paths[2], &err);
+    g_assert(dbs[2]);
+    g_assert(!err);
+
+    for (int x = 0; x < 3; x++) {
+        cr_db_add_pkg(dbs[x], pkg, &err);
+        g_assert(!err);
+        cr_db_add_pkg(dbs[x], pkg2, &err);
+        g_assert(!err);
+        cr_db_dbinfo_update(dbs[x], "foochecksum", &err);
+        g_assert(!err);
+        cr_db_close(dbs[x], &err);
+        g_assert(!err);
+    }
+}
+
+
+static void
+test_cr_db_copy_pkgs(TestData *testdata,
+                     G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    cr_SqliteDb *pri_db, *fil_db, *oth_db;
+    cr_Package *pkg, *pkg2;
+    gchar *in_paths[3], *out_paths[3];
+    const char *names[3] = { TMP_PRIMARY_NAME,
+                             TMP_FILELISTS_NAME,
+                             TMP_OTHER_NAME };
+
+    for (int x = 0; x < 3; x++) {
+        in_paths[x] = g_strconcat(testdata->tmp_dir, "/in_", names[x], NULL);
+        out_paths[x] = g_strconcat(testdata->tmp_dir, "/", names[x], NULL);
+    }
+
+    pkg = get_package();
+    pkg2 = get_package();
+    pkg2->pkgId = "abcdef";
+    pkg2->name = "bar";
+
+    // Input databases with both packages
+
+    create_copy_input(in_paths, pkg, pkg2);
+
+    // Copy only the second package
+
+    pri_db = cr_db_open_primary(out_paths[0], &err);
+    fil_db = cr_db_open_filelists(out_paths[1], &err);
+    oth_db = cr_db_open_other(out_paths[2], &err);
+    g_assert(!err);
+
+    pkg2->pkgKey = 7;
+    pkg2->location_base = "http://mirror/";
+    GSList *packages = g_slist_prepend(NULL, pkg2);
+    int ret = cr_db_copy_pkgs(pri_db, fil_db, oth_db,
+                              in_paths[0], in_paths[1], in_paths[2],
+                              packages, &err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!err);
+
+    // Package which is not in the input databases
+
+    cr_Package *missing = get_package();
+    missing->pkgId = "missing";
+    missing->pkgKey = 8;
+    GSList *missing_packages = g_slist_prepend(NULL, missing);
+    ret = cr_db_copy_pkgs(pri_db, fil_db, oth_db,
+                          in_paths[0], in_paths[1], in_paths[2],
+                          missing_packages, &err);
+    g_assert_cmpint(ret, ==, CRE_DB);
+    g_assert(err);
+    g_clear_error(&err);
+    g_slist_free(missing_packages);
+    g_slist_free(packages);
+
+    cr_db_close(pri_db, &err);
+    cr_db_close(fil_db, &err);
+    cr_db_close(oth_db, &err);
+    g_assert(!err);
+
+    // Check the copied rows
+
+    g_assert_cmpint(count_rows(out_paths[0],
+        "SELECT COUNT(*) FROM packages WHERE pkgKey = 7 AND name = 'bar' "
+        "AND location_base = 'http://mirror/'"), ==, 1);
+    g_assert_cmpint(count_rows(out_paths[0],
+        "SELECT COUNT(*) FROM packages"), ==, 1);
+    g_assert_cmpint(count_rows(out_paths[0],
+        "SELECT COUNT(*) FROM requires WHERE pkgKey = 7"), ==, 2);
+    g_assert_cmpint(count_rows(out_paths[0],
+        "SELECT COUNT(*) FROM requires WHERE pre = 'TRUE'"), ==, 1);
+    g_assert_cmpint(count_rows(out_paths[0],
+        "SELECT COUNT(*) FROM provides WHERE pkgKey = 7"), ==, 1);
+    g_assert_cmpint(count_rows(out_paths[1],
+        "SELECT COUNT(*) FROM packages WHERE pkgKey = 7"), ==, 1);
+    g_assert_cmpint(count_rows(out_paths[1],
+        "SELECT COUNT(*) FROM filelist WHERE pkgKey = 7"), ==,
+        count_rows(in_paths[1], "SELECT COUNT(*) FROM filelist "
+                   "WHERE pkgKey = 2"));
+    g_assert_cmpint(count_rows(out_paths[2],
+        "SELECT COUNT(*) FROM packages WHERE pkgKey = 7"), ==, 1);
+
+    for (int x = 0; x < 3; x++) {
+        g_free(in_paths[x]);
+        g_free(out_paths[x]);
+    }
+}
+
+
+static void
+test_cr_db_copy_pkgs_rollback(TestData *testdata,
+                              G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    cr_SqliteDb *pri_db, *fil_db, *oth_db;
+    cr_Package *pkg, *pkg2, *other;
+    gchar *in_paths[3], *out_paths[3];
+    const char *names[3] = { TMP_PRIMARY_NAME,
+                             TMP_FILELISTS_NAME,
+                             TMP_OTHER_NAME };
+
+    for (int x = 0; x < 3; x++) {
+        in_paths[x] = g_strconcat(testdata->tmp_dir, "/in_", names[x], NULL);
+        out_paths[x] = g_strconcat(testdata->tmp_dir, "/", names[x], NULL);
+    }
+
+    pkg = get_package();
+    pkg2 = get_package();
+    pkg2->pkgId = "abcdef";
+    create_copy_input(in_paths, pkg, pkg2);
+
+    // The filelists db already uses the pkgKey, so the copy fails
+    // after the rows were copied into the primary db
+
+    pri_db = cr_db_open_primary(out_paths[0], &err);
+    fil_db = cr_db_open_filelists(out_paths[1], &err);
+    oth_db = cr_db_open_other(out_paths[2], &err);
+    g_assert(!err);
+
+    other = get_package();
+    other->pkgId = "other";
+    cr_db_add_pkg(fil_db, other, &err);
+    g_assert(!err);
+
+    pkg->pkgKey = other->pkgKey;
+    GSList *packages = g_slist_prepend(NULL, pkg);
+    int ret = cr_db_copy_pkgs(pri_db, fil_db, oth_db,
+                              in_paths[0], in_paths[1], in_paths[2],
+                              packages, &err);
+    g_assert_cmpint(ret, ==, CRE_DB);
+    g_assert(err);
+    g_clear_error(&err);
+    g_slist_free(packages);
+
+    cr_db_close(pri_db, &err);
+    cr_db_close(fil_db, &err);
+    cr_db_close(oth_db, &err);
+    g_assert(!err);
+
+    // Nothing was copied
+
+    g_assert_cmpint(count_rows(out_paths[0],
+        "SELECT COUNT(*) FROM packages"), ==, 0);
+    g_assert_cmpint(count_rows(out_paths[0],
+        "SELECT COUNT(*) FROM requires"), ==, 0);
+    g_assert_cmpint(count_rows(out_paths[1],
+        "SELECT COUNT(*) FROM packages WHERE pkgId = 'other'"), ==, 1);
+    g_assert_cmpint(count_rows(out_paths[1],
+        "SELECT COUNT(*) FROM packages"), ==, 1);
+    g_assert_cmpint(count_rows(out_paths[2],
+        "SELECT COUNT(*) FROM packages"), ==, 0);
+
+    for (int x = 0; x < 3; x++) {
+        g_free(in_paths[x]);
+        g_free(out_paths[x]);
+    }
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -252,6 +458,8 @@ main(int argc, char *argv[])
     g_test_add("/sqlite/test_cr_db_add_primary_pkg", TestData, NULL, testdata_setup, test_cr_db_add_primary_pkg, testdata_teardown);
     g_test_add("/sqlite/test_cr_db_dbinfo_update", TestData, NULL, testdata_setup, test_cr_db_dbinfo_update, testdata_teardown);
     g_test_add("/sqlite/test_all", TestData, NULL, testdata_setup, test_all, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_copy_pkgs", TestData, NULL, testdata_setup, test_cr_db_copy_pkgs, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_copy_pkgs_rollback", TestData, NULL, testdata_setup, test_cr_db_copy_pkgs_rollback, testdata_teardown);
 
     return g_test_run();
 }
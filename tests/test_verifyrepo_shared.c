@@ -0,0 +1,199 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2014  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/verifyrepo_shared.h"
+
+typedef struct {
+    gchar *tmp_dir;
+} TestFixtures;
+
+static void
+fixtures_setup(TestFixtures *fixtures,
+               G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *tmp_err = NULL;
+    gchar *template = g_strdup(TMPDIR_TEMPLATE);
+    fixtures->tmp_dir = mkdtemp(template);
+    g_assert(fixtures->tmp_dir);
+
+    // Copy of the repo_02 with its packages
+    gchar *repodata = g_build_filename(fixtures->tmp_dir, "repodata", NULL);
+    g_assert_cmpint(g_mkdir(repodata, 0755), ==, 0);
+
+    GDir *dir = g_dir_open(TEST_REPO_02"repodata", 0, NULL);
+    g_assert(dir);
+    const gchar *name;
+    while ((name = g_dir_read_name(dir))) {
+        gchar *src = g_build_filename(TEST_REPO_02"repodata", name, NULL);
+        gchar *dst = g_build_filename(repodata, name, NULL);
+        g_assert(cr_copy_file(src, dst, &tmp_err));
+        g_assert_no_error(tmp_err);
+        g_free(src);
+        g_free(dst);
+    }
+    g_dir_close(dir);
+    g_free(repodata);
+
+    const char *packages[] = { "fake_bash-1.1.1-1.x86_64.rpm",
+                               "super_kernel-6.0.1-2.x86_64.rpm" };
+    for (gsize x = 0; x < G_N_ELEMENTS(packages); x++) {
+        gchar *src = g_build_filename(TEST_PACKAGES_PATH, packages[x], NULL);
+        gchar *dst = g_build_filename(fixtures->tmp_dir, packages[x], NULL);
+        g_assert(cr_copy_file(src, dst, &tmp_err));
+        g_assert_no_error(tmp_err);
+        g_free(src);
+        g_free(dst);
+    }
+}
+
+static void
+fixtures_teardown(TestFixtures *fixtures,
+                  G_GNUC_UNUSED gconstpointer test_data)
+{
+    if (!fixtures->tmp_dir)
+        return;
+
+    cr_remove_dir(fixtures->tmp_dir, NULL);
+    g_free(fixtures->tmp_dir);
+}
+
+static cr_VerifyResult *
+get_result(GPtrArray *results, const char *target)
+{
+    for (guint x = 0; x < results->len; x++) {
+        cr_VerifyResult *result = g_ptr_array_index(results, x);
+        if (!g_strcmp0(result->target, target))
+            return result;
+    }
+    return NULL;
+}
+
+static void
+test_cr_verify_repo(TestFixtures *fixtures,
+                    G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *tmp_err = NULL;
+
+    // Metadata only
+    cr_VerifyReport *report = cr_verify_repo(fixtures->tmp_dir, FALSE, 2,
+                                             &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert(report);
+    g_assert(cr_verify_report_ok(report));
+    g_assert_cmpint(report->metadata->len, ==, 3);
+    g_assert_cmpint(report->packages->len, ==, 0);
+    g_assert_cmpint(report->failed, ==, 0);
+    g_assert_cmpint(get_result(report->metadata, "primary")->size, ==, 973);
+    cr_verify_report_free(report);
+
+    // Packages
+    report = cr_verify_repo(fixtures->tmp_dir, TRUE, 0, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert(cr_verify_report_ok(report));
+    g_assert_cmpint(report->packages->len, ==, 2);
+    g_assert_cmpint(report->skipped, ==, 0);
+
+    gchar *json = cr_verify_report_to_json(report);
+    g_assert(strstr(json, "\"ok\": true"));
+    g_assert(strstr(json, "\"target\": \"primary\""));
+    g_assert(strstr(json, "\"packages\": []"));
+    g_free(json);
+    cr_verify_report_free(report);
+}
+
+static void
+test_cr_verify_repo_failures(TestFixtures *fixtures,
+                             G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *tmp_err = NULL;
+    cr_VerifyResult *result;
+
+    // Missing package and modified metadata
+    gchar *path = g_build_filename(fixtures->tmp_dir,
+                                   "super_kernel-6.0.1-2.x86_64.rpm", NULL);
+    g_assert_cmpint(g_unlink(path), ==, 0);
+    g_free(path);
+
+    path = g_build_filename(fixtures->tmp_dir, "repodata",
+            "ab5d3edeea50f9b4ec5ee13e4d25c147e318e3a433dbabc94d3461f58ac28255"
+            "-other.xml.gz", NULL);
+    FILE *f = fopen(path, "ab");
+    g_assert(f);
+    fputs("garbage", f);
+    fclose(f);
+    g_free(path);
+
+    cr_VerifyReport *report = cr_verify_repo(fixtures->tmp_dir, TRUE, 2,
+                                             &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert(report);
+    g_assert(!cr_verify_report_ok(report));
+    g_assert_cmpint(report->failed, ==, 2);
+
+    result = get_result(report->metadata, "other");
+    g_assert(result);
+    g_assert_cmpint(result->status, ==, CR_VERIFY_FAILED);
+    g_assert(g_str_has_prefix(result->errors->data, "Wrong size"));
+    result = get_result(report->metadata, "filelists");
+    g_assert_cmpint(result->status, ==, CR_VERIFY_OK);
+
+    result = get_result(report->packages, "super_kernel-6.0.1-2.x86_64.rpm");
+    g_assert(result);
+    g_assert_cmpint(result->status, ==, CR_VERIFY_FAILED);
+    g_assert_cmpint(result->size, ==, -1);
+    result = get_result(report->packages, "fake_bash-1.1.1-1.x86_64.rpm");
+    g_assert_cmpint(result->status, ==, CR_VERIFY_OK);
+
+    // Only the failed package is in the report
+    gchar *json = cr_verify_report_to_json(report);
+    g_assert(strstr(json, "\"ok\": false"));
+    g_assert(strstr(json, "super_kernel"));
+    g_assert(!strstr(json, "fake_bash"));
+    g_free(json);
+    cr_verify_report_free(report);
+
+    // Repository without repomd.xml
+    report = cr_verify_repo(TEST_PACKAGES_PATH, FALSE, 1, &tmp_err);
+    g_assert(!report);
+    g_assert(tmp_err);
+    g_error_free(tmp_err);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add("/verifyrepo_shared/test_cr_verify_repo",
+               TestFixtures, NULL, fixtures_setup,
+               test_cr_verify_repo, fixtures_teardown);
+    g_test_add("/verifyrepo_shared/test_cr_verify_repo_failures",
+               TestFixtures, NULL, fixtures_setup,
+               test_cr_verify_repo_failures, fixtures_teardown);
+
+    return g_test_run();
+}
@@ -23,11 +23,14 @@
 #include <glib/gstdio.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include "fixtures.h"
 #include "createrepo/misc.h"
 #include "createrepo/xml_file.h"
 #include "createrepo/compression_wrapper.h"
+#include "createrepo/load_metadata.h"
+#include "createrepo/locate_metadata.h"
 
 typedef struct {
     gchar *tmpdir;
@@ -139,6 +142,233 @@ test_rewrite_header_pacakge_count(TestFixtures *fixtures,
     g_free(path);
 }
 
+static gchar *
+write_chunks(const gchar *path, gsize buffer_size, cr_ContentStat *stat)
+{
+    GError *err = NULL;
+    GString *expected = g_string_new(NULL);
+
+    cr_XmlFile *f = cr_xmlfile_sopen_primary(path, CR_CW_GZ_COMPRESSION,
+                                             stat, &err);
+    g_assert(f);
+    g_assert_no_error(err);
+    cr_xmlfile_set_buffer_size(f, buffer_size, &err);
+    g_assert_no_error(err);
+
+    for (int x = 0; x < 1000; x++) {
+        gchar *chunk = g_strdup_printf("<package>%d</package>\n", x);
+        if (x == 500) {
+            // Chunk bigger than the buffer
+            g_free(chunk);
+            chunk = g_strnfill(1000, 'x');
+        }
+        cr_xmlfile_add_chunk(f, chunk, &err);
+        g_assert_no_error(err);
+        g_string_append(expected, chunk);
+        g_free(chunk);
+    }
+
+    cr_xmlfile_close(f, &err);
+    g_assert_no_error(err);
+
+    return g_string_free(expected, FALSE);
+}
+
+static void
+test_buffered_chunks(TestFixtures *fixtures,
+                     G_GNUC_UNUSED gconstpointer test_data)
+{
+    const gsize sizes[] = { 0, 64, CR_XMLFILE_DEFAULT_BUFFER_SIZE };
+    gchar *first_checksum = NULL;
+    GError *err = NULL;
+
+    for (gsize x = 0; x < G_N_ELEMENTS(sizes); x++) {
+        gchar *filename = g_strdup_printf("primary%"G_GSIZE_FORMAT".xml.gz", x);
+        gchar *path = g_build_filename(fixtures->tmpdir, filename, NULL);
+        cr_ContentStat *stat = cr_contentstat_new(CR_CHECKSUM_SHA256, &err);
+        g_assert_no_error(err);
+
+        gchar *chunks = write_chunks(path, sizes[x], stat);
+
+        // Content is the same regardless of the buffer size
+        gchar *contents = NULL;
+        gsize len = 0;
+        CR_FILE *crf = cr_open(path, CR_CW_MODE_READ,
+                               CR_CW_AUTO_DETECT_COMPRESSION, &err);
+        g_assert(crf);
+        contents = g_malloc0(64*1024);
+        len = cr_read(crf, contents, 64*1024 - 1, &err);
+        g_assert_no_error(err);
+        cr_close(crf, NULL);
+
+        g_assert_cmpint(stat->size, ==, len);
+        g_assert(g_str_has_suffix(contents, "</metadata>"));
+        g_assert(strstr(contents, chunks));
+        if (!first_checksum)
+            first_checksum = g_strdup(stat->checksum);
+        g_assert_cmpstr(stat->checksum, ==, first_checksum);
+
+        g_free(contents);
+        g_free(chunks);
+        cr_contentstat_free(stat, NULL);
+        g_free(path);
+        g_free(filename);
+    }
+
+    g_free(first_checksum);
+}
+
+static void
+test_direct_write(TestFixtures *fixtures,
+                  G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    gchar *contents = NULL;
+    gchar *path = g_build_filename(fixtures->tmpdir, "primary.xml", NULL);
+
+    // Without an explicit buffer size the chunks are not staged, so
+    // they keep their order with the content written into f directly
+    cr_XmlFile *f = cr_xmlfile_open_primary(path, CR_CW_NO_COMPRESSION, &err);
+    g_assert(f);
+    g_assert_no_error(err);
+    cr_xmlfile_add_chunk(f, "<a/>\n", &err);
+    g_assert_no_error(err);
+    cr_puts(f->f, "<b/>\n", &err);
+    g_assert_no_error(err);
+    cr_xmlfile_add_chunk(f, "<c/>\n", &err);
+    g_assert_no_error(err);
+    cr_xmlfile_close(f, &err);
+    g_assert_no_error(err);
+
+    g_assert(g_file_get_contents(path, &contents, NULL, NULL));
+    g_assert(strstr(contents, "<a/>\n<b/>\n<c/>\n"));
+
+    g_free(contents);
+    g_free(path);
+}
+
+static void
+test_seekable(TestFixtures *fixtures,
+              G_GNUC_UNUSED gconstpointer test_data)
+{
+    GError *err = NULL;
+    gchar *path = g_build_filename(fixtures->tmpdir, "filelists.xml.xz", NULL);
+    gchar *index_path = g_build_filename(fixtures->tmpdir,
+                                         "filelists_index.txt.xz", NULL);
+    gchar **chunks = g_new0(gchar *, 1001);
+
+    cr_XmlFile *f = cr_xmlfile_open_filelists(path, CR_CW_XZ_COMPRESSION, &err);
+    g_assert(f);
+    g_assert_no_error(err);
+    cr_xmlfile_set_seekable(f, index_path, CR_CW_XZ_COMPRESSION, NULL, &err);
+    g_assert_no_error(err);
+
+    for (int x = 0; x < 1000; x++) {
+        // Every package has ~1KiB, so there are several frames
+        gchar *padding = g_strnfill(1000, 'a' + x % 26);
+        chunks[x] = g_strdup_printf(
+                "<package pkgid=\"%064d\" name=\"pkg%d\" arch=\"noarch\">\n"
+                "  <version epoch=\"0\" ver=\"1\" rel=\"%d\"/>\n"
+                "  <file>/%s</file>\n"
+                "</package>\n", x, x, x, padding);
+        gchar *pkgid = g_strdup_printf("%064d", x);
+        cr_xmlfile_add_indexed_chunk(f, pkgid, chunks[x], &err);
+        g_assert_no_error(err);
+        g_free(pkgid);
+        g_free(padding);
+    }
+
+    cr_xmlfile_close(f, &err);
+    g_assert_no_error(err);
+
+    // The file is a regular xz file
+    CR_FILE *crf = cr_open(path, CR_CW_MODE_READ,
+                           CR_CW_AUTO_DETECT_COMPRESSION, &err);
+    g_assert(crf);
+    gchar *contents = g_malloc0(2*1024*1024);
+    int len = cr_read(crf, contents, 2*1024*1024 - 1, &err);
+    g_assert_no_error(err);
+    g_assert_cmpint(len, >, 1000*1000);
+    cr_close(crf, NULL);
+    g_assert(strstr(contents, chunks[0]));
+    g_assert(g_str_has_suffix(contents, "</filelists>"));
+    g_free(contents);
+
+    // Every line of the index points to the chunk of the package
+    crf = cr_open(index_path, CR_CW_MODE_READ,
+                  CR_CW_AUTO_DETECT_COMPRESSION, &err);
+    g_assert(crf);
+    contents = g_malloc0(1024*1024);
+    len = cr_read(crf, contents, 1024*1024 - 1, &err);
+    g_assert_no_error(err);
+    cr_close(crf, NULL);
+
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    gint64 last_frame = -1;
+    int frames = 0, packages = 0;
+    for (int x = 0; lines[x]; x++) {
+        gint64 frame_offset, frame_size, offset, length;
+        char pkgid[65];
+        if (!*lines[x] || *lines[x] == '#')
+            continue;
+        g_assert_cmpint(sscanf(lines[x], "%64s %"G_GINT64_FORMAT" %"
+                               G_GINT64_FORMAT" %"G_GINT64_FORMAT" %"
+                               G_GINT64_FORMAT, pkgid, &frame_offset,
+                               &frame_size, &offset, &length), ==, 5);
+        g_assert_cmpint(atoi(pkgid), ==, packages);
+        if (frame_offset != last_frame) {
+            frames++;
+            last_frame = frame_offset;
+        }
+
+        gsize frame_len = 0;
+        gchar *frame = cr_read_frame(path, frame_offset, frame_size,
+                                     &frame_len, &err);
+        g_assert_no_error(err);
+        g_assert(frame);
+        g_assert_cmpint(offset + length, <=, frame_len);
+        g_assert_cmpint(frame_len, <=, CR_XMLFILE_FRAME_SIZE);
+        g_assert(!strncmp(frame + offset, chunks[packages], length));
+        g_assert_cmpint(strlen(chunks[packages]), ==, length);
+        g_free(frame);
+        packages++;
+    }
+    g_assert_cmpint(packages, ==, 1000);
+    g_assert_cmpint(frames, >, 1);
+    g_strfreev(lines);
+    g_free(contents);
+
+    // Reading packages through the metadata index
+    struct cr_MetadataLocation *ml = g_new0(struct cr_MetadataLocation, 1);
+    ml->fil_xml_href = g_strdup(path);
+    ml->fil_index_href = g_strdup(index_path);
+    cr_MetadataIndex *index = cr_metadata_index_open(ml, &err);
+    g_assert_no_error(err);
+    g_assert(index);
+
+    gchar *pkgid = g_strdup_printf("%064d", 777);
+    cr_Package *pkg = cr_metadata_index_get_package(index, pkgid, &err);
+    g_assert_no_error(err);
+    g_assert(pkg);
+    g_assert_cmpstr(pkg->pkgId, ==, pkgid);
+    g_assert_cmpstr(pkg->name, ==, "pkg777");
+    g_assert_cmpstr(pkg->release, ==, "777");
+    g_assert_cmpint(g_slist_length(pkg->files), ==, 1);
+    cr_package_free(pkg);
+    g_free(pkgid);
+
+    pkg = cr_metadata_index_get_package(index, "unknown", &err);
+    g_assert_no_error(err);
+    g_assert(!pkg);
+
+    cr_metadata_index_free(index);
+    cr_metadatalocation_free(ml);
+
+    g_strfreev(chunks);
+    g_free(index_path);
+    g_free(path);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -147,6 +377,12 @@ main(int argc, char *argv[])
     g_test_add("/xml_file/test_no_packages", TestFixtures, NULL, fixtures_setup, test_no_packages, fixtures_teardown);
     g_test_add("/xml_file/test_write_modified_header", TestFixtures, NULL,
             fixtures_setup, test_rewrite_header_pacakge_count, fixtures_teardown);
+    g_test_add("/xml_file/test_buffered_chunks", TestFixtures, NULL,
+            fixtures_setup, test_buffered_chunks, fixtures_teardown);
+    g_test_add("/xml_file/test_direct_write", TestFixtures, NULL,
+            fixtures_setup, test_direct_write, fixtures_teardown);
+    g_test_add("/xml_file/test_seekable", TestFixtures, NULL,
+            fixtures_setup, test_seekable, fixtures_teardown);
 
     return g_test_run();
 }
@@ -58,6 +58,15 @@ pkgcb(cr_Package *pkg, void *cbdata, GError **err)
     return CR_CB_RET_OK;
 }
 
+static int
+pkgcb_keep(cr_Package *pkg, void *cbdata, GError **err)
+{
+    g_assert(pkg);
+    g_assert(!err || *err == NULL);
+    g_ptr_array_add((GPtrArray *) cbdata, pkg);
+    return CR_CB_RET_OK;
+}
+
 static int
 pkgcb_interrupt(cr_Package *pkg, void *cbdata, GError **err)
 {
@@ -364,6 +373,92 @@ test_cr_xml_parse_filelists_snippet_snippet_02(void)
     g_assert_cmpint(parsed, ==, 2);
 }
 
+static GPtrArray *
+parse_filelists_raw(const char *content)
+{
+    GError *tmp_err = NULL;
+    GPtrArray *pkgs = g_ptr_array_new_with_free_func(
+                                (GDestroyNotify) cr_package_free);
+    gchar *tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    g_assert(mkdtemp(tmp_dir));
+    gchar *path = g_build_filename(tmp_dir, "filelists.xml", NULL);
+    g_assert(g_file_set_contents(path, content, -1, NULL));
+
+    int ret = cr_xml_parse_filelists_raw(path, NULL, NULL, pkgcb_keep, pkgs,
+                                         NULL, NULL, &tmp_err);
+    g_assert_no_error(tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+
+    cr_remove_dir(tmp_dir, NULL);
+    g_free(path);
+    g_free(tmp_dir);
+    return pkgs;
+}
+
+#define RAW_PKG_A \
+    "<package pkgid=\"a\" name=\"a\" arch=\"noarch\">\n" \
+    "  <version epoch=\"0\" ver=\"1\" rel=\"1\"/>\n" \
+    "  <file><![CDATA[/a/</package>]]></file>\n" \
+    "</package>"
+#define RAW_PKG_B \
+    "<package pkgid=\"b\" name=\"b\" arch=\"noarch\">\n" \
+    "  <version epoch=\"0\" ver=\"1\" rel=\"1\"/>\n" \
+    "  <file>/b</file>\n" \
+    "</package >"
+#define RAW_PKG_C \
+    "<package pkgid=\"c\" name=\"c\" arch=\"noarch\">\n" \
+    "  <version epoch=\"0\" ver=\"1\" rel=\"1\"/>\n" \
+    "  <file>/c</file>\n" \
+    "</package>"
+
+static void
+test_cr_xml_parse_filelists_raw(void)
+{
+    GPtrArray *pkgs = parse_filelists_raw(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<filelists xmlns=\"http://linux.duke.edu/metadata/filelists\" "
+        "packages=\"3\">\n"
+        RAW_PKG_A "\n<!-- </package> -->\n" RAW_PKG_B "\n" RAW_PKG_C "\n"
+        "</filelists>\n");
+
+    g_assert_cmpint(pkgs->len, ==, 3);
+    cr_Package *a = pkgs->pdata[0], *b = pkgs->pdata[1], *c = pkgs->pdata[2];
+
+    // "</package>" in CDATA and in a comment is not the end of the element
+    g_assert_cmpstr(a->pkgId, ==, "a");
+    g_assert_cmpstr(a->raw_filelists, ==, RAW_PKG_A);
+
+    // End tag which is not literally "</package>" is not kept
+    g_assert_cmpstr(b->pkgId, ==, "b");
+    g_assert(!b->raw_filelists);
+
+    g_assert_cmpstr(c->pkgId, ==, "c");
+    g_assert_cmpstr(c->raw_filelists, ==, RAW_PKG_C);
+
+    g_ptr_array_free(pkgs, TRUE);
+}
+
+static void
+test_cr_xml_parse_filelists_raw_not_utf8(void)
+{
+    GPtrArray *pkgs = parse_filelists_raw(
+        "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n"
+        "<filelists xmlns=\"http://linux.duke.edu/metadata/filelists\" "
+        "packages=\"1\">\n"
+        "<package pkgid=\"a\" name=\"a\" arch=\"noarch\">\n"
+        "  <version epoch=\"0\" ver=\"1\" rel=\"1\"/>\n"
+        "  <file>/caf\xe9</file>\n"
+        "</package>\n"
+        "</filelists>\n");
+
+    g_assert_cmpint(pkgs->len, ==, 1);
+    cr_Package *a = pkgs->pdata[0];
+    g_assert_cmpstr(((cr_PackageFile *) a->files->data)->name, ==, "caf\xc3\xa9");
+    g_assert(!a->raw_filelists);
+
+    g_ptr_array_free(pkgs, TRUE);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -397,6 +492,10 @@ main(int argc, char *argv[])
                     test_cr_xml_parse_filelists_bad_file_type_00);
     g_test_add_func("/xml_parser_filelists/test_cr_xml_parse_filelists_bad_file_type_01",
                     test_cr_xml_parse_filelists_bad_file_type_01);
+    g_test_add_func("/xml_parser_filelists/test_cr_xml_parse_filelists_raw",
+                    test_cr_xml_parse_filelists_raw);
+    g_test_add_func("/xml_parser_filelists/test_cr_xml_parse_filelists_raw_not_utf8",
+                    test_cr_xml_parse_filelists_raw_not_utf8);
     g_test_add_func("/xml_parser_filelists/test_cr_xml_parse_different_md_type",
                     test_cr_xml_parse_different_md_type);
     g_test_add_func("/xml_parser_filelists/test_cr_xml_parse_filelists_snippet_snippet_01",
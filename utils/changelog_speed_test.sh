@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Global variables
+
+REPO=""             # Path to repo
+RUNS=3              # Number of runs for every setup
+LIMITS="10 -1"      # Tested --changelog-limit values
+SIZE_LIMIT=16384    # Tested --changelog-size-limit value
+
+# Param check
+
+if [ $# -lt "1" -o $# -gt "3" ]; then
+    echo "Usage: `basename $0` <repository> [size_limit] [runs]"
+    exit 1
+fi
+
+if [ $1 == "-h" ]; then
+    echo "Tool for comparsion of createrepo_c run time with different changelog limits."
+    echo "Useful with a repository of packages with long changelogs."
+    echo "WARNING! This tool changes (removes) repodata if exits!"
+    echo "Usage: `basename $0` <repository> [size_limit] [runs]"
+    exit 0
+fi
+
+REPO=$1
+
+if [ $# -ge "2" ]; then
+    SIZE_LIMIT=$2
+fi
+
+if [ $# -eq "3" ]; then
+    RUNS=$3
+fi
+
+if [ ! -d "$REPO" ]; then
+    echo "Directory $REPO doesn't exists"
+    exit 1
+fi
+
+# Main
+
+function run {
+    # Run createrepo_c $RUNS times and print the run time and other.xml size
+
+    for i in `seq 1 $RUNS`; do
+        rm -rf "$REPO"/.repodata # Just in case previous run of createrepo_c failed
+        rm -rf "$REPO"/repodata
+        /usr/bin/time -f "  %e s" createrepo_c --no-database $1 "$REPO" > /dev/null
+    done
+    du -b "$REPO"/repodata/*other.xml* | sed "s/^\([0-9]*\).*$/  other.xml: \1 B/"
+}
+
+echo "Test setup"
+echo "+---------------------------------------------------------------+"
+uname --operating-system --kernel-release
+grep "model name" /proc/cpuinfo | sort | uniq -c
+echo "Test repo: $REPO"
+echo
+for LIMIT in $LIMITS; do
+    echo "+ --changelog-limit $LIMIT"
+    echo "+----------------------+"
+    run "--changelog-limit $LIMIT"
+    echo "+ --changelog-limit $LIMIT --changelog-size-limit $SIZE_LIMIT"
+    echo "+----------------------+"
+    run "--changelog-limit $LIMIT --changelog-size-limit $SIZE_LIMIT"
+done
+
+# Final clean up
+
+rm -rf "$REPO"/repodata
+rm -rf "$REPO"/.repodata
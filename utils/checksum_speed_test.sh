@@ -0,0 +1,72 @@
+#!/bin/bash
+
+# Global variables
+
+REPO=""             # Path to repo
+WORKERS=""          # Number of workers (empty = createrepo_c default)
+RUNS=3              # Number of runs for every mode
+
+# Param check
+
+if [ $# -lt "1" -o $# -gt "3" ]; then
+    echo "Usage: `basename $0` <repository> [workers] [runs]"
+    exit 1
+fi
+
+if [ $1 == "-h" ]; then
+    echo "Tool for comparsion of createrepo_c throughput with and without"
+    echo "multi-buffer checksums (--checksum-batching). Use a repository with many"
+    echo "small packages to see the difference."
+    echo "WARNING! This tool changes (removes) repodata if exits!"
+    echo "Usage: `basename $0` <repository> [workers] [runs]"
+    exit 0
+fi
+
+REPO=$1
+
+if [ $# -ge "2" ]; then
+    WORKERS="--workers $2"
+fi
+
+if [ $# -eq "3" ]; then
+    RUNS=$3
+fi
+
+if [ ! -d "$REPO" ]; then
+    echo "Directory $REPO doesn't exists"
+    exit 1
+fi
+
+# Main
+
+function run {
+    # Run createrepo_c $RUNS times and print the reported pool throughput
+
+    for i in `seq 1 $RUNS`; do
+        rm -rf "$REPO"/.repodata # Just in case previous run of createrepo_c failed
+        rm -rf "$REPO"/repodata
+        createrepo_c --no-database $WORKERS $1 "$REPO" 2>&1 \
+            | grep "Pool throughput\|Multi-buffer checksums" \
+            | sed "s/^.*\(Pool throughput\|Multi-buffer checksums\): /  /"
+    done
+}
+
+echo "Test setup"
+echo "+---------------------------------------------------------------+"
+uname --operating-system --kernel-release
+grep "model name" /proc/cpuinfo | sort | uniq -c
+grep -o -w "avx2\|sha_ni" /proc/cpuinfo | sort -u | tr "\n" " " | sed "s/^/CPU flags: /"
+echo
+echo "Test repo: $REPO ($(find "$REPO" -name "*.rpm" | wc -l) packages)"
+echo
+echo "+ OpenSSL (--checksum-batching=never)"
+echo "+----------------------+"
+run "--checksum-batching=never"
+echo "+ Multi-buffer (--checksum-batching=always)"
+echo "+----------------------+"
+run "--checksum-batching=always"
+
+# Final clean up
+
+rm -rf "$REPO"/repodata
+rm -rf "$REPO"/.repodata
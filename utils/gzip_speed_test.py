@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+
+"""
+Measure gzip compression and decompression throughput of the createrepo_c
+library (the gzip implementation is selected by -DGZIP_BACKEND at build time).
+
+Primary and filelists metadata of the given repository are decompressed
+into a temporary directory and then repeatedly compressed (cr_write)
+and decompressed (cr_read) with gzip.
+
+Run it with the same repository against builds with different backends,
+e.g.:
+
+    PYTHONPATH=build/src/python ./utils/gzip_speed_test.py /path/to/repo
+"""
+
+import os
+import sys
+import time
+import shutil
+import tempfile
+import argparse
+
+import createrepo_c as cr
+
+
+def best_of(runs, func, *args):
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        func(*args)
+        elapsed = time.perf_counter() - start
+        if best is None or elapsed < best:
+            best = elapsed
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Gzip throughput of the createrepo_c library")
+    parser.add_argument("repo", help="Path to a repository with repodata")
+    parser.add_argument("-r", "--runs", type=int, default=3,
+                        help="Number of runs (the best one is reported)")
+    args = parser.parse_args()
+
+    repomd = cr.Repomd(os.path.join(args.repo, "repodata", "repomd.xml"))
+    records = [rec for rec in repomd.records
+               if rec.type in ("primary", "filelists")]
+    if not records:
+        print("No primary or filelists metadata in {0}".format(args.repo))
+        return 1
+
+    print("Version: {0}".format(cr.VERSION))
+    tmpdir = tempfile.mkdtemp(prefix="gzip_speed_test_")
+    try:
+        for rec in records:
+            src = os.path.join(args.repo, rec.location_href)
+            plain = os.path.join(tmpdir, rec.type + ".xml")
+            gz = plain + ".gz"
+            out = plain + ".out"
+
+            cr.decompress_file(src, plain, cr.AUTO_DETECT_COMPRESSION)
+            size = os.path.getsize(plain)
+
+            comp = best_of(args.runs, cr.compress_file, plain, gz,
+                           cr.GZ_COMPRESSION)
+            decomp = best_of(args.runs, cr.decompress_file, gz, out,
+                             cr.GZ_COMPRESSION)
+            mib = size / (1024.0 * 1024.0)
+
+            print("{0}: {1:.1f} MiB, ratio {2:.2f}".format(
+                rec.type, mib, float(size) / os.path.getsize(gz)))
+            print("  compression:   {0:8.1f} MiB/s".format(mib / comp))
+            print("  decompression: {0:8.1f} MiB/s".format(mib / decomp))
+    finally:
+        shutil.rmtree(tmpdir)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+
+"""
+Measure how fast per-package XML chunks are written into compressed
+metadata files with and without the chunk buffer of cr_XmlFile.
+
+Packages of the given repository are dumped into primary XML chunks
+which are then repeatedly written (one add_chunk() call per package,
+like createrepo_c does) into a primary.xml with every compression type,
+once with the buffering disabled and once with the default buffer size.
+
+    PYTHONPATH=build/src/python ./utils/xml_write_speed_test.py /path/to/repo
+"""
+
+import os
+import sys
+import time
+import shutil
+import tempfile
+import argparse
+
+import createrepo_c as cr
+
+
+COMPRESSIONS = (
+    ("gz", cr.GZ_COMPRESSION),
+    ("bz2", cr.BZ2_COMPRESSION),
+    ("xz", cr.XZ_COMPRESSION),
+    ("zck", cr.ZCK_COMPRESSION),
+)
+
+DEFAULT_BUFFER_SIZE = 256 * 1024
+
+
+def write(path, compression, chunks, buffer_size):
+    f = cr.PrimaryXmlFile(path, compression)
+    f.set_buffer_size(buffer_size)
+    f.set_num_of_pkgs(len(chunks))
+    for chunk in chunks:
+        f.add_chunk(chunk)
+    f.close()
+
+
+def best_of(runs, func, *args):
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        func(*args)
+        elapsed = time.perf_counter() - start
+        if best is None or elapsed < best:
+            best = elapsed
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Buffered vs. unbuffered XML chunk writes")
+    parser.add_argument("repo", help="Path to a repository with repodata")
+    parser.add_argument("-r", "--runs", type=int, default=3,
+                        help="Number of runs (the best one is reported)")
+    args = parser.parse_args()
+
+    md = cr.Metadata()
+    md.locate_and_load_xml(args.repo)
+    chunks = [cr.xml_dump_primary(md.get(key)) for key in md.keys()]
+    if not chunks:
+        print("No packages in {0}".format(args.repo))
+        return 1
+    size = sum(len(chunk) for chunk in chunks) / (1024.0 * 1024.0)
+
+    print("Version: {0}".format(cr.VERSION))
+    print("Packages: {0} ({1:.1f} MiB of primary XML)".format(len(chunks),
+                                                              size))
+    tmpdir = tempfile.mkdtemp(prefix="xml_write_speed_test_")
+    try:
+        for name, compression in COMPRESSIONS:
+            path = os.path.join(tmpdir, "primary.xml." + name)
+            try:
+                unbuffered = best_of(args.runs, write, path, compression,
+                                     chunks, 0)
+            except cr.CreaterepoCError:
+                print("{0}: not supported".format(name))
+                continue
+            buffered = best_of(args.runs, write, path, compression,
+                               chunks, DEFAULT_BUFFER_SIZE)
+            print("{0}:".format(name))
+            print("  unbuffered: {0:8.1f} MiB/s".format(size / unbuffered))
+            print("  buffered:   {0:8.1f} MiB/s".format(size / buffered))
+    finally:
+        shutil.rmtree(tmpdir)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())